@@ -84,6 +84,22 @@
 */
 #define MOTOR_POLES 8
 
+/*!
+   \brief Back-EMF constant of the motor.
+
+   This macro defines the line-to-line back-EMF of the motor in mV per Hz of
+   electrical frequency. It is used to match the duty cycle to the back-EMF of
+   a spinning rotor on a flying start.
+
+   The motor provided with the kit, 42BLS40-24-01, has a back-EMF of about
+   4.1 V per 1000 RPM, which is about 61 mV/Hz with 8 poles.
+
+   \todo Specify the back-EMF constant of the specific motor being used.
+
+   \see FLYING_START
+*/
+#define MOTOR_BEMF_CONSTANT 61
+
 /*!
    \brief Maximum allowed gate switching frequency.
 
@@ -207,7 +223,8 @@
    hardware-generated outputs, initiating a motor sequencing process.
 
    \note This will not work if \ref SPEED_CONTROL_METHOD is set to \ref
-   SPEED_CONTROL_CLOSED_LOOP.
+   SPEED_CONTROL_CLOSED_LOOP or \ref SPEED_CONTROL_POSITION, and these methods
+   cannot be selected at runtime while this feature is enabled.
 
    \warning Do not have hall sensors connected while this feature is set to \ref
    TRUE.
@@ -241,23 +258,222 @@
    This macro defines the number of commutation 'ticks' that must pass without
    any hall changes before the motor is considered to be stopped.
 
+   While the motor turns, the limit adapts to the speed, \ref
+   COMMUTATION_TIMEOUT_FACTOR times the time between hall changes, and this
+   macro is the upper limit. It is also the limit when the speed is not known,
+   such as when starting. Raise it if a healthy motor running at a very low
+   speed is considered stopped. The range is 1-65534.
+
    \todo Define how many 'ticks' before the motor is considered stopped.
+
+   \see COMMUTATION_TIMEOUT_FACTOR, COMMUTATION_TICKS_STOPPED_MIN
 */
 #define COMMUTATION_TICKS_STOPPED 6000
+#if (COMMUTATION_TICKS_STOPPED < 1) || (COMMUTATION_TICKS_STOPPED > 65534)
+#error "COMMUTATION_TICKS_STOPPED must be in the range 1-65534."
+#endif
+
+/*!
+   \brief Commutation Timeout Factor
+
+   This macro defines how many times the last time between two hall changes
+   must pass without any hall changes before the motor is considered to be
+   stopped, so a locked rotor is found quickly at high speed. The limit is kept
+   within \ref COMMUTATION_TICKS_STOPPED_MIN and \ref COMMUTATION_TICKS_STOPPED.
+
+   \todo Define the commutation timeout as a multiple of the last hall period.
+
+   \see COMMUTATION_TICKS_STOPPED, COMMUTATION_TICKS_STOPPED_MIN
+*/
+#define COMMUTATION_TIMEOUT_FACTOR 4
+#if (COMMUTATION_TIMEOUT_FACTOR < 2) || (COMMUTATION_TIMEOUT_FACTOR > 255)
+#error "COMMUTATION_TIMEOUT_FACTOR must be in the range 2-255."
+#endif
+
+/*!
+   \brief Commutation Stopped Lower Limit
+
+   This macro defines the least number of commutation 'ticks' that must pass
+   without any hall changes before the motor is considered to be stopped,
+   however fast it was turning.
+
+   \todo Define the least number of 'ticks' before the motor is considered
+   stopped.
+
+   \see COMMUTATION_TICKS_STOPPED, COMMUTATION_TIMEOUT_FACTOR
+*/
+#define COMMUTATION_TICKS_STOPPED_MIN 400
+#if (COMMUTATION_TICKS_STOPPED_MIN < 1) || (COMMUTATION_TICKS_STOPPED_MIN > COMMUTATION_TICKS_STOPPED)
+#error "COMMUTATION_TICKS_STOPPED_MIN must be in the range 1 to COMMUTATION_TICKS_STOPPED."
+#endif
+
+/*!
+   \brief Stall Current Threshold
+
+   This macro sets the IBUS register value above which a motor that is driven
+   but considered stopped is stalled, rather than just stopped. A stall sets
+   the stall fault flag, turns off the drivers and restarts the motor after
+   \ref COMMUTATION_TICKS_STOPPED, up to \ref STALL_RESTART_ATTEMPTS times. The
+   default is about 5 A with the NEVB-MTR1-I56-1.
+
+   \todo Set the stall current threshold.
+
+   \see STALL_RESTART_ATTEMPTS, ibus, IBUS_GAIN, IBUS_SENSE_RESISTOR
+*/
+#define STALL_IBUS_THRESHOLD 205
+
+/*!
+   \brief Stall Restart Attempts
+
+   This macro sets how many times a stalled motor is restarted before it is
+   disabled. The motor then has to be enabled again, which also clears the
+   stall fault flag. Set it to 0 to disable the motor on the first stall.
+
+   \todo Set the number of restart attempts after a stall.
+
+   \see STALL_IBUS_THRESHOLD
+*/
+#define STALL_RESTART_ATTEMPTS 3
+#if (STALL_RESTART_ATTEMPTS < 0) || (STALL_RESTART_ATTEMPTS > 255)
+#error "STALL_RESTART_ATTEMPTS must be in the range 0-255."
+#endif
 
 /*!
    \brief Turn Off Mode
 
    Set this macro to either \ref TURN_OFF_MODE_COAST <s>or \ref TURN_OFF_MODE_RAMP</s>
-   to specify the desired turn mode.
+   or \ref TURN_OFF_MODE_BRAKE to specify the desired turn mode.
+
+   With \ref TURN_OFF_MODE_BRAKE the motor is braked by switching the low side
+   MOSFETs of all phases together. While they are off, the winding current
+   flows back into the supply through the high side diodes, so the motor
+   regenerates. The low side on-time is ramped up by \ref BRAKE_STEP to a
+   full short circuit, held back by \ref BRAKE_IPHASE_LIMIT and pushed to a
+   full short circuit when VBUS rises above \ref BRAKE_VBUS_LIMIT.
 
    \todo Select the turn mode by assigning \ref TURN_OFF_MODE_COAST <s>or \ref
-   TURN_OFF_MODE_RAMP</s>.
+   TURN_OFF_MODE_RAMP</s> or \ref TURN_OFF_MODE_BRAKE.
 
-   \see TURN_OFF_MODE_RAMP, TURN_OFF_MODE_COAST
+   \see TURN_OFF_MODE_RAMP, TURN_OFF_MODE_COAST, TURN_OFF_MODE_BRAKE
 */
 #define TURN_OFF_MODE TURN_OFF_MODE_RAMP
 
+/*!
+   \brief Braking VBUS Limit
+
+   This macro sets the VBUS register value above which regeneration is stopped
+   by shorting the windings completely, so the supply is not pumped up by the
+   returned energy. The default is about 33.5 V with the VBUS divider of the
+   NEVB-MTR1-C-1.
+
+   \note This parameter is applicable when \ref TURN_OFF_MODE is set to \ref
+         TURN_OFF_MODE_BRAKE.
+
+   \todo Set the braking VBUS limit, above the supply voltage.
+
+   \see vbusVref, VBUS_RTOP, VBUS_RBOTTOM
+*/
+#define BRAKE_VBUS_LIMIT 400
+
+/*!
+   \brief Braking Current Limit
+
+   This macro sets the in-line phase current, in register values from the zero
+   current reading of 511, above which the low side on-time is reduced. While
+   the low sides are on the winding current circulates through them and never
+   crosses the bus current shunt, so the braking current is limited on the
+   largest of the phase currents. The default is about 5 A with the
+   NEVB-MTR1-I56-1, about 10.2 register values per ampere.
+
+   \note This parameter is applicable when \ref TURN_OFF_MODE is set to \ref
+         TURN_OFF_MODE_BRAKE.
+
+   \todo Set the braking current limit in the range 1-510, below the rating of
+   the MOSFETs and the motor.
+
+   \see iphaseU, IPHASE_GAIN, IPHASE_SENSE_RESISTOR
+*/
+#define BRAKE_IPHASE_LIMIT 51
+#if (BRAKE_IPHASE_LIMIT < 1) || (BRAKE_IPHASE_LIMIT > 510)
+#error "BRAKE_IPHASE_LIMIT must be in the range 1-510."
+#endif
+
+/*!
+   \brief Braking Step
+
+   This macro sets how much the low side on-time, with a range of 0-255, is
+   changed every speed controller iteration while braking.
+
+   \note This parameter is applicable when \ref TURN_OFF_MODE is set to \ref
+         TURN_OFF_MODE_BRAKE.
+
+   \todo Set the braking step.
+
+   \see SPEED_CONTROLLER_TIME_BASE
+*/
+#define BRAKE_STEP 8
+#if (BRAKE_STEP < 1) || (BRAKE_STEP > 255)
+#error "BRAKE_STEP must be in the range 1-255."
+#endif
+
+/*!
+   \brief Direction Reversal On The Fly
+
+   Set this macro to TRUE to reverse the motor without stopping it when the
+   direction input changes while it is running. The motor is decelerated
+   under control, the commutation is switched to the new direction when the
+   rotor reaches zero speed and the motor accelerates again without having to
+   be enabled again. With \ref TURN_OFF_MODE_BRAKE the motor is braked down
+   to zero speed, otherwise the duty cycle is ramped down.
+
+   Set it to FALSE to stop the motor when the direction changes, it then has
+   to be enabled again.
+
+   \todo Enable or disable direction reversal on the fly.
+
+   \see DIRECTION_REVERSAL_TICKS
+*/
+#define DIRECTION_REVERSAL FALSE
+
+/*!
+   \brief Direction Reversal Zero Crossing Limit
+
+   This macro defines the number of commutation 'ticks' that must pass without
+   any hall changes while reversing before the rotor is considered to be at
+   zero speed and the commutation is switched to the new direction. It must be
+   less than \ref COMMUTATION_TICKS_STOPPED.
+
+   \note This parameter is applicable when \ref DIRECTION_REVERSAL is set to
+         TRUE.
+
+   \todo Define how many 'ticks' before the rotor is considered at zero speed.
+*/
+#define DIRECTION_REVERSAL_TICKS 1000
+#if (DIRECTION_REVERSAL_TICKS < 1) || (DIRECTION_REVERSAL_TICKS >= COMMUTATION_TICKS_STOPPED)
+#error "DIRECTION_REVERSAL_TICKS must be in the range 1 to COMMUTATION_TICKS_STOPPED - 1."
+#endif
+
+/*!
+   \brief Flying Start
+
+   Set this macro to TRUE to catch a rotor that is still spinning when the
+   motor is enabled. The speed measured from the hall sensor edges while the
+   motor was disabled and \ref vbusVref give the duty cycle that matches the
+   back-EMF, \ref speedOutput and the PID integrator are preset to it and block
+   commutation is engaged immediately.
+
+   Set it to FALSE to wait until the rotor has stopped, \ref
+   COMMUTATION_TICKS_STOPPED, and start from zero output.
+
+   \note Set \ref MOTOR_BEMF_CONSTANT for the motor being used, a wrong value
+         causes a current spike on the flying start.
+
+   \todo Enable or disable the flying start.
+
+   \see MOTOR_BEMF_CONSTANT
+*/
+#define FLYING_START FALSE
+
 /*!
    \brief In-line Phase Current Gain for Current Measurement
 
@@ -418,17 +634,300 @@
 */
 #define IBUS_FAULT_ENABLE TRUE
 
+/*!
+   \brief Thermal Overload Model
+
+   When enabled, an I²t model of the motor and of the MOSFETs is updated on
+   every bus current measurement. The heat rises with the square of the
+   current above a rated current and falls below it. Each model allows \ref
+   THERMAL_PEAK_CURRENT for a peak time from cold. Once less than \ref
+   THERMAL_DERATE_BUDGET percent of the thermal budget is left, the output is
+   derated linearly, to zero when the budget is empty, so the current settles
+   at the rated current. The remaining budget is reported by the SCPI command
+   `MEASure:THERmal?`.
+
+   \note This does not replace \ref IBUS_ERROR_THRESHOLD, which still trips
+   immediately.
+
+   \todo Enable or disable the thermal model by setting to \ref TRUE or \ref
+   FALSE.
+
+   \see THERMAL_PEAK_CURRENT, THERMAL_MOTOR_RATED_CURRENT,
+        THERMAL_MOTOR_PEAK_TIME, THERMAL_MOSFET_RATED_CURRENT,
+        THERMAL_MOSFET_PEAK_TIME, THERMAL_DERATE_BUDGET
+*/
+#define THERMAL_MODEL FALSE
+
+/*!
+   \brief Thermal Model Peak Current (Register Value)
+
+   This macro specifies the peak bus current, as an IBUS register value, that
+   the motor and the MOSFETs can carry from cold for \ref
+   THERMAL_MOTOR_PEAK_TIME and \ref THERMAL_MOSFET_PEAK_TIME. See \ref
+   IBUS_WARNING_THRESHOLD for the formula. The default value is 307 which
+   corresponds to approximately 7.5 A.
+
+   \todo Set the peak current, at most \ref IBUS_ERROR_THRESHOLD.
+
+   \see THERMAL_MODEL
+*/
+#define THERMAL_PEAK_CURRENT 307
+#if (THERMAL_PEAK_CURRENT < 1) || (THERMAL_PEAK_CURRENT > IBUS_ERROR_THRESHOLD)
+#error "THERMAL_PEAK_CURRENT must be in the range 1-IBUS_ERROR_THRESHOLD."
+#endif
+
+/*!
+   \brief Motor Rated Current (Register Value)
+
+   This macro specifies the bus current, as an IBUS register value, that the
+   motor can carry continuously. The default value is 154 which corresponds to
+   approximately 3.75 A.
+
+   \todo Set the rated current of the motor.
+
+   \see THERMAL_MODEL, THERMAL_MOTOR_PEAK_TIME
+*/
+#define THERMAL_MOTOR_RATED_CURRENT 154
+#if (THERMAL_MOTOR_RATED_CURRENT < 1) || (THERMAL_MOTOR_RATED_CURRENT >= THERMAL_PEAK_CURRENT)
+#error "THERMAL_MOTOR_RATED_CURRENT must be in the range 1-(THERMAL_PEAK_CURRENT - 1)."
+#endif
+
+/*!
+   \brief Motor Peak Time
+
+   This macro specifies the time in milliseconds the motor can carry \ref
+   THERMAL_PEAK_CURRENT from cold before its thermal budget is empty.
+
+   \todo Set the peak time of the motor.
+
+   \see THERMAL_MODEL, THERMAL_MOTOR_RATED_CURRENT
+*/
+#define THERMAL_MOTOR_PEAK_TIME 5000
+
+/*!
+   \brief MOSFET Rated Current (Register Value)
+
+   This macro specifies the bus current, as an IBUS register value, that the
+   MOSFETs can carry continuously. The default value is 205 which corresponds
+   to approximately 5 A.
+
+   \todo Set the rated current of the MOSFETs.
+
+   \see THERMAL_MODEL, THERMAL_MOSFET_PEAK_TIME
+*/
+#define THERMAL_MOSFET_RATED_CURRENT 205
+#if (THERMAL_MOSFET_RATED_CURRENT < 1) || (THERMAL_MOSFET_RATED_CURRENT >= THERMAL_PEAK_CURRENT)
+#error "THERMAL_MOSFET_RATED_CURRENT must be in the range 1-(THERMAL_PEAK_CURRENT - 1)."
+#endif
+
+/*!
+   \brief MOSFET Peak Time
+
+   This macro specifies the time in milliseconds the MOSFETs can carry \ref
+   THERMAL_PEAK_CURRENT from cold before their thermal budget is empty. The
+   MOSFETs heat up faster than the motor, so this is usually shorter than \ref
+   THERMAL_MOTOR_PEAK_TIME.
+
+   \todo Set the peak time of the MOSFETs.
+
+   \see THERMAL_MODEL, THERMAL_MOSFET_RATED_CURRENT
+*/
+#define THERMAL_MOSFET_PEAK_TIME 1000
+
+/*!
+   \brief Thermal Derating Budget
+
+   This macro specifies the remaining thermal budget, in percent, below which
+   the output is derated. The output falls linearly from full at this budget
+   to zero at an empty budget.
+
+   \todo Set the budget at which derating starts.
+
+   \see THERMAL_MODEL
+*/
+#define THERMAL_DERATE_BUDGET 25
+#if (THERMAL_DERATE_BUDGET < 1) || (THERMAL_DERATE_BUDGET > 100)
+#error "THERMAL_DERATE_BUDGET must be in the range 1-100."
+#endif
+
+/*!
+   \brief Power and Energy Metering
+
+   When enabled, the product of every VBUS and bus current measurement pair is
+   accumulated in the ADC interrupt, with integer additions only. The sum
+   since the last reset gives the energy drawn from the supply, and the
+   average and peak power are taken over windows of \ref POWER_WINDOW. They
+   are reported by the SCPI commands `MEASure:POWer?` and `MEASure:ENERgy?`,
+   and the window is changed with `MEASure:POWer:WINDow`.
+
+   \todo Enable or disable power metering by setting to \ref TRUE or \ref
+   FALSE.
+
+   \see POWER_WINDOW
+*/
+#define POWER_METER FALSE
+
+/*!
+   \brief Power Metering Window
+
+   This macro specifies the time in milliseconds the average and peak power
+   are taken over at power up. It can be changed while running with the SCPI
+   command `MEASure:POWer:WINDow`, within the same range.
+
+   \todo Set the default power metering window.
+
+   \see POWER_METER
+*/
+#define POWER_WINDOW 1000
+#if (POWER_WINDOW < 10) || (POWER_WINDOW > 25000)
+#error "POWER_WINDOW must be in the range 10-25000."
+#endif
+
+/*!
+   \brief Telemetry Streaming
+
+   When enabled, the measured variables can be streamed continuously with the
+   SCPI command `TELemetry:STReam`. The records are taken at a rate of up to
+   the speed controller rate in the Timer4 overflow interrupt, so every record
+   is a snapshot from one instant, and are written to the serial interface by
+   the main loop.
+
+   \todo Enable or disable telemetry streaming by setting to \ref TRUE or \ref
+   FALSE.
+
+   \see TELEMETRY_QUEUE_LENGTH
+*/
+#define TELEMETRY_STREAM FALSE
+
+/*!
+   \brief Telemetry Queue Length
+
+   This macro specifies the number of records taken in the interrupt that can
+   wait to be written. A record is dropped when the queue is full, which shows
+   as a gap in the sequence numbers.
+
+   \todo Set the telemetry queue length.
+
+   \see TELEMETRY_STREAM
+*/
+#define TELEMETRY_QUEUE_LENGTH 4
+#if (TELEMETRY_QUEUE_LENGTH != 2) && (TELEMETRY_QUEUE_LENGTH != 4) && (TELEMETRY_QUEUE_LENGTH != 8)
+#error "TELEMETRY_QUEUE_LENGTH must be 2, 4 or 8."
+#endif
+
+/*!
+   \brief Waveform Capture
+
+   When enabled, selected variables can be captured every PWM period, or every
+   few PWM periods, with the SCPI commands `ACQuire` and `TRIGger`. The samples
+   are taken into a static buffer, around a trigger on a level, a hall sensor
+   edge, a fault or a command, and read out afterwards as a binary block. While
+   a capture runs, its currents and voltage are converted by the ADC at the
+   start of every PWM period and the sample is taken when they are done, so
+   every sample holds conversions of its own PWM period.
+
+   \todo Enable or disable waveform capture by setting to \ref TRUE or \ref
+   FALSE.
+
+   \see CAPTURE_LENGTH, CAPTURE_CHANNELS
+*/
+#define WAVEFORM_CAPTURE FALSE
+
+/*!
+   \brief Waveform Capture Length
+
+   This macro specifies the number of samples of every capture. The buffer
+   takes 2 bytes of SRAM per sample and channel, see \ref CAPTURE_CHANNELS.
+
+   \todo Set the number of samples, 16, 32, 64, 128 or 256.
+
+   \see WAVEFORM_CAPTURE
+*/
+#define CAPTURE_LENGTH 128
+#if (CAPTURE_LENGTH != 16) && (CAPTURE_LENGTH != 32) && (CAPTURE_LENGTH != 64) && (CAPTURE_LENGTH != 128) && (CAPTURE_LENGTH != 256)
+#error "CAPTURE_LENGTH must be 16, 32, 64, 128 or 256."
+#endif
+
+/*!
+   \brief Waveform Capture Channels
+
+   This macro specifies the maximum number of variables captured at the same
+   time.
+
+   \todo Set the number of channels in the range 1-4.
+
+   \see WAVEFORM_CAPTURE
+*/
+#define CAPTURE_CHANNELS 2
+#if (CAPTURE_CHANNELS < 1) || (CAPTURE_CHANNELS > 4)
+#error "CAPTURE_CHANNELS must be in the range 1-4."
+#endif
+#if (CAPTURE_LENGTH * CAPTURE_CHANNELS > 512)
+#error "The capture buffer must be no larger than 1024 bytes, reduce CAPTURE_LENGTH or CAPTURE_CHANNELS."
+#endif
+
+/*!
+   \brief Framed Binary Protocol
+
+   When enabled, the SCPI command `SYSTem:PROTocol BINary` switches the serial
+   interface to a compact binary protocol of COBS framed packets with a
+   CRC-16, for fast set point and measurement exchanges. A serial break, the
+   exit request or \ref FRAME_TIMEOUT without a valid frame switches back to
+   SCPI.
+
+   \todo Enable or disable the framed binary protocol by setting to \ref
+   TRUE or \ref FALSE.
+
+   \see FRAME_TIMEOUT
+*/
+#define FRAMED_PROTOCOL FALSE
+
+/*!
+   \brief Framed Binary Protocol Timeout
+
+   This macro specifies the time in milliseconds without a valid frame after
+   which the serial interface returns to SCPI.
+
+   \todo Set the timeout in the range 10-60000 ms.
+
+   \see FRAMED_PROTOCOL
+*/
+#define FRAME_TIMEOUT 1000
+#if (FRAME_TIMEOUT < 10) || (FRAME_TIMEOUT > 60000)
+#error "FRAME_TIMEOUT must be in the range 10-60000."
+#endif
+
 /*!
    \brief Speed Control Method
 
    Select the type of speed control by setting this macro to either \ref
-   SPEED_CONTROL_OPEN_LOOP or \ref SPEED_CONTROL_CLOSED_LOOP.
+   SPEED_CONTROL_OPEN_LOOP, \ref SPEED_CONTROL_CLOSED_LOOP, \ref
+   SPEED_CONTROL_TORQUE or \ref SPEED_CONTROL_POSITION.
+
+   With \ref SPEED_CONTROL_TORQUE the speed input sets the bus current, and so
+   the torque, instead of the speed. A current regulator runs every PWM period
+   on a bus current conversion made at the middle of the high side on-time, and
+   the speed is limited to \ref TORQUE_SPEED_LIMIT.
+
+   With \ref SPEED_CONTROL_POSITION the motor moves to a target count of hall
+   sensor edges, set with the SCPI command `CONFigure:POSition`, following a
+   trapezoidal speed profile that is tracked by the closed loop speed
+   controller.
+
+   All methods are compiled in. This macro selects the method used at
+   power-up, and the method can be changed at runtime with the SCPI command
+   `CONFigure:METHod`, even while the motor is running. The regulator being
+   switched to is preloaded with the present duty cycle, so the output does not
+   step.
 
    \todo Select the speed control method by assigning \ref
-         SPEED_CONTROL_OPEN_LOOP or \ref SPEED_CONTROL_CLOSED_LOOP.
+         SPEED_CONTROL_OPEN_LOOP, \ref SPEED_CONTROL_CLOSED_LOOP, \ref
+         SPEED_CONTROL_TORQUE or \ref SPEED_CONTROL_POSITION.
 
    \see SPEED_CONTROLLER_TIME_BASE, SPEED_CONTROLLER_MAX_DELTA,
-        SPEED_CONTROLLER_MAX_SPEED, PID_K_P, PID_K_I, PID_K_D_ENABLE, PID_K_D
+        SPEED_CONTROLLER_MAX_SPEED, PID_K_P, PID_K_I, PID_K_D_ENABLE, PID_K_D,
+        TORQUE_MAX_CURRENT, TORQUE_K_P, TORQUE_K_I, POSITION_MAX_SPEED,
+        POSITION_MIN_SPEED, POSITION_ACCELERATION
 */
 #define SPEED_CONTROL_METHOD SPEED_CONTROL_OPEN_LOOP
 
@@ -570,7 +1069,9 @@
 
    This macro sets the maximum absolute value of the accumulated error sum
    inside the PID integrator. When the sum would exceed this limit it is
-   clamped, preventing integrator wind-up.
+   clamped. This is a hard limit on top of the back-calculation anti-windup
+   (see \ref PID_TRACKING_SHIFT), which normally keeps the integrator well
+   inside it.
 
    The i-term contribution to the output is approximately:
    \f[ \text{i-term} \approx \frac{\text{PID\_MAX\_I\_TERM} \times
@@ -614,6 +1115,348 @@
 */
 #define PID_OUTPUT_MAX 200
 
+/*!
+   \brief PID Derivative Filter Shift (Only for Closed Loop)
+
+   The D-term acts on the measured speed only and is passed through a first
+   order low-pass filter, which moves it by \f$ 2^{-\text{PID\_D\_FILTER\_SHIFT}}
+   \f$ of the way towards the new value every controller iteration. This
+   suppresses the noise that the hall timing quantisation puts on the
+   derivative. Setting it to 0 disables the filter. The range is 0-6.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP and \ref PID_K_D_ENABLE is \ref TRUE.
+
+   \todo Set the derivative filter time constant as a power of two.
+
+   \see PID_K_D_ENABLE, PID_K_D
+*/
+#define PID_D_FILTER_SHIFT 2
+#if (PID_D_FILTER_SHIFT < 0) || (PID_D_FILTER_SHIFT > 6)
+#error "PID_D_FILTER_SHIFT must be in the range 0-6."
+#endif
+
+/*!
+   \brief PID Set Point Weight (Only for Closed Loop)
+
+   The P-term acts on \f$ b \cdot \text{set point} - \text{speed} \f$, where b
+   is this macro divided by 256, while the I-term always acts on the full
+   error. Values below 256 soften the response to set point steps without
+   changing how disturbances are rejected (two degrees of freedom). 256 gives
+   the classic controller. The range is 0-256.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the set point weight of the P-term in x256.
+
+   \see PID_K_P
+*/
+#define PID_SETPOINT_WEIGHT 256
+#if (PID_SETPOINT_WEIGHT < 0) || (PID_SETPOINT_WEIGHT > 256)
+#error "PID_SETPOINT_WEIGHT must be in the range 0-256."
+#endif
+
+/*!
+   \brief PID Back-Calculation Tracking Shift (Only for Closed Loop)
+
+   When the PID output is limited to 0 or \ref PID_OUTPUT_MAX, the difference
+   between the limited and the unlimited output, divided by \f$
+   2^{\text{PID\_TRACKING\_SHIFT}} \f$, is fed back into the integrator every
+   controller iteration. This unwinds the integrator while the output is
+   saturated, so the speed does not overshoot once the output comes off the
+   limit. Larger values unwind more slowly. The range is 0-8.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the anti-windup tracking time constant as a power of two.
+
+   \see PID_OUTPUT_MAX, PID_MAX_I_TERM
+*/
+#define PID_TRACKING_SHIFT 1
+#if (PID_TRACKING_SHIFT < 0) || (PID_TRACKING_SHIFT > 8)
+#error "PID_TRACKING_SHIFT must be in the range 0-8."
+#endif
+
+/*!
+   \brief PID Benchmark Enable Flag (Only for Closed Loop)
+
+   Setting this macro to \ref TRUE keeps a copy of the previous, division
+   based, PID controller and adds the `SYSTem:BENChmark:PID?` SCPI command,
+   which reports the CPU cycles per call of both controllers and of the gain
+   schedule update. It costs flash and is meant for development only.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set to \ref TRUE to benchmark the PID controller.
+*/
+#define PID_BENCHMARK_ENABLE FALSE
+
+/*!
+   \brief Number of Points in the PID Gain Schedule (Only for Closed Loop)
+
+   This macro sets the number of breakpoints in the speed-scheduled PID gain
+   table. Each breakpoint holds a measured speed and the P, I and D gains to
+   use at that speed. Between breakpoints the gains are linearly interpolated
+   from the measured speed, and outside the table the nearest breakpoint is
+   used.
+
+   The table is initialised with \ref PID_K_P, \ref PID_K_I and \ref PID_K_D at
+   every breakpoint, spread evenly from 0 to \ref SPEED_CONTROLLER_MAX_SPEED,
+   so the default behaviour is identical to a fixed gain set. It can be
+   modified at runtime over SCPI and stored in EEPROM, in which case the stored
+   table is used from the next power up.
+
+   Each breakpoint costs 8 bytes of SRAM and 8 bytes of EEPROM. The range is
+   2-8. More than 5 breakpoints do not fit in one `CONFigure:PID:TABLe:DATA`
+   command unless SCPI_BUFFER_LENGTH in scpi_config.h is raised.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the number of gain schedule breakpoints.
+
+   \see PID_K_P, PID_K_I, PID_K_D, SPEED_CONTROLLER_MAX_SPEED
+*/
+#define PID_GAIN_SCHEDULE_POINTS 4
+#if (PID_GAIN_SCHEDULE_POINTS < 2) || (PID_GAIN_SCHEDULE_POINTS > 8)
+#error "PID_GAIN_SCHEDULE_POINTS must be in the range 2-8."
+#endif
+
+/*!
+   \brief PID Auto-Tune Relay Step (Only for Closed Loop)
+
+   This macro sets how far the relay feedback auto-tune switches \ref
+   speedOutput above and below the output the motor was running at when the
+   experiment was started. A larger step gives a larger, easier to measure
+   speed oscillation, but loads the mechanics more. The relay output is
+   limited to 0 and \ref PID_OUTPUT_MAX. The range is 1-127.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the relay step of the auto-tune experiment.
+
+   \see PID_AUTOTUNE_HYSTERESIS, PID_AUTOTUNE_CYCLES, PID_AUTOTUNE_TIMEOUT
+*/
+#define PID_AUTOTUNE_STEP 20
+#if (PID_AUTOTUNE_STEP < 1) || (PID_AUTOTUNE_STEP > 127)
+#error "PID_AUTOTUNE_STEP must be in the range 1-127."
+#endif
+
+/*!
+   \brief PID Auto-Tune Relay Hysteresis (Only for Closed Loop)
+
+   This macro sets how far the measured speed has to cross the auto-tune set
+   point before the relay switches. It keeps noise on the hall timing from
+   switching the relay more than once per half period. The unit is the same as
+   the speed controller's process value, where 1 corresponds to 120 / \ref
+   MOTOR_POLES RPM.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the relay hysteresis of the auto-tune experiment.
+
+   \see PID_AUTOTUNE_STEP, PID_AUTOTUNE_CYCLES, PID_AUTOTUNE_TIMEOUT
+*/
+#define PID_AUTOTUNE_HYSTERESIS 2
+
+/*!
+   \brief PID Auto-Tune Measured Periods (Only for Closed Loop)
+
+   This macro sets how many oscillation periods the auto-tune averages the
+   period and amplitude over. The first period after the start is not
+   measured, as the speed is still settling into the oscillation. The range is
+   1-16.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the number of periods measured by the auto-tune experiment.
+
+   \see PID_AUTOTUNE_STEP, PID_AUTOTUNE_HYSTERESIS, PID_AUTOTUNE_TIMEOUT
+*/
+#define PID_AUTOTUNE_CYCLES 4
+#if (PID_AUTOTUNE_CYCLES < 1) || (PID_AUTOTUNE_CYCLES > 16)
+#error "PID_AUTOTUNE_CYCLES must be in the range 1-16."
+#endif
+
+/*!
+   \brief PID Auto-Tune Timeout (Only for Closed Loop)
+
+   This macro sets the maximum length of the auto-tune experiment in speed
+   controller iterations (see \ref SPEED_CONTROLLER_TIME_BASE). If the
+   requested number of periods has not been measured by then, the experiment
+   fails and the previous gains are kept. The range is 100-6000.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_CLOSED_LOOP.
+
+   \todo Set the timeout of the auto-tune experiment.
+
+   \see PID_AUTOTUNE_STEP, PID_AUTOTUNE_HYSTERESIS, PID_AUTOTUNE_CYCLES
+*/
+#define PID_AUTOTUNE_TIMEOUT 3000
+#if (PID_AUTOTUNE_TIMEOUT < 100) || (PID_AUTOTUNE_TIMEOUT > 6000)
+#error "PID_AUTOTUNE_TIMEOUT must be in the range 100-6000."
+#endif
+
+/*!
+   \brief Torque Controller Maximum Current (Only for Torque Control)
+
+   This macro specifies the IBUS register value used as the current set point
+   when the maximum speed reference value is input to the torque controller.
+   The default is about 5 A with the NEVB-MTR1-I56-1, see \ref
+   IBUS_WARNING_THRESHOLD for the formula.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_TORQUE.
+
+   \todo Set the current at full torque, below \ref IBUS_WARNING_THRESHOLD.
+
+   \see SPEED_CONTROL_METHOD, TORQUE_K_P, TORQUE_K_I
+*/
+#define TORQUE_MAX_CURRENT 205
+#if (TORQUE_MAX_CURRENT < 1) || (TORQUE_MAX_CURRENT > 1023)
+#error "TORQUE_MAX_CURRENT must be in the range 1-1023."
+#endif
+
+/*!
+   \brief Torque Controller Proportional Gain (Only for Torque Control)
+
+   This macro specifies the change of \ref speedOutput, in 1/256, per IBUS
+   register value of current error. The current regulator runs every PWM
+   period, or every second period when the PWM frequency is too high for the
+   conversion, above about 50 kHz.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_TORQUE.
+
+   \todo Tune the proportional gain of the current regulator.
+
+   \see SPEED_CONTROL_METHOD, TORQUE_K_I
+*/
+#define TORQUE_K_P 64
+#if (TORQUE_K_P < 0) || (TORQUE_K_P > 1023)
+#error "TORQUE_K_P must be in the range 0-1023."
+#endif
+
+/*!
+   \brief Torque Controller Integral Gain (Only for Torque Control)
+
+   This macro specifies how much the integrator of the current regulator, in
+   1/65536 of \ref speedOutput, changes per IBUS register value of current
+   error every time the regulator runs. At 20 kHz the default changes the
+   output by about 5 per second for every register value of error.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_TORQUE.
+
+   \todo Tune the integral gain of the current regulator.
+
+   \see SPEED_CONTROL_METHOD, TORQUE_K_P
+*/
+#define TORQUE_K_I 16
+#if (TORQUE_K_I < 1) || (TORQUE_K_I > 255)
+#error "TORQUE_K_I must be in the range 1-255."
+#endif
+
+/*!
+   \brief Torque Controller Speed Limit (Only for Torque Control)
+
+   This macro specifies the electrical frequency in Hz above which the current
+   set point is reduced by \ref TORQUE_SPEED_LIMIT_GAIN per Hz, so an unloaded
+   motor does not run away.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_TORQUE.
+
+   \todo Set the speed limit of the torque controller.
+
+   \see SPEED_CONTROL_METHOD, TORQUE_SPEED_LIMIT_GAIN
+*/
+#define TORQUE_SPEED_LIMIT SPEED_CONTROLLER_MAX_SPEED
+
+/*!
+   \brief Torque Controller Speed Limit Gain (Only for Torque Control)
+
+   This macro specifies how much the current set point, in IBUS register
+   values, is reduced for every Hz the electrical frequency is above \ref
+   TORQUE_SPEED_LIMIT.
+
+   \note This parameter is applicable when \ref SPEED_CONTROL_METHOD is set to
+   \ref SPEED_CONTROL_TORQUE.
+
+   \todo Set the speed limit gain of the torque controller.
+
+   \see SPEED_CONTROL_METHOD, TORQUE_SPEED_LIMIT
+*/
+#define TORQUE_SPEED_LIMIT_GAIN 4
+#if (TORQUE_SPEED_LIMIT_GAIN < 1) || (TORQUE_SPEED_LIMIT_GAIN > 1023)
+#error "TORQUE_SPEED_LIMIT_GAIN must be in the range 1-1023."
+#endif
+
+/*!
+   \brief Position Move Cruise Speed (Only for Position Control)
+
+   This macro specifies the electrical frequency in Hz the motor runs at
+   between the acceleration and deceleration ramps of a position move.
+
+   \note This parameter is applicable when the control method is \ref
+   SPEED_CONTROL_POSITION.
+
+   \todo Set the cruise speed of position moves.
+
+   \see SPEED_CONTROL_METHOD, POSITION_MIN_SPEED, POSITION_ACCELERATION
+*/
+#define POSITION_MAX_SPEED 100
+#if (POSITION_MAX_SPEED < 1) || (POSITION_MAX_SPEED > SPEED_CONTROLLER_MAX_SPEED)
+#error "POSITION_MAX_SPEED must be in the range 1-SPEED_CONTROLLER_MAX_SPEED."
+#endif
+
+/*!
+   \brief Position Move Creep Speed (Only for Position Control)
+
+   This macro specifies the electrical frequency in Hz the deceleration ramp
+   of a position move ends at. The motor creeps at this speed until it reaches
+   the target and is then turned off, so it should be low enough for the
+   motor to coast to a stop within one hall sector.
+
+   \note This parameter is applicable when the control method is \ref
+   SPEED_CONTROL_POSITION.
+
+   \todo Set the creep speed of position moves.
+
+   \see SPEED_CONTROL_METHOD, POSITION_MAX_SPEED, POSITION_ACCELERATION
+*/
+#define POSITION_MIN_SPEED 10
+#if (POSITION_MIN_SPEED < 1) || (POSITION_MIN_SPEED > POSITION_MAX_SPEED)
+#error "POSITION_MIN_SPEED must be in the range 1-POSITION_MAX_SPEED."
+#endif
+
+/*!
+   \brief Position Move Acceleration (Only for Position Control)
+
+   This macro specifies how much the speed set point of a position move, in
+   Hz, changes every speed controller iteration on the acceleration and
+   deceleration ramps.
+
+   \note This parameter is applicable when the control method is \ref
+   SPEED_CONTROL_POSITION.
+
+   \todo Set the acceleration of position moves.
+
+   \see SPEED_CONTROL_METHOD, SPEED_CONTROLLER_TIME_BASE, POSITION_MAX_SPEED,
+        POSITION_MIN_SPEED
+*/
+#define POSITION_ACCELERATION 2
+#if (POSITION_ACCELERATION < 1) || (POSITION_ACCELERATION > 255)
+#error "POSITION_ACCELERATION must be in the range 1-255."
+#endif
+
 /*!
    \brief Top resistor value in the VBUS voltage potential divider.
 
@@ -691,6 +1534,43 @@
 */
 #define VBUS_MIN_THRESHOLD 96
 
+/*!
+   \brief VBUS Compensation
+
+   Set this macro to TRUE to scale the duty cycle by the ratio of \ref
+   VBUS_NOMINAL to the measured \ref vbusVref, so the motor voltage, and with
+   it the speed, follows \ref speedOutput regardless of the supply voltage. The
+   ratio is found from a table of reciprocals whenever VBUS is measured, so
+   the PWM interrupt only multiplies. The duty cycle is still limited to 100
+   %.
+
+   Set it to FALSE to map \ref speedOutput to the duty cycle directly.
+
+   \todo Enable or disable VBUS compensation.
+
+   \see VBUS_NOMINAL
+*/
+#define VBUS_COMPENSATION FALSE
+
+/*!
+   \brief Nominal VBUS (Register Value)
+
+   This macro sets the VBUS register value at which the duty cycle is not
+   changed by the VBUS compensation. The default of 287 corresponds to about
+   24 V with the NEVB-MTR1-C-1, see \ref VBUS_MIN_THRESHOLD for the formula.
+
+   \note This parameter is applicable when \ref VBUS_COMPENSATION is set to
+         TRUE.
+
+   \todo Calculate and set the register value for the nominal supply voltage.
+
+   \see VBUS_COMPENSATION, vbusVref
+*/
+#define VBUS_NOMINAL 287
+#if (VBUS_NOMINAL < VBUS_MIN_THRESHOLD) || (VBUS_NOMINAL > 1023)
+#error "VBUS_NOMINAL must be in the range VBUS_MIN_THRESHOLD to 1023."
+#endif
+
 /*!
    \brief Wait for inverter board connection before starting execution.
 
@@ -729,6 +1609,164 @@
 */
 #define REMOTE_DEBUG_MODE FALSE
 
+/*!
+   \brief Speed Estimator
+
+   This macro selects how the motor speed is estimated from the hall sensors.
+
+   - \ref SPEED_ESTIMATOR_PLL : A phase-locked loop tracks the electrical angle
+     and speed. It is corrected at every hall sensor edge and extrapolated
+     every PWM tick, so the speed follows acceleration without lag and the
+     angle is known between edges. The bandwidth is set by \ref
+     SPEED_TRACKER_BANDWIDTH.
+   - \ref SPEED_ESTIMATOR_FILTER : The time between hall sensor changes is
+     filtered by \ref FILTER_SPEED_TYPE and the speed is found by division.
+
+   \todo Select the speed estimator.
+
+   \see SPEED_TRACKER_BANDWIDTH, FILTER_SPEED_TYPE
+*/
+#define SPEED_ESTIMATOR SPEED_ESTIMATOR_PLL
+
+/*!
+   \brief Speed Tracker Bandwidth
+
+   This macro sets the bandwidth of the speed and angle tracker as a power of
+   two fraction of the hall sensor edge rate. At every edge the angle is
+   corrected by 2^(1 - n) and the speed by 2^(-2n) of the phase error, which
+   gives a critically damped loop. Lower values follow changes in speed
+   faster, higher values give a smoother speed estimate. The range is 1-6.
+
+   \note This parameter is applicable when \ref SPEED_ESTIMATOR is set to \ref
+         SPEED_ESTIMATOR_PLL.
+
+   \todo Set the speed tracker bandwidth.
+
+   \see SPEED_ESTIMATOR
+*/
+#define SPEED_TRACKER_BANDWIDTH 3
+#if (SPEED_TRACKER_BANDWIDTH < 1) || (SPEED_TRACKER_BANDWIDTH > 6)
+#error "SPEED_TRACKER_BANDWIDTH must be in the range 1-6."
+#endif
+
+/*!
+   \brief IBUS Measurement Filter
+
+   This macro selects the filter applied to the \ref ibus measurement at power
+   up. It can be changed at runtime over SCPI. The over-current warning and
+   error checks always use the unfiltered sample, so filtering does not delay
+   the protection.
+
+   \todo Set to one of the FILTER_TYPE_* values.
+
+   \see FILTER_VBUS_TYPE, FILTER_SPEED_TYPE, FILTER_INPUT_TYPE
+*/
+#define FILTER_IBUS_TYPE FILTER_TYPE_NONE
+
+/*!
+   \brief VBUS Measurement Filter
+
+   This macro selects the filter applied to the \ref vbusVref measurement at
+   power up. It can be changed at runtime over SCPI.
+
+   \todo Set to one of the FILTER_TYPE_* values.
+
+   \see FILTER_IBUS_TYPE, FILTER_SPEED_TYPE, FILTER_INPUT_TYPE
+*/
+#define FILTER_VBUS_TYPE FILTER_TYPE_NONE
+
+/*!
+   \brief Speed Estimate Filter
+
+   This macro selects the filter applied to the time between hall sensor
+   changes, \ref lastCommutationTicks, at power up. It can be changed at
+   runtime over SCPI. The default EMA with \ref FILTER_EMA_EXPONENT of 2 gives
+   the same speed estimate as earlier versions. The filtered time is only used
+   for the speed when \ref SPEED_ESTIMATOR is set to \ref
+   SPEED_ESTIMATOR_FILTER.
+
+   \todo Set to one of the FILTER_TYPE_* values.
+
+   \see FILTER_IBUS_TYPE, FILTER_VBUS_TYPE, FILTER_INPUT_TYPE
+*/
+#define FILTER_SPEED_TYPE FILTER_TYPE_EMA
+
+/*!
+   \brief Speed Input Filter
+
+   This macro selects the filter applied to the local speed input
+   (potentiometer), \ref speedInput, at power up. It can be changed at runtime
+   over SCPI.
+
+   \todo Set to one of the FILTER_TYPE_* values.
+
+   \see FILTER_IBUS_TYPE, FILTER_VBUS_TYPE, FILTER_SPEED_TYPE
+*/
+#define FILTER_INPUT_TYPE FILTER_TYPE_NONE
+
+/*!
+   \brief Default EMA Alpha Exponent
+
+   This macro sets the alpha exponent used when a channel is set to \ref
+   FILTER_TYPE_EMA without giving one, where alpha = 1 / (2 ^ exponent). The
+   range is 1-8.
+
+   \todo Set the default EMA alpha exponent.
+*/
+#define FILTER_EMA_EXPONENT 2
+#if (FILTER_EMA_EXPONENT < 1) || (FILTER_EMA_EXPONENT > 8)
+#error "FILTER_EMA_EXPONENT must be in the range 1-8."
+#endif
+
+/*!
+   \brief Default Rate Limiter Step
+
+   This macro sets the largest change per sample used when a channel is set to
+   \ref FILTER_TYPE_RATE_LIMIT without giving one. The unit is the raw unit of
+   the channel.
+
+   \todo Set the default rate limiter step.
+*/
+#define FILTER_RATE_LIMIT_STEP 8
+
+/*!
+   \brief Moving Average Filter Taps
+
+   This macro sets the number of samples averaged by \ref FILTER_TYPE_AVERAGE.
+   Every tap costs 2 bytes of SRAM for each measurement channel. Powers of two
+   are fastest. The range is 1-16.
+
+   \todo Set the number of moving average taps.
+*/
+#define FILTER_AVERAGE_TAPS 8
+#if (FILTER_AVERAGE_TAPS < 1) || (FILTER_AVERAGE_TAPS > 16)
+#error "FILTER_AVERAGE_TAPS must be in the range 1-16."
+#endif
+
+/*!
+   \brief Biquad Filter Coefficients
+
+   These macros set the coefficients of \ref FILTER_TYPE_BIQUAD in Q14 format
+   (16384 = 1.0), with the filter given as \f$ y_n = b_0 x_n + b_1 x_{n-1} +
+   b_2 x_{n-2} - a_1 y_{n-1} - a_2 y_{n-2} \f$. The same coefficients are used
+   for every channel, so the cut-off frequency scales with the sample rate of
+   the channel.
+
+   The default is a second order Butterworth low-pass filter with the cut-off
+   at 1/20 of the sample rate.
+
+   \todo Set the biquad coefficients.
+*/
+#define FILTER_BIQUAD_B0 329
+//! \copydoc FILTER_BIQUAD_B0
+#define FILTER_BIQUAD_B1 658
+//! \copydoc FILTER_BIQUAD_B0
+#define FILTER_BIQUAD_B2 329
+//! \copydoc FILTER_BIQUAD_B0
+#define FILTER_BIQUAD_A1 (-25576)
+//! \copydoc FILTER_BIQUAD_B0
+#define FILTER_BIQUAD_A2 10508
+
 /** @} */
 
 /*!
@@ -833,6 +1871,22 @@
 #define ADC_REFERENCE_VOLTAGE ADC_REFERENCE_VOLTAGE_VCC
 //! ADC trigger used in this application.
 #define ADC_TRIGGER ADC_TRIGGER_TIMER0_OVF
+//! ADC conversions per second, Timer 0 overflows at F_CPU / 64 / 256.
+#define ADC_SAMPLE_RATE (F_CPU / 16384UL)
+//! Number of ADC channels converted in turn, so each is sampled at ADC_SAMPLE_RATE / ADC_CHANNELS.
+#define ADC_CHANNELS 6
+//! ADC trigger of the conversions synchronised to the PWM, at the middle of the high side on-time.
+#define ADC_FAST_TRIGGER ADC_TRIGGER_TIMER4_OVF
+//! ADC clock pre-scaler while conversions are synchronised to the PWM. The 1 MHz ADC clock gives about 14 us conversions at a reduced resolution.
+#define ADC_FAST_PRESCALER ADC_PRESCALER_DIV_16
+//! Largest number of channels converted at the start of every PWM period, all analog waveform capture variables.
+#if (WAVEFORM_CAPTURE == TRUE)
+#define ADC_FAST_CHANNELS 5
+#else
+#define ADC_FAST_CHANNELS 1
+#endif
+//! Index of the PWM synchronous conversion in progress while a round robin channel is converted instead.
+#define ADC_FAST_IDLE 0xFF
 
 // Input pin definitions
 //! Pin where direction command input is located.
@@ -861,6 +1915,8 @@
 // Waveform macro definitions
 //! Waveform constant for block commutation.
 #define WAVEFORM_BLOCK_COMMUTATION 0
+//! Waveform constant for low side braking.
+#define WAVEFORM_BRAKE 1
 //! Waveform status flag used for coasting.
 #define WAVEFORM_UNDEFINED 3
 
@@ -869,12 +1925,51 @@
 #define TURN_OFF_MODE_COAST 0
 //! TURN_OFF_MODE value for ramping down (drivers ramp to zero speed reference).
 #define TURN_OFF_MODE_RAMP 1
+//! TURN_OFF_MODE value for braking (low side short circuit with regeneration).
+#define TURN_OFF_MODE_BRAKE 2
 
 // Speed control macro definitions
 //! Speed control selection for open loop control.
 #define SPEED_CONTROL_OPEN_LOOP 0
 //! Speed control selection for closed loop control.
 #define SPEED_CONTROL_CLOSED_LOOP 1
+//! Speed control selection for torque (bus current) control.
+#define SPEED_CONTROL_TORQUE 2
+//! Speed control selection for position (hall count) control.
+#define SPEED_CONTROL_POSITION 3
+
+// Speed estimator macro definitions
+//! Speed estimator selection for the filtered time between hall changes.
+#define SPEED_ESTIMATOR_FILTER 0
+//! Speed estimator selection for the phase-locked loop tracker.
+#define SPEED_ESTIMATOR_PLL 1
+
+// Filter macro definitions
+//! Filter type that passes samples unchanged.
+#define FILTER_TYPE_NONE 0
+//! Filter type for an exponential moving average.
+#define FILTER_TYPE_EMA 1
+//! Filter type for a moving average over FILTER_AVERAGE_TAPS samples.
+#define FILTER_TYPE_AVERAGE 2
+//! Filter type for a 3-point median.
+#define FILTER_TYPE_MEDIAN3 3
+//! Filter type for a 5-point median.
+#define FILTER_TYPE_MEDIAN5 4
+//! Filter type for the FILTER_BIQUAD_* biquad.
+#define FILTER_TYPE_BIQUAD 5
+//! Filter type for a rate limiter.
+#define FILTER_TYPE_RATE_LIMIT 6
+
+//! Filter channel of the IBUS measurement.
+#define FILTER_CHANNEL_IBUS 0
+//! Filter channel of the VBUS measurement.
+#define FILTER_CHANNEL_VBUS 1
+//! Filter channel of the speed estimate.
+#define FILTER_CHANNEL_SPEED 2
+//! Filter channel of the local speed input.
+#define FILTER_CHANNEL_INPUT 3
+//! Number of filter channels.
+#define FILTER_CHANNELS 4
 
 /*!
    \brief Maximum Speed Reference Input
@@ -890,6 +1985,17 @@
 */
 #define SPEED_CONTROLLER_MAX_INPUT 255
 
+/*!
+   \brief Flying Start Gain
+
+   Duty cycle, in \ref speedOutput units, that matches the back-EMF at 1 Hz
+   electrical frequency and a \ref vbusVref of 1. The duty cycle for a measured
+   speed is this gain times the speed divided by \ref vbusVref.
+
+   \see FLYING_START, MOTOR_BEMF_CONSTANT
+*/
+#define FLYING_START_GAIN ((uint16_t)((256ULL * MOTOR_BEMF_CONSTANT * VBUS_RBOTTOM * 1000) / (4888ULL * (VBUS_RTOP + VBUS_RBOTTOM))))
+
 //! Macro to choose Timer4 pre-scaler.
 #define CHOOSE_TIM4_PRESCALER(tim4Freq) ((tim4Freq) < 15625 ? 4 : ((tim4Freq) < 31250 ? 2 : 1))
 
@@ -1057,6 +2163,10 @@
 #define ADC_MUX_L_BITS ((1 << MUX4) | (1 << MUX3) | (1 << MUX2) | (1 << MUX1) | (1 << MUX0))
 //! High ADC channel selection bit (MUX5) mask.
 #define ADC_MUX_H_BITS (1 << MUX5)
+//! ADC pre-scaler selection bits (ADPS2:0) mask.
+#define ADC_PRESCALER_BITS ((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0))
+//! ADC auto trigger source selection bits (ADTS3:0) mask.
+#define ADC_TRIGGER_BITS ((1 << ADTS3) | (1 << ADTS2) | (1 << ADTS1) | (1 << ADTS0))
 //! Lower ADC channel selection bits (MUX4:0) - ADC0/PF0.
 #define ADC_MUX_L_ADC0 ((0 << MUX4) | (0 << MUX3) | (0 << MUX2) | (0 << MUX1) | (0 << MUX0))
 //! High ADC channel selection bit (MUX5) - ADC0/PF0.
@@ -1195,7 +2305,11 @@
 typedef struct motorflags
 {
    //! Reserved bit(s).
-   uint8_t reserved : 7;
+   uint8_t reserved : 5;
+   //! Should a spinning rotor be caught by the main loop?
+   uint8_t flyingStart : 1;
+   //! Is the direction being reversed while running?
+   uint8_t reversing : 1;
    //! Should speed controller run?
    uint8_t speedControllerRun : 1;
    //! Is the remote enabled?
@@ -1218,8 +2332,8 @@ typedef struct motorflags
 */
 typedef struct faultflags
 {
-   //! Reserved bit(s).
-   uint8_t reserved : 1;
+   //! Has the motor stalled while driven?
+   uint8_t stall : 1;
    //! Is motor spinning in an unexpected direction?
    uint8_t reverseDirection : 1;
    //! Is motor stopped?
@@ -1240,8 +2354,8 @@ typedef struct faultflags
  */
 typedef enum
 {
-   //! Reserved flag, always false.
-   FAULT_RESERVED,
+   //! Has the motor stalled while driven?
+   FAULT_STALL,
    //! Is motor spinning in an unexpected direction?
    FAULT_REVERSE_DIRECTION,
    //! Is motor stopped?
@@ -1273,8 +2387,215 @@ typedef struct motorconfigs
    uint16_t tim4DeadTime : 11; // max value 2047
    //! SpeedInput source select (only for remote mode).
    uint8_t speedInputSource : 1;
+   //! Active control method, one of the SPEED_CONTROL_* values.
+   uint8_t controlMethod : 2;
+#if (POWER_METER == TRUE)
+   //! Power metering window in VBUS and IBUS measurement pairs.
+   uint16_t powerWindow;
+#endif
 } motorconfigs_t;
 
+/*! \brief Braking report.
+
+    This struct contains the results of the last braking, used when \ref
+    TURN_OFF_MODE is set to \ref TURN_OFF_MODE_BRAKE.
+*/
+typedef struct brakereport
+{
+   //! PWM ticks since braking started.
+   uint32_t elapsed;
+   //! PWM ticks from the start of braking to the last hall change.
+   uint32_t ticks;
+   //! Sum of VBUS x IBUS register values per speed controller iteration / 16.
+   uint32_t energy;
+} brakereport_t;
+
+/*! \brief Power meter.
+
+    This struct contains the accumulated power measurements. All values are
+    VBUS x IBUS register values, one per pair of measurements.
+*/
+typedef struct powermeter
+{
+   //! Sum of all measurements since the last reset.
+   uint64_t energy;
+   //! Sum of the measurements in the present window.
+   uint32_t windowSum;
+   //! Highest measurement in the present window.
+   uint32_t windowPeak;
+   //! Number of measurements in the present window.
+   uint16_t windowSamples;
+   //! Sum of the measurements in the last complete window.
+   uint32_t sum;
+   //! Number of measurements in the last complete window.
+   uint16_t samples;
+   //! Highest measurement in the last complete window.
+   uint32_t peak;
+} powermeter_t;
+
+/*! \brief Measurement snapshot.
+
+    This struct contains the measured variables as register values, copied
+    together with interrupts disabled so they are from the same instant.
+*/
+typedef struct measurements
+{
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+   //! Speed of the speed tracker, angle per PWM tick.
+   int32_t trackerSpeed;
+#else
+   //! Ticks between the last two commutations, 0xffff when stopped.
+   uint16_t commutationTicks;
+#endif
+   //! Bus current register value.
+   uint16_t ibus;
+   //! Phase current register values.
+   int16_t iphaseU;
+   int16_t iphaseV;
+   int16_t iphaseW;
+   //! VBUS voltage register value.
+   uint16_t vbus;
+   //! PWM compare value, 0 when the motor is disabled.
+   uint16_t duty;
+   //! Hall sensor edge counter.
+   int32_t position;
+   //! Motor control flags.
+   motorflags_t flags;
+   //! Fault flags.
+   faultflags_t faults;
+} measurements_t;
+
+/*! \brief Telemetry record.
+
+    This struct contains one record of the telemetry stream, used when \ref
+    TELEMETRY_STREAM is set to \ref TRUE.
+*/
+typedef struct telemetryrecord
+{
+   //! Sequence number, counting dropped records too.
+   uint16_t sequence;
+   //! Time of the snapshot in microseconds since power up.
+   uint32_t timestamp;
+   //! Measurement snapshot.
+   measurements_t measurements;
+} telemetryrecord_t;
+
+/*! \brief Telemetry stream.
+
+    This struct contains the state of the telemetry stream and the queue of
+    records taken in the interrupt, used when \ref TELEMETRY_STREAM is set to
+    \ref TRUE.
+*/
+typedef struct telemetrystream
+{
+   //! TRUE while streaming.
+   volatile uint8_t enable;
+   //! Speed controller iterations per record.
+   uint16_t divider;
+   //! Speed controller iterations until the next record.
+   uint16_t countdown;
+   //! Sequence number of the next record.
+   uint16_t sequence;
+   //! Free running write index of the queue.
+   volatile uint8_t head;
+   //! Free running read index of the queue.
+   volatile uint8_t tail;
+   //! Queue of records.
+   telemetryrecord_t records[TELEMETRY_QUEUE_LENGTH];
+} telemetrystream_t;
+
+/*! \brief Enumeration of the waveform capture variables.
+ */
+typedef enum
+{
+   //! Bus current, ADC counts.
+   CAPTURE_IBUS,
+   //! Phase U current, ADC counts.
+   CAPTURE_IPHASE_U,
+   //! Phase V current, ADC counts.
+   CAPTURE_IPHASE_V,
+   //! Phase W current, ADC counts.
+   CAPTURE_IPHASE_W,
+   //! VBUS voltage, ADC counts.
+   CAPTURE_VOLTAGE,
+   //! Duty cycle, Timer4 compare value.
+   CAPTURE_DUTY,
+   //! Hall sensor state, 0-7.
+   CAPTURE_HALL,
+} capture_variable_t;
+
+/*! \brief Enumeration of the waveform capture trigger sources.
+ */
+typedef enum
+{
+   //! A variable crossing a level.
+   CAPTURE_TRIGGER_LEVEL,
+   //! A hall sensor edge.
+   CAPTURE_TRIGGER_HALL,
+   //! A fault flag, other than motor stopped, being set.
+   CAPTURE_TRIGGER_FAULT,
+   //! The `TRIGger:IMMediate` command only.
+   CAPTURE_TRIGGER_BUS,
+} capture_trigger_t;
+
+/*! \brief Enumeration of the waveform capture states.
+ */
+typedef enum
+{
+   //! Not capturing.
+   CAPTURE_STATE_IDLE,
+   //! Capturing and waiting for the trigger.
+   CAPTURE_STATE_ARMED,
+   //! Capturing the samples after the trigger.
+   CAPTURE_STATE_TRIGGERED,
+   //! The buffer holds a complete capture.
+   CAPTURE_STATE_DONE,
+} capture_state_t;
+
+/*! \brief Waveform capture.
+
+    This struct contains the settings and the sample buffer of the waveform
+    capture, used when \ref WAVEFORM_CAPTURE is set to \ref TRUE. The settings
+    are only changed while the state is \ref CAPTURE_STATE_IDLE.
+*/
+typedef struct capture
+{
+   //! One of \ref capture_state_t, armed with interrupts disabled.
+   volatile uint8_t state;
+   //! Set to force the trigger.
+   volatile uint8_t force;
+   //! Number of captured variables.
+   uint8_t channelCount;
+   //! Captured variables, \ref capture_variable_t.
+   uint8_t channels[CAPTURE_CHANNELS];
+   //! Trigger source, \ref capture_trigger_t.
+   uint8_t source;
+   //! Variable compared with the trigger level.
+   uint8_t levelChannel;
+   //! Captured or compared variables converted by the ADC, bit (1 << variable) per \ref capture_variable_t.
+   uint8_t adcVariables;
+   //! TRUE to trigger on a rising level crossing, FALSE on a falling one.
+   uint8_t rising;
+   //! Trigger level in the unit of the variable.
+   int16_t level;
+   //! Value of the trigger variable at the previous sample.
+   int16_t previous;
+   //! PWM periods per sample.
+   uint8_t decimation;
+   //! PWM periods until the next sample.
+   uint8_t countdown;
+   //! Samples kept before the trigger.
+   uint16_t pretrigger;
+   //! Samples taken since arming, up to \ref CAPTURE_LENGTH.
+   uint16_t count;
+   //! Samples still to take after the trigger.
+   uint16_t remaining;
+   //! Index of the next sample, the oldest one when done.
+   uint16_t index;
+   //! Sample buffer.
+   int16_t samples[CAPTURE_LENGTH][CAPTURE_CHANNELS];
+} capture_t;
+
 /** @} */
 
 /**
@@ -1336,10 +2657,61 @@ Divide by frequency to get duration.
 #error "Invalid TIM3_FREQ set"
 #endif
 
-#if ((EMULATE_HALL == TRUE) && (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP))
+#if ((EMULATE_HALL == TRUE) && ((SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP) || (SPEED_CONTROL_METHOD == SPEED_CONTROL_POSITION)))
 #error "Invalid combination of EMULATE_HALL and SPEED_CONTROL_METHOD"
 #endif
 
+/*!
+   \brief Heat capacity of the motor thermal model.
+
+   The heat of carrying \ref THERMAL_PEAK_CURRENT for \ref
+   THERMAL_MOTOR_PEAK_TIME, in IBUS register values squared times bus current
+   samples.
+*/
+#define THERMAL_MOTOR_CAPACITY                                                                     \
+  (((1UL * THERMAL_PEAK_CURRENT * THERMAL_PEAK_CURRENT) -                                           \
+    (1UL * THERMAL_MOTOR_RATED_CURRENT * THERMAL_MOTOR_RATED_CURRENT)) *                            \
+   ((1UL * THERMAL_MOTOR_PEAK_TIME * (ADC_SAMPLE_RATE / ADC_CHANNELS)) / 1000UL))
+
+//! Heat capacity of the MOSFET thermal model, see \ref THERMAL_MOTOR_CAPACITY.
+#define THERMAL_MOSFET_CAPACITY                                                                    \
+  (((1UL * THERMAL_PEAK_CURRENT * THERMAL_PEAK_CURRENT) -                                           \
+    (1UL * THERMAL_MOSFET_RATED_CURRENT * THERMAL_MOSFET_RATED_CURRENT)) *                          \
+   ((1UL * THERMAL_MOSFET_PEAK_TIME * (ADC_SAMPLE_RATE / ADC_CHANNELS)) / 1000UL))
+
+// The derating budget must be at least 2^8 and the heat must fit in 32 bits.
+#if (((THERMAL_MOTOR_CAPACITY / 100) * THERMAL_DERATE_BUDGET) < 256) || \
+    (((THERMAL_MOSFET_CAPACITY / 100) * THERMAL_DERATE_BUDGET) < 256)
+#error "THERMAL_MOTOR_PEAK_TIME or THERMAL_MOSFET_PEAK_TIME is too short."
+#endif
+#if (THERMAL_MOTOR_CAPACITY > 0xffffffffUL) || (THERMAL_MOSFET_CAPACITY > 0xffffffffUL)
+#error "THERMAL_MOTOR_PEAK_TIME or THERMAL_MOSFET_PEAK_TIME is too long."
+#endif
+
+//! Shortest power metering window in milliseconds.
+#define POWER_WINDOW_MIN 10
+
+//! Longest power metering window in milliseconds.
+#define POWER_WINDOW_MAX 25000
+
+//! Number of VBUS and IBUS measurement pairs in a window of \p window milliseconds.
+#define POWER_WINDOW_SAMPLES(window) ((1UL * (window) * (ADC_SAMPLE_RATE / ADC_CHANNELS)) / 1000UL)
+
+//! VBUS x IBUS register values in one millijoule, with 8 fractional bits.
+#define POWER_UNITS_PER_MJ_Q8                                                                     \
+  ((uint32_t)((256.0 * 1023.0 * VBUS_RBOTTOM * 1023.0 * IBUS_GAIN * IBUS_SENSE_RESISTOR * ADC_SAMPLE_RATE) / \
+              (5.0 * (VBUS_RTOP + VBUS_RBOTTOM) * 5.0 * 1000000.0 * 1000.0 * ADC_CHANNELS)))
+
+// The sum of the longest window must fit in 32 bits.
+#if (POWER_WINDOW_SAMPLES(POWER_WINDOW_MIN) < 1) || ((POWER_WINDOW_SAMPLES(POWER_WINDOW_MAX) * 1023UL * 1023UL) > 0xffffffffUL)
+#error "Invalid POWER_WINDOW_MIN or POWER_WINDOW_MAX set"
+#endif
+
+// The stopping distance of a position move is calculated in 32 bits.
+#if ((3ULL * SPEED_CONTROLLER_TIME_BASE * POSITION_MAX_SPEED * POSITION_MAX_SPEED) > 0xffffffffULL)
+#error "POSITION_MAX_SPEED is too high for SPEED_CONTROLLER_TIME_BASE."
+#endif
+
 /*!
    \brief PID integrator clamp value passed to the PID controller.
 
@@ -1405,9 +2777,26 @@ Divide by frequency to get duration.
      EMULATE_HALL).
    - Configurable electrical rotational frequency for emulated motor (\ref
      TIM3_FREQ).
-   - Threshold for determining when the motor is considered stopped (\ref
-     COMMUTATION_TICKS_STOPPED).
-   - Selectable turn-off mode (coast or brake) (\ref TURN_OFF_MODE).
+   - Speed adaptive threshold for determining when the motor is considered
+     stopped (\ref COMMUTATION_TICKS_STOPPED, \ref COMMUTATION_TIMEOUT_FACTOR).
+   - Stall detection with automatic restart (\ref STALL_IBUS_THRESHOLD, \ref
+     STALL_RESTART_ATTEMPTS).
+   - Selectable turn-off mode (coast, ramp or regenerative brake) (\ref
+     TURN_OFF_MODE).
+   - Optional direction reversal on the fly without re-enabling the motor
+     (\ref DIRECTION_REVERSAL).
+   - Optional flying start of a spinning rotor (\ref FLYING_START).
+   - Optional compensation of the duty cycle for supply voltage changes (\ref
+     VBUS_COMPENSATION).
+   - Optional I²t thermal model of the motor and MOSFETs that allows short
+     current peaks and derates the output (\ref THERMAL_MODEL).
+   - Optional power and energy metering (\ref POWER_METER).
+   - Optional streaming of time-consistent measurement records (\ref
+     TELEMETRY_STREAM).
+   - Optional triggered capture of waveforms at the PWM frequency (\ref
+     WAVEFORM_CAPTURE).
+   - Optional framed binary protocol with integrity checking next to SCPI
+     (\ref FRAMED_PROTOCOL).
 
    \section drive_controls Drive Controls
    - Slow ramp up or down when turning on the motor or changing the speed
@@ -1415,7 +2804,8 @@ Divide by frequency to get duration.
      mode.)
    - Set the direction of rotation of the motor using input buttons.
    - Enable/disable the motor using input buttons.
-   - Easily set a duty cycle or speed based on choice of speed control.
+   - Easily set a duty cycle, speed or torque based on choice of speed
+     control.
 
    \section current_monitor Current Monitor
    - Adjustable current gain factor (\ref IBUS_GAIN).
@@ -1427,13 +2817,22 @@ Divide by frequency to get duration.
      exceeded (\ref IBUS_FAULT_ENABLE).
 
    \section speed_control Speed Control
-   - Selection between open-loop and closed-loop speed control (\ref
-     SPEED_CONTROL_METHOD).
+   - Selection between open-loop and closed-loop speed control, or torque
+     control (\ref SPEED_CONTROL_METHOD).
+   - Bumpless change of the control method at runtime with SCPI.
+   - Position control to a hall sensor edge count with a trapezoidal speed
+     profile (\ref POSITION_MAX_SPEED, \ref POSITION_MIN_SPEED, \ref
+     POSITION_ACCELERATION).
+   - Current regulator with a speed limit for torque control (\ref
+     TORQUE_MAX_CURRENT, \ref TORQUE_K_P, \ref TORQUE_K_I, \ref
+     TORQUE_SPEED_LIMIT).
    - Adjustable parameters for PID controller in closed-loop control (\ref
      PID_K_P, \ref PID_K_I, \ref PID_K_D_ENABLE, \ref PID_K_D).
    - Maximum speed for closed-loop control (\ref SPEED_CONTROLLER_MAX_SPEED).
    - Parameters for both speed control (\ref SPEED_CONTROLLER_TIME_BASE, \ref
      SPEED_CONTROLLER_MAX_DELTA).
+   - Phase-locked loop speed and angle tracker with adjustable bandwidth (\ref
+     SPEED_ESTIMATOR, \ref SPEED_TRACKER_BANDWIDTH).
 
    \section scpi_implementation SCPI Implementation
    - Implementation of SCPI protocol for remote control and communication.
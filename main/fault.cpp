@@ -186,7 +186,7 @@ void faultSequentialStateMachine(volatile faultflags_t *faultFlags, volatile mot
   switch (state)
   {
   case 1:
-    if (faultFlags->motorStopped == TRUE && motorFlags->enable == TRUE)
+    if ((faultFlags->motorStopped == TRUE && motorFlags->enable == TRUE) || faultFlags->stall == TRUE)
     {
       EnableMotorStoppedLED();
     }
@@ -6,7 +6,8 @@
 
    \details
         This file contains the exponential moving average (EMA) filter
-        implementation.
+        implementation and the selectable measurement filter built on the
+        filter templates in \ref filter.h.
 
    \author
         Nexperia: http://www.nexperia.com
@@ -20,6 +21,8 @@
  ******************************************************************************/
 
 #include "filter.h"
+// Include interrupt locking for changing filters used by ISRs
+#include <util/atomic.h>
 
 /*! \brief Exponential Moving Average (EMA) calculation algorithm.
 
@@ -52,3 +55,117 @@ int16_t calculateEMA(uint16_t currentSample, uint16_t previousEMA, uint8_t alpha
 
      return newEMA;
 }
+
+/*! \brief Select the filter of a measurement channel.
+
+    The filter is reset to \a value, so the output does not jump when the
+    type changes. This is done with interrupts disabled, so it is safe to call
+    while the channel is updated from an interrupt service routine.
+
+    \param filter  Measurement filter. \param type  Filter type, one of the
+    FILTER_TYPE_* values. \param parameter  Alpha exponent for \ref
+    FILTER_TYPE_EMA, step per sample for \ref FILTER_TYPE_RATE_LIMIT, not used
+    otherwise. \param value  Initial output.
+ */
+void FilterSelect(filterChannel_t *filter, uint8_t type, int16_t parameter, int16_t value)
+{
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+     {
+          filter->type = type;
+          filter->parameter = parameter;
+          FilterReset(filter, value);
+     }
+}
+
+/*! \brief Reset a measurement filter to a value.
+
+    \param filter  Measurement filter. \param value  New output.
+ */
+void FilterReset(filterChannel_t *filter, int16_t value)
+{
+     switch (filter->type)
+     {
+     case FILTER_TYPE_EMA:
+          filter->state.ema.Reset(value);
+          break;
+     case FILTER_TYPE_AVERAGE:
+          filter->state.average.Reset(value);
+          break;
+     case FILTER_TYPE_MEDIAN3:
+          filter->state.median3.Reset(value);
+          break;
+     case FILTER_TYPE_MEDIAN5:
+          filter->state.median5.Reset(value);
+          break;
+     case FILTER_TYPE_BIQUAD:
+          filter->state.biquad.Reset(value);
+          break;
+     case FILTER_TYPE_RATE_LIMIT:
+          filter->state.rate.Reset(value);
+          break;
+     default:
+          break;
+     }
+}
+
+/*! \brief Filter one sample of a measurement channel.
+
+    All measurement channels carry non-negative values, so the output is
+    limited to 0-MAX_INT.
+
+    \param filter  Measurement filter. \param sample  New sample.
+
+    \return Returns the filtered sample.
+ */
+int16_t FilterUpdate(filterChannel_t *filter, int16_t sample)
+{
+     int16_t output;
+
+     switch (filter->type)
+     {
+     case FILTER_TYPE_EMA:
+          output = filter->state.ema.Update(sample, filter->parameter);
+          break;
+     case FILTER_TYPE_AVERAGE:
+          output = filter->state.average.Update(sample);
+          break;
+     case FILTER_TYPE_MEDIAN3:
+          output = filter->state.median3.Update(sample);
+          break;
+     case FILTER_TYPE_MEDIAN5:
+          output = filter->state.median5.Update(sample);
+          break;
+     case FILTER_TYPE_BIQUAD:
+          output = filter->state.biquad.Update(sample);
+          break;
+     case FILTER_TYPE_RATE_LIMIT:
+          output = filter->state.rate.Update(sample, filter->parameter);
+          break;
+     default:
+          output = sample;
+          break;
+     }
+
+     if (output < 0)
+     {
+          output = 0;
+     }
+
+     return output;
+}
+
+/*! \brief Default parameter of a filter type.
+
+    \param type  Filter type, one of the FILTER_TYPE_* values.
+
+    \return Returns \ref FILTER_RATE_LIMIT_STEP for \ref FILTER_TYPE_RATE_LIMIT
+    and \ref FILTER_EMA_EXPONENT otherwise.
+ */
+int16_t FilterDefaultParameter(uint8_t type)
+{
+     if (type == FILTER_TYPE_RATE_LIMIT)
+     {
+          return FILTER_RATE_LIMIT_STEP;
+     }
+     return FILTER_EMA_EXPONENT;
+}
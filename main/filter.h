@@ -8,6 +8,17 @@
         This file contains defines, typedefs and prototypes for the filter
         implementation.
 
+        Besides the exponential moving average (EMA), it provides a small
+        library of fixed-point filters as class templates: a biquad IIR
+        filter, an N-tap moving average, a 3 or 5-point median filter and a
+        rate limiter. Samples are 16-bit (Q15) values and intermediate results
+        are kept in 32-bit (Q31) accumulators and saturated back to 16 bits.
+        None of the filters allocate memory or depend on global state, so they
+        can be updated from interrupt service routines.
+
+        The filters have no constructors, so they can share storage in a union
+        and must be reset before use.
+
    \author
         Nexperia: http://www.nexperia.com
 
@@ -25,10 +36,356 @@
 // Include standard integer type definitions
 #include "stdint.h"
 
+// Include motor config (filter defaults and biquad coefficients)
+#include "config.h"
+
 //! Maximum value of integers
 #define MAX_INT 32767
 
+//! Minimum value of Q15 numbers
+#define MIN_Q15 (-32768)
+
+//! Maximum value of Q31 numbers
+#define MAX_Q31 2147483647L
+
+//! Minimum value of Q31 numbers
+#define MIN_Q31 (-MAX_Q31 - 1)
+
+/*! \brief Saturate a Q31 number to Q15.
+
+    \param value  Value to saturate. \return Value limited to the Q15 range.
+*/
+static inline int16_t SatQ15(int32_t value)
+{
+     if (value > MAX_INT)
+     {
+          return MAX_INT;
+     }
+     else if (value < MIN_Q15)
+     {
+          return MIN_Q15;
+     }
+     return (int16_t)value;
+}
+
+/*! \brief Saturating Q15 addition.
+
+    \param a  First operand. \param b  Second operand. \return Saturated sum.
+*/
+static inline int16_t AddQ15(int16_t a, int16_t b)
+{
+     return SatQ15((int32_t)a + b);
+}
+
+/*! \brief Saturating Q15 multiplication.
+
+    \param a  First operand. \param b  Second operand. \return Saturated
+    product, rounded towards minus infinity.
+*/
+static inline int16_t MulQ15(int16_t a, int16_t b)
+{
+     return SatQ15(((int32_t)a * b) >> 15);
+}
+
+/*! \brief Saturating Q31 addition.
+
+    \param a  First operand. \param b  Second operand. \return Saturated sum.
+*/
+static inline int32_t AddQ31(int32_t a, int32_t b)
+{
+     int32_t sum = (int32_t)((uint32_t)a + (uint32_t)b);
+
+     // Overflow if both operands have the same sign and the sum does not.
+     if (((a ^ sum) & (b ^ sum)) < 0)
+     {
+          return (a < 0) ? MIN_Q31 : MAX_Q31;
+     }
+     return sum;
+}
+
+/*! \brief Exponential moving average filter.
+
+    \f$ y_n = y_{n-1} + (x_n - y_{n-1}) / 2^k \f$, where k is given on every
+    update.
+*/
+class EmaFilter
+{
+public:
+     /*! \brief Set the output to a value.
+
+         \param value  New output.
+     */
+     void Reset(int16_t value)
+     {
+          output = value;
+     }
+
+     /*! \brief Filter one sample.
+
+         \param sample  New sample. \param exponent  Alpha exponent k.
+         \return Filtered value.
+     */
+     int16_t Update(int16_t sample, uint8_t exponent)
+     {
+          output += ((int32_t)sample - output) >> exponent;
+          return output;
+     }
+
+private:
+     //! Last output.
+     int16_t output;
+};
+
+/*! \brief N-tap moving average filter.
+
+    Keeps the last N samples and a running sum, so every update costs one
+    addition and one subtraction regardless of N. If N is a power of two the
+    division is a shift.
+
+    \tparam N  Number of taps, 1-64.
+*/
+template <uint8_t N>
+class MovingAverageFilter
+{
+     static_assert((N > 0) && (N <= 64), "MovingAverageFilter supports 1-64 taps.");
+
+public:
+     /*! \brief Fill the filter with a value.
+
+         \param value  New output.
+     */
+     void Reset(int16_t value)
+     {
+          for (uint8_t n = 0; n < N; n++)
+          {
+               samples[n] = value;
+          }
+          sum = (int32_t)value * N;
+          index = 0;
+     }
+
+     /*! \brief Filter one sample.
+
+         \param sample  New sample. \return Average of the last N samples.
+     */
+     int16_t Update(int16_t sample)
+     {
+          sum += (int32_t)sample - samples[index];
+          samples[index] = sample;
+          if (++index >= N)
+          {
+               index = 0;
+          }
+          return (int16_t)(sum / N);
+     }
+
+private:
+     //! Last N samples.
+     int16_t samples[N];
+     //! Sum of the last N samples.
+     int32_t sum;
+     //! Position of the oldest sample.
+     uint8_t index;
+};
+
+/*! \brief 3 or 5-point median filter.
+
+    Removes single sample spikes (3 points) or pairs of spikes (5 points)
+    without smoothing steps.
+
+    \tparam N  Number of points, 3 or 5.
+*/
+template <uint8_t N>
+class MedianFilter
+{
+     static_assert((N == 3) || (N == 5), "MedianFilter supports 3 or 5 points.");
+
+public:
+     /*! \brief Fill the filter with a value.
+
+         \param value  New output.
+     */
+     void Reset(int16_t value)
+     {
+          for (uint8_t n = 0; n < N; n++)
+          {
+               samples[n] = value;
+          }
+          index = 0;
+     }
+
+     /*! \brief Filter one sample.
+
+         \param sample  New sample. \return Median of the last N samples.
+     */
+     int16_t Update(int16_t sample)
+     {
+          int16_t sorted[N];
+
+          samples[index] = sample;
+          if (++index >= N)
+          {
+               index = 0;
+          }
+
+          // Insertion sort, at most 10 compares for 5 points.
+          for (uint8_t n = 0; n < N; n++)
+          {
+               int16_t value = samples[n];
+               uint8_t m = n;
+               while ((m > 0) && (sorted[m - 1] > value))
+               {
+                    sorted[m] = sorted[m - 1];
+                    m--;
+               }
+               sorted[m] = value;
+          }
+          return sorted[N >> 1];
+     }
+
+private:
+     //! Last N samples.
+     int16_t samples[N];
+     //! Position of the oldest sample.
+     uint8_t index;
+};
+
+/*! \brief Biquad IIR filter.
+
+    Direct form I second order section
+    \f$ y_n = b_0 x_n + b_1 x_{n-1} + b_2 x_{n-2} - a_1 y_{n-1} - a_2 y_{n-2}
+    \f$, with the coefficients given as template arguments so they are folded
+    into the code and take no SRAM. The sum is accumulated in 32 bits with
+    saturating additions.
+
+    \tparam B0  b0 coefficient. \tparam B1  b1 coefficient. \tparam B2  b2
+    coefficient. \tparam A1  a1 coefficient. \tparam A2  a2 coefficient.
+    \tparam FRAC  Number of fractional bits of the coefficients, 14 allows
+    coefficients in the range -2 to 2.
+*/
+template <int16_t B0, int16_t B1, int16_t B2, int16_t A1, int16_t A2, uint8_t FRAC = 14>
+class BiquadFilter
+{
+public:
+     /*! \brief Set the filter to steady state at a value.
+
+         \param value  New output.
+     */
+     void Reset(int16_t value)
+     {
+          x1 = value;
+          x2 = value;
+          y1 = value;
+          y2 = value;
+     }
+
+     /*! \brief Filter one sample.
+
+         \param sample  New sample. \return Filtered value.
+     */
+     int16_t Update(int16_t sample)
+     {
+          int32_t acc = (int32_t)B0 * sample;
+          acc = AddQ31(acc, (int32_t)B1 * x1);
+          acc = AddQ31(acc, (int32_t)B2 * x2);
+          acc = AddQ31(acc, -(int32_t)A1 * y1);
+          acc = AddQ31(acc, -(int32_t)A2 * y2);
+
+          x2 = x1;
+          x1 = sample;
+          y2 = y1;
+          y1 = SatQ15(acc >> FRAC);
+          return y1;
+     }
+
+private:
+     //! Previous input.
+     int16_t x1;
+     //! Input before the previous input.
+     int16_t x2;
+     //! Previous output.
+     int16_t y1;
+     //! Output before the previous output.
+     int16_t y2;
+};
+
+/*! \brief Rate limiter.
+
+    Follows the input, but moves at most a given step per update.
+*/
+class RateLimiter
+{
+public:
+     /*! \brief Set the output to a value.
+
+         \param value  New output.
+     */
+     void Reset(int16_t value)
+     {
+          output = value;
+     }
+
+     /*! \brief Filter one sample.
+
+         \param sample  New sample. \param step  Largest change per update.
+         \return Rate limited value.
+     */
+     int16_t Update(int16_t sample, int16_t step)
+     {
+          int32_t delta = (int32_t)sample - output;
+
+          if (delta > step)
+          {
+               delta = step;
+          }
+          else if (delta < -step)
+          {
+               delta = -step;
+          }
+          output += delta;
+          return output;
+     }
+
+private:
+     //! Last output.
+     int16_t output;
+};
+
+/*! \brief Selectable Measurement Filter
+
+   One filter of the type chosen at runtime, used to filter a measurement
+   channel. The filter states share storage, so changing the type resets the
+   filter.
+*/
+typedef struct filterChannel
+{
+     //! Filter type, one of the FILTER_TYPE_* values
+     uint8_t type;
+     //! Alpha exponent for the EMA, step for the rate limiter
+     int16_t parameter;
+     //! State of the selected filter
+     union
+     {
+          //! EMA state
+          EmaFilter ema;
+          //! Moving average state
+          MovingAverageFilter<FILTER_AVERAGE_TAPS> average;
+          //! 3-point median state
+          MedianFilter<3> median3;
+          //! 5-point median state
+          MedianFilter<5> median5;
+          //! Biquad state
+          BiquadFilter<FILTER_BIQUAD_B0, FILTER_BIQUAD_B1, FILTER_BIQUAD_B2, FILTER_BIQUAD_A1, FILTER_BIQUAD_A2> biquad;
+          //! Rate limiter state
+          RateLimiter rate;
+     } state;
+} filterChannel_t;
+
 // Prototypes
 int16_t calculateEMA(uint16_t currentSample, uint16_t previousEMA, uint8_t alphaExponent);
+void FilterSelect(filterChannel_t *filter, uint8_t type, int16_t parameter, int16_t value);
+void FilterReset(filterChannel_t *filter, int16_t value);
+int16_t FilterUpdate(filterChannel_t *filter, int16_t sample);
+int16_t FilterDefaultParameter(uint8_t type);
 
 #endif
@@ -0,0 +1,103 @@
+/* This file has been prepared for Doxygen automatic documentation generation.*/
+/*! \file ********************************************************************
+
+   \brief
+        Framed binary protocol source file.
+
+   \details
+        This file contains the CRC and the COBS encoding and decoding of the
+        framed binary protocol.
+
+   \author
+        Nexperia: http://www.nexperia.com
+
+   \par Support Page
+        For additional support, visit: https://www.nexperia.com/support
+
+   $Author: Aanas Sayed $
+   $Date: 2024/03/08 $  \n
+
+ ******************************************************************************/
+
+#include "frame.h"
+// Include the table free CRC update of avr-libc
+#include <util/crc16.h>
+
+/*! \brief Calculate the CRC of a packet.
+
+    \param data  Bytes to check. \param length  Number of bytes. \return
+    CRC-16/CCITT-FALSE of the bytes.
+*/
+uint16_t FrameCrc(const uint8_t *data, uint8_t length)
+{
+     uint16_t crc = 0xFFFF;
+
+     while (length--)
+     {
+          crc = _crc_xmodem_update(crc, *data++);
+     }
+     return crc;
+}
+
+/*! \brief COBS encode a packet.
+
+    Every zero byte is replaced by the distance to the next one, with a first
+    byte for the distance to the first one, so one byte is added. The
+    delimiter is not added.
+
+    \param packet  Packet to encode, shorter than 254 bytes. \param length
+    Length of the packet. \param frame  Buffer of at least length + 1 bytes
+    for the encoded packet. \return Length of the encoded packet.
+*/
+uint8_t FrameEncode(const uint8_t *packet, uint8_t length, uint8_t *frame)
+{
+     uint8_t code = 0;
+     uint8_t out = 1;
+
+     for (uint8_t i = 0; i < length; i++)
+     {
+          if (packet[i] == 0)
+          {
+               frame[code] = out - code;
+               code = out++;
+          }
+          else
+          {
+               frame[out++] = packet[i];
+          }
+     }
+     frame[code] = out - code;
+     return out;
+}
+
+/*! \brief Decode a COBS encoded packet.
+
+    \param frame  Encoded packet without the delimiter. \param length  Length
+    of the encoded packet. \param packet  Buffer of at least length - 1 bytes
+    for the packet. \return Length of the packet, 0 if the encoding is
+    invalid.
+*/
+uint8_t FrameDecode(const uint8_t *frame, uint8_t length, uint8_t *packet)
+{
+     uint8_t in = 0;
+     uint8_t out = 0;
+
+     while (in < length)
+     {
+          uint8_t code = frame[in++];
+          if ((code == 0) || (in + code - 1 > length))
+          {
+               return 0;
+          }
+          for (uint8_t i = 1; i < code; i++)
+          {
+               packet[out++] = frame[in++];
+          }
+          // A block shorter than 254 bytes ends with a zero byte, except at the end.
+          if ((code != 0xFF) && (in < length))
+          {
+               packet[out++] = 0;
+          }
+     }
+     return out;
+}
@@ -0,0 +1,132 @@
+/* This file has been prepared for Doxygen automatic documentation generation.*/
+/*! \file ********************************************************************
+
+   \brief
+        Framed binary protocol header file.
+
+   \details
+        This file contains defines, typedefs and prototypes for the framed
+        binary protocol that can replace SCPI on the serial interface.
+
+        A packet is a type byte, a fixed-layout payload and a CRC-16 of the
+        type and payload. It is sent COBS (Consistent Overhead Byte Stuffing)
+        encoded, so it holds no zero bytes, followed by a zero byte that
+        delimits the frame. A receiver that loses a byte resynchronises at the
+        next zero byte.
+
+        The CRC is CRC-16/CCITT-FALSE, polynomial 0x1021 and initial value
+        0xFFFF without reflection, so "123456789" gives 0x29B1. All multi-byte
+        values, the CRC included, are little-endian.
+
+   \author
+        Nexperia: http://www.nexperia.com
+
+   \par Support Page
+        For additional support, visit: https://www.nexperia.com/support
+
+   $Author: Aanas Sayed $
+   $Date: 2024/03/08 $  \n
+
+ ******************************************************************************/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+// Include standard integer type definitions
+#include "stdint.h"
+
+//! Byte that ends every frame, never found in an encoded packet.
+#define FRAME_DELIMITER 0x00
+
+//! Request: set the set point, \ref frameSetPoint_t.
+#define FRAME_SET_POINT 0x01
+//! Request: enable or disable the motor, \ref frameEnable_t.
+#define FRAME_ENABLE 0x02
+//! Request: set the direction, \ref frameDirection_t.
+#define FRAME_DIRECTION 0x03
+//! Request: take a measurement snapshot, answered with \ref frameSnapshot_t.
+#define FRAME_MEASURE 0x04
+//! Request: return to SCPI after the response, no payload.
+#define FRAME_EXIT 0x05
+
+//! Set in the type of a response, added to the type of the request.
+#define FRAME_RESPONSE 0x80
+//! Type of the response to a packet with a bad length or CRC.
+#define FRAME_ERROR 0xFF
+
+//! Response status: the request was carried out.
+#define FRAME_STATUS_OK 0
+//! Response status: the packet was too short or its CRC was wrong.
+#define FRAME_STATUS_CRC 1
+//! Response status: the type is unknown or the payload has the wrong length.
+#define FRAME_STATUS_TYPE 2
+//! Response status: a value is out of range or not accepted now.
+#define FRAME_STATUS_PARAMETER 3
+
+//! Number of measured variables in \ref frameSnapshot_t.
+#define FRAME_SNAPSHOT_VALUES 11
+
+//! Length of the CRC at the end of every packet.
+#define FRAME_CRC_LENGTH 2
+
+//! Length of the longest packet, the snapshot response.
+#define FRAME_MAX_PACKET (sizeof(frameResponse_t) + sizeof(frameSnapshot_t) + FRAME_CRC_LENGTH)
+
+//! Length of the longest encoded packet, without the delimiter.
+#define FRAME_MAX_LENGTH (FRAME_MAX_PACKET + 1)
+
+/*! \brief Set point request.
+
+    In position control the value is the target in hall sensor edges. With
+    the other control methods it is the speed input, 0 to \ref
+    SPEED_CONTROLLER_MAX_INPUT for no to full duty cycle, speed or current.
+*/
+typedef struct frameSetPoint
+{
+     //! Set point.
+     int32_t value;
+} frameSetPoint_t;
+
+/*! \brief Enable request.
+*/
+typedef struct frameEnable
+{
+     //! 1 to enable, 0 to disable the motor.
+     uint8_t enable;
+} frameEnable_t;
+
+/*! \brief Direction request.
+*/
+typedef struct frameDirection
+{
+     //! 0 forward, 1 reverse.
+     uint8_t direction;
+} frameDirection_t;
+
+/*! \brief Start of every response.
+*/
+typedef struct frameResponse
+{
+     //! Request type with \ref FRAME_RESPONSE set, or \ref FRAME_ERROR.
+     uint8_t type;
+     //! One of the FRAME_STATUS_* values.
+     uint8_t status;
+} frameResponse_t;
+
+/*! \brief Measurement snapshot response payload.
+
+    The variables of `MEASure:ALL?` in its order, scaled as in the binary
+    telemetry records.
+*/
+typedef struct frameSnapshot
+{
+     //! Speed, currents, voltage, duty cycle, position, direction, enable and faults.
+     int32_t values[FRAME_SNAPSHOT_VALUES];
+} frameSnapshot_t;
+
+// Prototypes
+uint16_t FrameCrc(const uint8_t *data, uint8_t length);
+uint8_t FrameEncode(const uint8_t *packet, uint8_t length, uint8_t *frame);
+uint8_t FrameDecode(const uint8_t *frame, uint8_t length, uint8_t *packet);
+
+#endif
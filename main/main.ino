@@ -6,8 +6,8 @@
 
    \details
         This file contains the full implementation of the motor control, except
-        the PID-controller, filter, fault, SCPI and table implementations and
-        definitions.
+        the PID-controller, filter, speed tracker, fault, SCPI and table
+        implementations and definitions.
 
    \par User Manual:
         ANxxx: Trapezoidal Control of BLDC Motors Using Hall Effect Sensors
@@ -34,9 +34,17 @@
 #include "filter.h"
 #include "scpi.h"
 
-// Include PID control algorithm if closed-loop speed control is enabled
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
+// Include speed and angle tracker if selected as speed estimator
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+#include "tracker.h"
+#endif
+
+// Include PID control algorithm for closed-loop speed control
 #include "pid.h"
+
+// Include thermal overload model if enabled
+#if (THERMAL_MODEL == TRUE)
+#include "thermal.h"
 #endif
 
 /*! \brief Motor control flags placed in I/O space for fast access.
@@ -93,6 +101,26 @@ volatile uint16_t commutationTicks = 0;
 */
 volatile uint16_t lastCommutationTicks = 0xffff;
 
+/*!
+  \brief The number of 'ticks' without hall sensor changes before the motor is
+  considered stopped.
+
+    This variable is updated on every hall sensor change to \ref
+    COMMUTATION_TIMEOUT_FACTOR times \ref lastCommutationTicks, limited to \ref
+    COMMUTATION_TICKS_STOPPED_MIN and \ref COMMUTATION_TICKS_STOPPED. It is set
+    to \ref COMMUTATION_TICKS_STOPPED when the motor is stopped.
+
+  \see commutationTicks
+*/
+volatile uint16_t commutationTimeout = COMMUTATION_TICKS_STOPPED;
+
+/*!
+  \brief The number of restarts after a stall since the motor was enabled.
+
+  \see STALL_RESTART_ATTEMPTS
+*/
+uint8_t stallRestarts = 0;
+
 /*! \brief The most recent "speed" input measurement.
 
     This variable is set by the ADC from the speed input reference pin. The
@@ -100,6 +128,86 @@ volatile uint16_t lastCommutationTicks = 0xffff;
 */
 volatile uint8_t speedInput = 0;
 
+/*! \brief Current set point of the torque controller.
+
+    This variable is set by the speed controller from \ref speedInput and
+    reduced above \ref TORQUE_SPEED_LIMIT. It is given as an IBUS register
+    value.
+
+    \see TorqueController()
+*/
+volatile uint16_t torqueSetpoint = 0;
+
+/*! \brief Integrator of the current regulator.
+
+    The integral part of \ref speedOutput with 16 fractional bits.
+
+    \see TorqueController()
+*/
+int32_t torqueIntegrator = 0;
+
+/*! \brief Channels converted at the start of every PWM period.
+
+    Every entry is the channel selection, MUX5 together with MUX4:0. Only the
+    first \ref adcFastCount entries are used.
+
+    \see ADCFastUpdate()
+*/
+uint8_t adcFastChannels[ADC_FAST_CHANNELS];
+
+//! Number of channels in \ref adcFastChannels, 0 when no conversion is synchronised to the PWM.
+uint8_t adcFastCount = 0;
+
+//! Index in \ref adcFastChannels of the conversion in progress, or \ref ADC_FAST_IDLE.
+volatile uint8_t adcFastIndex = ADC_FAST_IDLE;
+
+//! Latest PWM synchronous conversions (Register Values), in the order of \ref adcFastChannels.
+volatile uint16_t adcFastSamples[ADC_FAST_CHANNELS];
+
+//! Next round robin channel, converted after the PWM synchronous conversions.
+uint8_t adcRoundRobinChannel;
+
+//! Timer0 count after the last PWM synchronous conversions, to find its overflows.
+uint8_t adcTimer0;
+
+#if (WAVEFORM_CAPTURE == TRUE)
+//! Channel selection of every analog waveform capture variable, up to \ref CAPTURE_VOLTAGE.
+const uint8_t adcCaptureChannels[CAPTURE_VOLTAGE + 1] = {
+    ADC_MUX_H_IBUS | ADC_MUX_L_IBUS,
+    ADC_MUX_H_IPHASE_U | ADC_MUX_L_IPHASE_U,
+    ADC_MUX_H_IPHASE_V | ADC_MUX_L_IPHASE_V,
+    ADC_MUX_H_IPHASE_W | ADC_MUX_L_IPHASE_W,
+    ADC_MUX_H_VBUSVREF | ADC_MUX_L_VBUSVREF,
+};
+
+//! Index in \ref adcFastSamples of every analog waveform capture variable in \ref adcFastVariables.
+uint8_t adcCaptureIndex[CAPTURE_VOLTAGE + 1];
+
+//! Waveform capture variables in \ref adcFastChannels, as \ref capture_t::adcVariables.
+uint8_t adcFastVariables = 0;
+#endif
+
+/*! \brief Rotor position in hall sensor edges.
+
+    This variable is incremented on every hall sensor edge in the forward
+    direction and decremented in the reverse direction, so it counts 60
+    electrical degrees per step. It wraps around after 2^31 edges. Reading it
+    outside the hall sensor interrupt must be done with interrupts disabled.
+*/
+volatile int32_t hallPosition = 0;
+
+/*! \brief Target of the position controller in hall sensor edges.
+
+    \see PositionProfile()
+*/
+int32_t positionTarget = 0;
+
+/*! \brief Speed set point of the position move profile in Hz.
+
+    \see PositionProfile()
+*/
+uint16_t positionSpeed = 0;
+
 /*! \brief The most recent "speed" output from the speed controller.
 
     This variable controls the duty cycle of the generated PWM signals. The
@@ -249,15 +357,128 @@ volatile int16_t iphaseW = 0;
   The NEVB-MTR1-C-1 has a resistor divider with RTOP of 100 kΩ and RBOTTOM of 6.2
   kΩ, so it corresponds to approximately 0.0837 volts (V) per register value.
 
-  \note It is not used for any significant purpose in this implementation, but
-  the measurement is updated.
+  \note It holds off the speed controller below \ref VBUS_MIN_THRESHOLD and,
+  with \ref VBUS_COMPENSATION, scales the duty cycle.
 */
 volatile uint16_t vbusVref = 0;
 
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
+#if (VBUS_COMPENSATION == TRUE)
+/*!
+  \brief Duty cycle gain that compensates for VBUS changes.
+
+  Ratio of \ref VBUS_NOMINAL to \ref vbusVref with 6 fractional bits, so 64 is
+  a gain of one. It is updated with every VBUS measurement.
+
+  \see VBUS_COMPENSATION, VbusCompensationUpdate()
+*/
+volatile uint8_t vbusCompensation = 64;
+#endif
+
+#if (THERMAL_MODEL == TRUE)
+/*!
+  \brief I²t thermal model of the motor.
+
+  \see THERMAL_MODEL, THERMAL_MOTOR_RATED_CURRENT, THERMAL_MOTOR_PEAK_TIME
+*/
+thermalModel_t motorThermal;
+
+/*!
+  \brief I²t thermal model of the MOSFETs.
+
+  \see THERMAL_MODEL, THERMAL_MOSFET_RATED_CURRENT, THERMAL_MOSFET_PEAK_TIME
+*/
+thermalModel_t mosfetThermal;
+
+/*!
+  \brief Duty cycle gain that derates the output as the thermal budget drains.
+
+  The lower derating factor of \ref motorThermal and \ref mosfetThermal with 8
+  fractional bits, so 256 is full output. It is updated with every bus current
+  measurement.
+
+  \see THERMAL_MODEL, ThermalModelDerate()
+*/
+volatile uint16_t thermalDerate = THERMAL_DERATE_NONE;
+#endif
+
+#if (POWER_METER == TRUE)
+/*!
+  \brief Power meter.
+
+  Energy, average and peak power accumulated from the VBUS and IBUS
+  measurements, read with the "MEASure:POWer?" and "MEASure:ENERgy?" commands.
+
+  \see POWER_METER, PowerMeterUpdate()
+*/
+powermeter_t powerMeter;
+#endif
+
+#if (TELEMETRY_STREAM == TRUE)
+/*!
+  \brief Telemetry stream.
+
+  Configured with the "TELemetry:STReam" commands. Records are queued by
+  TelemetrySample() and written by the main loop.
+
+  \see TELEMETRY_STREAM, TelemetrySample()
+*/
+telemetrystream_t telemetryStream;
+#endif
+
+#if (WAVEFORM_CAPTURE == TRUE)
+/*!
+  \brief Waveform capture.
+
+  Configured with the "ACQuire" and "TRIGger" commands. Samples are taken by
+  CaptureSample() and read out by the main loop once the capture is done.
+
+  \see WAVEFORM_CAPTURE, CaptureSample()
+*/
+capture_t capture;
+#endif
+
+/*! \brief Measurement filters.
+
+    Filters applied to the IBUS and VBUS measurements, the speed estimate and
+    the local speed input, indexed by the FILTER_CHANNEL_* values.
+*/
+filterChannel_t filterChannels[FILTER_CHANNELS];
+
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+/*! \brief Speed and angle tracker.
+
+    Phase-locked loop that estimates the electrical angle and speed from the
+    hall sensor edges. It is corrected in the hall sensor change interrupt and
+    extrapolated every PWM tick.
+
+    \see SPEED_ESTIMATOR, SPEED_TRACKER_BANDWIDTH
+*/
+speedTracker_t speedTracker;
+#endif
+
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+/*! \brief The low side on-time while braking.
+
+    This variable sets the part of every PWM period that the low side MOSFETs
+    of all phases are on while braking. The range is 0-255, where 255 shorts
+    the windings completely.
+
+    \see BrakeController()
+*/
+volatile uint8_t brakeOutput = 0;
+
+/*! \brief Braking report.
+
+    Stopping time and regenerated energy of the last braking, read with the
+    "MEASure:BRAKe?" command.
+*/
+brakereport_t brakeReport;
+#endif
+
 //! Struct used to hold PID controller parameters and variables.
 pidData_t pidParameters;
-#endif
+//! Struct used to hold the PID relay auto-tune status.
+pidAutoTune_t pidAutoTune;
 
 /*! \brief Main initialization function
 
@@ -272,6 +493,20 @@ void setup(void)
   // Initialize flags.
   FlagsInit();
 
+  // Initialize measurement filters.
+  FiltersInit();
+
+#if (THERMAL_MODEL == TRUE)
+  // Start the thermal models cold.
+  ThermalModelInit(&motorThermal, THERMAL_MOTOR_RATED_CURRENT, THERMAL_MOTOR_CAPACITY);
+  ThermalModelInit(&mosfetThermal, THERMAL_MOSFET_RATED_CURRENT, THERMAL_MOSFET_CAPACITY);
+#endif
+
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+  // Unlock the speed tracker until the motor turns.
+  TrackerReset(&speedTracker);
+#endif
+
   // Check if remote mode requested.
   RemoteUpdate();
 
@@ -281,18 +516,14 @@ void setup(void)
   PLLInit();
   TimersInit();
 
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
   PIDInit(PID_K_P, PID_K_I, PID_K_D, &pidParameters);
-#endif
+  PIDGainScheduleInit();
 
   if (motorFlags.remote == TRUE)
   {
     // Start serial interface with 115200 bauds.
     Serial.begin(115200);
     // while (!Serial); // wait for serial to finish initializing
-
-    // Initialise SCPI subsystem if remote mode.
-    ScpiInit();
   }
   else
   {
@@ -322,8 +553,28 @@ void loop()
 {
   if (motorFlags.remote == TRUE)
   {
+#if (FRAMED_PROTOCOL == TRUE)
+    // A break on the serial interface returns to SCPI.
+    if (Serial.readBreak() >= 0)
+    {
+      ScpiBreak();
+    }
+#endif
     ScpiInput(Serial);
   }
+#if (FLYING_START == TRUE)
+  if (motorFlags.flyingStart)
+  {
+    // Interrupts are disabled, so the drive waveform cannot change under it.
+    cli();
+    motorFlags.flyingStart = FALSE;
+    if ((motorFlags.enable == TRUE) && (motorFlags.driveWaveform != WAVEFORM_BLOCK_COMMUTATION))
+    {
+      FlyingStart();
+    }
+    sei();
+  }
+#endif
   if (motorFlags.speedControllerRun)
   {
     SpeedController();
@@ -346,6 +597,8 @@ static void FlagsInit(void)
   motorFlags.desiredDirection = DIRECTION_FORWARD;
   motorFlags.driveWaveform = WAVEFORM_UNDEFINED;
   motorFlags.fatalFault = FALSE;
+  motorFlags.reversing = FALSE;
+  motorFlags.flyingStart = FALSE;
 
   // Initialize faultFlags with default values. Set motorStopped to FALSE at
   // startup. This will make sure that the motor is not started if it is not
@@ -357,6 +610,19 @@ static void FlagsInit(void)
   faultFlags.userFlag1 = FALSE;
   faultFlags.userFlag2 = FALSE;
   faultFlags.userFlag3 = FALSE;
+  faultFlags.stall = FALSE;
+}
+
+/*! \brief Initializes the measurement filters
+
+    This function selects the power up filter of every measurement channel.
+*/
+static void FiltersInit(void)
+{
+  FilterSelect(&filterChannels[FILTER_CHANNEL_IBUS], FILTER_IBUS_TYPE, FilterDefaultParameter(FILTER_IBUS_TYPE), 0);
+  FilterSelect(&filterChannels[FILTER_CHANNEL_VBUS], FILTER_VBUS_TYPE, FilterDefaultParameter(FILTER_VBUS_TYPE), 0);
+  FilterSelect(&filterChannels[FILTER_CHANNEL_SPEED], FILTER_SPEED_TYPE, FilterDefaultParameter(FILTER_SPEED_TYPE), MAX_INT);
+  FilterSelect(&filterChannels[FILTER_CHANNEL_INPUT], FILTER_INPUT_TYPE, FilterDefaultParameter(FILTER_INPUT_TYPE), 0);
 }
 
 /*! \brief Initializes motorConfigs
@@ -369,6 +635,10 @@ static void ConfigsInit(void)
   motorConfigs.tim4Top = (uint16_t)TIM4_TOP(motorConfigs.tim4Freq);
   motorConfigs.tim4DeadTime = (uint16_t)DEAD_TIME;
   motorConfigs.speedInputSource = (uint8_t)SPEED_INPUT_SOURCE_LOCAL;
+  motorConfigs.controlMethod = (uint8_t)SPEED_CONTROL_METHOD;
+#if (POWER_METER == TRUE)
+  motorConfigs.powerWindow = (uint16_t)POWER_WINDOW_SAMPLES(POWER_WINDOW);
+#endif
 }
 
 /*!
@@ -530,6 +800,8 @@ static void PinChangeIntInit(void)
     the ADC at a rate of ~977 samples per second. The ADC prescaler is set to
     \ref ADC_PRESCALER_DIV_128 as this gives a 125kHz ADC clock. It is recommended
     to have the ADC clock between 50kHz and 200kHz to get maximum ADC resolution.
+    While conversions are synchronised to the PWM, the trigger and pre-scaler
+    are changed by \ref ADCFastUpdate().
 
     \see ADC_TRIGGER
 */
@@ -624,17 +896,31 @@ static uint16_t ADCSingleConversion(void)
       driver signals, allowing the motor to coast.
     - If \ref TURN_OFF_MODE is set to \ref TURN_OFF_MODE_RAMP, it sets the
       motor to ramp down before disabling driver signals.
+    - If \ref TURN_OFF_MODE is set to \ref TURN_OFF_MODE_BRAKE, it brakes the
+      motor before disabling driver signals.
+
+    If the pin is set, the stall fault flag and the stall restart count are
+    cleared. If \ref FLYING_START is TRUE, a rotor that is still spinning is
+    caught with \ref FlyingStart(), which is left to the main loop. Otherwise
+    a motor that is still braking is braked by \ref SpeedController() until it
+    has stopped, and then started.
 
     \note The behavior of this function depends on the \ref TURN_OFF_MODE
     configuration.
 
-    \see TURN_OFF_MODE
+    \see TURN_OFF_MODE, FLYING_START
 */
 static void EnableUpdate(void)
 {
   if ((PIND & (1 << ENABLE_PIN)) != 0)
   {
     motorFlags.enable = TRUE;
+    SetFaultFlag(FAULT_STALL, FALSE);
+    stallRestarts = 0;
+#if (FLYING_START == TRUE)
+    // Catch the rotor in the main loop, between speed controller iterations.
+    motorFlags.flyingStart = TRUE;
+#endif
   }
   else
   {
@@ -650,6 +936,11 @@ static void EnableUpdate(void)
       driver signals, allowing the motor to coast.
     - If \ref TURN_OFF_MODE is set to \ref TURN_OFF_MODE_RAMP, it sets the
       motor to ramp down before disabling driver signals.
+    - If \ref TURN_OFF_MODE is set to \ref TURN_OFF_MODE_BRAKE, it starts
+      braking the motor if it is being driven.
+
+    A direction reversal in progress is abandoned, the new direction is taken
+    over once the motor has stopped.
 
     \note The behavior of this function depends on the \ref TURN_OFF_MODE
     configuration.
@@ -659,6 +950,7 @@ static void EnableUpdate(void)
 static void DisableMotor(void)
 {
   motorFlags.enable = FALSE;
+  motorFlags.reversing = FALSE;
   SetFaultFlag(FAULT_MOTOR_STOPPED, FALSE);
 
 #if (TURN_OFF_MODE == TURN_OFF_MODE_COAST)
@@ -666,6 +958,12 @@ static void DisableMotor(void)
   motorFlags.driveWaveform = WAVEFORM_UNDEFINED;
   DisablePWMOutputs();
   ClearPWMPorts();
+#elif (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+  // Brake the motor if it is driven, otherwise it is stopped already.
+  if (motorFlags.driveWaveform == WAVEFORM_BLOCK_COMMUTATION)
+  {
+    TimersSetModeBrake();
+  }
 #endif
 }
 
@@ -688,23 +986,291 @@ static void RemoteUpdate(void)
   }
 }
 
+/*! \brief Get the measured electrical frequency.
+
+    The speed is taken from the speed and angle tracker with \ref
+    SPEED_ESTIMATOR_PLL, and from the filtered time between hall sensor edges
+    otherwise.
+
+    \return Electrical frequency in Hz.
+
+    \see SPEED_ESTIMATOR
+*/
+static uint16_t GetElectricalFrequency(void)
+{
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+  return TrackerFrequency(&speedTracker, motorConfigs.tim4Freq) >> 4;
+#else
+  return (motorConfigs.tim4Freq / (lastCommutationTicks * 3)) >> 1;
+#endif
+}
+
+#if (FLYING_START == TRUE)
+/*! \brief Catch a spinning rotor.
+
+    Called from the main loop, with interrupts disabled, when the motor has
+    been enabled while it is not driven. It runs between the iterations of
+    \ref SpeedController(), so the PID state is not changed while the
+    controller updates it. If the rotor is turning in the desired direction,
+    the duty cycle that matches its back-EMF is found from the measured speed
+    and \ref vbusVref, \ref speedOutput and the PID integrator are preset to it
+    and block commutation is engaged immediately. Otherwise the motor starts
+    from zero output once it has stopped, as without a flying start.
+
+    \see FLYING_START, FLYING_START_GAIN, MOTOR_BEMF_CONSTANT
+*/
+static void FlyingStart(void)
+{
+#if (VBUS_COMPENSATION == TRUE)
+  // The duty cycle is compensated for VBUS, so match the back-EMF at the
+  // nominal VBUS once the motor is known to be supplied.
+  uint16_t voltage = (vbusVref < VBUS_MIN_THRESHOLD) ? vbusVref : VBUS_NOMINAL;
+#else
+  uint16_t voltage = vbusVref;
+#endif
+
+  if ((faultFlags.motorStopped == TRUE) || (motorFlags.actualDirection != motorFlags.desiredDirection) ||
+      (voltage < VBUS_MIN_THRESHOLD))
+  {
+    return;
+  }
+
+  uint16_t frequency = GetElectricalFrequency();
+  uint32_t duty = ((uint32_t)frequency * FLYING_START_GAIN) / voltage;
+  uint8_t maxDuty = (motorConfigs.controlMethod == SPEED_CONTROL_CLOSED_LOOP) ? PID_OUTPUT_MAX : 255;
+  if (duty > maxDuty)
+  {
+    duty = maxDuty;
+  }
+
+  speedOutput = duty;
+  PIDPreset(duty, frequency, &pidParameters);
+  TimersSetModeBlockCommutation();
+  BlockCommutate(motorFlags.desiredDirection, GetHall());
+}
+#endif
+
+/*! \brief Change the control method.
+
+    Selects the regulator run by \ref SpeedController() without stopping the
+    motor. The regulator being switched to takes over from the present duty
+    cycle, \ref speedOutput, so the output does not step: the PID integrator
+    is preset with \ref PIDPreset() and the current regulator integrator is
+    loaded directly. A running PID auto-tune is aborted.
+
+    If the speed input source is remote, the speed input is rescaled to the
+    present operating point in the unit of the new method, the measured speed
+    for closed loop, the bus current for torque and the duty cycle for open
+    loop, so the motor holds its operating point until a new set point is
+    given. A local speed input is used as is. Position control starts with
+    the present position as its target, so the motor stops until a new target
+    is given.
+
+    \param method  New control method, one of SPEED_CONTROL_*. \return TRUE if
+    the method was selected, FALSE if it is not available.
+
+    \see SPEED_CONTROL_METHOD
+*/
+uint8_t ControlMethodSet(uint8_t method)
+{
+  if (method > SPEED_CONTROL_POSITION)
+  {
+    return FALSE;
+  }
+#if (EMULATE_HALL == TRUE)
+  // The emulated hall sensors follow the output, there is no speed to regulate.
+  if ((method == SPEED_CONTROL_CLOSED_LOOP) || (method == SPEED_CONTROL_POSITION))
+  {
+    return FALSE;
+  }
+#endif
+  if (method == motorConfigs.controlMethod)
+  {
+    return TRUE;
+  }
+
+  uint8_t duty = speedOutput;
+  uint16_t frequency = GetElectricalFrequency();
+  uint16_t input;
+
+  PIDAutoTuneAbort(&pidAutoTune);
+
+  if (method == SPEED_CONTROL_CLOSED_LOOP)
+  {
+    PIDPreset(duty, frequency, &pidParameters);
+    input = ((uint32_t)frequency * SPEED_CONTROLLER_MAX_INPUT) / SPEED_CONTROLLER_MAX_SPEED;
+  }
+  else if (method == SPEED_CONTROL_TORQUE)
+  {
+    // The current regulator only runs in torque mode, so the integrator can be
+    // loaded before the mode is selected.
+    torqueIntegrator = (int32_t)duty << 16;
+    input = ((uint32_t)ibus * SPEED_CONTROLLER_MAX_INPUT) / TORQUE_MAX_CURRENT;
+  }
+  else if (method == SPEED_CONTROL_POSITION)
+  {
+    // Hold the present position until a target is given.
+    PIDPreset(duty, frequency, &pidParameters);
+    cli();
+    positionTarget = hallPosition;
+    sei();
+    positionSpeed = 0;
+    input = duty;
+  }
+  else
+  {
+    input = duty;
+  }
+
+  if (motorConfigs.speedInputSource == SPEED_INPUT_SOURCE_REMOTE)
+  {
+    speedInput = (input > SPEED_CONTROLLER_MAX_INPUT) ? SPEED_CONTROLLER_MAX_INPUT : input;
+  }
+
+  motorConfigs.controlMethod = method;
+  return TRUE;
+}
+
+/*! \brief Take a snapshot of the measured variables.
+
+    Copies the measured variables with interrupts disabled, so they are from
+    the same instant. Can also be called from an interrupt.
+
+    \param snapshot  Snapshot to fill in.
+*/
+void MeasurementsSnapshot(measurements_t *snapshot)
+{
+  uint8_t sreg = SREG;
+  cli();
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+  snapshot->trackerSpeed = speedTracker.speed;
+#else
+  snapshot->commutationTicks = lastCommutationTicks;
+#endif
+  snapshot->ibus = ibus;
+  snapshot->iphaseU = iphaseU;
+  snapshot->iphaseV = iphaseV;
+  snapshot->iphaseW = iphaseW;
+  snapshot->vbus = vbusVref;
+  snapshot->position = hallPosition;
+  snapshot->flags = *(motorflags_t *)&motorFlags;
+  snapshot->faults = *(faultflags_t *)&faultFlags;
+  // Reading the low byte latches the high bits into TC4H.
+  snapshot->duty = 0xff & OCR4A;
+  snapshot->duty |= (0x03 & TC4H) << 8;
+  SREG = sreg;
+
+  if (snapshot->flags.enable == FALSE)
+  {
+    snapshot->duty = 0;
+  }
+}
+
+/*! \brief Position move profile.
+
+    Called every speed controller iteration in position control. The distance
+    to \ref positionTarget is taken from \ref hallPosition, and the speed set
+    point follows a trapezoidal profile: it ramps up by \ref
+    POSITION_ACCELERATION per iteration to \ref POSITION_MAX_SPEED, and ramps
+    down to \ref POSITION_MIN_SPEED once the distance left is the distance
+    needed to slow down,
+
+    \f[ d = \frac{3 \cdot T_{base} \cdot (v^2 - v_{min}^2)}{a \cdot f_{PWM}} \f]
+
+    hall sensor edges, where \f$ T_{base} \f$ is \ref
+    SPEED_CONTROLLER_TIME_BASE. Within one sector of the target the output is
+    turned off and the motor coasts to a stop. If the target is behind the
+    motor, it first coasts to a stop and the commutation is then switched to
+    the other direction.
+
+    \return Speed set point in Hz, or -1 if the output should be turned off.
+
+    \see POSITION_MAX_SPEED, POSITION_MIN_SPEED, POSITION_ACCELERATION
+*/
+static int16_t PositionProfile(void)
+{
+  cli();
+  int32_t error = positionTarget - hallPosition;
+  sei();
+
+  uint8_t direction = (error < 0) ? DIRECTION_REVERSE : DIRECTION_FORWARD;
+  uint32_t distance = (error < 0) ? -(uint32_t)error : (uint32_t)error;
+
+  // The target is reached.
+  if (distance <= 1)
+  {
+    positionSpeed = 0;
+    return -1;
+  }
+
+  // Coast to a stop before moving in the other direction.
+  if (direction != motorFlags.desiredDirection)
+  {
+    positionSpeed = 0;
+    if (faultFlags.motorStopped == FALSE)
+    {
+      return -1;
+    }
+    cli();
+    motorFlags.desiredDirection = direction;
+    if (motorFlags.driveWaveform == WAVEFORM_BLOCK_COMMUTATION)
+    {
+      BlockCommutate(direction, GetHall());
+    }
+    sei();
+  }
+
+  uint32_t stopping = (((uint32_t)positionSpeed * positionSpeed - (uint32_t)POSITION_MIN_SPEED * POSITION_MIN_SPEED) *
+                       (3UL * SPEED_CONTROLLER_TIME_BASE)) /
+                      ((uint32_t)POSITION_ACCELERATION * motorConfigs.tim4Freq);
+
+  if (positionSpeed < POSITION_MIN_SPEED)
+  {
+    positionSpeed = POSITION_MIN_SPEED;
+  }
+  else if (distance <= stopping)
+  {
+    positionSpeed = (positionSpeed > POSITION_MIN_SPEED + POSITION_ACCELERATION) ? (positionSpeed - POSITION_ACCELERATION) : POSITION_MIN_SPEED;
+  }
+  else
+  {
+    positionSpeed = (positionSpeed + POSITION_ACCELERATION < POSITION_MAX_SPEED) ? (positionSpeed + POSITION_ACCELERATION) : POSITION_MAX_SPEED;
+  }
+
+  return positionSpeed;
+}
+
 /*! \brief Speed regulator loop.
 
     This function is called periodically every \ref SPEED_CONTROLLER_TIME_BASE
     ticks. In this implementation, a simple PID controller loop is called, but
     this function could be replaced by any speed or other regulator.
 
-    If the \ref SPEED_CONTROL_METHOD is set to \ref SPEED_CONTROL_CLOSED_LOOP, a
-    PID controller is used to regulate the speed. The speed input is converted
-    into an increment set point, and a PID controller computes the output value.
-    The output is limited to a maximum value of \ref PID_OUTPUT_MAX.
-
-    If the \ref SPEED_CONTROL_METHOD is not set to \ref
-    SPEED_CONTROL_CLOSED_LOOP, a simple speed control mechanism is applied. If
-    the motor is enabled, the function calculates the delta between the speed
-    input and the current speed output. If the delta exceeds the maximum allowed
-    change, it limits the change to \ref SPEED_CONTROLLER_MAX_DELTA. If the
-    motor is disabled, the speed output is set to 0.
+    The regulator is selected at runtime by \ref motorConfigs. If the control
+    method is \ref SPEED_CONTROL_CLOSED_LOOP, a PID controller is used to
+    regulate the speed. The speed input is converted into an increment set
+    point, the PID gains are looked up from the gain schedule for the measured
+    speed, and a PID controller computes the output value. The output is
+    limited to a maximum value of \ref PID_OUTPUT_MAX. While a relay auto-tune
+    experiment is running, the PID controller is bypassed and the output is
+    switched by \ref PIDAutoTuneRun() instead. The experiment is aborted if
+    the motor is disabled or VBUS drops.
+
+    If the control method is \ref SPEED_CONTROL_POSITION, the same PID
+    controller follows the speed set point of \ref PositionProfile() instead
+    of the speed input.
+
+    If the control method is \ref SPEED_CONTROL_TORQUE, the speed input is
+    scaled to the current set point of \ref TorqueController() and the set
+    point is reduced by \ref TORQUE_SPEED_LIMIT_GAIN for every Hz the measured
+    speed is above \ref TORQUE_SPEED_LIMIT.
+
+    If the control method is \ref SPEED_CONTROL_OPEN_LOOP, a simple speed
+    control mechanism is applied. If the motor is enabled, the function
+    calculates the delta between the speed input and the current speed output.
+    If the delta exceeds the maximum allowed change, it limits the change to
+    \ref SPEED_CONTROLLER_MAX_DELTA. If the motor is disabled, the speed output
+    is set to 0.
 
     Before running the regulator, the function checks \ref vbusVref against
     \ref VBUS_MIN_THRESHOLD. If VBUS is below the threshold (e.g. motor power
@@ -712,8 +1278,8 @@ static void RemoteUpdate(void)
     held at zero, and the function returns immediately. This prevents integrator
     wind-up and unintended drive output at startup.
 
-    \note The behavior of this function depends on the \ref SPEED_CONTROL_METHOD
-    configuration.
+    \note The control method at power-up is \ref SPEED_CONTROL_METHOD, see
+    \ref ControlMethodSet() for changing it.
 
     \see SPEED_CONTROL_METHOD, SPEED_CONTROLLER_TIME_BASE,
         SPEED_CONTROLLER_MAX_DELTA, SPEED_CONTROLLER_MAX_SPEED, PID_K_P,
@@ -723,58 +1289,153 @@ static void SpeedController(void)
 {
   if (motorFlags.enable == TRUE)
   {
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+    // Keep braking if the motor was enabled again while braking. Block
+    // commutation is engaged once the motor has stopped, or by FlyingStart().
+    if (motorFlags.driveWaveform == WAVEFORM_BRAKE)
+    {
+      PIDResetIntegrator(&pidParameters);
+      PIDAutoTuneAbort(&pidAutoTune);
+      BrakeController();
+      return;
+    }
+#endif
+
     // Inhibit drive output if VBUS is not sufficiently powered. This prevents
     // PID integrator wind-up and unintended PWM when the motor power rail is
     // absent at startup.
     if (vbusVref < VBUS_MIN_THRESHOLD)
     {
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
       PIDResetIntegrator(&pidParameters);
-#endif
+      PIDAutoTuneAbort(&pidAutoTune);
+      // Writing a 16 bit value read by the ADC interrupt so disabling
+      // interrupts for atomic operation
+      cli();
+      torqueSetpoint = 0;
+      sei();
       speedOutput = 0;
       return;
     }
 
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
-    // Calculate an increment set point from the analog speed input.
-    int16_t incrementSetpoint = ((int32_t)speedInput * SPEED_CONTROLLER_MAX_SPEED) / SPEED_CONTROLLER_MAX_INPUT;
-
-    // PID regulator with feed forward from speed input.
-    uint16_t outputValue;
-
-    outputValue = PIDController(incrementSetpoint, (motorConfigs.tim4Freq / (lastCommutationTicks * 3)) >> 1, &pidParameters);
-
-    if (outputValue > PID_OUTPUT_MAX)
-    {
-      outputValue = PID_OUTPUT_MAX;
-    }
-
-    speedOutput = outputValue;
-
-    // Without the delay PID does not reset when needed
-    _delay_us(1);
-#else
-    // Calculate the delta in speedInput
-    int16_t delta = speedInput - speedOutput;
-    // If delta exceeds the maximum allowed change, limit it and update
-    // speedOutput
-    if (delta > SPEED_CONTROLLER_MAX_DELTA)
-    {
-      speedOutput += SPEED_CONTROLLER_MAX_DELTA;
-    }
-    else if (delta < -SPEED_CONTROLLER_MAX_DELTA)
-    {
-      speedOutput -= SPEED_CONTROLLER_MAX_DELTA;
-    }
-    else
-    {
-      speedOutput = speedInput;
-    }
-#endif
-  }
-  else
-  {
-    if (speedOutput > 0)
+#if (DIRECTION_REVERSAL == TRUE)
+    // Decelerate to zero speed while the direction is being reversed. The
+    // commutation is switched to the new direction in CommutationTicksUpdate().
+    if (motorFlags.reversing == TRUE)
+    {
+      PIDResetIntegrator(&pidParameters);
+      PIDAutoTuneAbort(&pidAutoTune);
+      if (speedOutput > SPEED_CONTROLLER_MAX_DELTA)
+      {
+        speedOutput -= SPEED_CONTROLLER_MAX_DELTA;
+      }
+      else
+      {
+        speedOutput = 0;
+      }
+      return;
+    }
+#endif
+
+    if ((motorConfigs.controlMethod == SPEED_CONTROL_CLOSED_LOOP) || (motorConfigs.controlMethod == SPEED_CONTROL_POSITION))
+    {
+      int16_t incrementSetpoint;
+
+      if (motorConfigs.controlMethod == SPEED_CONTROL_POSITION)
+      {
+        // Follow the speed profile of the position move.
+        incrementSetpoint = PositionProfile();
+        if (incrementSetpoint < 0)
+        {
+          PIDResetIntegrator(&pidParameters);
+          speedOutput = 0;
+          return;
+        }
+      }
+      else
+      {
+        // Calculate an increment set point from the analog speed input.
+        incrementSetpoint = ((int32_t)speedInput * SPEED_CONTROLLER_MAX_SPEED) / SPEED_CONTROLLER_MAX_INPUT;
+      }
+
+      // Calculate the measured speed in the same unit as the set point, the
+      // electrical frequency in Hz.
+      int16_t processValue = GetElectricalFrequency();
+
+      // Run the relay experiment instead of the regulator while auto-tuning.
+      if (pidAutoTune.state == PID_AUTOTUNE_RUNNING)
+      {
+        speedOutput = PIDAutoTuneRun(processValue, &pidAutoTune, &pidParameters);
+        return;
+      }
+
+      // Pick the PID gains for the measured speed from the gain schedule.
+      PIDGainScheduleUpdate(processValue, &pidParameters);
+
+      // PID regulator with feed forward from speed input.
+      uint16_t outputValue;
+
+      outputValue = PIDController(incrementSetpoint, processValue, &pidParameters);
+
+      if (outputValue > PID_OUTPUT_MAX)
+      {
+        outputValue = PID_OUTPUT_MAX;
+      }
+
+      speedOutput = outputValue;
+
+      // Without the delay PID does not reset when needed
+      _delay_us(1);
+    }
+    else if (motorConfigs.controlMethod == SPEED_CONTROL_TORQUE)
+    {
+      // Scale the speed input to a current set point. The current regulator
+      // runs on every bus current measurement.
+      uint16_t setpoint = ((uint32_t)speedInput * TORQUE_MAX_CURRENT) / SPEED_CONTROLLER_MAX_INPUT;
+
+      // Reduce the current above the speed limit.
+      int32_t overspeed = (int32_t)GetElectricalFrequency() - TORQUE_SPEED_LIMIT;
+      if (overspeed > 0)
+      {
+        uint32_t reduction = (uint32_t)overspeed * TORQUE_SPEED_LIMIT_GAIN;
+        setpoint = (reduction < setpoint) ? (setpoint - reduction) : 0;
+      }
+
+      // Writing a 16 bit value read by the ADC interrupt so disabling
+      // interrupts for atomic operation
+      cli();
+      torqueSetpoint = setpoint;
+      sei();
+    }
+    else
+    {
+      // Calculate the delta in speedInput
+      int16_t delta = speedInput - speedOutput;
+      // If delta exceeds the maximum allowed change, limit it and update
+      // speedOutput
+      if (delta > SPEED_CONTROLLER_MAX_DELTA)
+      {
+        speedOutput += SPEED_CONTROLLER_MAX_DELTA;
+      }
+      else if (delta < -SPEED_CONTROLLER_MAX_DELTA)
+      {
+        speedOutput -= SPEED_CONTROLLER_MAX_DELTA;
+      }
+      else
+      {
+        speedOutput = speedInput;
+      }
+    }
+  }
+  else
+  {
+    PIDAutoTuneAbort(&pidAutoTune);
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+    if (motorFlags.driveWaveform == WAVEFORM_BRAKE)
+    {
+      BrakeController();
+    }
+#endif
+    if (speedOutput > 0)
     {
       if (speedOutput > SPEED_CONTROLLER_MAX_DELTA)
       {
@@ -788,6 +1449,62 @@ static void SpeedController(void)
   }
 }
 
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+/*! \brief Braking profile.
+
+    This function is called every speed controller iteration while braking. It
+    adds the bus power to the regenerated energy and sets the low side on-time,
+    \ref brakeOutput:
+    - If the largest in-line phase current is above \ref BRAKE_IPHASE_LIMIT,
+      the on-time is reduced by \ref BRAKE_STEP. The winding current
+      circulates through the low side MOSFETs while they are on and never
+      crosses the bus current shunt, so it is limited on the phase currents.
+    - Otherwise, if VBUS is above \ref BRAKE_VBUS_LIMIT, the windings are
+      shorted completely, so no more energy is returned to the supply. The
+      phase current limit comes first, as it protects the MOSFETs.
+    - Otherwise the on-time is increased by \ref BRAKE_STEP until the windings
+      are shorted completely.
+
+    \note The bus current sense measures the current magnitude, so the
+    regenerated energy assumes all bus current flows back into the supply
+    while braking.
+
+    \see BRAKE_VBUS_LIMIT, BRAKE_IPHASE_LIMIT, BRAKE_STEP
+*/
+static void BrakeController(void)
+{
+  uint16_t voltage = vbusVref;
+  uint16_t current = ibus;
+
+  brakeReport.energy += ((uint32_t)voltage * current) >> 4;
+
+  // Magnitude of the largest phase current, zero at 511.
+  int16_t phase[3] = {iphaseU, iphaseV, iphaseW};
+  uint16_t phaseCurrent = 0;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    uint16_t magnitude = abs(phase[i] - 511);
+    if (magnitude > phaseCurrent)
+    {
+      phaseCurrent = magnitude;
+    }
+  }
+
+  if (phaseCurrent > BRAKE_IPHASE_LIMIT)
+  {
+    brakeOutput = (brakeOutput > BRAKE_STEP) ? (brakeOutput - BRAKE_STEP) : 0;
+  }
+  else if (voltage > BRAKE_VBUS_LIMIT)
+  {
+    brakeOutput = 255;
+  }
+  else
+  {
+    brakeOutput = (brakeOutput < (255 - BRAKE_STEP)) ? (brakeOutput + BRAKE_STEP) : 255;
+  }
+}
+#endif
+
 /**
    \brief Handle a fatal error and enter a fault state.
 
@@ -854,6 +1571,43 @@ static FORCE_INLINE void TimersSetModeBlockCommutation(void)
   EnablePWMOutputs();
 }
 
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+/*! \brief Configures timers for braking.
+
+    This function is called when the motor is disabled while it is driven. The
+    high side MOSFETs are turned off and only the low side outputs follow the
+    PWM, so the low side MOSFETs of all phases switch together with an on-time
+    set by \ref brakeOutput. The on-time starts at zero and the braking report
+    is cleared.
+*/
+static FORCE_INLINE void TimersSetModeBrake(void)
+{
+  // Set PWM pins to input (High-Z) while changing modes.
+  DisablePWMOutputs();
+  ClearPWMPorts();
+
+  // Only the inverted (low side) outputs are controlled by the timer.
+  TCCR4E = (TCCR4E & ~0b00111111) | (1 << OC4OE4) | (1 << OC4OE2) | (1 << OC4OE0);
+
+  speedOutput = 0;
+  brakeOutput = 0;
+  brakeReport.elapsed = 0;
+  brakeReport.ticks = 0;
+  brakeReport.energy = 0;
+
+  // Start with the low sides off.
+  SetDuty(motorConfigs.tim4Top << 1);
+
+  // Wait for the next PWM cycle to ensure that all outputs are updated.
+  TimersWaitForNextPWMCycle();
+
+  motorFlags.driveWaveform = WAVEFORM_BRAKE;
+
+  // Change PWM pins to output again to allow PWM control.
+  EnablePWMOutputs();
+}
+#endif
+
 /*! \brief Wait for the start of the next PWM cycle.
 
     This function waits for the beginning of the next PWM cycle to ensure smooth
@@ -949,6 +1703,65 @@ static FORCE_INLINE void DesiredDirectionUpdate(void)
   }
 }
 
+#if (DIRECTION_REVERSAL == TRUE)
+/*! \brief Start or cancel a direction reversal while running.
+
+    Reads the direction input pin. If it differs from the desired direction,
+    the motor is decelerated, by braking with \ref TURN_OFF_MODE_BRAKE or by
+    ramping down the duty cycle otherwise, until \ref DirectionReversalSwitch()
+    is called at zero speed. If the pin is changed back before that, the
+    reversal is cancelled and the motor accelerates in the old direction again.
+
+    \see DIRECTION_REVERSAL
+*/
+static void DirectionReversalUpdate(void)
+{
+  uint8_t direction = ((PIND & (1 << DIRECTION_COMMAND_PIN)) != 0) ? DIRECTION_REVERSE : DIRECTION_FORWARD;
+
+  if (direction != motorFlags.desiredDirection)
+  {
+    motorFlags.reversing = TRUE;
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+    if (motorFlags.driveWaveform == WAVEFORM_BLOCK_COMMUTATION)
+    {
+      TimersSetModeBrake();
+    }
+#endif
+  }
+  else if (motorFlags.reversing == TRUE)
+  {
+    motorFlags.reversing = FALSE;
+    if (motorFlags.driveWaveform != WAVEFORM_BLOCK_COMMUTATION)
+    {
+      speedOutput = 0;
+      TimersSetModeBlockCommutation();
+      BlockCommutate(motorFlags.desiredDirection, GetHall());
+    }
+  }
+}
+
+/*! \brief Switch the commutation to the new direction.
+
+    Called when the rotor has reached zero speed during a direction reversal.
+    The desired direction is changed and block commutation restarts from zero
+    output in the new direction, so the motor accelerates again without being
+    enabled again.
+*/
+static FORCE_INLINE void DirectionReversalSwitch(void)
+{
+  motorFlags.reversing = FALSE;
+  motorFlags.desiredDirection = (motorFlags.desiredDirection == DIRECTION_FORWARD) ? DIRECTION_REVERSE : DIRECTION_FORWARD;
+
+  speedOutput = 0;
+  PIDResetIntegrator(&pidParameters);
+  if (motorFlags.driveWaveform != WAVEFORM_BLOCK_COMMUTATION)
+  {
+    TimersSetModeBlockCommutation();
+  }
+  BlockCommutate(motorFlags.desiredDirection, GetHall());
+}
+#endif
+
 /*! \brief Update the global actual direction flag based on the two latest hall
     values.
 
@@ -1043,22 +1856,39 @@ static FORCE_INLINE void ClearPWMPorts(void)
 /*! \brief Update the 'tick' counter and check for a stopped motor.
 
     This function should be called at every PWM timer overflow to update the
-    'tick' counter. It increments the 'tick' counter until it reaches the
-    maximum tick limit, indicating a potentially stopped or stalled motor. If
-    the limit is reached, the global motor stopped flag is set.
+    'tick' counter. It increments the 'tick' counter until it reaches \ref
+    commutationTimeout, indicating a stopped or stalled motor. If the limit is
+    reached, the global motor stopped flag is set.
 
-    \note This function can be used to detect a stalled motor and take
-    appropriate actions.
+    If the motor is driven and the bus current is above \ref
+    STALL_IBUS_THRESHOLD, the motor has stalled. The stall fault flag is set
+    and the drivers are turned off. The motor is restarted after \ref
+    COMMUTATION_TICKS_STOPPED, or disabled once it has been restarted \ref
+    STALL_RESTART_ATTEMPTS times.
 
     \note If the motor is determined to be stopped, it may change the motor
     drive waveform and disable PWM outputs as necessary.
 
-    \see COMMUTATION_TICKS_STOPPED, TURN_OFF_MODE
+    \note While the direction is reversed on the fly, the commutation is
+    switched to the new direction once \ref DIRECTION_REVERSAL_TICKS pass
+    without any hall changes, or once the motor is considered stopped.
+
+    \see COMMUTATION_TICKS_STOPPED, COMMUTATION_TIMEOUT_FACTOR, TURN_OFF_MODE,
+    DIRECTION_REVERSAL_TICKS, STALL_IBUS_THRESHOLD, STALL_RESTART_ATTEMPTS
 */
 static FORCE_INLINE void CommutationTicksUpdate(void)
 {
+#if (DIRECTION_REVERSAL == TRUE)
+  // The rotor has slowed down to zero speed, so reverse the commutation.
+  if ((motorFlags.reversing == TRUE) &&
+      ((commutationTicks >= DIRECTION_REVERSAL_TICKS) || (commutationTicks >= commutationTimeout)))
+  {
+    DirectionReversalSwitch();
+  }
+#endif
+
   // If the motor is not stopped, increment the tick counter.
-  if (commutationTicks < COMMUTATION_TICKS_STOPPED)
+  if (commutationTicks < commutationTimeout)
   {
     commutationTicks++;
   }
@@ -1068,6 +1898,11 @@ static FORCE_INLINE void CommutationTicksUpdate(void)
     // Set flags to notify that the motor is stopped.
     SetFaultFlag(FAULT_MOTOR_STOPPED, TRUE);
     lastCommutationTicks = 0xffff;
+    commutationTimeout = COMMUTATION_TICKS_STOPPED;
+    FilterReset(&filterChannels[FILTER_CHANNEL_SPEED], MAX_INT);
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+    TrackerReset(&speedTracker);
+#endif
 
     // Get the current hall value.
     uint8_t hall = GetHall();
@@ -1085,21 +1920,42 @@ static FORCE_INLINE void CommutationTicksUpdate(void)
         _delay_ms(2);
       }
     }
+    // If the motor is driven against a high current, it has stalled. Turn off
+    // the drivers and restart it after COMMUTATION_TICKS_STOPPED, or disable it
+    // if it has been restarted too often.
+    else if ((motorFlags.driveWaveform == WAVEFORM_BLOCK_COMMUTATION) && (motorFlags.enable == TRUE) &&
+             (ibus > STALL_IBUS_THRESHOLD))
+    {
+      SetFaultFlag(FAULT_STALL, TRUE);
+      speedOutput = 0;
+      PIDResetIntegrator(&pidParameters);
+      motorFlags.driveWaveform = WAVEFORM_UNDEFINED;
+      DisablePWMOutputs();
+      ClearPWMPorts();
+      commutationTicks = 0;
+
+      if (stallRestarts < STALL_RESTART_ATTEMPTS)
+      {
+        stallRestarts++;
+      }
+      else
+      {
+        DisableMotor();
+      }
+    }
     // If the motor is supposed to be enabled, and the drive method is not block commutation,
     // reset the speed output and set the drive waveform.
     else if (motorFlags.driveWaveform != WAVEFORM_BLOCK_COMMUTATION && motorFlags.enable == TRUE)
     {
       speedOutput = 0;
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
       PIDResetIntegrator(&pidParameters);
-#endif
       TimersSetModeBlockCommutation();
       BlockCommutate(motorFlags.desiredDirection, GetHall());
     }
     // If the motor is supposed to be stopped, (and it has stopped now) ...
     else if (motorFlags.enable == FALSE)
     {
-#if (TURN_OFF_MODE == TURN_OFF_MODE_RAMP)
+#if (TURN_OFF_MODE == TURN_OFF_MODE_RAMP) || (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
       // ... unset the drive waveform and disable PWM outputs.
       motorFlags.driveWaveform = WAVEFORM_UNDEFINED;
       DisablePWMOutputs();
@@ -1125,7 +1981,8 @@ ISR(INT0_vect)
 
     This interrupt service routine is called every time any of the hall sensors
     change. The actual direction, the reverse rotation and no hall connections
-    flags are updated.
+    flags are updated, the speed and angle tracker is corrected and the edge
+    is counted in \ref hallPosition.
 
     The motor stopped flag is also set to FALSE, since the motor is obviously
     not stopped when there is a hall change.
@@ -1146,12 +2003,58 @@ ISR(PCINT0_vect)
   ActualDirectionUpdate(lastHall, hall);
   ReverseRotationSignalUpdate();
 
+  // Count the edge in the direction of rotation.
+  if (motorFlags.actualDirection == DIRECTION_FORWARD)
+  {
+    hallPosition++;
+  }
+  else if (motorFlags.actualDirection == DIRECTION_REVERSE)
+  {
+    hallPosition--;
+  }
+
+#if (DIRECTION_REVERSAL == TRUE)
+  // The rotor already turns in the new direction, so it has passed zero speed.
+  if ((motorFlags.reversing == TRUE) && (motorFlags.actualDirection != DIRECTION_UNKNOWN) &&
+      (motorFlags.actualDirection != motorFlags.desiredDirection))
+  {
+    DirectionReversalSwitch();
+  }
+#endif
+
   lastHall = hall;
 
-  // Reset commutation timer.
-  lastCommutationTicks = calculateEMA(commutationTicks, lastCommutationTicks, 2);
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+  // The motor has not stopped yet, so extend the stopping time.
+  if (motorFlags.driveWaveform == WAVEFORM_BRAKE)
+  {
+    brakeReport.ticks = brakeReport.elapsed;
+  }
+#endif
+
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+  // Correct the speed and angle tracker with the angle of this edge.
+  TrackerHallEdge(&speedTracker, hall, motorFlags.actualDirection, commutationTicks);
+#endif
+
+  // Filter the time since the last hall change into the speed estimate and
+  // reset the commutation timer. Never report 0 ticks as it is a divisor.
+  int16_t ticks = FilterUpdate(&filterChannels[FILTER_CHANNEL_SPEED], commutationTicks);
+  lastCommutationTicks = (ticks > 0) ? ticks : 1;
   commutationTicks = 0;
 
+  // Consider the motor stopped after a few hall periods without a change.
+  uint32_t timeout = (uint32_t)lastCommutationTicks * COMMUTATION_TIMEOUT_FACTOR;
+  if (timeout > COMMUTATION_TICKS_STOPPED)
+  {
+    timeout = COMMUTATION_TICKS_STOPPED;
+  }
+  else if (timeout < COMMUTATION_TICKS_STOPPED_MIN)
+  {
+    timeout = COMMUTATION_TICKS_STOPPED_MIN;
+  }
+  commutationTimeout = timeout;
+
   // Since the hall sensors are changing, the motor can not be stopped.
   // For fast access, SetFaultFlag() is not used to update this flag.
   // Instead, the flag is updated directly.
@@ -1166,13 +2069,28 @@ ISR(PCINT0_vect)
     updated accordingly. The motor will not start again until the enable pin is
     turned on again.
 
+    With \ref DIRECTION_REVERSAL set to TRUE, a running motor is reversed on the
+    fly instead and keeps running in the new direction, except in position
+    control.
+
     \note Depending on the \ref TURN_OFF_MODE configuration, it will either
-    coast or ramp down the motor.
+    coast, ramp down or brake the motor.
 
-    \see TURN_OFF_MODE
+    \see TURN_OFF_MODE, DIRECTION_REVERSAL
 */
 ISR(INT2_vect)
 {
+#if (DIRECTION_REVERSAL == TRUE)
+  // Reverse a running motor without stopping it. In position control the
+  // direction belongs to the move, so the motor is stopped instead.
+  if ((motorFlags.enable == TRUE) && (motorConfigs.controlMethod != SPEED_CONTROL_POSITION) &&
+      ((motorFlags.driveWaveform == WAVEFORM_BLOCK_COMMUTATION) || (motorFlags.reversing == TRUE)))
+  {
+    DirectionReversalUpdate();
+    return;
+  }
+#endif
+
   // Update desired direction flag.
   DesiredDirectionUpdate();
 
@@ -1180,11 +2098,274 @@ ISR(INT2_vect)
   DisableMotor();
 }
 
+/*! \brief Current regulator.
+
+    This function is called on every PWM synchronous bus current conversion,
+    see \ref ADCFastUpdate(). A PI regulator drives \ref speedOutput so that
+    the bus current follows \ref torqueSetpoint. The conversion is made at the
+    middle of the high side on-time, so it is the winding current rather than
+    the average of \ref ibus. The integrator is limited to the output range, so
+    it does not wind up.
+
+    While the motor is not driven, is being reversed or VBUS is below \ref
+    VBUS_MIN_THRESHOLD, the speed controller sets \ref speedOutput and the
+    integrator follows it, so the regulator takes over without a step.
+
+    \param current  Bus current conversion (register value).
+
+    \see SPEED_CONTROL_TORQUE, TORQUE_K_P, TORQUE_K_I
+*/
+static FORCE_INLINE void TorqueController(uint16_t current)
+{
+  if ((motorFlags.enable == FALSE) || (motorFlags.driveWaveform != WAVEFORM_BLOCK_COMMUTATION) ||
+      (motorFlags.reversing == TRUE) || (vbusVref < VBUS_MIN_THRESHOLD))
+  {
+    torqueIntegrator = (int32_t)speedOutput << 16;
+    return;
+  }
+
+  int16_t error = (int16_t)torqueSetpoint - (int16_t)current;
+
+  torqueIntegrator += (int32_t)error * TORQUE_K_I;
+  if (torqueIntegrator > (255L << 16))
+  {
+    torqueIntegrator = 255L << 16;
+  }
+  else if (torqueIntegrator < 0)
+  {
+    torqueIntegrator = 0;
+  }
+
+  int32_t output = (torqueIntegrator >> 16) + (((int32_t)error * TORQUE_K_P) >> 8);
+  speedOutput = (output > 255) ? 255 : ((output < 0) ? 0 : output);
+}
+
+#if (VBUS_COMPENSATION == TRUE)
+/*! \brief Update the VBUS compensation gain.
+
+    Finds \f$ 2^{16} / v \f$ by linear interpolation in \ref
+    vbusReciprocalTable and multiplies it by \ref VBUS_NOMINAL, so no division
+    is needed. The gain is limited to just below 4.
+
+    \param voltage  Filtered VBUS register value.
+
+    \see VBUS_COMPENSATION, vbusCompensation
+*/
+static FORCE_INLINE void VbusCompensationUpdate(uint16_t voltage)
+{
+  uint8_t index = (voltage >> 4) & 0x3f;
+  uint8_t fraction = voltage & 0x0f;
+  uint16_t lower = pgm_read_word_near(&vbusReciprocalTable[index]);
+  uint16_t upper = pgm_read_word_near(&vbusReciprocalTable[index + 1]);
+  uint16_t reciprocal = lower - (((lower - upper) * fraction) >> 4);
+
+  uint32_t gain = ((uint32_t)VBUS_NOMINAL * reciprocal) >> 10;
+  vbusCompensation = (gain > 255) ? 255 : gain;
+}
+#endif
+
+#if (POWER_METER == TRUE)
+/*! \brief Update the power meter.
+
+    Adds the product of one VBUS and IBUS measurement pair to the energy and
+    the present window. At the end of every window of \ref
+    motorconfigs::powerWindow pairs its sum and length are kept, the average
+    is only divided out when it is queried.
+
+    \param voltage  Filtered VBUS register value.
+    \param current  Filtered IBUS register value.
+
+    \see POWER_METER, powerMeter
+*/
+static FORCE_INLINE void PowerMeterUpdate(uint16_t voltage, uint16_t current)
+{
+  uint32_t power = (uint32_t)voltage * current;
+
+  powerMeter.energy += power;
+  powerMeter.windowSum += power;
+  if (power > powerMeter.windowPeak)
+  {
+    powerMeter.windowPeak = power;
+  }
+
+  uint16_t window = motorConfigs.powerWindow;
+
+  if (++powerMeter.windowSamples >= window)
+  {
+    powerMeter.sum = powerMeter.windowSum;
+    powerMeter.samples = powerMeter.windowSamples;
+    powerMeter.peak = powerMeter.windowPeak;
+    powerMeter.windowSum = 0;
+    powerMeter.windowPeak = 0;
+    powerMeter.windowSamples = 0;
+  }
+}
+#endif
+
+#if (TELEMETRY_STREAM == TRUE)
+/*! \brief Take a telemetry record.
+
+    Called every speed controller iteration. Every \ref telemetryStream divider
+    iterations a measurement snapshot is queued with its sequence number and
+    time. When the queue is full the record is dropped, but its sequence
+    number is still used, so the gap shows in the stream.
+
+    \see TELEMETRY_STREAM, telemetryStream
+*/
+static FORCE_INLINE void TelemetrySample(void)
+{
+  if ((telemetryStream.enable == FALSE) || (--telemetryStream.countdown != 0))
+  {
+    return;
+  }
+  telemetryStream.countdown = telemetryStream.divider;
+
+  uint8_t head = telemetryStream.head;
+  if ((uint8_t)(head - telemetryStream.tail) < TELEMETRY_QUEUE_LENGTH)
+  {
+    telemetryrecord_t *record = &telemetryStream.records[head & (TELEMETRY_QUEUE_LENGTH - 1)];
+    record->sequence = telemetryStream.sequence;
+    record->timestamp = micros();
+    MeasurementsSnapshot(&record->measurements);
+    telemetryStream.head = head + 1;
+  }
+  telemetryStream.sequence++;
+}
+#endif
+
+#if (WAVEFORM_CAPTURE == TRUE)
+/*! \brief Reads one waveform capture variable.
+
+    The currents and the voltage are the unfiltered conversions of the present
+    PWM period, see \ref ADCFastUpdate().
+
+    \param variable  One of \ref capture_variable_t.
+
+    \return The present value of the variable in its register unit.
+*/
+static FORCE_INLINE int16_t CaptureValue(uint8_t variable)
+{
+  if (variable <= CAPTURE_VOLTAGE)
+  {
+    return adcFastSamples[adcCaptureIndex[variable]];
+  }
+
+  switch (variable)
+  {
+  case CAPTURE_DUTY:
+  {
+    // Reading the low byte latches the high bits into TC4H.
+    uint16_t duty = 0xff & OCR4A;
+    duty |= (0x03 & TC4H) << 8;
+    return duty;
+  }
+  default:
+    return GetHall();
+  }
+}
+
+/*! \brief Takes a waveform capture sample.
+
+    Called every PWM period, from the Timer4 overflow interrupt when the
+    capture has no analog variables, otherwise from \ref ADCFastConversion()
+    once they are converted. While armed or triggered, every \ref
+    capture_t::decimation periods the selected variables are written to the
+    ring buffer. Once the buffer holds the pre-trigger samples, the trigger
+    condition is checked on every sample. After the trigger the samples that
+    fill the rest of the buffer are taken and the capture is done.
+
+    \see WAVEFORM_CAPTURE, capture
+*/
+static FORCE_INLINE void CaptureSample(void)
+{
+  uint8_t state = capture.state;
+  if ((state != CAPTURE_STATE_ARMED) && (state != CAPTURE_STATE_TRIGGERED))
+  {
+    return;
+  }
+  if (--capture.countdown != 0)
+  {
+    return;
+  }
+  capture.countdown = capture.decimation;
+
+  int16_t *sample = capture.samples[capture.index];
+  for (uint8_t i = 0; i < capture.channelCount; i++)
+  {
+    sample[i] = CaptureValue(capture.channels[i]);
+  }
+  capture.index = (capture.index + 1) & (CAPTURE_LENGTH - 1);
+
+  if (state == CAPTURE_STATE_TRIGGERED)
+  {
+    if (--capture.remaining == 0)
+    {
+      capture.state = CAPTURE_STATE_DONE;
+    }
+    return;
+  }
+
+  // Compare with the previous sample to find an edge.
+  int16_t value;
+  uint8_t triggered = FALSE;
+  switch (capture.source)
+  {
+  case CAPTURE_TRIGGER_LEVEL:
+    value = CaptureValue(capture.levelChannel);
+    if (capture.rising)
+    {
+      triggered = (capture.previous < capture.level) && (value >= capture.level);
+    }
+    else
+    {
+      triggered = (capture.previous > capture.level) && (value <= capture.level);
+    }
+    break;
+  case CAPTURE_TRIGGER_HALL:
+    value = GetHall();
+    triggered = (value != capture.previous);
+    break;
+  case CAPTURE_TRIGGER_FAULT:
+  {
+    faultflags_t faults = *(faultflags_t *)&faultFlags;
+    faults.motorStopped = FALSE;
+    value = *(uint8_t *)&faults;
+    triggered = (capture.previous == 0) && (value != 0);
+    break;
+  }
+  default:
+    value = 0;
+    break;
+  }
+  capture.previous = value;
+
+  // The first sample has no previous one, and the pre-trigger samples must
+  // be in the buffer before the trigger is accepted.
+  if (capture.count < CAPTURE_LENGTH)
+  {
+    capture.count++;
+  }
+  if ((capture.count <= capture.pretrigger) || ((capture.count == 1) && (capture.force == FALSE)))
+  {
+    return;
+  }
+
+  if (triggered || capture.force)
+  {
+    capture.remaining = CAPTURE_LENGTH - capture.pretrigger - 1;
+    capture.state = (capture.remaining == 0) ? CAPTURE_STATE_DONE : CAPTURE_STATE_TRIGGERED;
+  }
+}
+#endif
+
 /*! \brief Timer4 Overflow Event Interrupt Service Routine.
 
    This interrupt service routine is trigger on Timer4 overflow. It manages the
-   commutation ticks, which determines motor status. It also controls the
-   execution of the speed regulation loop at constant intervals.
+   commutation ticks, which determines motor status, and advances the speed
+   and angle tracker. It also controls the execution of the speed regulation
+   loop at constant intervals, and takes the telemetry records at the same
+   intervals. The waveform capture samples without analog variables are taken
+   every PWM period.
 
    \see TimersInit(), F_MOSFET
 */
@@ -1192,7 +2373,17 @@ ISR(TIMER4_OVF_vect)
 {
   if (motorFlags.driveWaveform == WAVEFORM_BLOCK_COMMUTATION)
   {
-    uint16_t dutyCycle = ((uint32_t)speedOutput * motorConfigs.tim4Top) >> 7;
+#if (VBUS_COMPENSATION == TRUE)
+    // Scale the output by the nominal to actual VBUS ratio.
+    uint16_t output = ((uint16_t)speedOutput * vbusCompensation) >> 6;
+#else
+    uint16_t output = speedOutput;
+#endif
+#if (THERMAL_MODEL == TRUE)
+    // Derate the output as the thermal budget drains.
+    output = ((uint32_t)output * thermalDerate) >> 8;
+#endif
+    uint16_t dutyCycle = ((uint32_t)output * motorConfigs.tim4Top) >> 7;
 
     if (dutyCycle > (uint16_t)(motorConfigs.tim4Top << 1))
     {
@@ -1201,9 +2392,29 @@ ISR(TIMER4_OVF_vect)
 
     SetDuty(dutyCycle);
   }
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+  else if (motorFlags.driveWaveform == WAVEFORM_BRAKE)
+  {
+    // The low sides are on while the high side output would be off.
+    SetDuty((uint16_t)(motorConfigs.tim4Top << 1) - (((uint32_t)brakeOutput * motorConfigs.tim4Top) >> 7));
+    brakeReport.elapsed++;
+  }
+#endif
+
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+  // Extrapolate the electrical angle to this tick.
+  TrackerTick(&speedTracker);
+#endif
 
   CommutationTicksUpdate();
 
+#if (WAVEFORM_CAPTURE == TRUE)
+  if (capture.adcVariables == 0)
+  {
+    CaptureSample();
+  }
+#endif
+
   {
     // Run the speed regulation loop with constant intervals.
     static uint8_t speedRegTicks = 0;
@@ -1212,6 +2423,9 @@ ISR(TIMER4_OVF_vect)
     {
       motorFlags.speedControllerRun = TRUE;
       speedRegTicks -= SPEED_CONTROLLER_TIME_BASE;
+#if (TELEMETRY_STREAM == TRUE)
+      TelemetrySample();
+#endif
     }
   }
 }
@@ -1264,6 +2478,143 @@ ISR(TIMER1_OVF_vect)
   faultSequentialStateMachine(&faultFlags, &motorFlags);
 }
 
+/*! \brief Select the ADC channel of the next conversion.
+
+    \param channel  MUX5 and MUX4:0 together, as in \ref ADC_MUX_H_BITS and
+    \ref ADC_MUX_L_BITS.
+*/
+static FORCE_INLINE void ADCSelectChannel(uint8_t channel)
+{
+  ADMUX = (ADMUX & ~ADC_MUX_L_BITS) | (channel & ADC_MUX_L_BITS);
+  ADCSRB = (ADCSRB & ~ADC_MUX_H_BITS) | (channel & ADC_MUX_H_BITS);
+}
+
+/*! \brief Select the PWM synchronous conversions.
+
+    Called after every round robin conversion. The channels that must be
+    converted every PWM period are listed in \ref adcFastChannels: the bus
+    current in torque control, then the analog variables of a running waveform
+    capture. If there are any, the ADC is triggered by \ref ADC_FAST_TRIGGER
+    and runs at \ref ADC_FAST_PRESCALER, the listed channels are converted one
+    after the other from the start of every PWM period, and the next round
+    robin channel is converted after them once per Timer0 overflow, so the
+    round robin keeps its rate of \ref ADC_SAMPLE_RATE. Otherwise the ADC is
+    triggered by \ref ADC_TRIGGER only.
+
+    A trigger that comes while a conversion is still running is ignored, so at
+    PWM frequencies above about 50 kHz per listed channel the conversions are
+    made every second PWM period. With all five analog capture variables that
+    is the case above about 15 kHz.
+*/
+static void ADCFastUpdate(void)
+{
+  uint8_t count = 0;
+
+  if (motorConfigs.controlMethod == SPEED_CONTROL_TORQUE)
+  {
+    adcFastChannels[count++] = ADC_MUX_H_IBUS | ADC_MUX_L_IBUS;
+  }
+#if (WAVEFORM_CAPTURE == TRUE)
+  uint8_t variables = 0;
+  uint8_t state = capture.state;
+  if ((state == CAPTURE_STATE_ARMED) || (state == CAPTURE_STATE_TRIGGERED))
+  {
+    variables = capture.adcVariables;
+  }
+  for (uint8_t variable = CAPTURE_IBUS; variable <= CAPTURE_VOLTAGE; variable++)
+  {
+    if (variables & (1 << variable))
+    {
+      // The bus current can be listed for torque control already.
+      uint8_t channel = adcCaptureChannels[variable];
+      uint8_t i = 0;
+      while ((i < count) && (adcFastChannels[i] != channel))
+      {
+        i++;
+      }
+      if (i == count)
+      {
+        adcFastChannels[count++] = channel;
+      }
+      adcCaptureIndex[variable] = i;
+    }
+  }
+  adcFastVariables = variables;
+#endif
+  adcFastCount = count;
+
+  if (count == 0)
+  {
+    ADCSRB = (ADCSRB & ~(ADC_TRIGGER_BITS | (1 << ADHSM))) | ADC_TRIGGER;
+    ADCSRA = (ADCSRA & ~ADC_PRESCALER_BITS) | ADC_PRESCALER;
+    return;
+  }
+
+  // Remember the next round robin channel and wait for the PWM period.
+  adcRoundRobinChannel = (ADMUX & ADC_MUX_L_BITS) | (ADCSRB & ADC_MUX_H_BITS);
+  ADCSelectChannel(adcFastChannels[0]);
+  adcFastIndex = 0;
+  adcTimer0 = TCNT0;
+  ADCSRA = (ADCSRA & ~ADC_PRESCALER_BITS) | ADC_FAST_PRESCALER;
+  ADCSRB = (ADCSRB & ~ADC_TRIGGER_BITS) | ADC_FAST_TRIGGER | (1 << ADHSM);
+}
+
+/*! \brief Handle a PWM synchronous conversion.
+
+    Stores the result, runs the current regulator on a bus current conversion
+    in torque control and starts the next listed channel. After the last one,
+    the waveform capture sample is taken if its variables are listed, and the
+    next round robin channel is converted if Timer0 has overflowed since
+    the last PWM period, otherwise the first listed channel waits for the next
+    PWM period.
+
+    \param index  Index of the converted channel in \ref adcFastChannels.
+*/
+static FORCE_INLINE void ADCFastConversion(uint8_t index)
+{
+  uint16_t sample = ADCL >> 6;
+  sample |= (ADCH << 2);
+  adcFastSamples[index] = sample;
+
+  if ((adcFastChannels[index] == (ADC_MUX_H_IBUS | ADC_MUX_L_IBUS)) &&
+      (motorConfigs.controlMethod == SPEED_CONTROL_TORQUE))
+  {
+    TorqueController(sample);
+  }
+
+  index++;
+  if (index < adcFastCount)
+  {
+    ADCSelectChannel(adcFastChannels[index]);
+    adcFastIndex = index;
+    ADCSRA |= (1 << ADSC);
+    return;
+  }
+
+#if (WAVEFORM_CAPTURE == TRUE)
+  // Not until the list is updated for a newly armed capture.
+  if ((adcFastVariables != 0) && (adcFastVariables == capture.adcVariables))
+  {
+    CaptureSample();
+  }
+#endif
+
+  uint8_t timer = TCNT0;
+  if (timer < adcTimer0)
+  {
+    // Timer0 has overflowed, so convert the next round robin channel now.
+    ADCSelectChannel(adcRoundRobinChannel);
+    adcFastIndex = ADC_FAST_IDLE;
+    ADCSRA |= (1 << ADSC);
+  }
+  else
+  {
+    ADCSelectChannel(adcFastChannels[0]);
+    adcFastIndex = 0;
+  }
+  adcTimer0 = timer;
+}
+
 /**
    \brief ADC Conversion Complete Interrupt Service Routine.
 
@@ -1271,22 +2622,31 @@ ISR(TIMER1_OVF_vect)
    conversion is finished, and the converted result is available in the ADC data
    register.
 
-   The switch/case construct ensures that the converted value is stored in the
-   variable corresponding to the selected channel and changes the channel for
-   the next ADC measurement.
+   PWM synchronous conversions are handled by \ref ADCFastConversion(). For
+   the round robin conversions, the switch/case construct ensures that the
+   converted value is stored in the variable corresponding to the selected
+   channel and changes the channel for the next ADC measurement.
 
    Additional ADC measurements can be added to the cycle by extending the
    switch/case construct.
 */
 ISR(ADC_vect)
 {
+  uint8_t index = adcFastIndex;
+  if (index != ADC_FAST_IDLE)
+  {
+    ADCFastConversion(index);
+    return;
+  }
+
   switch ((ADMUX & ADC_MUX_L_BITS) | (ADCSRB & ADC_MUX_H_BITS))
   {
   case (ADC_MUX_H_SPEED | ADC_MUX_L_SPEED):
     // Handle ADC conversion result for speed measurement.
     if (motorConfigs.speedInputSource == SPEED_INPUT_SOURCE_LOCAL)
     {
-      speedInput = ADCH;
+      int16_t input = FilterUpdate(&filterChannels[FILTER_CHANNEL_INPUT], ADCH);
+      speedInput = (input < SPEED_CONTROLLER_MAX_INPUT) ? input : SPEED_CONTROLLER_MAX_INPUT;
     }
     ADMUX &= ~ADC_MUX_L_BITS;
     ADMUX |= ADC_MUX_L_IBUS;
@@ -1294,9 +2654,22 @@ ISR(ADC_vect)
     ADCSRB |= ADC_MUX_H_IBUS;
     break;
   case (ADC_MUX_H_IBUS | ADC_MUX_L_IBUS):
-    // Handle ADC conversion result for current measurement.
-    ibus = ADCL >> 6;
-    ibus |= (ADCH << 2);
+  {
+    // Handle ADC conversion result for current measurement. The fault checks
+    // use the unfiltered sample so filtering does not delay them.
+    uint16_t sample = ADCL >> 6;
+    sample |= (ADCH << 2);
+    ibus = FilterUpdate(&filterChannels[FILTER_CHANNEL_IBUS], sample);
+#if (THERMAL_MODEL == TRUE)
+    {
+      // Heat up the thermal models and derate by the hotter one.
+      ThermalModelUpdate(&motorThermal, ibus);
+      ThermalModelUpdate(&mosfetThermal, ibus);
+      uint16_t motorDerate = ThermalModelDerate(&motorThermal);
+      uint16_t mosfetDerate = ThermalModelDerate(&mosfetThermal);
+      thermalDerate = (motorDerate < mosfetDerate) ? motorDerate : mosfetDerate;
+    }
+#endif
     ADMUX &= ~ADC_MUX_L_BITS;
     ADMUX |= ADC_MUX_L_IPHASE_U;
     ADCSRB &= ~ADC_MUX_H_BITS;
@@ -1305,7 +2678,7 @@ ISR(ADC_vect)
 #if (IBUS_FAULT_ENABLE == TRUE)
     // Debounce current error flags.
     static uint8_t currentErrorCount = 0;
-    if (ibus > IBUS_ERROR_THRESHOLD)
+    if (sample > IBUS_ERROR_THRESHOLD)
     {
       if (currentErrorCount < 3)
       {
@@ -1322,7 +2695,7 @@ ISR(ADC_vect)
     }
     else
 #endif
-        if (ibus > IBUS_WARNING_THRESHOLD)
+        if (sample > IBUS_WARNING_THRESHOLD)
     {
       SetFaultFlag(FAULT_OVER_CURRENT, TRUE);
 #if (IBUS_FAULT_ENABLE == TRUE)
@@ -1337,6 +2710,7 @@ ISR(ADC_vect)
 #endif
     }
     break;
+  }
   case (ADC_MUX_H_IPHASE_U | ADC_MUX_L_IPHASE_U):
     // Handle ADC conversion result for phase current measurement.
     iphaseU = ADCL >> 6;
@@ -1365,14 +2739,23 @@ ISR(ADC_vect)
     ADCSRB |= ADC_MUX_H_VBUSVREF;
     break;
   case (ADC_MUX_H_VBUSVREF | ADC_MUX_L_VBUSVREF):
+  {
     // Handle ADC conversion result for gate voltage reference measurement.
-    vbusVref = ADCL >> 6;
-    vbusVref |= (ADCH << 2);
+    uint16_t sample = ADCL >> 6;
+    sample |= (ADCH << 2);
+    vbusVref = FilterUpdate(&filterChannels[FILTER_CHANNEL_VBUS], sample);
+#if (VBUS_COMPENSATION == TRUE)
+    VbusCompensationUpdate(vbusVref);
+#endif
+#if (POWER_METER == TRUE)
+    PowerMeterUpdate(vbusVref, ibus);
+#endif
     ADMUX &= ~ADC_MUX_L_BITS;
     ADMUX |= ADC_MUX_L_SPEED;
     ADCSRB &= ~ADC_MUX_H_BITS;
     ADCSRB |= ADC_MUX_H_SPEED;
     break;
+  }
   default:
     // This is probably an error and should be handled.
     SetFaultFlag(FAULT_USER_FLAG1, TRUE);
@@ -1384,6 +2767,8 @@ ISR(ADC_vect)
 
   // Clear Timer/Counter0 overflow flag.
   TIFR0 = (1 << TOV0);
+
+  ADCFastUpdate();
 }
 
 /**
@@ -1407,8 +2792,8 @@ static void SetFaultFlag(fault_flag_t flag, uint8_t value)
 
   switch (flag)
   {
-  case FAULT_RESERVED:
-    faultFlags.reserved = value;
+  case FAULT_STALL:
+    faultFlags.stall = value;
     break;
   case FAULT_REVERSE_DIRECTION:
     faultFlags.reverseDirection = value;
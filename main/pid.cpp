@@ -22,6 +22,106 @@
 #include "config.h"
 // Include PID header
 #include "pid.h"
+// Include EEPROM access for storing the gain schedule
+#include <avr/eeprom.h>
+#if (PID_BENCHMARK_ENABLE == TRUE)
+// Include timer registers and interrupt locking for the benchmark
+#include <avr/io.h>
+#include <util/atomic.h>
+#endif
+
+//! Marker stored with the gain schedule to validate the EEPROM contents.
+#define PID_GAIN_SCHEDULE_MAGIC 0x5A
+
+/*! \brief PID gain schedule EEPROM image.
+
+    Layout of the gain schedule as stored in EEPROM.
+*/
+typedef struct pidGainScheduleStore
+{
+  //! Set to \ref PID_GAIN_SCHEDULE_MAGIC when a table has been stored.
+  uint8_t magic;
+  //! Stored gain schedule breakpoints.
+  pidGainPoint_t points[PID_GAIN_SCHEDULE_POINTS];
+  //! Sum of all bytes in points, used to detect corrupt contents.
+  uint8_t checksum;
+} pidGainScheduleStore_t;
+
+/*! \brief PID gain schedule segment slopes.
+
+    Change of each gain per unit of speed between two neighbouring breakpoints,
+    with \ref PID_GAIN_SLOPE_SHIFT fractional bits.
+*/
+typedef struct pidGainSlope
+{
+  //! Slope of the Proportional tuning constant
+  int32_t P_Factor;
+  //! Slope of the Integral tuning constant
+  int32_t I_Factor;
+  //! Slope of the Derivative tuning constant
+  int32_t D_Factor;
+} pidGainSlope_t;
+
+//! Number of fractional bits of the gain schedule slopes.
+#define PID_GAIN_SLOPE_SHIFT 16
+
+/*! \brief Largest Q format I gain that is limited by \ref MAX_I_TERM.
+
+    Above this gain \ref MAX_I_TERM expressed as an I-term is larger than
+    \ref MAX_INT in Q format. Worked out here, so changing the gains needs no
+    division.
+*/
+#define PID_MAX_I_TERM_KI (((uint32_t)MAX_INT << PID_Q_SHIFT) / ((uint32_t)MAX_I_TERM + 1))
+
+//! Speed-scheduled gain table, sorted by ascending speed.
+pidGainPoint_t pidGainSchedule[PID_GAIN_SCHEDULE_POINTS];
+
+//! Slopes of the gain table segments, worked out whenever the table changes.
+static pidGainSlope_t pidGainSlopes[PID_GAIN_SCHEDULE_POINTS - 1];
+
+//! Gain schedule storage in EEPROM.
+static pidGainScheduleStore_t EEMEM pidGainScheduleStore;
+
+#if (PID_BENCHMARK_ENABLE == TRUE)
+//! Number of controller calls timed by the benchmark, a power of two.
+#define PID_BENCHMARK_ITERATIONS 16
+
+/*! \brief Reference PID Status
+
+   Data used by the previous, division based, PID control algorithm. Only
+   used to benchmark the fixed-point controller against.
+*/
+typedef struct pidReferenceData
+{
+  //! Last process value, used to find derivative of process value.
+  int16_t lastProcessValue;
+  //! Summation of errors, used for integrate calculations
+  int32_t sumError;
+  //! The Proportional tuning constant, given in x1000
+  int16_t P_Factor;
+  //! The Integral tuning constant, given in x1000
+  int16_t I_Factor;
+  //! The Derivative tuning constant, given in x1000
+  int16_t D_Factor;
+  //! Maximum allowed error, avoid overflow
+  int16_t maxError;
+  //! Maximum allowed sum error, avoid overflow
+  int32_t maxSumError;
+} pidReferenceData_t;
+#endif
+
+// Forward declarations
+static uint8_t PIDGainScheduleChecksum(const pidGainPoint_t *points);
+static uint8_t PIDGainScheduleValid(const pidGainPoint_t *points);
+static void PIDGainScheduleSlopes(void);
+static int32_t PIDSlope(int16_t lower, int16_t upper, int16_t span);
+static int16_t PIDInterpolate(int16_t lower, int32_t slope, int16_t offset);
+static void PIDAutoTuneFinish(pidAutoTune_t *tune, pidData_t *pid);
+static int16_t PIDLimitGain(int32_t gain);
+static int32_t PIDLimit(int32_t value, int32_t limit);
+#if (PID_BENCHMARK_ENABLE == TRUE)
+static uint16_t PIDReferenceController(int16_t setPoint, int16_t processValue, pidReferenceData_t *pid_st);
+#endif
 
 /*! \brief Initialisation of PID controller parameters.
 
@@ -34,49 +134,637 @@ void PIDInit(int16_t p_factor, int16_t i_factor, int16_t d_factor, pidData_t *pi
 // Set up PID controller parameters
 {
   // Start values for PID controller
-  pid->sumError = 0;
+  pid->integrator = 0;
   pid->lastProcessValue = 0;
-  // Tuning constants for PID loop
+#if (PID_K_D_ENABLE == TRUE)
+  pid->d_term = 0;
+#endif
+  pid->outputMax = PID_OUTPUT_MAX;
+  // Tuning constants and limits for PID loop
+  PIDSetGains(p_factor, i_factor, d_factor, pid);
+}
+
+/*! \brief Change the gains of a running PID controller.
+
+    The gains are converted to Q format and the integrator limit that depends
+    on them is worked out first, without a division, then everything is
+    written together, so the controller never runs with a mix of old and new
+    values. The integrator
+    holds the I-term itself rather than the error sum, so the output is free
+    of bumps when the I gain changes.
+
+    \note The PID controller and all callers of this function run from the
+    main loop, so no further locking is needed.
+
+    \param p_factor  Proportional term. \param i_factor  Integral term. \param
+    d_factor  Derivate term. \param pid  Struct with PID status.
+*/
+void PIDSetGains(int16_t p_factor, int16_t i_factor, int16_t d_factor, pidData_t *pid)
+{
+  uint16_t ki = PID_GAIN_TO_Q(i_factor);
+  int32_t maxIntegrator = (int32_t)MAX_INT << PID_Q_SHIFT;
+
+  // The error sum limit of PID_MAX_I_TERM, expressed as an I-term.
+  if ((ki > 0) && (ki <= PID_MAX_I_TERM_KI))
+  {
+    maxIntegrator = MAX_I_TERM * ki;
+  }
+
   pid->P_Factor = p_factor;
   pid->I_Factor = i_factor;
   pid->D_Factor = d_factor;
-  // Limits to avoid overflow
-  pid->maxError = MAX_INT / pid->P_Factor;
-  pid->maxSumError = MAX_I_TERM / pid->I_Factor;
+  pid->kp = PID_GAIN_TO_Q(p_factor);
+  pid->ki = ki;
+  pid->kd = PID_GAIN_TO_Q(d_factor);
+  pid->maxIntegrator = maxIntegrator;
+  pid->integrator = PIDLimit(pid->integrator, maxIntegrator);
 }
 
 /*! \brief PID control algorithm.
 
     Calculates output from set point, process value, and PID status.
 
+    All arithmetic is done in Q format with \ref PID_Q_SHIFT fractional bits,
+    so there is no division on this path. The P-term acts on the set point
+    weighted by \ref PID_SETPOINT_WEIGHT, and the D-term acts on the process
+    value only and is low-pass filtered by \ref PID_D_FILTER_SHIFT. When the
+    output saturates, the excess is fed back into the integrator scaled by
+    \ref PID_TRACKING_SHIFT (back-calculation anti-windup), so the integrator
+    unwinds as soon as the output leaves the limit.
+
     \param setPoint  Desired value. \param processValue  Measured value. \param
     pid_st  PID status struct. \return Calculated control output as a 16-bit
-    unsigned integer.
+    unsigned integer, limited to 0 to outputMax.
 */
 uint16_t PIDController(int16_t setPoint, int16_t processValue, pidData_t *pid_st)
+{
+  int32_t output;
+  int32_t saturated;
+  int16_t error;
+  int16_t weightedError;
+
+  error = setPoint - processValue;
+#if (PID_SETPOINT_WEIGHT == 256)
+  weightedError = error;
+#else
+  weightedError = (int16_t)(((int32_t)setPoint * PID_SETPOINT_WEIGHT) >> 8) - processValue;
+#endif
+
+  // Each term is limited to MAX_INT in Q format, so their sum fits in 32 bits.
+  output = PIDLimit((int32_t)weightedError * pid_st->kp, (int32_t)MAX_INT << PID_Q_SHIFT) + pid_st->integrator;
+
+#if (PID_K_D_ENABLE == TRUE)
+  // Filtered D-term on the process value, so set point steps do not kick.
+  int32_t d_raw = PIDLimit((int32_t)(int16_t)(pid_st->lastProcessValue - processValue) * pid_st->kd, (int32_t)MAX_INT << PID_Q_SHIFT);
+  pid_st->d_term += (d_raw - pid_st->d_term) >> PID_D_FILTER_SHIFT;
+  output += pid_st->d_term;
+#endif
+
+  pid_st->lastProcessValue = processValue;
+
+  // Saturate the output.
+  saturated = output;
+  if (saturated > ((int32_t)pid_st->outputMax << PID_Q_SHIFT))
+  {
+    saturated = (int32_t)pid_st->outputMax << PID_Q_SHIFT;
+  }
+  else if (saturated < 0)
+  {
+    saturated = 0;
+  }
+
+  // Integrate and feed the saturation excess back to the integrator.
+  pid_st->integrator = PIDLimit(pid_st->integrator + (int32_t)error * pid_st->ki + ((saturated - output) >> PID_TRACKING_SHIFT), pid_st->maxIntegrator);
+
+  return ((uint16_t)(saturated >> PID_Q_SHIFT));
+}
+
+/*! \brief Resets the integrator in the PID regulator.
+
+    Calling this function will reset the integrator in the PID regulator.
+
+    \param pid_st  Pointer to the PID status struct for which the integrator
+    will be reset.
+*/
+void PIDResetIntegrator(pidData_t *pid_st)
+{
+  pid_st->integrator = 0;
+#if (PID_K_D_ENABLE == TRUE)
+  pid_st->d_term = 0;
+#endif
+}
+
+/*! \brief Preset the PID regulator to a known output.
+
+    Loads the integrator with the given output and the last process value with
+    the given measurement, so the regulator takes over from that output without
+    a step when the set point matches the process value.
+
+    \param output  Output to continue from. \param processValue  Present
+    measured value. \param pid_st  PID status struct.
+*/
+void PIDPreset(uint8_t output, int16_t processValue, pidData_t *pid_st)
+{
+  pid_st->integrator = PIDLimit((int32_t)output << PID_Q_SHIFT, pid_st->maxIntegrator);
+  pid_st->lastProcessValue = processValue;
+#if (PID_K_D_ENABLE == TRUE)
+  pid_st->d_term = 0;
+#endif
+}
+
+/*! \brief Initialise the speed-scheduled gain table.
+
+    Loads the gain table from EEPROM. If no valid table has been stored, every
+    breakpoint is set to \ref PID_K_P, \ref PID_K_I and \ref PID_K_D, with the
+    breakpoint speeds spread evenly from 0 to \ref SPEED_CONTROLLER_MAX_SPEED.
+*/
+void PIDGainScheduleInit(void)
+{
+  pidGainPoint_t points[PID_GAIN_SCHEDULE_POINTS];
+
+  if (eeprom_read_byte(&pidGainScheduleStore.magic) == PID_GAIN_SCHEDULE_MAGIC)
+  {
+    eeprom_read_block(points, pidGainScheduleStore.points, sizeof(points));
+    if ((eeprom_read_byte(&pidGainScheduleStore.checksum) == PIDGainScheduleChecksum(points)) && PIDGainScheduleValid(points))
+    {
+      memcpy(pidGainSchedule, points, sizeof(points));
+      PIDGainScheduleSlopes();
+      return;
+    }
+  }
+
+  for (uint8_t n = 0; n < PID_GAIN_SCHEDULE_POINTS; n++)
+  {
+    pidGainSchedule[n].speed = ((int32_t)SPEED_CONTROLLER_MAX_SPEED * n) / (PID_GAIN_SCHEDULE_POINTS - 1);
+    pidGainSchedule[n].P_Factor = PID_K_P;
+    pidGainSchedule[n].I_Factor = PID_K_I;
+    pidGainSchedule[n].D_Factor = PID_K_D;
+  }
+  PIDGainScheduleSlopes();
+}
+
+/*! \brief Replace one breakpoint of the gain table.
+
+    The breakpoint is only accepted if all gains and the speed are
+    non-negative and the table stays sorted by speed. The new gains are picked
+    up by the next call to \ref PIDGainScheduleUpdate().
+
+    \param index  Breakpoint to replace. \param point  New breakpoint.
+    \return \ref TRUE if the breakpoint was accepted, \ref FALSE otherwise.
+*/
+uint8_t PIDGainScheduleSet(uint8_t index, const pidGainPoint_t *point)
+{
+  pidGainPoint_t points[PID_GAIN_SCHEDULE_POINTS];
+
+  if (index >= PID_GAIN_SCHEDULE_POINTS)
+  {
+    return FALSE;
+  }
+
+  memcpy(points, pidGainSchedule, sizeof(points));
+  points[index] = *point;
+  if (!PIDGainScheduleValid(points))
+  {
+    return FALSE;
+  }
+
+  pidGainSchedule[index] = *point;
+  PIDGainScheduleSlopes();
+  return TRUE;
+}
+
+/*! \brief Replace the whole gain table.
+
+    The table is only accepted if all gains and speeds are non-negative and
+    it is sorted by speed, so unlike \ref PIDGainScheduleSet() breakpoints can
+    move past each other.
+
+    \param points  New table of \ref PID_GAIN_SCHEDULE_POINTS breakpoints.
+    \return \ref TRUE if the table was accepted, \ref FALSE otherwise.
+*/
+uint8_t PIDGainScheduleLoad(const pidGainPoint_t *points)
+{
+  if (!PIDGainScheduleValid(points))
+  {
+    return FALSE;
+  }
+
+  memcpy(pidGainSchedule, points, sizeof(pidGainSchedule));
+  PIDGainScheduleSlopes();
+  return TRUE;
+}
+
+/*! \brief Update the PID gains from the measured speed.
+
+    Looks up the measured speed in the gain table and linearly interpolates
+    the gains between the two surrounding breakpoints, with the segment slopes
+    worked out when the table was written, so there is no division on this
+    path. Below the first and above the last breakpoint the gains of that
+    breakpoint are used. The gains are only written when they change.
+
+    \param processValue  Measured value. \param pid  Struct with PID status.
+*/
+void PIDGainScheduleUpdate(int16_t processValue, pidData_t *pid)
+{
+  const pidGainPoint_t *lower;
+  const pidGainPoint_t *upper;
+  const pidGainSlope_t *slope;
+  int16_t p_factor;
+  int16_t i_factor;
+  int16_t d_factor;
+  uint8_t n = 0;
+
+  // Find the first breakpoint at or above the measured speed.
+  while ((n < (PID_GAIN_SCHEDULE_POINTS - 1)) && (processValue > pidGainSchedule[n].speed))
+  {
+    n++;
+  }
+  upper = &pidGainSchedule[n];
+
+  if ((n == 0) || (processValue >= upper->speed))
+  {
+    p_factor = upper->P_Factor;
+    i_factor = upper->I_Factor;
+    d_factor = upper->D_Factor;
+  }
+  else
+  {
+    lower = &pidGainSchedule[n - 1];
+    slope = &pidGainSlopes[n - 1];
+    int16_t offset = processValue - lower->speed;
+
+    p_factor = PIDInterpolate(lower->P_Factor, slope->P_Factor, offset);
+    i_factor = PIDInterpolate(lower->I_Factor, slope->I_Factor, offset);
+    d_factor = PIDInterpolate(lower->D_Factor, slope->D_Factor, offset);
+  }
+
+  if ((p_factor != pid->P_Factor) || (i_factor != pid->I_Factor) || (d_factor != pid->D_Factor))
+  {
+    PIDSetGains(p_factor, i_factor, d_factor, pid);
+  }
+}
+
+/*! \brief Store the gain table in EEPROM.
+
+    Only bytes that differ from the EEPROM contents are written, so saving an
+    unchanged table does not wear the EEPROM.
+*/
+void PIDGainScheduleSave(void)
+{
+  eeprom_update_block(pidGainSchedule, pidGainScheduleStore.points, sizeof(pidGainSchedule));
+  eeprom_update_byte(&pidGainScheduleStore.checksum, PIDGainScheduleChecksum(pidGainSchedule));
+  eeprom_update_byte(&pidGainScheduleStore.magic, PID_GAIN_SCHEDULE_MAGIC);
+}
+
+/*! \brief Start a relay feedback auto-tune experiment.
+
+    The output is switched to \a bias plus \ref PID_AUTOTUNE_STEP while the
+    process value is below the set point and to \a bias minus \ref
+    PID_AUTOTUNE_STEP while it is above, which makes the speed oscillate at the
+    ultimate period of the loop. \ref PIDAutoTuneRun() must be called every
+    controller iteration instead of \ref PIDController() until the experiment
+    is no longer running.
+
+    \param setPoint  Speed to oscillate around. \param bias  Output the motor
+    is running at. \param rule  \ref PID_TUNE_RULE_ZIEGLER_NICHOLS or \ref
+    PID_TUNE_RULE_TYREUS_LUYBEN. \param store  Store the gain table in EEPROM
+    on success. \param tune  Struct with auto-tune status.
+*/
+void PIDAutoTuneStart(int16_t setPoint, uint8_t bias, uint8_t rule, uint8_t store, pidAutoTune_t *tune)
+{
+  int16_t high = (int16_t)bias + PID_AUTOTUNE_STEP;
+  int16_t low = (int16_t)bias - PID_AUTOTUNE_STEP;
+
+  if (high > PID_OUTPUT_MAX)
+  {
+    high = PID_OUTPUT_MAX;
+  }
+  if (low < 0)
+  {
+    low = 0;
+  }
+
+  tune->setPoint = setPoint;
+  tune->maxProcessValue = -MAX_INT;
+  tune->minProcessValue = MAX_INT;
+  tune->amplitudeSum = 0;
+  tune->periodSum = 0;
+  tune->ticks = 0;
+  tune->lastCrossing = 0;
+  tune->outputHigh = high;
+  tune->outputLow = low;
+  tune->crossings = 0;
+  tune->cycles = 0;
+  tune->rule = rule;
+  tune->relayHigh = TRUE;
+  tune->store = store;
+  tune->P_Factor = 0;
+  tune->I_Factor = 0;
+  tune->D_Factor = 0;
+  tune->state = PID_AUTOTUNE_RUNNING;
+}
+
+/*! \brief Relay feedback auto-tune iteration.
+
+    Switches the relay on the measured speed and measures the period and the
+    peak to peak amplitude between upward set point crossings. Once \ref
+    PID_AUTOTUNE_CYCLES periods have been measured the gains are computed and
+    loaded, and the state changes to \ref PID_AUTOTUNE_DONE. If that takes
+    longer than \ref PID_AUTOTUNE_TIMEOUT iterations the state changes to \ref
+    PID_AUTOTUNE_FAILED.
+
+    \param processValue  Measured value. \param tune  Struct with auto-tune
+    status. \param pid  Struct with PID status, loaded on success.
+    \return Control output for this iteration.
+*/
+uint8_t PIDAutoTuneRun(int16_t processValue, pidAutoTune_t *tune, pidData_t *pid)
+{
+  if (tune->state != PID_AUTOTUNE_RUNNING)
+  {
+    return (tune->outputHigh + tune->outputLow) >> 1;
+  }
+
+  if (++tune->ticks > PID_AUTOTUNE_TIMEOUT)
+  {
+    tune->state = PID_AUTOTUNE_FAILED;
+    return (tune->outputHigh + tune->outputLow) >> 1;
+  }
+
+  if (processValue > tune->maxProcessValue)
+  {
+    tune->maxProcessValue = processValue;
+  }
+  if (processValue < tune->minProcessValue)
+  {
+    tune->minProcessValue = processValue;
+  }
+
+  if (tune->relayHigh)
+  {
+    if (processValue > (tune->setPoint + PID_AUTOTUNE_HYSTERESIS))
+    {
+      tune->relayHigh = FALSE;
+
+      // A period ends at every upward crossing. The first one is still
+      // settling and is not measured.
+      if (tune->crossings >= 2)
+      {
+        tune->periodSum += tune->ticks - tune->lastCrossing;
+        tune->amplitudeSum += tune->maxProcessValue - tune->minProcessValue;
+        tune->cycles++;
+      }
+      else
+      {
+        tune->crossings++;
+      }
+      tune->lastCrossing = tune->ticks;
+      tune->maxProcessValue = processValue;
+      tune->minProcessValue = processValue;
+
+      if (tune->cycles >= PID_AUTOTUNE_CYCLES)
+      {
+        PIDAutoTuneFinish(tune, pid);
+        return (tune->outputHigh + tune->outputLow) >> 1;
+      }
+    }
+  }
+  else if (processValue < (tune->setPoint - PID_AUTOTUNE_HYSTERESIS))
+  {
+    tune->relayHigh = TRUE;
+  }
+
+  return tune->relayHigh ? tune->outputHigh : tune->outputLow;
+}
+
+/*! \brief Abort a running auto-tune experiment.
+
+    The previous gains are kept.
+
+    \param tune  Struct with auto-tune status.
+*/
+void PIDAutoTuneAbort(pidAutoTune_t *tune)
+{
+  if (tune->state == PID_AUTOTUNE_RUNNING)
+  {
+    tune->state = PID_AUTOTUNE_FAILED;
+  }
+}
+
+/*! \brief Compute and load the gains from a finished relay experiment.
+
+    The ultimate gain is \f$ K_u = \frac{4 d}{\pi a} \f$, where d is half the
+    relay swing and a is half the peak to peak amplitude, and the ultimate
+    period \f$ T_u \f$ is the average oscillation period. In controller
+    iterations, \f$ K_I = K_P T / T_i \f$ and \f$ K_D = K_P T_d / T \f$.
+
+    The gains are loaded into the gain table breakpoint nearest to the set
+    point, which is moved to the set point if that keeps the table sorted, and
+    into the running controller. The integrator is preloaded so the controller
+    continues from the relay bias.
+
+    \param tune  Struct with auto-tune status. \param pid  Struct with PID
+    status.
+*/
+static void PIDAutoTuneFinish(pidAutoTune_t *tune, pidData_t *pid)
+{
+  pidGainPoint_t point;
+  int32_t ultimateGain;
+  int32_t p_factor;
+  int32_t i_factor;
+  int32_t d_factor;
+  uint8_t nearest = 0;
+
+  if ((tune->amplitudeSum <= 0) || (tune->periodSum == 0))
+  {
+    tune->state = PID_AUTOTUNE_FAILED;
+    return;
+  }
+
+  // Ku x 1000, with 4000 / pi = 1273 and the amplitudes summed over cycles.
+  ultimateGain = (1273L * (tune->outputHigh - tune->outputLow) * tune->cycles) / tune->amplitudeSum;
+
+  if (tune->rule == PID_TUNE_RULE_TYREUS_LUYBEN)
+  {
+    // Kp = Ku / 2.2, Ti = 2.2 Tu, Td = Tu / 6.3
+    p_factor = PIDLimitGain((ultimateGain * 10) / 22);
+    i_factor = (p_factor * tune->cycles * 10) / (22L * tune->periodSum);
+    d_factor = (p_factor * tune->periodSum * 10) / (63L * tune->cycles);
+  }
+  else
+  {
+    // Kp = 0.6 Ku, Ti = Tu / 2, Td = Tu / 8
+    p_factor = PIDLimitGain((ultimateGain * 6) / 10);
+    i_factor = (p_factor * tune->cycles * 2) / tune->periodSum;
+    d_factor = (p_factor * tune->periodSum) / (8L * tune->cycles);
+  }
+
+  if (p_factor == 0)
+  {
+    tune->state = PID_AUTOTUNE_FAILED;
+    return;
+  }
+
+  tune->P_Factor = p_factor;
+  tune->I_Factor = PIDLimitGain(i_factor);
+  tune->D_Factor = PIDLimitGain(d_factor);
+
+  for (uint8_t n = 1; n < PID_GAIN_SCHEDULE_POINTS; n++)
+  {
+    if (abs(pidGainSchedule[n].speed - tune->setPoint) < abs(pidGainSchedule[nearest].speed - tune->setPoint))
+    {
+      nearest = n;
+    }
+  }
+  point.speed = tune->setPoint;
+  point.P_Factor = tune->P_Factor;
+  point.I_Factor = tune->I_Factor;
+  point.D_Factor = tune->D_Factor;
+  if (!PIDGainScheduleSet(nearest, &point))
+  {
+    point.speed = pidGainSchedule[nearest].speed;
+    PIDGainScheduleSet(nearest, &point);
+  }
+  if (tune->store)
+  {
+    PIDGainScheduleSave();
+  }
+
+  PIDSetGains(tune->P_Factor, tune->I_Factor, tune->D_Factor, pid);
+  pid->integrator = PIDLimit((int32_t)((tune->outputHigh + tune->outputLow) >> 1) << PID_Q_SHIFT, pid->maxIntegrator);
+
+  tune->state = PID_AUTOTUNE_DONE;
+}
+
+/*! \brief Limit a computed gain to the range of the gain factors.
+
+    \param gain  Computed gain. \return Gain limited to 0 to \ref MAX_INT.
+*/
+static int16_t PIDLimitGain(int32_t gain)
+{
+  if (gain > MAX_INT)
+  {
+    return MAX_INT;
+  }
+  else if (gain < 0)
+  {
+    return 0;
+  }
+  return gain;
+}
+
+#if (PID_BENCHMARK_ENABLE == TRUE)
+/*! \brief Measure the execution time of the PID controller.
+
+    Runs \ref PIDController() and the previous, division based, controller
+    over the same sweep of process values, starting from \ref PID_K_P, \ref
+    PID_K_I and \ref PID_K_D. \ref PIDGainScheduleUpdate(), which runs before
+    the controller every iteration, is timed over a sweep of the whole gain
+    table, so the gains are interpolated and set with the present table. Timer 3 counts CPU cycles while interrupts are
+    disabled. Its registers are saved and restored, so the hall sensor
+    emulation (see \ref EMULATE_HALL) continues where it was afterwards.
+
+    \warning Interrupts are disabled for a few milliseconds, so this must not
+    be called while the motor is running.
+
+    \param referenceCycles  Average cycles per call of the previous
+    controller. \param fixedPointCycles  Average cycles per call of \ref
+    PIDController(). \param scheduleCycles  Average cycles per call of \ref
+    PIDGainScheduleUpdate().
+*/
+void PIDBenchmark(uint16_t *referenceCycles, uint16_t *fixedPointCycles, uint16_t *scheduleCycles)
+{
+  pidData_t pid;
+  pidReferenceData_t reference;
+  volatile uint16_t sink;
+  uint16_t cycles;
+  uint8_t timerControlA;
+  uint8_t timerControlB;
+  uint16_t timerCount;
+
+  PIDInit(PID_K_P, PID_K_I, PID_K_D, &pid);
+  reference.lastProcessValue = 0;
+  reference.sumError = 0;
+  reference.P_Factor = PID_K_P;
+  reference.I_Factor = PID_K_I;
+  reference.D_Factor = PID_K_D;
+  reference.maxError = (PID_K_P > 0) ? (MAX_INT / PID_K_P) : MAX_INT;
+  reference.maxSumError = (PID_K_I > 0) ? (MAX_I_TERM / PID_K_I) : MAX_I_TERM;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Save Timer3, used by the hall sensor emulation.
+    timerControlA = TCCR3A;
+    timerControlB = TCCR3B;
+    timerCount = TCNT3;
+
+    // Normal mode, clocked from the CPU clock.
+    TCCR3A = 0;
+    TCCR3B = (1 << CS30);
+
+    TCNT3 = 0;
+    for (uint8_t n = 0; n < PID_BENCHMARK_ITERATIONS; n++)
+    {
+      sink = PIDReferenceController(SPEED_CONTROLLER_MAX_SPEED >> 1, n << 4, &reference);
+    }
+    cycles = TCNT3;
+    *referenceCycles = cycles / PID_BENCHMARK_ITERATIONS;
+
+    TCNT3 = 0;
+    for (uint8_t n = 0; n < PID_BENCHMARK_ITERATIONS; n++)
+    {
+      sink = PIDController(SPEED_CONTROLLER_MAX_SPEED >> 1, n << 4, &pid);
+    }
+    cycles = TCNT3;
+    *fixedPointCycles = cycles / PID_BENCHMARK_ITERATIONS;
+
+    TCNT3 = 0;
+    for (uint8_t n = 0; n < PID_BENCHMARK_ITERATIONS; n++)
+    {
+      PIDGainScheduleUpdate(n * (SPEED_CONTROLLER_MAX_SPEED / PID_BENCHMARK_ITERATIONS), &pid);
+    }
+    cycles = TCNT3;
+    *scheduleCycles = cycles / PID_BENCHMARK_ITERATIONS;
+
+    // Restore Timer3, stopped while its mode is changed.
+    TCCR3B = 0;
+    TCCR3A = timerControlA;
+    TCNT3 = timerCount;
+    TCCR3B = timerControlB;
+  }
+  (void)sink;
+}
+
+/*! \brief Previous, division based, PID control algorithm.
+
+    Kept to benchmark \ref PIDController() against. Divides by 1000 for each
+    term and clamps the error sum for anti-windup.
+
+    \param setPoint  Desired value. \param processValue  Measured value. \param
+    pid_st  Reference PID status struct. \return Calculated control output.
+*/
+static uint16_t PIDReferenceController(int16_t setPoint, int16_t processValue, pidReferenceData_t *pid_st)
 {
   int32_t ret;
   int32_t temp;
   int16_t error;
+  int16_t p_term;
+  int32_t i_term;
 
   error = setPoint - processValue;
 
-  // Calculate "P" term and limit error overflow
   if (error > pid_st->maxError)
   {
-    pid_st->p_term = MAX_INT;
+    p_term = MAX_INT;
   }
   else if (error < -pid_st->maxError)
   {
-    pid_st->p_term = -MAX_INT;
+    p_term = -MAX_INT;
   }
   else
   {
-    pid_st->p_term = pid_st->P_Factor * error / 1000;
+    p_term = pid_st->P_Factor * error / 1000;
   }
 
-  // Calculate "I" term and limit integral runaway.
-  // i_term is always derived from sumError so the clamp is continuous.
   temp = pid_st->sumError + error;
   if (temp > pid_st->maxSumError)
   {
@@ -90,20 +778,14 @@ uint16_t PIDController(int16_t setPoint, int16_t processValue, pidData_t *pid_st
   {
     pid_st->sumError = temp;
   }
-  pid_st->i_term = pid_st->I_Factor * pid_st->sumError / 1000;
-
-#if (PID_K_D_ENABLE == TRUE)
-  // Calculate "D" term
-  pid_st->d_term = pid_st->D_Factor * (pid_st->lastProcessValue - processValue) / 1000;
-#endif
-
-  pid_st->lastProcessValue = processValue;
+  i_term = pid_st->I_Factor * pid_st->sumError / 1000;
 
 #if (PID_K_D_ENABLE == TRUE)
-  ret = (pid_st->p_term + pid_st->i_term + pid_st->d_term);
+  ret = p_term + i_term + pid_st->D_Factor * (pid_st->lastProcessValue - processValue) / 1000;
 #else
-  ret = (pid_st->p_term + pid_st->i_term);
+  ret = p_term + i_term;
 #endif
+  pid_st->lastProcessValue = processValue;
 
 #if (SCALING_FACTOR_ENABLED == TRUE)
   ret = ret / SCALING_FACTOR;
@@ -112,7 +794,6 @@ uint16_t PIDController(int16_t setPoint, int16_t processValue, pidData_t *pid_st
   {
     ret = MAX_INT;
   }
-  // Since the return type is uint16_t
   else if (ret < 0)
   {
     ret = 0;
@@ -120,20 +801,120 @@ uint16_t PIDController(int16_t setPoint, int16_t processValue, pidData_t *pid_st
 
   return ((uint16_t)ret);
 }
+#endif
 
-/*! \brief Resets the integrator in the PID regulator.
+/*! \brief Limit a value to a symmetric range.
 
-    Calling this function will reset the integrator in the PID regulator.
+    \param value  Value to limit. \param limit  Largest magnitude allowed.
+    \return Value limited to -limit to limit.
+*/
+static int32_t PIDLimit(int32_t value, int32_t limit)
+{
+  if (value > limit)
+  {
+    return limit;
+  }
+  else if (value < -limit)
+  {
+    return -limit;
+  }
+  return value;
+}
 
-    \param pid_st  Pointer to the PID status struct for which the integrator
-    will be reset.
+/*! \brief Calculate the checksum of a gain table.
+
+    \param points  Gain table. \return Sum of all bytes in the table.
 */
-void PIDResetIntegrator(pidData_t *pid_st)
+static uint8_t PIDGainScheduleChecksum(const pidGainPoint_t *points)
 {
-  pid_st->sumError = 0;
-  pid_st->p_term = 0;
-  pid_st->i_term = 0;
-#if (PID_K_D_ENABLE == TRUE)
-  pid_st->d_term = 0;
-#endif
+  const uint8_t *data = (const uint8_t *)points;
+  uint8_t sum = 0;
+
+  for (uint8_t n = 0; n < sizeof(pidGainSchedule); n++)
+  {
+    sum += data[n];
+  }
+
+  return sum;
+}
+
+/*! \brief Check that a gain table is usable.
+
+    \param points  Gain table. \return \ref TRUE if all speeds and gains are
+    non-negative and the speeds are in ascending order, \ref FALSE otherwise.
+*/
+static uint8_t PIDGainScheduleValid(const pidGainPoint_t *points)
+{
+  for (uint8_t n = 0; n < PID_GAIN_SCHEDULE_POINTS; n++)
+  {
+    if ((points[n].speed < 0) || (points[n].P_Factor < 0) || (points[n].I_Factor < 0) || (points[n].D_Factor < 0))
+    {
+      return FALSE;
+    }
+    if ((n > 0) && (points[n].speed < points[n - 1].speed))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/*! \brief Work out the slopes of the gain table segments.
+
+    Called whenever the gain table is written, so \ref PIDGainScheduleUpdate()
+    only needs a multiplication and a shift per gain.
+*/
+static void PIDGainScheduleSlopes(void)
+{
+  for (uint8_t n = 0; n < (PID_GAIN_SCHEDULE_POINTS - 1); n++)
+  {
+    const pidGainPoint_t *lower = &pidGainSchedule[n];
+    const pidGainPoint_t *upper = &pidGainSchedule[n + 1];
+    int16_t span = upper->speed - lower->speed;
+
+    pidGainSlopes[n].P_Factor = PIDSlope(lower->P_Factor, upper->P_Factor, span);
+    pidGainSlopes[n].I_Factor = PIDSlope(lower->I_Factor, upper->I_Factor, span);
+    pidGainSlopes[n].D_Factor = PIDSlope(lower->D_Factor, upper->D_Factor, span);
+  }
+}
+
+/*! \brief Slope of a gain between two breakpoints.
+
+    \param lower  Gain at the lower breakpoint. \param upper  Gain at the upper
+    breakpoint. \param span  Distance between the breakpoints.
+    \return Change of the gain per unit of speed with \ref
+    PID_GAIN_SLOPE_SHIFT fractional bits, 0 if the breakpoints are at the same
+    speed.
+*/
+static int32_t PIDSlope(int16_t lower, int16_t upper, int16_t span)
+{
+  if (span <= 0)
+  {
+    return 0;
+  }
+  // The gains are non-negative, so the difference fits in 16 bits.
+  return ((int32_t)(upper - lower) * (1L << PID_GAIN_SLOPE_SHIFT)) / span;
+}
+
+/*! \brief Linear interpolation between two gains.
+
+    The change is rounded towards zero, so the gain stays between the gains of
+    the two breakpoints.
+
+    \param lower  Gain at the lower breakpoint. \param slope  Slope of the
+    segment from \ref PIDSlope(). \param offset  Distance from the lower
+    breakpoint, must be smaller than the segment span.
+    \return Interpolated gain.
+*/
+static int16_t PIDInterpolate(int16_t lower, int32_t slope, int16_t offset)
+{
+  // The offset is smaller than the span, so the product fits in 32 bits.
+  int32_t change = slope * offset;
+
+  if (change < 0)
+  {
+    return lower - (int16_t)(-change >> PID_GAIN_SLOPE_SHIFT);
+  }
+  return lower + (int16_t)(change >> PID_GAIN_SLOPE_SHIFT);
 }
@@ -39,6 +39,22 @@
 */
 #define SCALING_FACTOR_ENABLED FALSE
 
+/*! \brief Number of fractional bits of the fixed-point PID controller.
+
+    The gains, the integrator and the filtered D-term are held in Q format with
+    this many fractional bits, so the output is found with a shift instead of a
+    division.
+*/
+#define PID_Q_SHIFT 10
+
+/*! \brief Convert a gain given in x1000 into Q format.
+
+    Multiplies by \f$ 2^{\text{PID\_Q\_SHIFT}} / 1000 \f$ using a 16-bit
+    fraction, which is exact to within 0.01 %. Only valid for non-negative
+    gains.
+*/
+#define PID_GAIN_TO_Q(gain) ((uint16_t)(((uint32_t)(gain) * (((1UL << (16 + PID_Q_SHIFT)) + 500) / 1000)) >> 16))
+
 /*! \brief PID Status
 
    Set points and data used by the PID control algorithm
@@ -47,29 +63,118 @@ typedef struct pidData
 {
      //! Last process value, used to find derivative of process value.
      int16_t lastProcessValue;
-     //! Summation of errors, used for integrate calculations
-     int32_t sumError;
-     //! The Proportional tuning constant, given in x100
+     //! I-term in Q format, includes the back-calculation correction
+     int32_t integrator;
+     //! The Proportional tuning constant, given in x1000
      int16_t P_Factor;
-     //! The Integral tuning constant, given in x100
+     //! The Integral tuning constant, given in x1000
      int16_t I_Factor;
-     //! The Derivative tuning constant, given in x100
+     //! The Derivative tuning constant, given in x1000
      int16_t D_Factor;
-     //! Maximum allowed error, avoid overflow
-     int16_t maxError;
-     //! Maximum allowed sum error, avoid overflow
-     int32_t maxSumError;
+     //! The Proportional gain in Q format
+     uint16_t kp;
+     //! The Integral gain in Q format
+     uint16_t ki;
+     //! The Derivative gain in Q format
+     uint16_t kd;
+     //! Maximum magnitude of the integrator, avoid overflow
+     int32_t maxIntegrator;
+     //! Output saturation limit, the lower limit is 0
+     int16_t outputMax;
 #if (PID_K_D_ENABLE == TRUE)
-     //! The D-term represents the rate of change of the error
-     int16_t d_term;
+     //! The low-pass filtered D-term in Q format
+     int32_t d_term;
 #endif
-     //! The P-term represents the immediate response to the current error
-     int16_t p_term;
-     //! The I-term accumulates the error over time to eliminate steady-state
-     //! errors
-     int32_t i_term;
 } pidData_t;
 
+/*! \brief Number of points in the PID gain schedule.
+
+    Prefer setting \ref PID_GAIN_SCHEDULE_POINTS in \ref config.h. The
+    fallback here is used if \c pid.h is compiled without it.
+*/
+#ifndef PID_GAIN_SCHEDULE_POINTS
+#define PID_GAIN_SCHEDULE_POINTS 4
+#endif
+
+/*! \brief PID Gain Schedule Point
+
+   One breakpoint of the speed-scheduled gain table. The gains are given in the
+   same scale as the P_Factor, I_Factor and D_Factor of \ref pidData_t.
+*/
+typedef struct pidGainPoint
+{
+     //! Measured speed at which the gains apply, same unit as the process value
+     int16_t speed;
+     //! The Proportional tuning constant at this speed
+     int16_t P_Factor;
+     //! The Integral tuning constant at this speed
+     int16_t I_Factor;
+     //! The Derivative tuning constant at this speed
+     int16_t D_Factor;
+} pidGainPoint_t;
+
+//! Speed-scheduled gain table, sorted by ascending speed.
+extern pidGainPoint_t pidGainSchedule[PID_GAIN_SCHEDULE_POINTS];
+
+//! Tuning rule: Ziegler-Nichols, fast response with little damping.
+#define PID_TUNE_RULE_ZIEGLER_NICHOLS 0
+//! Tuning rule: Tyreus-Luyben, slower response with more damping.
+#define PID_TUNE_RULE_TYREUS_LUYBEN 1
+
+//! Auto-tune state: no experiment has been run.
+#define PID_AUTOTUNE_IDLE 0
+//! Auto-tune state: relay experiment running.
+#define PID_AUTOTUNE_RUNNING 1
+//! Auto-tune state: gains computed and loaded.
+#define PID_AUTOTUNE_DONE 2
+//! Auto-tune state: experiment aborted or no usable oscillation found.
+#define PID_AUTOTUNE_FAILED 3
+
+/*! \brief PID Relay Auto-Tune Status
+
+   State of the relay feedback experiment used to find the ultimate gain and
+   period of the speed loop, and the gains computed from them.
+*/
+typedef struct pidAutoTune
+{
+     //! Speed the output is switched around, same unit as the process value
+     int16_t setPoint;
+     //! Highest process value in the current oscillation period
+     int16_t maxProcessValue;
+     //! Lowest process value in the current oscillation period
+     int16_t minProcessValue;
+     //! Sum of the measured peak to peak amplitudes
+     int32_t amplitudeSum;
+     //! Sum of the measured periods, in controller iterations
+     uint16_t periodSum;
+     //! Controller iterations since the experiment started
+     uint16_t ticks;
+     //! Iteration of the last upward set point crossing
+     uint16_t lastCrossing;
+     //! Output while the process value is below the set point
+     uint8_t outputHigh;
+     //! Output while the process value is above the set point
+     uint8_t outputLow;
+     //! Number of upward set point crossings seen
+     uint8_t crossings;
+     //! Number of oscillation periods measured
+     uint8_t cycles;
+     //! Selected tuning rule
+     uint8_t rule;
+     //! Experiment state
+     uint8_t state;
+     //! TRUE while the relay is switched to the high output
+     uint8_t relayHigh;
+     //! TRUE if the gain schedule is stored in EEPROM on success
+     uint8_t store;
+     //! Computed Proportional tuning constant
+     int16_t P_Factor;
+     //! Computed Integral tuning constant
+     int16_t I_Factor;
+     //! Computed Derivative tuning constant
+     int16_t D_Factor;
+} pidAutoTune_t;
+
 //! Maximum value of integers
 #define MAX_INT 32767
 
@@ -87,6 +192,33 @@ typedef struct pidData
 #define MAX_I_TERM (MAX_LONG - (2 * (int32_t)MAX_INT))
 #endif
 
+/*! \brief Derivative filter shift.
+
+    Prefer setting \ref PID_D_FILTER_SHIFT in \ref config.h. The fallback
+    here leaves the derivative unfiltered.
+*/
+#ifndef PID_D_FILTER_SHIFT
+#define PID_D_FILTER_SHIFT 0
+#endif
+
+/*! \brief Set point weight of the P-term in x256.
+
+    Prefer setting \ref PID_SETPOINT_WEIGHT in \ref config.h. The fallback
+    here gives a classic one degree of freedom controller.
+*/
+#ifndef PID_SETPOINT_WEIGHT
+#define PID_SETPOINT_WEIGHT 256
+#endif
+
+/*! \brief Back-calculation tracking shift.
+
+    Prefer setting \ref PID_TRACKING_SHIFT in \ref config.h. The fallback here
+    removes the whole saturation excess from the integrator every iteration.
+*/
+#ifndef PID_TRACKING_SHIFT
+#define PID_TRACKING_SHIFT 0
+#endif
+
 // Boolean values
 //! FALSE constant.
 #ifndef FALSE
@@ -101,5 +233,18 @@ typedef struct pidData
 void PIDInit(int16_t p_factor, int16_t i_factor, int16_t d_factor, pidData_t *pid);
 uint16_t PIDController(int16_t setPoint, int16_t processValue, pidData_t *pid_st);
 void PIDResetIntegrator(pidData_t *pid_st);
+void PIDPreset(uint8_t output, int16_t processValue, pidData_t *pid_st);
+void PIDSetGains(int16_t p_factor, int16_t i_factor, int16_t d_factor, pidData_t *pid);
+void PIDGainScheduleInit(void);
+uint8_t PIDGainScheduleSet(uint8_t index, const pidGainPoint_t *point);
+uint8_t PIDGainScheduleLoad(const pidGainPoint_t *points);
+void PIDGainScheduleUpdate(int16_t processValue, pidData_t *pid);
+void PIDGainScheduleSave(void);
+void PIDAutoTuneStart(int16_t setPoint, uint8_t bias, uint8_t rule, uint8_t store, pidAutoTune_t *tune);
+uint8_t PIDAutoTuneRun(int16_t processValue, pidAutoTune_t *tune, pidData_t *pid);
+void PIDAutoTuneAbort(pidAutoTune_t *tune);
+#if (PID_BENCHMARK_ENABLE == TRUE)
+void PIDBenchmark(uint16_t *referenceCycles, uint16_t *fixedPointCycles, uint16_t *scheduleCycles);
+#endif
 
 #endif /* PID_H */
@@ -34,9 +34,14 @@
 static void ScpiCoreIdnQ(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void ScpiSystemErrorCountQ(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void ScpiSystemErrorNextQ(SCPI_C commands, SCPI_P parameters, Stream &interface);
+#if (FRAMED_PROTOCOL == TRUE)
+static void ScpiSystemProtocol(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void FrameInput(Stream &interface);
+#endif
+static void ConfigureDataFormat(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetDataFormat(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void GetMotorEnable(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void ConfigureMotorEnable(SCPI_C commands, SCPI_P parameters, Stream &interface);
-static void GetConfigureMotorDutyCycleSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void ConfigureMotorDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void ConfigureMotorFrequency(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void GetConfigureMotorFrequency(SCPI_C commands, SCPI_P parameters, Stream &interface);
@@ -50,65 +55,305 @@ static void MeasureMotorCurrentPhaseW(SCPI_C commands, SCPI_P parameters, Stream
 static void MeasureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void MeasureMotorVoltage(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void MeasureGateDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &interface);
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_OPEN_LOOP)
-static void ConfigureMotorDutyCycleSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
-#elif (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
-static void ConfigureMotorSpeedSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
-static void GetMotorSpeedSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void MeasureAll(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void FetchAll(SCPI_C commands, SCPI_P parameters, Stream &interface);
+#if (TELEMETRY_STREAM == TRUE)
+static void ConfigureTelemetryStream(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTelemetryStream(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTelemetryRate(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTelemetryRate(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTelemetryFormat(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTelemetryFormat(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTelemetryVariables(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTelemetryVariables(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void TelemetryOutput(Stream &interface);
+#endif
+#if (WAVEFORM_CAPTURE == TRUE)
+static void ConfigureAcquireState(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetAcquireState(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureAcquireVariables(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetAcquireVariables(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureAcquireDecimation(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetAcquireDecimation(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetAcquirePoints(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetAcquireData(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTriggerSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTriggerSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTriggerLevel(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTriggerLevel(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTriggerSlope(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTriggerSlope(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureTriggerPretrigger(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetTriggerPretrigger(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void TriggerImmediate(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static bool CaptureWrite(Stream &output);
+static bool CaptureOutput(Stream &interface);
+#endif
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+static void MeasureBrake(SCPI_C commands, SCPI_P parameters, Stream &interface);
+#endif
+#if (THERMAL_MODEL == TRUE)
+static void MeasureThermal(SCPI_C commands, SCPI_P parameters, Stream &interface);
+#endif
+#if (POWER_METER == TRUE)
+static void MeasurePower(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigurePowerWindow(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetPowerWindow(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void MeasureEnergy(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ResetEnergy(SCPI_C commands, SCPI_P parameters, Stream &interface);
+#endif
+static void ConfigureFilter(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetConfigureFilter(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureMotorMethod(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetConfigureMotorMethod(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureMotorInputSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetMotorInputSource(SCPI_C commands, SCPI_P parameters, Stream &interface);
 static void ConfigureMotorSpeed(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigurePIDTable(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetConfigurePIDTable(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigurePIDTableData(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetConfigurePIDTableData(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigurePIDSave(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void CalibratePID(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetCalibratePID(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureMotorTorque(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void ConfigureMotorPosition(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void GetConfigureMotorPosition(SCPI_C commands, SCPI_P parameters, Stream &interface);
+static void MeasureMotorPosition(SCPI_C commands, SCPI_P parameters, Stream &interface);
+#if (PID_BENCHMARK_ENABLE == TRUE)
+static void ScpiSystemBenchmarkPIDQ(SCPI_C commands, SCPI_P parameters, Stream &interface);
 #endif
 
-// Instantiate the SCPI Parser
-SCPI_Parser scpiParser;
+/**
+ * \brief Keywords of the SCPI commands.
+ *
+ * Every keyword of \ref scpiCommands is listed once, with its short form in
+ * upper case followed by the rest of its long form in lower case.
+ */
+static constexpr SCPI_Keyword scpiKeywords[] PROGMEM = {
+    SCPI_KEYWORD("*IDN"),
+    SCPI_KEYWORD("SYSTem"),
+    SCPI_KEYWORD("ERRor"),
+    SCPI_KEYWORD("COUNt"),
+    SCPI_KEYWORD("BENChmark"),
+    SCPI_KEYWORD("CONFigure"),
+    SCPI_KEYWORD("ENABle"),
+    SCPI_KEYWORD("METHod"),
+    SCPI_KEYWORD("DUTYcycle"),
+    SCPI_KEYWORD("SOURce"),
+    SCPI_KEYWORD("SPEEd"),
+    SCPI_KEYWORD("TORQue"),
+    SCPI_KEYWORD("POSition"),
+    SCPI_KEYWORD("PID"),
+    SCPI_KEYWORD("TABLe"),
+    SCPI_KEYWORD("SAVE"),
+    SCPI_KEYWORD("FREQuency"),
+    SCPI_KEYWORD("DIREction"),
+    SCPI_KEYWORD("FILTer"),
+    SCPI_KEYWORD("MEASure"),
+    SCPI_KEYWORD("CURRent"),
+    SCPI_KEYWORD("IBUS"),
+    SCPI_KEYWORD("IPHU"),
+    SCPI_KEYWORD("IPHV"),
+    SCPI_KEYWORD("IPHW"),
+    SCPI_KEYWORD("VOLTage"),
+    SCPI_KEYWORD("BRAKe"),
+    SCPI_KEYWORD("THERmal"),
+    SCPI_KEYWORD("POWer"),
+    SCPI_KEYWORD("ENERgy"),
+    SCPI_KEYWORD("WINDow"),
+    SCPI_KEYWORD("RESet"),
+    SCPI_KEYWORD("CALibrate"),
+    SCPI_KEYWORD("ALL"),
+    SCPI_KEYWORD("FETCh"),
+    SCPI_KEYWORD("TELemetry"),
+    SCPI_KEYWORD("STReam"),
+    SCPI_KEYWORD("RATE"),
+    SCPI_KEYWORD("FORMat"),
+    SCPI_KEYWORD("VARiables"),
+    SCPI_KEYWORD("DATA"),
+    SCPI_KEYWORD("ACQuire"),
+    SCPI_KEYWORD("STATe"),
+    SCPI_KEYWORD("DECimation"),
+    SCPI_KEYWORD("POINts"),
+    SCPI_KEYWORD("TRIGger"),
+    SCPI_KEYWORD("LEVel"),
+    SCPI_KEYWORD("SLOPe"),
+    SCPI_KEYWORD("PRETrigger"),
+    SCPI_KEYWORD("IMMediate"),
+    SCPI_KEYWORD("PROTocol"),
+};
+
+//! Command table entry for the command \p text handled by \p caller.
+#define SCPI_COMMAND(text, caller) {ScpiCommandCode(scpiKeywords, text), caller}
 
 /**
- * \brief Initializes the SCPI command parser and registers all supported commands.
+ * \brief Supported SCPI commands.
  *
- * This function sets up the SCPI parser instance and registers the core IEEE
- * mandated commands, required SCPI commands, and the custom motor control
- * and measurement commands.
+ * The IEEE mandated commands, required SCPI commands, and the custom motor
+ * control and measurement commands. Only the hash code of every command is
+ * stored, the command text is used at compile time only.
  */
-void ScpiInit(void)
-{
+static constexpr SCPI_Command scpiCommands[] PROGMEM = {
     /* IEEE Mandated Commands (SCPI std V1999.0 4.1.1) */
     // "*CLS" and "*RST" are not supported
-    scpiParser.RegisterCommand(F("*IDN?"), &ScpiCoreIdnQ);
+    SCPI_COMMAND("*IDN?", &ScpiCoreIdnQ),
 
     /* Required SCPI commands (SCPI std V1999.0 4.2.1) */
     // "SYSTem:VERSion?" and "SYSTem:ERRor:NEXT?" are not supported
-    scpiParser.SetCommandTreeBase(F("SYSTem"));
-    scpiParser.RegisterCommand(F(":ERRor?"), &ScpiSystemErrorNextQ);
-    scpiParser.RegisterCommand(F(":ERRor:COUNt?"), &ScpiSystemErrorCountQ);
+    SCPI_COMMAND("SYSTem:ERRor?", &ScpiSystemErrorNextQ),
+    SCPI_COMMAND("SYSTem:ERRor:COUNt?", &ScpiSystemErrorCountQ),
+#if (PID_BENCHMARK_ENABLE == TRUE)
+    SCPI_COMMAND("SYSTem:BENChmark:PID?", &ScpiSystemBenchmarkPIDQ),
+#endif
+#if (FRAMED_PROTOCOL == TRUE)
+    SCPI_COMMAND("SYSTem:PROTocol", &ScpiSystemProtocol),
+#endif
+    SCPI_COMMAND("FORMat:DATA", &ConfigureDataFormat),
+    SCPI_COMMAND("FORMat:DATA?", &GetDataFormat),
 
     /* Motor Configuration Commands */
-    scpiParser.SetCommandTreeBase(F("CONFigure"));
-    scpiParser.RegisterCommand(F(":ENABle"), &ConfigureMotorEnable);
-    scpiParser.RegisterCommand(F(":ENABle?"), &GetMotorEnable);
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_OPEN_LOOP)
-    scpiParser.RegisterCommand(F(":DUTYcycle:SOURce"), &ConfigureMotorDutyCycleSource);
-    scpiParser.RegisterCommand(F(":DUTYcycle:SOURce?"), &GetConfigureMotorDutyCycleSource);
-    scpiParser.RegisterCommand(F(":DUTYcycle"), &ConfigureMotorDutyCycle);
-#else
-    scpiParser.RegisterCommand(F(":SPEED:SOURce"), &ConfigureMotorSpeedSource);
-    scpiParser.RegisterCommand(F(":SPEED:SOURce?"), &GetMotorSpeedSource);
-    scpiParser.RegisterCommand(F(":SPEED"), &ConfigureMotorSpeed);
-#endif
-    scpiParser.RegisterCommand(F(":FREQuency"), &ConfigureMotorFrequency);
-    scpiParser.RegisterCommand(F(":FREQuency?"), &GetConfigureMotorFrequency);
-    scpiParser.RegisterCommand(F(":DIREction"), &ConfigureMotorDirection);
-    scpiParser.RegisterCommand(F(":DIREction?"), &GetConfigureMotorDirection);
+    SCPI_COMMAND("CONFigure:ENABle", &ConfigureMotorEnable),
+    SCPI_COMMAND("CONFigure:ENABle?", &GetMotorEnable),
+    SCPI_COMMAND("CONFigure:METHod", &ConfigureMotorMethod),
+    SCPI_COMMAND("CONFigure:METHod?", &GetConfigureMotorMethod),
+    // The speed input source is shared by all control methods.
+    SCPI_COMMAND("CONFigure:DUTYcycle:SOURce", &ConfigureMotorInputSource),
+    SCPI_COMMAND("CONFigure:DUTYcycle:SOURce?", &GetMotorInputSource),
+    SCPI_COMMAND("CONFigure:DUTYcycle", &ConfigureMotorDutyCycle),
+    SCPI_COMMAND("CONFigure:SPEEd:SOURce", &ConfigureMotorInputSource),
+    SCPI_COMMAND("CONFigure:SPEEd:SOURce?", &GetMotorInputSource),
+    SCPI_COMMAND("CONFigure:SPEEd", &ConfigureMotorSpeed),
+    SCPI_COMMAND("CONFigure:TORQue:SOURce", &ConfigureMotorInputSource),
+    SCPI_COMMAND("CONFigure:TORQue:SOURce?", &GetMotorInputSource),
+    SCPI_COMMAND("CONFigure:TORQue", &ConfigureMotorTorque),
+    SCPI_COMMAND("CONFigure:POSition", &ConfigureMotorPosition),
+    SCPI_COMMAND("CONFigure:POSition?", &GetConfigureMotorPosition),
+    SCPI_COMMAND("CONFigure:PID:TABLe", &ConfigurePIDTable),
+    SCPI_COMMAND("CONFigure:PID:TABLe?", &GetConfigurePIDTable),
+    SCPI_COMMAND("CONFigure:PID:TABLe:DATA", &ConfigurePIDTableData),
+    SCPI_COMMAND("CONFigure:PID:TABLe:DATA?", &GetConfigurePIDTableData),
+    SCPI_COMMAND("CONFigure:PID:SAVE", &ConfigurePIDSave),
+    SCPI_COMMAND("CONFigure:FREQuency", &ConfigureMotorFrequency),
+    SCPI_COMMAND("CONFigure:FREQuency?", &GetConfigureMotorFrequency),
+    SCPI_COMMAND("CONFigure:DIREction", &ConfigureMotorDirection),
+    SCPI_COMMAND("CONFigure:DIREction?", &GetConfigureMotorDirection),
+    SCPI_COMMAND("CONFigure:FILTer", &ConfigureFilter),
+    SCPI_COMMAND("CONFigure:FILTer?", &GetConfigureFilter),
 
     /* Motor Measurement Commands */
-    scpiParser.SetCommandTreeBase(F("MEASure"));
-    scpiParser.RegisterCommand(F(":SPEEd?"), &MeasureMotorSpeed);
-    scpiParser.RegisterCommand(F(":CURRent:IBUS?"), &MeasureMotorCurrentVBus);
-    scpiParser.RegisterCommand(F(":CURRent:IPHU?"), &MeasureMotorCurrentPhaseU);
-    scpiParser.RegisterCommand(F(":CURRent:IPHV?"), &MeasureMotorCurrentPhaseV);
-    scpiParser.RegisterCommand(F(":CURRent:IPHW?"), &MeasureMotorCurrentPhaseW);
-    scpiParser.RegisterCommand(F(":VOLTage?"), &MeasureMotorVoltage);
-    scpiParser.RegisterCommand(F(":DIREction?"), &MeasureMotorDirection);
-    scpiParser.RegisterCommand(F(":DUTYcycle?"), &MeasureGateDutyCycle);
-}
+    SCPI_COMMAND("MEASure:SPEEd?", &MeasureMotorSpeed),
+    SCPI_COMMAND("MEASure:CURRent:IBUS?", &MeasureMotorCurrentVBus),
+    SCPI_COMMAND("MEASure:CURRent:IPHU?", &MeasureMotorCurrentPhaseU),
+    SCPI_COMMAND("MEASure:CURRent:IPHV?", &MeasureMotorCurrentPhaseV),
+    SCPI_COMMAND("MEASure:CURRent:IPHW?", &MeasureMotorCurrentPhaseW),
+    SCPI_COMMAND("MEASure:VOLTage?", &MeasureMotorVoltage),
+    SCPI_COMMAND("MEASure:DIREction?", &MeasureMotorDirection),
+    SCPI_COMMAND("MEASure:POSition?", &MeasureMotorPosition),
+    SCPI_COMMAND("MEASure:DUTYcycle?", &MeasureGateDutyCycle),
+    SCPI_COMMAND("MEASure:ALL?", &MeasureAll),
+    SCPI_COMMAND("FETCh?", &FetchAll),
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+    SCPI_COMMAND("MEASure:BRAKe?", &MeasureBrake),
+#endif
+#if (THERMAL_MODEL == TRUE)
+    SCPI_COMMAND("MEASure:THERmal?", &MeasureThermal),
+#endif
+#if (POWER_METER == TRUE)
+    SCPI_COMMAND("MEASure:POWer?", &MeasurePower),
+    SCPI_COMMAND("MEASure:POWer:WINDow", &ConfigurePowerWindow),
+    SCPI_COMMAND("MEASure:POWer:WINDow?", &GetPowerWindow),
+    SCPI_COMMAND("MEASure:ENERgy?", &MeasureEnergy),
+    SCPI_COMMAND("MEASure:ENERgy:RESet", &ResetEnergy),
+#endif
+#if (TELEMETRY_STREAM == TRUE)
+    SCPI_COMMAND("TELemetry:STReam", &ConfigureTelemetryStream),
+    SCPI_COMMAND("TELemetry:STReam?", &GetTelemetryStream),
+    SCPI_COMMAND("TELemetry:STReam:RATE", &ConfigureTelemetryRate),
+    SCPI_COMMAND("TELemetry:STReam:RATE?", &GetTelemetryRate),
+    SCPI_COMMAND("TELemetry:STReam:FORMat", &ConfigureTelemetryFormat),
+    SCPI_COMMAND("TELemetry:STReam:FORMat?", &GetTelemetryFormat),
+    SCPI_COMMAND("TELemetry:STReam:VARiables", &ConfigureTelemetryVariables),
+    SCPI_COMMAND("TELemetry:STReam:VARiables?", &GetTelemetryVariables),
+#endif
+
+#if (WAVEFORM_CAPTURE == TRUE)
+    /* Waveform Capture Commands */
+    SCPI_COMMAND("ACQuire:STATe", &ConfigureAcquireState),
+    SCPI_COMMAND("ACQuire:STATe?", &GetAcquireState),
+    SCPI_COMMAND("ACQuire:VARiables", &ConfigureAcquireVariables),
+    SCPI_COMMAND("ACQuire:VARiables?", &GetAcquireVariables),
+    SCPI_COMMAND("ACQuire:DECimation", &ConfigureAcquireDecimation),
+    SCPI_COMMAND("ACQuire:DECimation?", &GetAcquireDecimation),
+    SCPI_COMMAND("ACQuire:POINts?", &GetAcquirePoints),
+    SCPI_COMMAND("ACQuire:DATA?", &GetAcquireData),
+    SCPI_COMMAND("TRIGger:SOURce", &ConfigureTriggerSource),
+    SCPI_COMMAND("TRIGger:SOURce?", &GetTriggerSource),
+    SCPI_COMMAND("TRIGger:LEVel", &ConfigureTriggerLevel),
+    SCPI_COMMAND("TRIGger:LEVel?", &GetTriggerLevel),
+    SCPI_COMMAND("TRIGger:SLOPe", &ConfigureTriggerSlope),
+    SCPI_COMMAND("TRIGger:SLOPe?", &GetTriggerSlope),
+    SCPI_COMMAND("TRIGger:PRETrigger", &ConfigureTriggerPretrigger),
+    SCPI_COMMAND("TRIGger:PRETrigger?", &GetTriggerPretrigger),
+    SCPI_COMMAND("TRIGger:IMMediate", &TriggerImmediate),
+#endif
+
+    /* Calibration Commands */
+    SCPI_COMMAND("CALibrate:PID", &CalibratePID),
+    SCPI_COMMAND("CALibrate:PID?", &GetCalibratePID),
+};
+
+//! Number of keyword forms.
+#define SCPI_KEYWORD_FORMS ScpiFormCount(scpiKeywords)
+//! Number of commands.
+#define SCPI_COMMANDS (sizeof(scpiCommands) / sizeof(scpiCommands[0]))
+
+static_assert(ScpiFormsUnique(scpiKeywords),
+              "SCPI keyword hash collision or duplicate keyword, change SCPI_HASH_MAGIC_NUMBER or SCPI_HASH_MAGIC_OFFSET");
+static_assert(ScpiCommandsUnique(scpiCommands),
+              "SCPI command hash collision or duplicate command, change SCPI_HASH_MAGIC_NUMBER or SCPI_HASH_MAGIC_OFFSET");
+static_assert(SCPI_KEYWORD_FORMS <= SCPI_MAX_KEYWORD_FORMS, "Too many SCPI keywords, increase SCPI_MAX_KEYWORD_FORMS");
+static_assert(SCPI_COMMANDS <= SCPI_MAX_COMMANDS, "Too many SCPI commands, increase SCPI_MAX_COMMANDS");
+
+//! Keyword form table entry \p n.
+#define SCPI_KEYWORD_FORM(n) ScpiKeywordFormAt(scpiKeywords, n)
+//! Command order table entry \p n.
+#define SCPI_COMMAND_ORDER(n) ScpiCommandAt(scpiCommands, n)
+
+//! Keyword forms sorted by hash.
+static constexpr uint8_t scpiKeywordForms[SCPI_MAX_KEYWORD_FORMS] PROGMEM = {
+    SCPI_ENTRIES(SCPI_MAX_KEYWORD_FORMS, SCPI_KEYWORD_FORM)};
+
+//! Command indices sorted by hash code.
+static constexpr uint8_t scpiCommandOrder[SCPI_MAX_COMMANDS] PROGMEM = {
+    SCPI_ENTRIES(SCPI_MAX_COMMANDS, SCPI_COMMAND_ORDER)};
+
+// Instantiate the SCPI Parser
+SCPI_Parser scpiParser({scpiKeywords, scpiKeywordForms, SCPI_KEYWORD_FORMS, scpiCommands, scpiCommandOrder, SCPI_COMMANDS});
+
+#if (FRAMED_PROTOCOL == TRUE)
+/**
+ * \brief Protocol of the serial interface, a \ref protocol_t.
+ */
+static uint8_t frameProtocol = PROTOCOL_SCPI;
+
+/**
+ * \brief Received bytes of the frame in progress, without the delimiter.
+ */
+static uint8_t frameBuffer[FRAME_MAX_LENGTH];
+
+/**
+ * \brief Number of bytes of the frame in progress, also counting those that
+ * did not fit in \ref frameBuffer.
+ */
+static uint8_t frameLength;
+
+/**
+ * \brief Time in milliseconds of the last valid frame or the switch to the
+ * framed binary protocol.
+ */
+static uint32_t frameTime;
+#endif
 
 /**
  * \brief Processes incoming data from a serial interface for SCPI commands.
@@ -116,12 +361,32 @@ void ScpiInit(void)
  * This function takes a `Stream` object (like `Serial`) and processes any
  * received data, looking for complete SCPI commands terminated by a newline
  * character. It then passes the command to the SCPI parser for execution.
+ * After `SYSTem:PROTocol BINary` the data is read as binary frames instead.
+ * While a telemetry stream is running, the queued records are written in
+ * turn with the responses. While an `ACQuire:DATA?` block is written, no
+ * commands are read and no records are written until it is complete.
  *
  * \param interface The serial stream interface to read commands from.
  */
 void ScpiInput(Stream &interface)
 {
+#if (FRAMED_PROTOCOL == TRUE)
+    if (frameProtocol == PROTOCOL_BINARY)
+    {
+        FrameInput(interface);
+        return;
+    }
+#endif
+#if (WAVEFORM_CAPTURE == TRUE)
+    if (CaptureOutput(interface))
+    {
+        return;
+    }
+#endif
     scpiParser.ProcessInput(interface, SCPI_CMD_TERM);
+#if (TELEMETRY_STREAM == TRUE)
+    TelemetryOutput(interface);
+#endif
 }
 
 /**
@@ -248,6 +513,9 @@ static void ScpiSystemErrorNextQ(SCPI_C commands, SCPI_P parameters, Stream &int
     case ErrorCode::MissingOrInvalidParameter:
         interface.println(F("Missing or invalid parameter"));
         break;
+    case ErrorCode::OutputOverflow:
+        interface.println(F("Output buffer overflow error"));
+        break;
     default:
         interface.println(F("Unknown error"));
     }
@@ -269,6 +537,51 @@ static void GetMotorEnable(SCPI_C commands, SCPI_P parameters, Stream &interface
     interface.println(motorFlags.enable);
 }
 
+/**
+ * \brief Enables or disables the motor through the enable pin.
+ *
+ * In remote mode the enable pin is an output, so setting or clearing it
+ * triggers the enable interrupt as the input would in local mode.
+ *
+ * \param enable true to enable, false to disable the motor.
+ */
+static void RemoteEnable(bool enable)
+{
+    if (enable)
+    {
+        // Set the enable pin
+        PORTD |= (1 << ENABLE_PIN);
+    }
+    else
+    {
+        // Clear the enable pin
+        PORTD &= ~(1 << ENABLE_PIN);
+    }
+}
+
+/**
+ * \brief Sets the motor direction through the direction command pin.
+ *
+ * In remote mode the direction command pin is an output, so setting or
+ * clearing it triggers the direction interrupt as the input would in local
+ * mode.
+ *
+ * \param direction \ref DIRECTION_FORWARD or \ref DIRECTION_REVERSE.
+ */
+static void RemoteDirection(uint8_t direction)
+{
+    if (direction)
+    {
+        // Set the direction pin if direction is 1 (DIRECTION_REVERSE)
+        PORTD |= (1 << DIRECTION_COMMAND_PIN);
+    }
+    else
+    {
+        // Clear the direction pin if direction is 0 (DIRECTION_FORWARD)
+        PORTD &= ~(1 << DIRECTION_COMMAND_PIN);
+    }
+}
+
 /**
  * \brief Configures the motor's enable state.
  *
@@ -292,36 +605,68 @@ static void ConfigureMotorEnable(SCPI_C commands, SCPI_P parameters, Stream &int
         scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
         return;
     }
-    if (param)
-    {
-        // Set the enable pin
-        PORTD |= (1 << ENABLE_PIN);
-    }
-    else
+    RemoteEnable(param);
+
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Configures the control method.
+ *
+ * This function reads a choice parameter ('OPEN', 'CLOSed', 'TORQue' or
+ * 'POSition') from the SCPI command and selects the control method
+ * accordingly, corresponding to `SPEED_CONTROL_OPEN_LOOP`,
+ * `SPEED_CONTROL_CLOSED_LOOP`, `SPEED_CONTROL_TORQUE` and
+ * `SPEED_CONTROL_POSITION`. The method can be changed while the motor is
+ * running, the new regulator takes over from the present duty cycle.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the control method choice.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureMotorMethod(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamChoice(parameters, controlMethods, CONTROL_METHOD_OPTIONS, param) || !ControlMethodSet(param))
     {
-        // Clear the enable pin
-        PORTD &= ~(1 << ENABLE_PIN);
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
-
     scpiParser.last_error = ErrorCode::NoError;
 }
 
+/**
+ * \brief Retrieves the selected control method.
+ *
+ * This function queries the active control method ('OPEN', 'CLOSED', 'TORQUE'
+ * or 'POSITION') and returns it as a string.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetConfigureMotorMethod(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(controlMethods, CONTROL_METHOD_OPTIONS, motorConfigs.controlMethod, name);
+    interface.println(name);
+}
+
 /**
  * \brief Configures the motor's speed input source.
  *
  * This function reads a choice parameter ('LOCAL' or 'REMOTE') from the SCPI
  * command and sets the motor's speed input source accordingly, corresponding
- * to `SPEED_INPUT_SOURCE_LOCAL` and `SPEED_INPUT_SOURCE_REMOTE`.
+ * to `SPEED_INPUT_SOURCE_LOCAL` and `SPEED_INPUT_SOURCE_REMOTE`. The source
+ * is shared by all control methods, so `DUTYcycle:SOURce`, `SPEEd:SOURce` and
+ * `TORQue:SOURce` are the same setting.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters containing the input source choice.
  * \param interface The serial interface (not used).
  */
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_OPEN_LOOP)
-static void ConfigureMotorDutyCycleSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
-#elif (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
-static void ConfigureMotorSpeedSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
-#endif
+static void ConfigureMotorInputSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
     uint8_t param;
 
@@ -346,43 +691,29 @@ static void ConfigureMotorSpeedSource(SCPI_C commands, SCPI_P parameters, Stream
     scpiParser.last_error = ErrorCode::NoError;
 }
 
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_OPEN_LOOP)
-/**
- * \brief Retrieves the configured motor's duty cycle source.
- *
- * This function queries the currently configured source for the motor's duty cycle
- * (either 'LOCAL' or 'REMOTE') and returns it as a string.
- *
- * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters (not used).
- * \param interface The serial interface to write the response to.
- */
-static void GetConfigureMotorDutyCycleSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
-#elif (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
 /**
- * \brief Retrieves the configured motor's speed source.
+ * \brief Retrieves the configured motor's speed input source.
  *
- * This function queries the currently configured source for the motor's speed
- * (either 'LOCAL' or 'REMOTE') and returns it as a string.
+ * This function queries the currently configured source for the motor's
+ * speed input (either 'LOCAL' or 'REMOTE') and returns it as a string.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
  * \param interface The serial interface to write the response to.
  */
-static void GetMotorSpeedSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
-#endif
+static void GetMotorInputSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    String name;
+    char name[SCPI_CHOICE_NAME_LENGTH];
     ScpiChoiceToName(inputSources, INPUT_SOURCE_OPTIONS, motorConfigs.speedInputSource, name);
     interface.println(name);
 }
 
-#if (SPEED_CONTROL_METHOD == SPEED_CONTROL_OPEN_LOOP)
 /**
  * \brief Configures the motor's speed input by setting the duty cycle.
  *
  * This function reads a double parameter (0.0 to 100.0) from the SCPI command
- * and sets the motor's duty cycle accordingly.
+ * and sets the motor's duty cycle accordingly. Only accepted when the control
+ * method is open loop.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters containing the duty cycle value.
@@ -391,7 +722,7 @@ static void GetMotorSpeedSource(SCPI_C commands, SCPI_P parameters, Stream &inte
 static void ConfigureMotorDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
     double param;
-    if (!ScpiParamDouble(parameters, param) || param < 0.0 || param > 100.0)
+    if ((motorConfigs.controlMethod != SPEED_CONTROL_OPEN_LOOP) || !ScpiParamDouble(parameters, param) || param < 0.0 || param > 100.0)
     {
         scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
         return;
@@ -399,13 +730,14 @@ static void ConfigureMotorDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &
     speedInput = param;
     scpiParser.last_error = ErrorCode::NoError;
 }
-#elif (SPEED_CONTROL_METHOD == SPEED_CONTROL_CLOSED_LOOP)
+
 /**
  * \brief Configures the motor's speed input by setting the speed reference.
  *
  * This function reads a double parameter representing the target speed and
  * sets the internal speed reference accordingly. The input speed is validated
- * against the maximum allowed speed.
+ * against the maximum allowed speed. Only accepted when the control method is
+ * closed loop.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters containing the target speed value.
@@ -414,7 +746,7 @@ static void ConfigureMotorDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &
 static void ConfigureMotorSpeed(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
     double param;
-    if (!ScpiParamDouble(parameters, param) || param > ((((uint32_t)SPEED_CONTROLLER_MAX_SPEED * 15) << 3) / MOTOR_POLES))
+    if ((motorConfigs.controlMethod != SPEED_CONTROL_CLOSED_LOOP) || !ScpiParamDouble(parameters, param) || param > ((((uint32_t)SPEED_CONTROLLER_MAX_SPEED * 15) << 3) / MOTOR_POLES))
     {
         scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
         return;
@@ -422,277 +754,2211 @@ static void ConfigureMotorSpeed(SCPI_C commands, SCPI_P parameters, Stream &inte
     speedInput = ((uint32_t)(param * SPEED_CONTROLLER_MAX_INPUT * MOTOR_POLES) >> 3) / ((uint32_t)SPEED_CONTROLLER_MAX_SPEED * 15);
     scpiParser.last_error = ErrorCode::NoError;
 }
-#endif
 
 /**
- * \brief Configures the motor's operating frequency.
+ * \brief Configures the motor's speed input by setting the torque reference.
  *
- * This function sets the motor's operating frequency based on the input
- * parameter. It validates the frequency range (7183 to 100000 Hz), updates
- * the motor configuration, and reinitializes timers after ensuring the motor
- * is stopped.
+ * This function reads a fixed-point parameter representing the target bus
+ * current in Amperes, with up to three decimal places, and sets the internal
+ * speed input accordingly. The current is validated against the current at
+ * full torque, `TORQUE_MAX_CURRENT`. Only accepted when the control method is
+ * torque.
  *
  * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters containing the frequency value in Hz.
+ * \param parameters The SCPI parameters containing the target current value.
  * \param interface The serial interface (not used).
  */
-static void ConfigureMotorFrequency(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void ConfigureMotorTorque(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    // Clear the enable pin to stop the motor before changing frequency
-    PORTD &= ~(1 << ENABLE_PIN);
-
+    // Current at full torque in milliamperes, evaluated at compile time.
+    static constexpr uint32_t maxCurrent = (uint32_t)(((double)TORQUE_MAX_CURRENT * 5.0 * 1000000.0 * 1000.0) / (1023.0 * IBUS_GAIN * IBUS_SENSE_RESISTOR));
+    static_assert((maxCurrent > 0) && (maxCurrent <= UINT32_MAX / SPEED_CONTROLLER_MAX_INPUT), "Torque current scale out of range");
     uint32_t param;
-
-    // Read first parameter if present and within range
-    if (!ScpiParamUInt32(parameters, param) || param < F_MOSFET_MIN || param > F_MOSFET_MAX)
+    if ((motorConfigs.controlMethod != SPEED_CONTROL_TORQUE) || !ScpiParamFixed(parameters, 3, maxCurrent, param))
     {
         scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
         return;
     }
+    speedInput = (param * SPEED_CONTROLLER_MAX_INPUT) / maxCurrent;
+    scpiParser.last_error = ErrorCode::NoError;
+}
 
-    // Reload the configs
-    motorConfigs.tim4Freq = param;
-    motorConfigs.tim4Top = (uint16_t)TIM4_TOP(motorConfigs.tim4Freq);
-
-    // Wait until motor is stopped
-    while (faultFlags.motorStopped == FALSE)
+/**
+ * \brief Configures the target of the position controller.
+ *
+ * This function reads a signed integer parameter representing the target
+ * position in hall sensor edges, six per electrical revolution, and starts a
+ * move to it. Only accepted when the control method is position.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the target position.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureMotorPosition(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    int32_t param;
+    if ((motorConfigs.controlMethod != SPEED_CONTROL_POSITION) || !ScpiParamInt32(parameters, param))
     {
-        ;
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
-
-    // Re-init timers with the new frequency
-    TimersInit();
+    positionTarget = param;
     scpiParser.last_error = ErrorCode::NoError;
 }
 
 /**
- * \brief Retrieves the configured motor frequency.
- *
- * This function queries the current frequency configuration of the motor and
- * returns it as a double value representing the frequency in Hertz.
+ * \brief Retrieves the target of the position controller.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
  * \param interface The serial interface to write the response to.
  */
-static void GetConfigureMotorFrequency(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void GetConfigureMotorPosition(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    interface.println(motorConfigs.tim4Freq);
+    interface.println(positionTarget);
 }
 
 /**
- * \brief Sets the motor's direction based on the input parameter.
- *
- * This function reads a direction parameter ('FORW' or 'REVE') and sets
- * the motor's direction accordingly by manipulating the `DIRECTION_COMMAND_PIN`
- * on `PORTD`.
+ * \brief Configures one breakpoint of the PID gain schedule.
  *
- * In remote mode, the `DIRECTION_COMMAND_PIN` is configured as an output.
- * Setting or clearing the pin triggers the relevant software interrupt as it
- * would in normal operation.
+ * This function reads five parameters: the breakpoint index, the speed in
+ * revolutions per minute (RPM) at which the gains apply, and the P, I and D
+ * gains. The breakpoint is only accepted if the table stays sorted by speed.
+ * The running speed controller picks up the new gains on its next iteration.
  *
  * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters containing the direction choice.
+ * \param parameters The SCPI parameters containing the breakpoint.
  * \param interface The serial interface (not used).
  */
-static void ConfigureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void ConfigurePIDTable(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    uint8_t param;
+    uint32_t gains[3];
+    uint32_t speed;
+    uint8_t index;
+    pidGainPoint_t point;
 
-    // read first parameter if present
-    if (!ScpiParamChoice(parameters, motorDirections, MOTOR_DIRECTION_OPTIONS, param))
+    if (parameters.Size() != 5)
     {
         scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
         return;
     }
 
-    if (param)
+    // Parameters are popped last first.
+    for (int8_t n = 2; n >= 0; n--)
     {
-        // Set the direction pin if param is 1 (DIRECTION_REVERSE)
-        PORTD |= (1 << DIRECTION_COMMAND_PIN);
+        if (!ScpiParamUInt32(parameters, gains[n]) || gains[n] > MAX_INT)
+        {
+            scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+            return;
+        }
     }
-    else
+    if (!ScpiParamUInt32(parameters, speed) || speed > (((uint32_t)MAX_INT * 120) / MOTOR_POLES) || !ScpiParamUInt8(parameters, index))
     {
-        // Clear the direction pin if param is 0 (DIRECTION_FORWARD)
-        PORTD &= ~(1 << DIRECTION_COMMAND_PIN);
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    // Convert from RPM to the speed controller's process value unit.
+    point.speed = (speed * MOTOR_POLES) / 120;
+    point.P_Factor = gains[0];
+    point.I_Factor = gains[1];
+    point.D_Factor = gains[2];
+
+    if (!PIDGainScheduleSet(index, &point))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
     scpiParser.last_error = ErrorCode::NoError;
 }
 
 /**
- * \brief Retrieves the configured direction of the motor.
+ * \brief Retrieves one breakpoint of the PID gain schedule.
  *
- * This function queries the desired direction of the motor and returns a
- * textual representation ('FORW' or 'REVE') based on the `motorFlags.desiredDirection`
- * setting.
+ * This function reads the breakpoint index and returns the breakpoint as
+ * `<speed>,<P>,<I>,<D>` with the speed in revolutions per minute (RPM).
  *
  * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters (not used).
+ * \param parameters The SCPI parameters containing the breakpoint index.
  * \param interface The serial interface to write the response to.
  */
-static void GetConfigureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void GetConfigurePIDTable(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    String name;
-    ScpiChoiceToName(motorDirections, MOTOR_DIRECTION_OPTIONS, motorFlags.desiredDirection, name);
-    interface.println(name);
+    uint8_t index;
+    if (!ScpiParamUInt8(parameters, index) || index >= PID_GAIN_SCHEDULE_POINTS)
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    const pidGainPoint_t *point = &pidGainSchedule[index];
+    interface.print(((int32_t)point->speed * 120) / MOTOR_POLES);
+    interface.print(',');
+    interface.print(point->P_Factor);
+    interface.print(',');
+    interface.print(point->I_Factor);
+    interface.print(',');
+    interface.println(point->D_Factor);
 }
 
 /**
- * \brief Measures the motor speed.
+ * \brief Sets the whole PID gain schedule from a binary block.
  *
- * This function calculates and returns the motor speed in revolutions per
- * minute (RPM). It uses the time difference between the last two commutation
- * events and the configured motor frequency and pole count for the calculation.
+ * This function reads a definite-length block of \ref
+ * PID_GAIN_SCHEDULE_POINTS breakpoints, each the speed, P, I and D gains as
+ * little-endian signed 16-bit integers. The speed is in the unit of the speed
+ * controller, electrical revolutions per second. The table is only taken over
+ * when the speeds are in ascending order and the gains are not negative.
  *
  * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters (not used).
- * \param interface The serial interface to write the response to.
+ * \param parameters The SCPI parameters containing the block.
+ * \param interface The serial interface (not used).
  */
-static void MeasureMotorSpeed(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void ConfigurePIDTableData(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    if (lastCommutationTicks == 0xffff)
+    // The shortest form of the command, the block and the line terminator.
+    static_assert(sizeof("CONF:PID:TABL:DATA #2") - 1 + sizeof(pidGainSchedule) + 1 <= SCPI_BUFFER_LENGTH,
+                  "CONFigure:PID:TABLe:DATA does not fit, raise SCPI_BUFFER_LENGTH or reduce PID_GAIN_SCHEDULE_POINTS");
+
+    pidGainPoint_t points[PID_GAIN_SCHEDULE_POINTS];
+    const char *data;
+    uint16_t length;
+
+    if (!ScpiParamBlock(parameters, data, length) || length != sizeof(points))
     {
-        interface.println(0.0);
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
-    else
+    memcpy(points, data, sizeof(points));
+
+    if (!PIDGainScheduleLoad(points))
     {
-        interface.println(
-            (motorConfigs.tim4Freq * 20.0) / (lastCommutationTicks * MOTOR_POLES));
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
+    scpiParser.last_error = ErrorCode::NoError;
 }
 
 /**
- * \brief Measures and returns the motor's VBUS current.
+ * \brief Retrieves the whole PID gain schedule as a binary block.
  *
- * This function reads the ADC value for the VBUS current sense, converts it
- * to Amperes using the known gain and sense resistor value.
+ * The block has the layout read by `CONFigure:PID:TABLe:DATA`.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
  * \param interface The serial interface to write the response to.
  */
-static void MeasureMotorCurrentVBus(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void GetConfigurePIDTableData(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    interface.println(((double)ibus * 5.0 * 1000000.0) / ((double)1023.0 * IBUS_GAIN * IBUS_SENSE_RESISTOR));
+    ScpiPrintBlockHeader(interface, sizeof(pidGainSchedule));
+    interface.write((const uint8_t *)pidGainSchedule, sizeof(pidGainSchedule));
+    interface.println();
 }
 
 /**
- * \brief Measures and returns the motor's phase U current.
+ * \brief Stores the PID gain schedule in EEPROM.
  *
- * This function reads the ADC value for the phase U current sense, converts it
- * to Amperes using the known gain and sense resistor value. It accounts for
- * the ADC offset (typically around 511 for a centered reading).
+ * The stored table replaces the compiled in gains from the next power up.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
- * \param interface The serial interface to write the response to.
+ * \param interface The serial interface (not used).
  */
-static void MeasureMotorCurrentPhaseU(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void ConfigurePIDSave(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    interface.println(((double)(iphaseU - 511) * 5.0 * 1000000.0) / ((double)1023.0 * IPHASE_GAIN * IPHASE_SENSE_RESISTOR));
+    PIDGainScheduleSave();
+    scpiParser.last_error = ErrorCode::NoError;
 }
 
 /**
- * \brief Measures and returns the motor's phase V current.
+ * \brief Starts a relay feedback auto-tune of the PID gains.
  *
- * This function reads the ADC value for the phase V current sense, converts it
- * to Amperes using the known gain and sense resistor value. It accounts for
- * the ADC offset (typically around 511 for a centered reading).
+ * This function reads the speed in revolutions per minute (RPM) to tune
+ * around, optionally followed by the tuning rule ('ZN' for Ziegler-Nichols or
+ * 'TL' for Tyreus-Luyben, default 'ZN') and a boolean selecting whether the
+ * resulting gain schedule is stored in EEPROM (default off).
+ *
+ * The motor must be enabled and should already be running close to the
+ * requested speed, as the relay switches around the present duty cycle. The
+ * experiment runs in the background, use `CALibrate:PID?` to follow it. Only
+ * accepted when the control method is closed loop.
  *
  * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters (not used).
- * \param interface The serial interface to write the response to.
+ * \param parameters The SCPI parameters containing the speed, rule and store flag.
+ * \param interface The serial interface (not used).
  */
-static void MeasureMotorCurrentPhaseV(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void CalibratePID(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    interface.println(((double)(iphaseV - 511) * 5.0 * 1000000.0) / ((double)1023.0 * IPHASE_GAIN * IPHASE_SENSE_RESISTOR));
-}
+    uint8_t count = parameters.Size();
+    uint8_t rule = PID_TUNE_RULE_ZIEGLER_NICHOLS;
+    bool store = false;
+    uint32_t speed;
 
-/**
- * \brief Measures and returns the motor's phase W current.
- *
- * This function reads the ADC value for the phase W current sense, converts it
- * to Amperes using the known gain and sense resistor value. It accounts for
- * the ADC offset (typically around 511 for a centered reading).
- *
- * \param commands The SCPI commands (not used).
- * \param parameters The SCPI parameters (not used).
- * \param interface The serial interface to write the response to.
+    if ((count < 1) || (count > 3) || (motorFlags.enable == FALSE) || (motorConfigs.controlMethod != SPEED_CONTROL_CLOSED_LOOP))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    // Parameters are popped last first.
+    if ((count == 3) && !ScpiParamBool(parameters, store))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    if ((count >= 2) && !ScpiParamChoice(parameters, pidTuneRules, PID_TUNE_RULE_OPTIONS, rule))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    if (!ScpiParamUInt32(parameters, speed) || speed > ((((uint32_t)SPEED_CONTROLLER_MAX_SPEED * 15) << 3) / MOTOR_POLES))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    PIDAutoTuneStart((speed * MOTOR_POLES) / 120, speedOutput, rule, store, &pidAutoTune);
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the state and result of the PID auto-tune.
+ *
+ * This function returns `<state>,<P>,<I>,<D>`, where the state is one of
+ * 'IDLE', 'RUNNING', 'DONE' or 'FAILED'. The gains are only valid when the
+ * state is 'DONE'.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetCalibratePID(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(pidAutoTuneStates, PID_AUTOTUNE_STATE_OPTIONS, pidAutoTune.state, name);
+    interface.print(name);
+    interface.print(',');
+    interface.print(pidAutoTune.P_Factor);
+    interface.print(',');
+    interface.print(pidAutoTune.I_Factor);
+    interface.print(',');
+    interface.println(pidAutoTune.D_Factor);
+}
+
+#if (PID_BENCHMARK_ENABLE == TRUE)
+/**
+ * \brief Implements the `SYSTem:BENChmark:PID?` command.
+ *
+ * This function times the fixed-point PID controller against the previous,
+ * division based, controller, and the gain schedule update run before it, and
+ * returns `<previous>,<fixed-point>,<schedule>` in CPU cycles per call. As interrupts are disabled while timing, the motor must be
+ * disabled.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void ScpiSystemBenchmarkPIDQ(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint16_t referenceCycles;
+    uint16_t fixedPointCycles;
+    uint16_t scheduleCycles;
+
+    if (motorFlags.enable == TRUE)
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    PIDBenchmark(&referenceCycles, &fixedPointCycles, &scheduleCycles);
+    interface.print(referenceCycles);
+    interface.print(',');
+    interface.print(fixedPointCycles);
+    interface.print(',');
+    interface.println(scheduleCycles);
+}
+#endif
+
+/**
+ * \brief Configures the motor's operating frequency.
+ *
+ * This function sets the motor's operating frequency based on the input
+ * parameter. It validates the frequency range (7183 to 100000 Hz), updates
+ * the motor configuration, and reinitializes timers after ensuring the motor
+ * is stopped.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the frequency value in Hz.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureMotorFrequency(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    // Clear the enable pin to stop the motor before changing frequency
+    PORTD &= ~(1 << ENABLE_PIN);
+
+    uint32_t param;
+
+    // Read first parameter if present and within range
+    if (!ScpiParamUInt32(parameters, param) || param < F_MOSFET_MIN || param > F_MOSFET_MAX)
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    // Reload the configs
+    motorConfigs.tim4Freq = param;
+    motorConfigs.tim4Top = (uint16_t)TIM4_TOP(motorConfigs.tim4Freq);
+
+    // Wait until motor is stopped
+    while (faultFlags.motorStopped == FALSE)
+    {
+        ;
+    }
+
+    // Re-init timers with the new frequency
+    TimersInit();
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the configured motor frequency.
+ *
+ * This function queries the current frequency configuration of the motor and
+ * returns it as a double value representing the frequency in Hertz.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetConfigureMotorFrequency(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    interface.println(motorConfigs.tim4Freq);
+}
+
+/**
+ * \brief Sets the motor's direction based on the input parameter.
+ *
+ * This function reads a direction parameter ('FORW' or 'REVE') and sets
+ * the motor's direction accordingly by manipulating the `DIRECTION_COMMAND_PIN`
+ * on `PORTD`.
+ *
+ * In remote mode, the `DIRECTION_COMMAND_PIN` is configured as an output.
+ * Setting or clearing the pin triggers the relevant software interrupt as it
+ * would in normal operation, so a running motor is stopped, or reversed on the
+ * fly if `DIRECTION_REVERSAL` is enabled.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the direction choice.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    // read first parameter if present
+    if (!ScpiParamChoice(parameters, motorDirections, MOTOR_DIRECTION_OPTIONS, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    RemoteDirection(param);
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the configured direction of the motor.
+ *
+ * This function queries the desired direction of the motor and returns a
+ * textual representation ('FORW' or 'REVE') based on the `motorFlags.desiredDirection`
+ * setting.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetConfigureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(motorDirections, MOTOR_DIRECTION_OPTIONS, motorFlags.desiredDirection, name);
+    interface.println(name);
+}
+
+/**
+ * \brief Configures the filter of a measurement channel.
+ *
+ * This function reads the channel ('IBUS', 'VBUS', 'SPEEd' or 'INPut'), the
+ * filter type ('NONE', 'EMA', 'AVERage', 'MED3', 'MED5', 'BIQuad' or 'RATE')
+ * and optionally a parameter: the alpha exponent (1-8) for 'EMA' or the
+ * largest change per sample (1-32767) for 'RATE'. Without a parameter the
+ * configured default is used. The filter starts from the present measurement,
+ * so the value does not jump.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the channel, type and parameter.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureFilter(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t count = parameters.Size();
+    uint32_t parameter = 0;
+    uint8_t channel;
+    uint8_t type;
+    int16_t value;
+
+    if ((count < 2) || (count > 3))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    // Parameters are popped last first.
+    if ((count == 3) && !ScpiParamUInt32(parameters, parameter))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    if (!ScpiParamChoice(parameters, filterTypeNames, FILTER_TYPE_OPTIONS, type) || !ScpiParamChoice(parameters, filterChannelNames, FILTER_CHANNEL_OPTIONS, channel))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    if (count == 2)
+    {
+        parameter = FilterDefaultParameter(type);
+    }
+    else if (((type == FILTER_TYPE_EMA) && ((parameter < 1) || (parameter > 8))) || ((type == FILTER_TYPE_RATE_LIMIT) && ((parameter < 1) || (parameter > MAX_INT))))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    switch (channel)
+    {
+    case FILTER_CHANNEL_IBUS:
+        value = ibus;
+        break;
+    case FILTER_CHANNEL_VBUS:
+        value = vbusVref;
+        break;
+    case FILTER_CHANNEL_SPEED:
+        value = (lastCommutationTicks > MAX_INT) ? MAX_INT : lastCommutationTicks;
+        break;
+    default:
+        value = speedInput;
+        break;
+    }
+
+    FilterSelect(&filterChannels[channel], type, parameter, value);
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the filter of a measurement channel.
+ *
+ * This function reads the channel and returns `<type>,<parameter>`.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the channel.
+ * \param interface The serial interface to write the response to.
+ */
+static void GetConfigureFilter(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t channel;
+    if (!ScpiParamChoice(parameters, filterChannelNames, FILTER_CHANNEL_OPTIONS, channel))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(filterTypeNames, FILTER_TYPE_OPTIONS, filterChannels[channel].type, name);
+    interface.print(name);
+    interface.print(',');
+    interface.println(filterChannels[channel].parameter);
+}
+
+//! Bus current in A per IBUS register count, fixed point.
+static constexpr uint32_t scpiScaleIbus = ScpiFixedScale((5.0 * 1000000.0) / (1023.0 * IBUS_GAIN * IBUS_SENSE_RESISTOR));
+
+//! Phase current in A per phase current register count, fixed point.
+static constexpr uint32_t scpiScaleIphase = ScpiFixedScale((5.0 * 1000000.0) / (1023.0 * IPHASE_GAIN * IPHASE_SENSE_RESISTOR));
+
+//! VBUS voltage in V per VBUS register count, fixed point.
+static constexpr uint32_t scpiScaleVbus = ScpiFixedScale((5.0 * (VBUS_RTOP + VBUS_RBOTTOM)) / (1023.0 * VBUS_RBOTTOM));
+
+static_assert((uint64_t)1023 * scpiScaleIbus <= INT32_MAX, "IBUS scale overflows, reduce SCPI_MEASURE_DECIMALS");
+static_assert((uint64_t)512 * scpiScaleIphase <= INT32_MAX, "Phase current scale overflows, reduce SCPI_MEASURE_DECIMALS");
+static_assert((uint64_t)1023 * scpiScaleVbus <= INT32_MAX, "VBUS scale overflows, reduce SCPI_MEASURE_DECIMALS");
+
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE) || (POWER_METER == TRUE)
+//! Fraction bits of the power scale, VBUS x IBUS register counts are small.
+#define SCPI_POWER_SHIFT 24
+
+//! Power in W per VBUS x IBUS register count.
+static constexpr double scpiPowerPerCount =
+    (5.0 * (VBUS_RTOP + VBUS_RBOTTOM) * 5.0 * 1000000.0) / (1023.0 * VBUS_RBOTTOM * 1023.0 * IBUS_GAIN * IBUS_SENSE_RESISTOR);
+
+//! Power in W per VBUS x IBUS register count, fixed point.
+static constexpr uint32_t scpiScalePower = ScpiFixedScale(scpiPowerPerCount, SCPI_POWER_SHIFT);
+
+static_assert(scpiPowerPerCount * ScpiPow10(SCPI_MEASURE_DECIMALS) * (1UL << SCPI_POWER_SHIFT) < 4294967295.0, "Power scale overflows, reduce SCPI_MEASURE_DECIMALS");
+#endif
+
+/**
+ * \brief Gets one measured variable of a snapshot as an integer.
+ *
+ * Speed in RPM, currents in A, voltage in V and duty cycle in percent are
+ * fixed point with `SCPI_MEASURE_DECIMALS` decimal places. The position is the
+ * hall sensor edge count, the direction is one of the DIRECTION_* values,
+ * enable is 0 or 1 and the faults are the fault flags as an integer.
+ *
+ * \param snapshot The measurement snapshot.
+ * \param channel The variable, one of \ref measure_channel_t.
+ * \return The value of the variable.
+ */
+static int32_t MeasurementValue(const measurements_t &snapshot, uint8_t channel)
+{
+    switch (channel)
+    {
+    case MEASURE_SPEED:
+    {
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+        // Electrical frequency is in 1/16 Hz, rpm = f * 120 / poles.
+        uint32_t frequency = TrackerSpeedFrequency(snapshot.trackerSpeed, motorConfigs.tim4Freq);
+        return (frequency * 15 * ScpiPow10(SCPI_MEASURE_DECIMALS) + MOTOR_POLES) / (2 * MOTOR_POLES);
+#else
+        if (snapshot.commutationTicks == 0xffff)
+        {
+            return 0;
+        }
+        uint32_t divisor = (uint32_t)snapshot.commutationTicks * MOTOR_POLES;
+        return (motorConfigs.tim4Freq * 20 * ScpiPow10(SCPI_MEASURE_DECIMALS) + divisor / 2) / divisor;
+#endif
+    }
+    case MEASURE_IBUS:
+        return ScpiFixedMultiply(snapshot.ibus, scpiScaleIbus);
+    case MEASURE_IPHASE_U:
+        return ScpiFixedMultiply(snapshot.iphaseU - 511, scpiScaleIphase);
+    case MEASURE_IPHASE_V:
+        return ScpiFixedMultiply(snapshot.iphaseV - 511, scpiScaleIphase);
+    case MEASURE_IPHASE_W:
+        return ScpiFixedMultiply(snapshot.iphaseW - 511, scpiScaleIphase);
+    case MEASURE_VOLTAGE:
+        return ScpiFixedMultiply(snapshot.vbus, scpiScaleVbus);
+    case MEASURE_DUTY:
+    {
+        uint16_t top = motorConfigs.tim4Top;
+        return ((uint32_t)snapshot.duty * 100 * ScpiPow10(SCPI_MEASURE_DECIMALS) + top / 2) / top;
+    }
+    case MEASURE_POSITION:
+        return snapshot.position;
+    case MEASURE_DIRECTION:
+        return snapshot.flags.actualDirection;
+    case MEASURE_ENABLE:
+        return snapshot.flags.enable;
+    case MEASURE_FAULTS:
+        return *(const uint8_t *)&snapshot.faults;
+    }
+    return 0;
+}
+
+/**
+ * \brief Prints one measured variable of a snapshot.
+ *
+ * Speed in RPM, currents in A, voltage in V and duty cycle in percent are
+ * printed with `SCPI_MEASURE_DECIMALS` decimal places. The position is the
+ * hall sensor edge count, the direction is 'FORW', 'REVE' or 'UNKN', enable
+ * is 0 or 1 and the faults are the fault flags as an integer.
+ *
+ * \param interface The serial interface to write to.
+ * \param snapshot The measurement snapshot.
+ * \param channel The variable, one of \ref measure_channel_t.
+ */
+static void PrintMeasurement(Stream &interface, const measurements_t &snapshot, uint8_t channel)
+{
+    int32_t value = MeasurementValue(snapshot, channel);
+
+    switch (channel)
+    {
+    case MEASURE_POSITION:
+    case MEASURE_ENABLE:
+    case MEASURE_FAULTS:
+        interface.print(value);
+        break;
+    case MEASURE_DIRECTION:
+        if (value == DIRECTION_UNKNOWN)
+        {
+            interface.print(F("UNKN"));
+        }
+        else
+        {
+            char name[SCPI_CHOICE_NAME_LENGTH];
+            ScpiChoiceToName(motorDirections, MOTOR_DIRECTION_OPTIONS, value, name);
+            interface.print(name);
+        }
+        break;
+    default:
+        ScpiPrintFixed(interface, value);
+        break;
+    }
+}
+
+/**
+ * \brief Measures and prints one variable.
+ *
+ * \param interface The serial interface to write the response to.
+ * \param channel The variable, one of \ref measure_channel_t.
+ */
+static void MeasureChannel(Stream &interface, uint8_t channel)
+{
+    measurements_t snapshot;
+    MeasurementsSnapshot(&snapshot);
+    PrintMeasurement(interface, snapshot, channel);
+    interface.println();
+}
+
+/**
+ * \brief Measures the motor speed.
+ *
+ * This function calculates and returns the motor speed in revolutions per
+ * minute (RPM). It uses the electrical frequency from the speed tracker, or
+ * the time difference between the last two commutation events and the
+ * configured motor frequency, and the pole count for the calculation.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorSpeed(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_SPEED);
+}
+
+/**
+ * \brief Measures and returns the motor's VBUS current.
+ *
+ * This function reads the ADC value for the VBUS current sense, converts it
+ * to Amperes using the known gain and sense resistor value.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorCurrentVBus(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_IBUS);
+}
+
+/**
+ * \brief Measures and returns the motor's phase U current.
+ *
+ * This function reads the ADC value for the phase U current sense, converts it
+ * to Amperes using the known gain and sense resistor value. It accounts for
+ * the ADC offset (typically around 511 for a centered reading).
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorCurrentPhaseU(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_IPHASE_U);
+}
+
+/**
+ * \brief Measures and returns the motor's phase V current.
+ *
+ * This function reads the ADC value for the phase V current sense, converts it
+ * to Amperes using the known gain and sense resistor value. It accounts for
+ * the ADC offset (typically around 511 for a centered reading).
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorCurrentPhaseV(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_IPHASE_V);
+}
+
+/**
+ * \brief Measures and returns the motor's phase W current.
+ *
+ * This function reads the ADC value for the phase W current sense, converts it
+ * to Amperes using the known gain and sense resistor value. It accounts for
+ * the ADC offset (typically around 511 for a centered reading).
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorCurrentPhaseW(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_IPHASE_W);
+}
+
+/**
+ * \brief Measures and reports the current direction of the motor.
+ *
+ * This function checks the `motorFlags.actualDirection` and returns a textual
+ * representation ('FORW', 'REVE', or 'UNKN') based on the motor's sensed
+ * direction.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_DIRECTION);
+}
+
+/**
+ * \brief Measures and returns the rotor position.
+ *
+ * This function reads the hall sensor edge counter, which counts six edges
+ * per electrical revolution and is incremented when running forward and
+ * decremented in reverse.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorPosition(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_POSITION);
+}
+
+/**
+ * \brief Measures and returns the VBUS voltage of the motor.
+ *
+ * This function reads the ADC value for the VBUS voltage reference and converts
+ * it to Volts using the voltage divider resistor values.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureMotorVoltage(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_VOLTAGE);
+}
+
+/**
+ * \brief Measures and returns the gate PWM duty cycle as a percentage.
+ *
+ * This function reads the current PWM duty cycle from Timer4's compare register
+ * (OCR4A) and calculates the percentage relative to the timer's top value.
+ * The duty cycle is 0 while the motor is disabled.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureGateDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasureChannel(interface, MEASURE_DUTY);
+}
+
+/**
+ * \brief Last snapshot of `MEASure:ALL?`, returned again by `FETCh?`.
+ */
+static measurements_t measureSnapshot;
+
+/**
+ * \brief TRUE once \ref measureSnapshot holds a snapshot.
+ */
+static uint8_t measureSnapshotValid = FALSE;
+
+/**
+ * \brief Format of the bulk query responses, a \ref data_format_t.
+ */
+static uint8_t dataFormat = DATA_FORMAT_ASCII;
+
+/**
+ * \brief Reads a list of measured variable names.
+ *
+ * \param parameters The SCPI parameters with the list of names.
+ * \param channels Array of \ref SCPI_ARRAY_SIZE variables to fill in.
+ * \param count Number of variables in the list, 0 without parameters.
+ * \return true if all names are valid, false otherwise.
+ */
+static bool ParseMeasureChannels(SCPI_P &parameters, uint8_t *channels, uint8_t &count)
+{
+    count = parameters.Size();
+
+    // Parameters are popped from the last one
+    for (uint8_t i = count; i > 0; i--)
+    {
+        if (parameters.overflow_error || !ScpiParamChoice(parameters, measureChannelNames, MEASURE_CHANNEL_OPTIONS, channels[i - 1]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Prints measured variables of a snapshot as one line.
+ *
+ * The parameters select the variables and their order, by their names in
+ * \ref measureChannelNames. All variables are printed without parameters.
+ * With `FORMat:DATA INTeger` or `REAL` the variables are sent as a
+ * definite-length block of little-endian 32-bit integers or floats instead.
+ *
+ * \param parameters The SCPI parameters with the optional selection list.
+ * \param interface The serial interface to write the response to.
+ * \param snapshot The measurement snapshot.
+ */
+static void PrintMeasurements(SCPI_P &parameters, Stream &interface, const measurements_t &snapshot)
+{
+    uint8_t channels[SCPI_ARRAY_SIZE];
+    uint8_t count;
+
+    if (!ParseMeasureChannels(parameters, channels, count))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    uint8_t total = (count == 0) ? MEASURE_CHANNEL_OPTIONS : count;
+    if (dataFormat != DATA_FORMAT_ASCII)
+    {
+        ScpiPrintBlockHeader(interface, total * sizeof(int32_t));
+    }
+    for (uint8_t i = 0; i < total; i++)
+    {
+        uint8_t channel = (count == 0) ? i : channels[i];
+        if (dataFormat == DATA_FORMAT_INTEGER)
+        {
+            int32_t value = MeasurementValue(snapshot, channel);
+            interface.write((const uint8_t *)&value, sizeof(value));
+        }
+        else if (dataFormat == DATA_FORMAT_REAL)
+        {
+            float value = MeasurementValue(snapshot, channel);
+            if (channel <= MEASURE_DUTY)
+            {
+                value /= ScpiPow10(SCPI_MEASURE_DECIMALS);
+            }
+            interface.write((const uint8_t *)&value, sizeof(value));
+        }
+        else
+        {
+            if (i != 0)
+            {
+                interface.print(',');
+            }
+            PrintMeasurement(interface, snapshot, channel);
+        }
+    }
+    interface.println();
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Measures all variables at the same instant.
+ *
+ * This function takes a snapshot of the measured variables with interrupts
+ * briefly disabled and returns them as one comma separated line, in the
+ * order speed, IBUS, IPHU, IPHV, IPHW, voltage, duty cycle, position,
+ * direction, enable and faults. An optional list of variable names selects
+ * the variables and their order, e.g. `MEASure:ALL? SPEEd,IBUS`.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters with the optional selection list.
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureAll(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    MeasurementsSnapshot(&measureSnapshot);
+    measureSnapshotValid = TRUE;
+    PrintMeasurements(parameters, interface, measureSnapshot);
+}
+
+/**
+ * \brief Returns the last snapshot of `MEASure:ALL?` again.
+ *
+ * This function returns the variables of the last `MEASure:ALL?` snapshot
+ * without taking a new one, so several selections can be read from the same
+ * instant. A snapshot is taken if there is none yet.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters with the optional selection list.
+ * \param interface The serial interface to write the response to.
+ */
+static void FetchAll(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    if (measureSnapshotValid == FALSE)
+    {
+        MeasurementsSnapshot(&measureSnapshot);
+        measureSnapshotValid = TRUE;
+    }
+    PrintMeasurements(parameters, interface, measureSnapshot);
+}
+
+/**
+ * \brief Selects the format of the bulk query responses.
+ *
+ * This function reads the format ('ASCii', 'INTeger' or 'REAL') of the
+ * `MEASure:ALL?` and `FETCh?` responses.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the format choice.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureDataFormat(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamChoice(parameters, dataFormats, DATA_FORMAT_OPTIONS, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    dataFormat = param;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the format of the bulk query responses.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetDataFormat(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(dataFormats, DATA_FORMAT_OPTIONS, dataFormat, name);
+    interface.println(name);
+}
+
+#if (TELEMETRY_STREAM == TRUE)
+/**
+ * \brief Variables of the telemetry records, all when the count is 0.
+ */
+static uint8_t telemetryChannels[SCPI_ARRAY_SIZE];
+
+/**
+ * \brief Number of variables in \ref telemetryChannels.
+ */
+static uint8_t telemetryChannelCount = 0;
+
+/**
+ * \brief Format of the telemetry records, one of \ref telemetry_format_t.
+ */
+static uint8_t telemetryFormat = TELEMETRY_FORMAT_ASCII;
+
+/**
+ * \brief Speed controller iterations per telemetry record.
+ */
+static uint16_t telemetryDivider = 1;
+
+/**
+ * \brief Starts or stops the telemetry stream.
+ *
+ * This function reads a boolean parameter from the SCPI command. Starting
+ * the stream discards the queued records and restarts the sequence numbers
+ * at 0, the first record is taken at the next speed controller iteration.
+ * Stopping the stream discards the records not written yet.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the boolean state.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTelemetryStream(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    bool param;
+    if (!ScpiParamBool(parameters, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    cli();
+    telemetryStream.divider = telemetryDivider;
+    telemetryStream.countdown = 1;
+    telemetryStream.sequence = 0;
+    telemetryStream.tail = telemetryStream.head;
+    telemetryStream.enable = param ? TRUE : FALSE;
+    sei();
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the telemetry stream state.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetTelemetryStream(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    interface.println(telemetryStream.enable);
+}
+
+/**
+ * \brief Configures the telemetry record rate.
+ *
+ * This function reads the rate in Hz from the SCPI command, up to the speed
+ * controller rate of the gate drive frequency divided by \ref
+ * SPEED_CONTROLLER_TIME_BASE. Records are taken every whole number of speed
+ * controller iterations, the nearest to the requested rate.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the rate.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTelemetryRate(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint32_t param;
+    uint32_t frequency = motorConfigs.tim4Freq;
+
+    if (!ScpiParamUInt32(parameters, param) || (param == 0) || (param > frequency / SPEED_CONTROLLER_TIME_BASE))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    uint32_t divider = (frequency + param * SPEED_CONTROLLER_TIME_BASE / 2) / (param * SPEED_CONTROLLER_TIME_BASE);
+    telemetryDivider = (divider > UINT16_MAX) ? UINT16_MAX : divider;
+
+    cli();
+    telemetryStream.divider = telemetryDivider;
+    if (telemetryStream.countdown > telemetryDivider)
+    {
+        telemetryStream.countdown = telemetryDivider;
+    }
+    sei();
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the telemetry record rate.
+ *
+ * This function returns the rate in Hz at the present gate drive frequency,
+ * with `SCPI_MEASURE_DECIMALS` decimal places.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetTelemetryRate(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint32_t divisor = (uint32_t)telemetryDivider * SPEED_CONTROLLER_TIME_BASE;
+    ScpiPrintFixed(interface, (motorConfigs.tim4Freq * ScpiPow10(SCPI_MEASURE_DECIMALS) + divisor / 2) / divisor);
+    interface.println();
+}
+
+/**
+ * \brief Configures the telemetry record format.
+ *
+ * This function reads a choice parameter ('ASCii' or 'BINary') from the SCPI
+ * command.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the format choice.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTelemetryFormat(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamChoice(parameters, telemetryFormats, TELEMETRY_FORMAT_OPTIONS, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    telemetryFormat = param;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the telemetry record format.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetTelemetryFormat(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(telemetryFormats, TELEMETRY_FORMAT_OPTIONS, telemetryFormat, name);
+    interface.println(name);
+}
+
+/**
+ * \brief Selects the variables of the telemetry records.
+ *
+ * This function reads a list of up to \ref SCPI_ARRAY_SIZE variable names,
+ * as for `MEASure:ALL?`, which select the variables and their order. All
+ * variables are selected without parameters.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters with the list of variables.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTelemetryVariables(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t channels[SCPI_ARRAY_SIZE];
+    uint8_t count;
+
+    if (!ParseMeasureChannels(parameters, channels, count))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    memcpy(telemetryChannels, channels, count);
+    telemetryChannelCount = count;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the variables of the telemetry records.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetTelemetryVariables(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t total = (telemetryChannelCount == 0) ? MEASURE_CHANNEL_OPTIONS : telemetryChannelCount;
+    for (uint8_t i = 0; i < total; i++)
+    {
+        char name[SCPI_CHOICE_NAME_LENGTH];
+        ScpiChoiceToName(measureChannelNames, MEASURE_CHANNEL_OPTIONS, (telemetryChannelCount == 0) ? i : telemetryChannels[i], name);
+        if (i != 0)
+        {
+            interface.print(',');
+        }
+        interface.print(name);
+    }
+    interface.println();
+}
+
+/**
+ * \brief Writes the oldest queued telemetry record.
+ *
+ * One record is written per call, once the last response or record has been
+ * sent, so records and responses take turns. A record that does not fit in
+ * the response buffer is dropped.
+ *
+ * An ASCII record is the line `<sequence>,<timestamp>,<variables>` with the
+ * variables as for `MEASure:ALL?`. A binary record starts with \ref
+ * TELEMETRY_RECORD_START and the number of bytes that follow, then the
+ * sequence number as 16-bit, the timestamp as 32-bit and every variable as
+ * a 32-bit integer of \ref MeasurementValue(), all little-endian.
+ *
+ * \param interface The serial interface to write the record to.
+ */
+static void TelemetryOutput(Stream &interface)
+{
+    uint8_t tail = telemetryStream.tail;
+    if (tail == telemetryStream.head)
+    {
+        return;
+    }
+
+    Stream *output = scpiParser.BeginOutput(interface);
+    if (output == NULL)
+    {
+        return;
+    }
+
+    // The record is not overwritten before the tail moves on.
+    const telemetryrecord_t &record = telemetryStream.records[tail & (TELEMETRY_QUEUE_LENGTH - 1)];
+    uint8_t total = (telemetryChannelCount == 0) ? MEASURE_CHANNEL_OPTIONS : telemetryChannelCount;
+
+    if (telemetryFormat == TELEMETRY_FORMAT_BINARY)
+    {
+        output->write(TELEMETRY_RECORD_START);
+        output->write((uint8_t)(sizeof(record.sequence) + sizeof(record.timestamp) + total * sizeof(int32_t)));
+        output->write((const uint8_t *)&record.sequence, sizeof(record.sequence));
+        output->write((const uint8_t *)&record.timestamp, sizeof(record.timestamp));
+        for (uint8_t i = 0; i < total; i++)
+        {
+            int32_t value = MeasurementValue(record.measurements, (telemetryChannelCount == 0) ? i : telemetryChannels[i]);
+            output->write((const uint8_t *)&value, sizeof(value));
+        }
+    }
+    else
+    {
+        output->print(record.sequence);
+        output->print(',');
+        output->print(record.timestamp);
+        for (uint8_t i = 0; i < total; i++)
+        {
+            output->print(',');
+            PrintMeasurement(*output, record.measurements, (telemetryChannelCount == 0) ? i : telemetryChannels[i]);
+        }
+        output->println();
+    }
+
+    telemetryStream.tail = tail + 1;
+    scpiParser.EndOutput();
+}
+#endif
+
+#if (WAVEFORM_CAPTURE == TRUE)
+/**
+ * \brief Variables of the next waveform capture.
+ */
+static uint8_t captureChannels[CAPTURE_CHANNELS] = {CAPTURE_IBUS};
+
+/**
+ * \brief Number of variables of the next waveform capture.
+ */
+static uint8_t captureChannelCount = 1;
+
+/**
+ * \brief PWM periods per sample of the next waveform capture.
+ */
+static uint8_t captureDecimation = 1;
+
+/**
+ * \brief Pre-trigger samples of the next waveform capture.
+ */
+static uint16_t capturePretrigger = CAPTURE_LENGTH / 2;
+
+/**
+ * \brief Trigger source of the next waveform capture, a \ref capture_trigger_t.
+ */
+static uint8_t captureSource = CAPTURE_TRIGGER_BUS;
+
+/**
+ * \brief Variable compared with the trigger level.
+ */
+static uint8_t captureLevelChannel = CAPTURE_IBUS;
+
+/**
+ * \brief Trigger level in the register unit of \ref captureLevelChannel.
+ */
+static int16_t captureLevel = 0;
+
+/**
+ * \brief Trigger slope, TRUE for rising.
+ */
+static uint8_t captureRising = TRUE;
+
+/**
+ * \brief Index of the next sample of the `ACQuire:DATA?` block to write.
+ */
+static uint16_t captureReadIndex;
+
+/**
+ * \brief Samples of the `ACQuire:DATA?` block still to write.
+ */
+static uint16_t captureReadCount;
+
+/**
+ * \brief TRUE while an `ACQuire:DATA?` block is not complete.
+ */
+static uint8_t captureReading = FALSE;
+
+/**
+ * \brief Arms or stops the waveform capture.
+ *
+ * This function reads a boolean parameter. `ON` clears the buffer and arms
+ * the capture with the present settings, so changed settings take effect at
+ * the next arming. `OFF` stops a running capture.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the state.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureAcquireState(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    bool param;
+
+    if (!ScpiParamBool(parameters, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    // The currents and the voltage are converted by the ADC for every sample.
+    uint8_t adcVariables = 0;
+    for (uint8_t i = 0; i < captureChannelCount; i++)
+    {
+        adcVariables |= 1 << captureChannels[i];
+    }
+    if (captureSource == CAPTURE_TRIGGER_LEVEL)
+    {
+        adcVariables |= 1 << captureLevelChannel;
+    }
+    adcVariables &= (1 << (CAPTURE_VOLTAGE + 1)) - 1;
+
+    // Writing the settings used by interrupts so disabling interrupts for
+    // atomic operation
+    cli();
+    capture.state = CAPTURE_STATE_IDLE;
+    if (param)
+    {
+        memcpy(capture.channels, captureChannels, sizeof(captureChannels));
+        capture.channelCount = captureChannelCount;
+        capture.decimation = captureDecimation;
+        capture.pretrigger = capturePretrigger;
+        capture.source = captureSource;
+        capture.levelChannel = captureLevelChannel;
+        capture.level = captureLevel;
+        capture.rising = captureRising;
+        capture.adcVariables = adcVariables;
+        capture.previous = 0;
+        capture.force = FALSE;
+        capture.countdown = 1;
+        capture.count = 0;
+        capture.index = 0;
+        capture.state = CAPTURE_STATE_ARMED;
+    }
+    sei();
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the waveform capture state.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetAcquireState(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(captureStates, CAPTURE_STATE_OPTIONS, capture.state, name);
+    interface.println(name);
+}
+
+/**
+ * \brief Selects the variables of the waveform capture.
+ *
+ * This function reads a list of 1 to \ref CAPTURE_CHANNELS variable names
+ * of \ref captureVariableNames, in the order they are stored in a sample.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters with the list of variables.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureAcquireVariables(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t channels[CAPTURE_CHANNELS];
+    uint8_t count = parameters.Size();
+
+    if ((count == 0) || (count > CAPTURE_CHANNELS))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    // Parameters are popped from the last one
+    for (uint8_t i = count; i > 0; i--)
+    {
+        if (!ScpiParamChoice(parameters, captureVariableNames, CAPTURE_VARIABLE_OPTIONS, channels[i - 1]))
+        {
+            scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+            return;
+        }
+    }
+    memcpy(captureChannels, channels, count);
+    captureChannelCount = count;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the variables of the waveform capture.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetAcquireVariables(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    for (uint8_t i = 0; i < captureChannelCount; i++)
+    {
+        char name[SCPI_CHOICE_NAME_LENGTH];
+        ScpiChoiceToName(captureVariableNames, CAPTURE_VARIABLE_OPTIONS, captureChannels[i], name);
+        if (i != 0)
+        {
+            interface.print(',');
+        }
+        interface.print(name);
+    }
+    interface.println();
+}
+
+/**
+ * \brief Configures the waveform capture decimation.
+ *
+ * This function reads the number of PWM periods per sample, `1` to `255`.
+ * At `1` a sample is taken every PWM period.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the decimation.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureAcquireDecimation(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamUInt8(parameters, param) || (param == 0))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    captureDecimation = param;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the waveform capture decimation in PWM periods per sample.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetAcquireDecimation(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    interface.println(captureDecimation);
+}
+
+/**
+ * \brief Configures the pretrigger depth of the capture.
+ *
+ * This function reads the number of samples kept before the trigger, which
+ * is the index of the trigger sample, `0` to \ref CAPTURE_LENGTH - 1. The
+ * trigger is only accepted once these samples have been taken.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the depth.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTriggerPretrigger(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint32_t param;
+
+    if (!ScpiParamUInt32(parameters, param) || (param >= CAPTURE_LENGTH))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    capturePretrigger = param;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the pretrigger depth of the capture.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetTriggerPretrigger(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    interface.println(capturePretrigger);
+}
+
+/**
+ * \brief Retrieves the number of samples of a capture, \ref CAPTURE_LENGTH.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetAcquirePoints(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    interface.println(CAPTURE_LENGTH);
+}
+
+/**
+ * \brief Converts a captured register value to the unit of its variable.
+ *
+ * Currents in A, voltage in V and duty cycle in percent, as the single
+ * measurement queries. The hall sensor state is returned as it is.
+ *
+ * \param variable The variable, one of \ref capture_variable_t.
+ * \param raw The captured register value.
+ * \return The value in the unit of the variable.
+ */
+static float CaptureUnitValue(uint8_t variable, int16_t raw)
+{
+    int32_t value;
+    switch (variable)
+    {
+    case CAPTURE_IBUS:
+        value = ScpiFixedMultiply(raw, scpiScaleIbus);
+        break;
+    case CAPTURE_IPHASE_U:
+    case CAPTURE_IPHASE_V:
+    case CAPTURE_IPHASE_W:
+        value = ScpiFixedMultiply(raw - 511, scpiScaleIphase);
+        break;
+    case CAPTURE_VOLTAGE:
+        value = ScpiFixedMultiply(raw, scpiScaleVbus);
+        break;
+    case CAPTURE_DUTY:
+        value = ((uint32_t)raw * 100 * ScpiPow10(SCPI_MEASURE_DECIMALS)) / motorConfigs.tim4Top;
+        break;
+    default:
+        return raw;
+    }
+    return (float)value / ScpiPow10(SCPI_MEASURE_DECIMALS);
+}
+
+/**
+ * \brief Reads out samples of a completed waveform capture.
+ *
+ * This function reads the optional index of the first sample, default `0`
+ * for the oldest, and the optional number of samples, default all. The
+ * samples are returned oldest first as a definite-length block, every sample
+ * holding the captured variables in their selected order. The trigger sample
+ * has the index set with `TRIGger:PRETrigger`.
+ *
+ * With `FORMat:DATA REAL` every value is a little-endian 32-bit float in the
+ * unit of the variable, otherwise it is the little-endian signed 16-bit
+ * register value. The samples that fit in the response buffer are written
+ * here, the rest by \ref CaptureOutput() as the buffer is sent.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters with the optional index and count.
+ * \param interface The serial interface to write the response to.
+ */
+static void GetAcquireData(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t size = parameters.Size();
+    uint32_t start = 0;
+    uint32_t count = CAPTURE_LENGTH;
+
+    // Parameters are popped from the last one
+    if ((capture.state != CAPTURE_STATE_DONE) || (size > 2) ||
+        ((size == 2) && (!ScpiParamUInt32(parameters, count) || (count == 0))) ||
+        ((size >= 1) && (!ScpiParamUInt32(parameters, start) || (start >= CAPTURE_LENGTH))))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+
+    uint8_t valueSize = (dataFormat == DATA_FORMAT_REAL) ? sizeof(float) : sizeof(int16_t);
+    if (count > CAPTURE_LENGTH - start)
+    {
+        count = CAPTURE_LENGTH - start;
+    }
+
+    ScpiPrintBlockHeader(interface, count * capture.channelCount * valueSize);
+    captureReadIndex = start;
+    captureReadCount = count;
+    captureReading = !CaptureWrite(interface);
+}
+
+/**
+ * \brief Writes the next samples of the `ACQuire:DATA?` block.
+ *
+ * Only whole samples are written, as many as there is room for in \p
+ * output without waiting for the interface. The line terminator follows the
+ * last sample.
+ *
+ * \param output The stream to write the samples to.
+ * \return true if the block is complete, false if samples are left.
+ */
+static bool CaptureWrite(Stream &output)
+{
+    uint8_t valueSize = (dataFormat == DATA_FORMAT_REAL) ? sizeof(float) : sizeof(int16_t);
+    uint8_t sampleSize = capture.channelCount * valueSize;
+
+    while ((captureReadCount > 0) && (output.availableForWrite() >= sampleSize))
+    {
+        const int16_t *sample = capture.samples[(capture.index + captureReadIndex) & (CAPTURE_LENGTH - 1)];
+        if (dataFormat == DATA_FORMAT_REAL)
+        {
+            for (uint8_t i = 0; i < capture.channelCount; i++)
+            {
+                float value = CaptureUnitValue(capture.channels[i], sample[i]);
+                output.write((const uint8_t *)&value, sizeof(value));
+            }
+        }
+        else
+        {
+            output.write((const uint8_t *)sample, sampleSize);
+        }
+        captureReadIndex++;
+        captureReadCount--;
+    }
+
+    if ((captureReadCount > 0) || (output.availableForWrite() < 2))
+    {
+        return false;
+    }
+    output.println();
+    return true;
+}
+
+/**
+ * \brief Writes the rest of an `ACQuire:DATA?` block.
+ *
+ * Once the response buffer has been sent, it is filled with the next
+ * samples, so a capture of any size is read out with one query without ever
+ * waiting for the interface.
+ *
+ * \param interface The serial interface to write the samples to.
+ * \return true while the block is being written, false otherwise.
+ */
+static bool CaptureOutput(Stream &interface)
+{
+    if (captureReading == FALSE)
+    {
+        return false;
+    }
+
+    Stream *output = scpiParser.BeginOutput(interface);
+    if (output == NULL)
+    {
+        return true;
+    }
+    captureReading = !CaptureWrite(*output);
+    scpiParser.EndOutput();
+    return true;
+}
+
+/**
+ * \brief Configures the waveform capture trigger source.
+ *
+ * This function reads a choice parameter ('LEVel', 'HALL', 'FAULt' or 'BUS').
+ * With 'BUS' only `TRIGger:IMMediate` triggers the capture.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the source choice.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTriggerSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamChoice(parameters, triggerSources, TRIGGER_SOURCE_OPTIONS, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    captureSource = param;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the waveform capture trigger source.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetTriggerSource(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(triggerSources, TRIGGER_SOURCE_OPTIONS, captureSource, name);
+    interface.println(name);
+}
+
+/**
+ * \brief Configures the level trigger.
+ *
+ * This function reads the variable to compare, as for `ACQuire:VARiables`,
+ * and the level in its register unit, as returned by `ACQuire:DATA?`.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the variable and level.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTriggerLevel(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    int32_t level;
+    uint8_t channel;
+
+    // Parameters are popped from the last one
+    if ((parameters.Size() != 2) || !ScpiParamInt32(parameters, level) || (level < INT16_MIN) || (level > INT16_MAX) ||
+        !ScpiParamChoice(parameters, captureVariableNames, CAPTURE_VARIABLE_OPTIONS, channel))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    captureLevelChannel = channel;
+    captureLevel = level;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the level trigger as `<variable>,<level>`.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
  */
-static void MeasureMotorCurrentPhaseW(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void GetTriggerLevel(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    interface.println(((double)(iphaseW - 511) * 5.0 * 1000000.0) / ((double)1023.0 * IPHASE_GAIN * IPHASE_SENSE_RESISTOR));
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(captureVariableNames, CAPTURE_VARIABLE_OPTIONS, captureLevelChannel, name);
+    interface.print(name);
+    interface.print(',');
+    interface.println(captureLevel);
 }
 
 /**
- * \brief Measures and reports the current direction of the motor.
+ * \brief Configures the slope of the level trigger.
  *
- * This function checks the `motorFlags.actualDirection` and returns a textual
- * representation ('FORW', 'REVE', or 'UNKN') based on the motor's sensed
- * direction.
+ * This function reads a choice parameter ('POSitive' for a rising or
+ * 'NEGative' for a falling level crossing).
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the slope choice.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigureTriggerSlope(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamChoice(parameters, triggerSlopes, TRIGGER_SLOPE_OPTIONS, param))
+    {
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
+    }
+    captureRising = (param == TRIGGER_SLOPE_POSITIVE);
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the slope of the level trigger.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
  * \param interface The serial interface to write the response to.
  */
-static void MeasureMotorDirection(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void GetTriggerSlope(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    char name[SCPI_CHOICE_NAME_LENGTH];
+    ScpiChoiceToName(triggerSlopes, TRIGGER_SLOPE_OPTIONS, captureRising ? TRIGGER_SLOPE_POSITIVE : TRIGGER_SLOPE_NEGATIVE, name);
+    interface.println(name);
+}
+
+/**
+ * \brief Triggers an armed waveform capture now.
+ *
+ * Works with every trigger source. The trigger is taken once the pre-trigger
+ * samples are in the buffer. An error is reported when the capture is not
+ * armed.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface (not used).
+ */
+static void TriggerImmediate(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    if (motorFlags.actualDirection == DIRECTION_UNKNOWN)
+    if (capture.state != CAPTURE_STATE_ARMED)
     {
-        interface.println(F("UNKN"));
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
-    else
+    capture.force = TRUE;
+    scpiParser.last_error = ErrorCode::NoError;
+}
+#endif
+
+#if (FRAMED_PROTOCOL == TRUE)
+static_assert(FRAME_SNAPSHOT_VALUES == MEASURE_CHANNEL_OPTIONS, "The snapshot response must hold all measured variables");
+static_assert(FRAME_MAX_PACKET < 254, "Packets must be shorter than 254 bytes");
+
+/**
+ * \brief Returns the serial interface to SCPI.
+ *
+ * Called by the main loop when a break is received on the serial interface.
+ */
+void ScpiBreak(void)
+{
+    frameProtocol = PROTOCOL_SCPI;
+}
+
+/**
+ * \brief Switches the serial interface protocol.
+ *
+ * This function reads a choice parameter ('SCPI' or 'BINary'). With 'BINary'
+ * the data received after this message is read as binary frames, until a
+ * serial break, an exit request or \ref FRAME_TIMEOUT without a valid frame.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the protocol choice.
+ * \param interface The serial interface (not used).
+ */
+static void ScpiSystemProtocol(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint8_t param;
+
+    if (!ScpiParamChoice(parameters, protocols, PROTOCOL_OPTIONS, param))
     {
-        String name;
-        ScpiChoiceToName(motorDirections, MOTOR_DIRECTION_OPTIONS, motorFlags.actualDirection, name);
-        interface.println(name);
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
+    frameLength = 0;
+    frameTime = millis();
+    frameProtocol = param;
+    scpiParser.last_error = ErrorCode::NoError;
 }
 
 /**
- * \brief Measures and returns the VBUS voltage of the motor.
+ * \brief Carries out one request of the framed binary protocol.
  *
- * This function reads the ADC value for the VBUS voltage reference and converts
- * it to Volts using the voltage divider resistor values.
+ * \param type The request type, one of the FRAME_* request values.
+ * \param payload The request payload.
+ * \param size The length of the payload.
+ * \param reply Buffer for the response payload.
+ * \param replySize The length of the response payload.
+ * \return The response status, one of the FRAME_STATUS_* values.
+ */
+static uint8_t FrameRequest(uint8_t type, const uint8_t *payload, uint8_t size, uint8_t *reply, uint8_t &replySize)
+{
+    replySize = 0;
+    switch (type)
+    {
+    case FRAME_SET_POINT:
+    {
+        frameSetPoint_t request;
+        if (size != sizeof(request))
+        {
+            return FRAME_STATUS_TYPE;
+        }
+        memcpy(&request, payload, sizeof(request));
+        if (motorConfigs.controlMethod == SPEED_CONTROL_POSITION)
+        {
+            positionTarget = request.value;
+        }
+        else if ((motorConfigs.speedInputSource == SPEED_INPUT_SOURCE_REMOTE) && (request.value >= 0) && (request.value <= SPEED_CONTROLLER_MAX_INPUT))
+        {
+            speedInput = request.value;
+        }
+        else
+        {
+            return FRAME_STATUS_PARAMETER;
+        }
+        return FRAME_STATUS_OK;
+    }
+    case FRAME_ENABLE:
+    {
+        frameEnable_t request;
+        if (size != sizeof(request))
+        {
+            return FRAME_STATUS_TYPE;
+        }
+        memcpy(&request, payload, sizeof(request));
+        if (request.enable > 1)
+        {
+            return FRAME_STATUS_PARAMETER;
+        }
+        RemoteEnable(request.enable);
+        return FRAME_STATUS_OK;
+    }
+    case FRAME_DIRECTION:
+    {
+        frameDirection_t request;
+        if (size != sizeof(request))
+        {
+            return FRAME_STATUS_TYPE;
+        }
+        memcpy(&request, payload, sizeof(request));
+        if (request.direction > DIRECTION_REVERSE)
+        {
+            return FRAME_STATUS_PARAMETER;
+        }
+        RemoteDirection(request.direction);
+        return FRAME_STATUS_OK;
+    }
+    case FRAME_MEASURE:
+    {
+        if (size != 0)
+        {
+            return FRAME_STATUS_TYPE;
+        }
+        measurements_t snapshot;
+        frameSnapshot_t response;
+        MeasurementsSnapshot(&snapshot);
+        for (uint8_t i = 0; i < FRAME_SNAPSHOT_VALUES; i++)
+        {
+            response.values[i] = MeasurementValue(snapshot, i);
+        }
+        memcpy(reply, &response, sizeof(response));
+        replySize = sizeof(response);
+        return FRAME_STATUS_OK;
+    }
+    case FRAME_EXIT:
+        if (size != 0)
+        {
+            return FRAME_STATUS_TYPE;
+        }
+        frameProtocol = PROTOCOL_SCPI;
+        return FRAME_STATUS_OK;
+    }
+    return FRAME_STATUS_TYPE;
+}
+
+/**
+ * \brief Answers the frame in \ref frameBuffer.
+ *
+ * Frames that cannot be decoded, are too short or fail the CRC are answered
+ * with type \ref FRAME_ERROR and status \ref FRAME_STATUS_CRC. The others are
+ * carried out and answered with the request type with \ref FRAME_RESPONSE
+ * set, the status and the response payload.
+ *
+ * \param output The stream to write the response frame to.
+ */
+static void FrameExecute(Print &output)
+{
+    uint8_t packet[FRAME_MAX_PACKET];
+    uint8_t response[FRAME_MAX_PACKET];
+    frameResponse_t header = {FRAME_ERROR, FRAME_STATUS_CRC};
+    uint8_t size = 0;
+
+    uint8_t length = (frameLength <= FRAME_MAX_LENGTH) ? FrameDecode(frameBuffer, frameLength, packet) : 0;
+    if (length > FRAME_CRC_LENGTH)
+    {
+        length -= FRAME_CRC_LENGTH;
+        uint16_t crc = packet[length] | ((uint16_t)packet[length + 1] << 8);
+        if (FrameCrc(packet, length) == crc)
+        {
+            frameTime = millis();
+            header.type = packet[0] | FRAME_RESPONSE;
+            header.status = FrameRequest(packet[0], &packet[1], length - 1, &response[sizeof(header)], size);
+        }
+    }
+
+    memcpy(response, &header, sizeof(header));
+    size += sizeof(header);
+    uint16_t crc = FrameCrc(response, size);
+    response[size++] = crc & 0xFF;
+    response[size++] = crc >> 8;
+
+    // The request has been decoded, so its buffer holds the response frame.
+    output.write(frameBuffer, FrameEncode(response, size, frameBuffer));
+    output.write((uint8_t)FRAME_DELIMITER);
+}
+
+/**
+ * \brief Reads and answers the frames of the framed binary protocol.
+ *
+ * Bytes are read up to the end of one frame per call, once the last response
+ * has been sent, so the responses are never delayed by the interface. Empty
+ * frames are skipped, so a host can send a delimiter to resynchronise. After
+ * \ref FRAME_TIMEOUT without a valid frame the interface returns to SCPI.
+ *
+ * \param interface The serial interface to read the frames from and write
+ * the responses to.
+ */
+static void FrameInput(Stream &interface)
+{
+    if ((millis() - frameTime) > FRAME_TIMEOUT)
+    {
+        frameProtocol = PROTOCOL_SCPI;
+        return;
+    }
+
+    Stream *output = scpiParser.BeginOutput(interface);
+    if (output == NULL)
+    {
+        return;
+    }
+
+    // The data received with the SYSTem:PROTocol message is still queued by
+    // the SCPI parser, so it is read first
+    int c;
+    while (((c = scpiParser.ReadQueued()) >= 0) || ((c = interface.read()) >= 0))
+    {
+        if (c != FRAME_DELIMITER)
+        {
+            if (frameLength < FRAME_MAX_LENGTH)
+            {
+                frameBuffer[frameLength] = c;
+            }
+            if (frameLength < UINT8_MAX)
+            {
+                frameLength++;
+            }
+        }
+        else if (frameLength != 0)
+        {
+            FrameExecute(*output);
+            frameLength = 0;
+            break;
+        }
+    }
+    scpiParser.EndOutput();
+}
+#endif
+
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+/**
+ * \brief Measures the stopping time and regenerated energy of the last braking.
+ *
+ * The stopping time runs from the start of braking to the last hall sensor
+ * change. The energy is the sum of VBUS times IBUS over the speed controller
+ * iterations while braking. Both are updated while braking is in progress.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
  * \param interface The serial interface to write the response to.
  */
-static void MeasureMotorVoltage(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void MeasureBrake(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    interface.println(((double)vbusVref * 5.0 * (VBUS_RTOP + VBUS_RBOTTOM)) / ((double)1023.0 * VBUS_RBOTTOM));
+    // Reading 32 bit values updated by interrupts so disabling interrupts for
+    // atomic operation
+    cli();
+    uint32_t ticks = brakeReport.ticks;
+    uint32_t energy = brakeReport.energy;
+    sei();
+
+    uint32_t frequency = motorConfigs.tim4Freq;
+
+    // Stopping time in milliseconds.
+    ScpiPrintFixed(interface, ((uint64_t)ticks * 1000 * ScpiPow10(SCPI_MEASURE_DECIMALS) + frequency / 2) / frequency);
+    interface.print(',');
+    // Energy in millijoules, every sum holds 16 x VBUS x IBUS register values
+    // for one speed controller iteration.
+    uint64_t energyScaled = ((uint64_t)energy * scpiScalePower) / frequency;
+    energyScaled = (energyScaled * 16 * 1000) >> (SCPI_POWER_SHIFT - SCPI_FIXED_SHIFT);
+    ScpiPrintFixed(interface, (energyScaled * SPEED_CONTROLLER_TIME_BASE + (1UL << (SCPI_FIXED_SHIFT - 1))) >> SCPI_FIXED_SHIFT);
+    interface.println();
 }
+#endif
 
+#if (THERMAL_MODEL == TRUE)
 /**
- * \brief Measures and returns the gate PWM duty cycle as a percentage.
+ * \brief Measures and returns the remaining thermal budget.
  *
- * This function reads the current PWM duty cycle from Timer4's compare register
- * (OCR4A) and calculates the percentage relative to the timer's top value.
- * Interrupts are briefly disabled to ensure atomic reading of the 16-bit duty
- * cycle value.
+ * This function returns `<motor>,<mosfet>` with the remaining budget of the
+ * motor and MOSFET thermal models in percent. The output is derated once
+ * either is below `THERMAL_DERATE_BUDGET`.
  *
  * \param commands The SCPI commands (not used).
  * \param parameters The SCPI parameters (not used).
  * \param interface The serial interface to write the response to.
  */
-static void MeasureGateDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &interface)
+static void MeasureThermal(SCPI_C commands, SCPI_P parameters, Stream &interface)
 {
-    if (motorFlags.enable == TRUE)
-    {
-        // Reading 16 bit register so disabling interrupts for atomic operation
-        cli();
-        uint16_t duty = 0xff & OCR4A;
-        duty |= (0x03 & TC4H) << 8;
-        sei();
+    interface.print(ThermalModelBudget(&motorThermal));
+    interface.print(',');
+    interface.println(ThermalModelBudget(&mosfetThermal));
+}
+#endif
 
-        interface.println((double)duty / (double)motorConfigs.tim4Top * 100.0);
-    }
-    else
+#if (POWER_METER == TRUE)
+/**
+ * \brief Measures and returns the average and peak electrical power.
+ *
+ * This function returns `<average>,<peak>` in watts over the last complete
+ * window set by `MEASure:POWer:WINDow`. The power is VBUS times IBUS, measured
+ * at the supply.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasurePower(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    // Reading 32 bit values updated by interrupts so disabling interrupts for
+    // atomic operation
+    cli();
+    uint32_t sum = powerMeter.sum;
+    uint16_t samples = powerMeter.samples;
+    uint32_t peak = powerMeter.peak;
+    sei();
+
+    // The average is divided out here, not in the ADC interrupt.
+    uint32_t average = (samples != 0) ? (sum / samples) : 0;
+
+    ScpiPrintFixed(interface, ((uint64_t)average * scpiScalePower + (1UL << (SCPI_POWER_SHIFT - 1))) >> SCPI_POWER_SHIFT);
+    interface.print(',');
+    ScpiPrintFixed(interface, ((uint64_t)peak * scpiScalePower + (1UL << (SCPI_POWER_SHIFT - 1))) >> SCPI_POWER_SHIFT);
+    interface.println();
+}
+
+/**
+ * \brief Configures the power metering window.
+ *
+ * This function reads the window in milliseconds from the SCPI command, in the
+ * range `POWER_WINDOW_MIN` to `POWER_WINDOW_MAX`. The present window is
+ * discarded, so the next average and peak cover the new window completely.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters containing the window.
+ * \param interface The serial interface (not used).
+ */
+static void ConfigurePowerWindow(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    uint32_t param;
+
+    if (!ScpiParamUInt32(parameters, param) || (param < POWER_WINDOW_MIN) || (param > POWER_WINDOW_MAX))
     {
-        interface.println(0.0);
+        scpiParser.last_error = ErrorCode::MissingOrInvalidParameter;
+        return;
     }
+
+    cli();
+    motorConfigs.powerWindow = POWER_WINDOW_SAMPLES(param);
+    powerMeter.windowSum = 0;
+    powerMeter.windowPeak = 0;
+    powerMeter.windowSamples = 0;
+    sei();
+    scpiParser.last_error = ErrorCode::NoError;
+}
+
+/**
+ * \brief Retrieves the power metering window.
+ *
+ * This function returns the window in milliseconds. It is a whole number of
+ * VBUS and IBUS measurement pairs, so it can be slightly shorter than the
+ * window that was set.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void GetPowerWindow(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    interface.println((motorConfigs.powerWindow * 1000UL) / (ADC_SAMPLE_RATE / ADC_CHANNELS));
+}
+
+/**
+ * \brief Measures and returns the electrical energy drawn from the supply.
+ *
+ * This function returns the energy in millijoules since power up or the last
+ * `MEASure:ENERgy:RESet`. The conversion uses 64 bit integers only, so the
+ * count is exact however large it gets.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface to write the response to.
+ */
+static void MeasureEnergy(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    // Reading 64 bit values updated by interrupts so disabling interrupts for
+    // atomic operation
+    cli();
+    uint64_t energy = powerMeter.energy;
+    sei();
+
+    // Print does not handle 64 bit values.
+    ScpiPrintFixed(interface, (energy << 8) / POWER_UNITS_PER_MJ_Q8, 0);
+    interface.println();
+}
+
+/**
+ * \brief Resets the electrical energy count to zero.
+ *
+ * \param commands The SCPI commands (not used).
+ * \param parameters The SCPI parameters (not used).
+ * \param interface The serial interface (not used).
+ */
+static void ResetEnergy(SCPI_C commands, SCPI_P parameters, Stream &interface)
+{
+    cli();
+    powerMeter.energy = 0;
+    sei();
+    scpiParser.last_error = ErrorCode::NoError;
 }
+#endif
 
 /**
  * \brief Array defining the possible motor directions for SCPI commands.
@@ -702,7 +2968,7 @@ static void MeasureGateDutyCycle(SCPI_C commands, SCPI_P parameters, Stream &int
  * associates a textual representation with a numerical value defined elsewhere
  * (e.g., `DIRECTION_FORWARD`, `DIRECTION_REVERSE`).
  */
-const SCPI_choice_def_t motorDirections[MOTOR_DIRECTION_OPTIONS] = {
+const SCPI_choice_def_t motorDirections[MOTOR_DIRECTION_OPTIONS] PROGMEM = {
     {"FORW", "ard", DIRECTION_FORWARD},
     {"REVE", "rse", DIRECTION_REVERSE},
 };
@@ -715,7 +2981,190 @@ const SCPI_choice_def_t motorDirections[MOTOR_DIRECTION_OPTIONS] = {
  * Each entry associates a textual representation with a numerical value
  * (e.g., `SPEED_INPUT_SOURCE_LOCAL`, `SPEED_INPUT_SOURCE_REMOTE`).
  */
-const SCPI_choice_def_t inputSources[INPUT_SOURCE_OPTIONS] = {
+const SCPI_choice_def_t inputSources[INPUT_SOURCE_OPTIONS] PROGMEM = {
     {"LOCA", "l", SPEED_INPUT_SOURCE_LOCAL},
     {"REMO", "te", SPEED_INPUT_SOURCE_REMOTE},
 };
+
+/**
+ * \brief Array defining the measurement filter channels for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret the measurement channel
+ * of a filter command ('IBUS', 'VBUS', 'SPEEd' for the speed estimate and
+ * 'INPut' for the local speed input).
+ */
+const SCPI_choice_def_t filterChannelNames[FILTER_CHANNEL_OPTIONS] PROGMEM = {
+    {"IBUS", "", FILTER_CHANNEL_IBUS},
+    {"VBUS", "", FILTER_CHANNEL_VBUS},
+    {"SPEE", "d", FILTER_CHANNEL_SPEED},
+    {"INP", "ut", FILTER_CHANNEL_INPUT},
+};
+
+/**
+ * \brief Array defining the measurement filter types for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the type
+ * of a measurement filter.
+ */
+const SCPI_choice_def_t filterTypeNames[FILTER_TYPE_OPTIONS] PROGMEM = {
+    {"NONE", "", FILTER_TYPE_NONE},
+    {"EMA", "", FILTER_TYPE_EMA},
+    {"AVER", "age", FILTER_TYPE_AVERAGE},
+    {"MED3", "", FILTER_TYPE_MEDIAN3},
+    {"MED5", "", FILTER_TYPE_MEDIAN5},
+    {"BIQ", "uad", FILTER_TYPE_BIQUAD},
+    {"RATE", "", FILTER_TYPE_RATE_LIMIT},
+};
+
+/**
+ * \brief Array defining the possible PID tuning rules for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret the tuning rule of the
+ * PID auto-tune ('ZN' for Ziegler-Nichols, 'TL' for Tyreus-Luyben).
+ */
+const SCPI_choice_def_t pidTuneRules[PID_TUNE_RULE_OPTIONS] PROGMEM = {
+    {"ZN", "", PID_TUNE_RULE_ZIEGLER_NICHOLS},
+    {"TL", "", PID_TUNE_RULE_TYREUS_LUYBEN},
+};
+
+/**
+ * \brief Array defining the PID auto-tune states for SCPI queries.
+ *
+ * This array is used to represent the state of the PID auto-tune ('IDLE',
+ * 'RUNNING', 'DONE' or 'FAILED').
+ */
+const SCPI_choice_def_t pidAutoTuneStates[PID_AUTOTUNE_STATE_OPTIONS] PROGMEM = {
+    {"IDLE", "", PID_AUTOTUNE_IDLE},
+    {"RUNN", "ing", PID_AUTOTUNE_RUNNING},
+    {"DONE", "", PID_AUTOTUNE_DONE},
+    {"FAIL", "ed", PID_AUTOTUNE_FAILED},
+};
+
+/**
+ * \brief Array defining the measured variables of `MEASure:ALL?` and `FETCh?`.
+ *
+ * This array is used by the SCPI parser to interpret the selection list of
+ * a snapshot query.
+ */
+const SCPI_choice_def_t measureChannelNames[MEASURE_CHANNEL_OPTIONS] PROGMEM = {
+    {"SPEE", "d", MEASURE_SPEED},
+    {"IBUS", "", MEASURE_IBUS},
+    {"IPHU", "", MEASURE_IPHASE_U},
+    {"IPHV", "", MEASURE_IPHASE_V},
+    {"IPHW", "", MEASURE_IPHASE_W},
+    {"VOLT", "age", MEASURE_VOLTAGE},
+    {"DUTY", "cycle", MEASURE_DUTY},
+    {"POS", "ition", MEASURE_POSITION},
+    {"DIRE", "ction", MEASURE_DIRECTION},
+    {"ENAB", "le", MEASURE_ENABLE},
+    {"FAUL", "ts", MEASURE_FAULTS},
+};
+
+/**
+ * \brief Array defining the bulk data formats for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the
+ * format of the bulk query responses ('ASCii', 'INTeger' or 'REAL').
+ */
+const SCPI_choice_def_t dataFormats[DATA_FORMAT_OPTIONS] PROGMEM = {
+    {"ASC", "ii", DATA_FORMAT_ASCII},
+    {"INT", "eger", DATA_FORMAT_INTEGER},
+    {"REAL", "", DATA_FORMAT_REAL},
+};
+
+#if (FRAMED_PROTOCOL == TRUE)
+/**
+ * \brief Array defining the serial interface protocols for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret the protocol ('SCPI' or
+ * 'BINary').
+ */
+const SCPI_choice_def_t protocols[PROTOCOL_OPTIONS] PROGMEM = {
+    {"SCPI", "", PROTOCOL_SCPI},
+    {"BIN", "ary", PROTOCOL_BINARY},
+};
+#endif
+
+#if (WAVEFORM_CAPTURE == TRUE)
+/**
+ * \brief Array defining the waveform capture variables for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the
+ * captured variables ('IBUS', 'IPHU', 'IPHV', 'IPHW', 'VOLTage', 'DUTYcycle'
+ * and 'HALL').
+ */
+const SCPI_choice_def_t captureVariableNames[CAPTURE_VARIABLE_OPTIONS] PROGMEM = {
+    {"IBUS", "", CAPTURE_IBUS},
+    {"IPHU", "", CAPTURE_IPHASE_U},
+    {"IPHV", "", CAPTURE_IPHASE_V},
+    {"IPHW", "", CAPTURE_IPHASE_W},
+    {"VOLT", "age", CAPTURE_VOLTAGE},
+    {"DUTY", "cycle", CAPTURE_DUTY},
+    {"HALL", "", CAPTURE_HALL},
+};
+
+/**
+ * \brief Array defining the waveform capture trigger sources for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the
+ * trigger source ('LEVel', 'HALL', 'FAULt' or 'BUS').
+ */
+const SCPI_choice_def_t triggerSources[TRIGGER_SOURCE_OPTIONS] PROGMEM = {
+    {"LEV", "el", CAPTURE_TRIGGER_LEVEL},
+    {"HALL", "", CAPTURE_TRIGGER_HALL},
+    {"FAUL", "t", CAPTURE_TRIGGER_FAULT},
+    {"BUS", "", CAPTURE_TRIGGER_BUS},
+};
+
+/**
+ * \brief Array defining the level trigger slopes for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the
+ * trigger slope ('POSitive' or 'NEGative').
+ */
+const SCPI_choice_def_t triggerSlopes[TRIGGER_SLOPE_OPTIONS] PROGMEM = {
+    {"POS", "itive", TRIGGER_SLOPE_POSITIVE},
+    {"NEG", "ative", TRIGGER_SLOPE_NEGATIVE},
+};
+
+/**
+ * \brief Array defining the waveform capture states for SCPI commands.
+ *
+ * This array is used by the SCPI parser to represent the capture state
+ * ('IDLE', 'ARMed', 'TRIGgered' or 'DONE').
+ */
+const SCPI_choice_def_t captureStates[CAPTURE_STATE_OPTIONS] PROGMEM = {
+    {"IDLE", "", CAPTURE_STATE_IDLE},
+    {"ARM", "ed", CAPTURE_STATE_ARMED},
+    {"TRIG", "gered", CAPTURE_STATE_TRIGGERED},
+    {"DONE", "", CAPTURE_STATE_DONE},
+};
+#endif
+
+#if (TELEMETRY_STREAM == TRUE)
+/**
+ * \brief Array defining the telemetry record formats for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the
+ * format of the telemetry records ('ASCii' or 'BINary').
+ */
+const SCPI_choice_def_t telemetryFormats[TELEMETRY_FORMAT_OPTIONS] PROGMEM = {
+    {"ASC", "ii", TELEMETRY_FORMAT_ASCII},
+    {"BIN", "ary", TELEMETRY_FORMAT_BINARY},
+};
+#endif
+
+/**
+ * \brief Array defining the control methods for SCPI commands.
+ *
+ * This array is used by the SCPI parser to interpret and represent the
+ * control method ('OPEN' for open loop, 'CLOSed' for closed loop speed,
+ * 'TORQue' for bus current and 'POSition' for hall sensor edge count
+ * control).
+ */
+const SCPI_choice_def_t controlMethods[CONTROL_METHOD_OPTIONS] PROGMEM = {
+    {"OPEN", "", SPEED_CONTROL_OPEN_LOOP},
+    {"CLOS", "ed", SPEED_CONTROL_CLOSED_LOOP},
+    {"TORQ", "ue", SPEED_CONTROL_TORQUE},
+    {"POS", "ition", SPEED_CONTROL_POSITION},
+};
@@ -30,6 +30,90 @@
 
 #include "scpi_helper.h"
 #include "config.h"
+#include "filter.h"
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+#include "tracker.h"
+#endif
+#include "pid.h"
+#if (THERMAL_MODEL == TRUE)
+#include "thermal.h"
+#endif
+#if (FRAMED_PROTOCOL == TRUE)
+#include "frame.h"
+#endif
+
+/*! \brief Measured variables of a snapshot query.
+ */
+typedef enum
+{
+    //! Speed in RPM.
+    MEASURE_SPEED,
+    //! Bus current in A.
+    MEASURE_IBUS,
+    //! Phase U current in A.
+    MEASURE_IPHASE_U,
+    //! Phase V current in A.
+    MEASURE_IPHASE_V,
+    //! Phase W current in A.
+    MEASURE_IPHASE_W,
+    //! VBUS voltage in V.
+    MEASURE_VOLTAGE,
+    //! Duty cycle in percent.
+    MEASURE_DUTY,
+    //! Hall sensor edge count.
+    MEASURE_POSITION,
+    //! Actual direction.
+    MEASURE_DIRECTION,
+    //! Motor enable flag.
+    MEASURE_ENABLE,
+    //! Fault flags.
+    MEASURE_FAULTS,
+} measure_channel_t;
+
+/*! \brief Formats of the telemetry records.
+ */
+typedef enum
+{
+    //! One comma separated line per record.
+    TELEMETRY_FORMAT_ASCII,
+    //! Little-endian integers per record.
+    TELEMETRY_FORMAT_BINARY,
+} telemetry_format_t;
+
+/*! \brief Formats of the bulk query responses.
+ */
+typedef enum
+{
+    //! Comma separated text.
+    DATA_FORMAT_ASCII,
+    //! Block of little-endian 32-bit integers.
+    DATA_FORMAT_INTEGER,
+    //! Block of little-endian 32-bit floats.
+    DATA_FORMAT_REAL,
+} data_format_t;
+
+/*! \brief Slopes of the level trigger.
+ */
+typedef enum
+{
+    //! Rising level crossing.
+    TRIGGER_SLOPE_POSITIVE,
+    //! Falling level crossing.
+    TRIGGER_SLOPE_NEGATIVE,
+} trigger_slope_t;
+
+/*! \brief Protocols of the serial interface.
+ */
+typedef enum
+{
+    //! SCPI commands and responses.
+    PROTOCOL_SCPI,
+    //! Framed binary protocol, see frame.h.
+    PROTOCOL_BINARY,
+} protocol_t;
+
+/*! \brief First byte of a binary telemetry record. */
+#define TELEMETRY_RECORD_START 0xA5
 
 /*! \brief Motor direction options array. */
 #define MOTOR_DIRECTION_OPTIONS 2
@@ -40,11 +124,65 @@ extern const SCPI_choice_def_t motorDirections[MOTOR_DIRECTION_OPTIONS];
 /*! \brief Number of speed input source options. */
 extern const SCPI_choice_def_t inputSources[INPUT_SOURCE_OPTIONS];
 /*! \brief Speed input source options array. */
+/*! \brief Number of filter channel options. */
+#define FILTER_CHANNEL_OPTIONS FILTER_CHANNELS
+/*! \brief Filter channel options array. */
+extern const SCPI_choice_def_t filterChannelNames[FILTER_CHANNEL_OPTIONS];
+/*! \brief Number of filter type options. */
+#define FILTER_TYPE_OPTIONS 7
+/*! \brief Filter type options array. */
+extern const SCPI_choice_def_t filterTypeNames[FILTER_TYPE_OPTIONS];
+/*! \brief Number of PID tuning rule options. */
+#define PID_TUNE_RULE_OPTIONS 2
+/*! \brief PID tuning rule options array. */
+extern const SCPI_choice_def_t pidTuneRules[PID_TUNE_RULE_OPTIONS];
+/*! \brief Number of PID auto-tune state options. */
+#define PID_AUTOTUNE_STATE_OPTIONS 4
+/*! \brief PID auto-tune state options array. */
+extern const SCPI_choice_def_t pidAutoTuneStates[PID_AUTOTUNE_STATE_OPTIONS];
+/*! \brief Number of control method options. */
+#define CONTROL_METHOD_OPTIONS 4
+/*! \brief Control method options array. */
+extern const SCPI_choice_def_t controlMethods[CONTROL_METHOD_OPTIONS];
+/*! \brief Number of measured variable options. */
+#define MEASURE_CHANNEL_OPTIONS 11
+/*! \brief Measured variable options array. */
+extern const SCPI_choice_def_t measureChannelNames[MEASURE_CHANNEL_OPTIONS];
+/*! \brief Number of telemetry record format options. */
+#define TELEMETRY_FORMAT_OPTIONS 2
+/*! \brief Telemetry record format options array. */
+extern const SCPI_choice_def_t telemetryFormats[TELEMETRY_FORMAT_OPTIONS];
+/*! \brief Number of bulk data format options. */
+#define DATA_FORMAT_OPTIONS 3
+/*! \brief Bulk data format options array. */
+extern const SCPI_choice_def_t dataFormats[DATA_FORMAT_OPTIONS];
+/*! \brief Number of waveform capture variable options. */
+#define CAPTURE_VARIABLE_OPTIONS 7
+/*! \brief Waveform capture variable options array. */
+extern const SCPI_choice_def_t captureVariableNames[CAPTURE_VARIABLE_OPTIONS];
+/*! \brief Number of trigger source options. */
+#define TRIGGER_SOURCE_OPTIONS 4
+/*! \brief Trigger source options array. */
+extern const SCPI_choice_def_t triggerSources[TRIGGER_SOURCE_OPTIONS];
+/*! \brief Number of trigger slope options. */
+#define TRIGGER_SLOPE_OPTIONS 2
+/*! \brief Trigger slope options array. */
+extern const SCPI_choice_def_t triggerSlopes[TRIGGER_SLOPE_OPTIONS];
+/*! \brief Number of waveform capture state options. */
+#define CAPTURE_STATE_OPTIONS 4
+/*! \brief Waveform capture state options array. */
+extern const SCPI_choice_def_t captureStates[CAPTURE_STATE_OPTIONS];
+/*! \brief Number of serial interface protocol options. */
+#define PROTOCOL_OPTIONS 2
+/*! \brief Serial interface protocol options array. */
+extern const SCPI_choice_def_t protocols[PROTOCOL_OPTIONS];
 
 /** @cond DOXYGEN_IGNORE */
 // External prototypes and (defined in main.cpp or another relevant file)
 extern void TimersInit(void);
 extern void ConfigsInit(void);
+extern uint8_t ControlMethodSet(uint8_t method);
+extern void MeasurementsSnapshot(measurements_t *snapshot);
 extern volatile motorflags_t motorFlags;
 extern volatile motorconfigs_t motorConfigs;
 extern volatile faultflags_t faultFlags;
@@ -55,14 +193,40 @@ extern volatile int16_t iphaseV;
 extern volatile int16_t iphaseW;
 extern volatile uint16_t vbusVref;
 extern volatile uint8_t speedInput;
+extern volatile uint8_t speedOutput;
+extern volatile int32_t hallPosition;
+extern int32_t positionTarget;
+extern filterChannel_t filterChannels[FILTER_CHANNELS];
+#if (TURN_OFF_MODE == TURN_OFF_MODE_BRAKE)
+extern brakereport_t brakeReport;
+#endif
+#if (SPEED_ESTIMATOR == SPEED_ESTIMATOR_PLL)
+extern speedTracker_t speedTracker;
+#endif
+#if (THERMAL_MODEL == TRUE)
+extern thermalModel_t motorThermal;
+extern thermalModel_t mosfetThermal;
+#endif
+#if (POWER_METER == TRUE)
+extern powermeter_t powerMeter;
+#endif
+#if (TELEMETRY_STREAM == TRUE)
+extern telemetrystream_t telemetryStream;
+#endif
+#if (WAVEFORM_CAPTURE == TRUE)
+extern capture_t capture;
+#endif
+extern pidAutoTune_t pidAutoTune;
 /** @endcond */
 
 // SCPI Parser Instance
 extern SCPI_Parser scpiParser;
 
 // Function Prototypes
-void ScpiInit(void);
 void ScpiInput(Stream &interface);
+#if (FRAMED_PROTOCOL == TRUE)
+void ScpiBreak(void);
+#endif
 
 /*!  \page scpi SCPI
 
@@ -263,8 +427,8 @@ void ScpiInput(Stream &interface);
      | 2     | `DEAD_TIME`                     | Dead time (ns)                              |
      | 3     | `EMULATE_HALL`                  | Hall emulation enable (0/1)                 |
      | 4     | `TIM3_FREQ`                     | Emulated motor electrical frequency (Hz)    |
-     | 5     | `COMMUTATION_TICKS_STOPPED`     | Ticks before motor considered stopped       |
-     | 6     | `TURN_OFF_MODE`                 | Turn-off mode (0=coast, 1=ramp)             |
+     | 5     | `COMMUTATION_TICKS_STOPPED`     | Most ticks before motor considered stopped  |
+     | 6     | `TURN_OFF_MODE`                 | Turn-off mode (0=coast, 1=ramp, 2=brake)    |
      | 7     | `IPHASE_GAIN`                   | In-line phase current amplifier gain        |
      | 8     | `IPHASE_SENSE_RESISTOR`         | Phase current sense resistor (μΩ)           |
      | 9     | `IBUS_GAIN`                     | Bus current amplifier gain                  |
@@ -272,7 +436,7 @@ void ScpiInput(Stream &interface);
      | 11    | `IBUS_WARNING_THRESHOLD`        | Bus current warning threshold (ADC counts)  |
      | 12    | `IBUS_ERROR_THRESHOLD`          | Bus current error threshold (ADC counts)    |
      | 13    | `IBUS_FAULT_ENABLE`             | Bus current fault enable (0/1)              |
-     | 14    | `SPEED_CONTROL_METHOD`          | Speed control method (0=open, 1=closed)     |
+     | 14    | `SPEED_CONTROL_METHOD`          | Control method (0=open, 1=closed, 2=torque, 3=position) |
      | 15    | `SPEED_CONTROLLER_TIME_BASE`    | Speed loop time base (ticks)                |
      | 16    | `SPEED_CONTROLLER_MAX_DELTA`    | Max speed change per iteration (open loop)  |
      | 17    | `SPEED_CONTROLLER_MAX_SPEED`    | Max speed reference (closed loop)           |
@@ -305,6 +469,54 @@ void ScpiInput(Stream &interface);
      | `SYSTem:ERRor?`           | Retrieves the next error from the error queue.  | None.      | The next error message or `0, "No error"` if none. |
      | `SYSTem:ERRor:COUNt?`     | Queries the count of errors in the error queue. | None.      | The number of errors in the queue.                 |
 
+     When \ref PID_BENCHMARK_ENABLE is \ref TRUE, the following development command is
+     also available.
+
+     | Command                   | Description                                     | Parameters | Return Value                                       |
+     |---------------------------|-------------------------------------------------|------------|----------------------------------------------------|
+     | `SYSTem:BENChmark:PID?`   | Times the previous and the fixed-point PID controller and the gain schedule update. | None. The motor must be disabled. | `<previous>,<fixed-point>,<schedule>` in CPU cycles per call. |
+
+     When \ref FRAMED_PROTOCOL is \ref TRUE, the serial interface can be
+     switched to a framed binary protocol.
+
+     | Command                   | Description                                     | Parameters | Return Value                                       |
+     |---------------------------|-------------------------------------------------|------------|----------------------------------------------------|
+     | `SYSTem:PROTocol`         | Switches the serial interface protocol.         | Protocol (`SCPI` or `BINary`). | None, or error code and message if incorrect parameter. |
+
+     After `SYSTem:PROTocol BINary` the data after the end of the message is
+     read as frames, see frame.h, also when it was received together with it.
+     Every frame is a COBS encoded packet of a type byte, a fixed-layout
+     payload and a little-endian CRC-16/CCITT-FALSE, ended by a zero byte.
+     Every request is answered with a \ref frameResponse_t and, for \ref
+     FRAME_MEASURE, a \ref frameSnapshot_t.
+
+     | Type                    | Request payload          | Response payload       |
+     |-------------------------|--------------------------|------------------------|
+     | \ref FRAME_SET_POINT    | \ref frameSetPoint_t     | None.                  |
+     | \ref FRAME_ENABLE       | \ref frameEnable_t       | None.                  |
+     | \ref FRAME_DIRECTION    | \ref frameDirection_t    | None.                  |
+     | \ref FRAME_MEASURE      | None.                    | \ref frameSnapshot_t.  |
+     | \ref FRAME_EXIT         | None.                    | None.                  |
+
+     The interface returns to SCPI after a \ref FRAME_EXIT request, a break
+     on the serial interface or \ref FRAME_TIMEOUT milliseconds without a
+     valid frame.
+
+     A set point exchange is a 9 byte request and a 6 byte response, 15 bytes
+     in one round trip, against about 35 bytes in two round trips for
+     `CONF:SPEE 1500` followed by `SYST:ERR?`. A snapshot is a 5 byte request
+     and a 50 byte response, against about 67 bytes for `MEAS:ALL?`. The
+     binary requests need no number parsing or formatting.
+
+     The exchanges per second over the USB link have not been measured yet,
+     so no throughput figure is given. On USB the round trips count for more
+     than the bytes, so measure them on the host the way a gateway uses the
+     link: send 10000 requests, each after the response to the previous one
+     has been read, and divide by the elapsed time. Time \ref
+     FRAME_SET_POINT frames against `CONF:SPEE <speed>` followed by
+     `SYST:ERR?`, and \ref FRAME_MEASURE frames against `MEAS:ALL?`, with
+     the motor disabled and the same host, port and USB hub for both.
+
      \subsection scpi_commands_motor Motor Control Commands
 
      Commands specific to motor control.
@@ -317,17 +529,158 @@ void ScpiInput(Stream &interface);
      | `CONFigure:FREQuency?`      | Queries the gate drive frequency.        | None.                                                              | Current gate drive frequency in Hertz (Hz).                      |
      | `CONFigure:DIREction`       | Sets the motor direction.                | Direction (`FORWard` or `REVErse`).                                | None, or error code and message if incorrect parameter.          |
      | `CONFigure:DIREction?`      | Queries the motor direction.             | None.                                                              | The configured motor direction (`FORWard` or `REVErse`).         |
+     | `CONFigure:METHod`          | Selects the control method.              | Method (`OPEN`, `CLOSed`, `TORQue` or `POSition`).                 | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:METHod?`         | Queries the control method.              | None.                                                              | The active control method (`OPEN`, `CLOSED`, `TORQUE` or `POSITION`). |
+     | `CONFigure:FILTer`          | Selects a measurement filter.            | Channel (`IBUS`, `VBUS`, `SPEEd` or `INPut`), type (`NONE`, `EMA`, `AVERage`, `MED3`, `MED5`, `BIQuad` or `RATE`), optionally the EMA alpha exponent (`1`-`8`) or the rate limit step (`1`-`32767`). | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:FILTer?`         | Queries a measurement filter.            | Channel (`IBUS`, `VBUS`, `SPEEd` or `INPut`).                       | `<type>,<parameter>`.                                            |
      | `MEASure:SPEEd?`            | Measures the motor speed.                | None.                                                              | Motor speed in revolutions per minute (RPM).                     |
      | `MEASure:CURRent:IBUS?`     | Measures the high-side bus current.      | None.                                                              | Motor current in Amperes (A).                                    |
      | `MEASure:CURRent:IPHU?`     | Measures the in-line phase U current.    | None.                                                              | Phase current in Amperes (A).                                    |
      | `MEASure:CURRent:IPHV?`     | Measures the in-line phase V current.    | None.                                                              | Phase current in Amperes (A).                                    |
      | `MEASure:CURRent:IPHW?`     | Measures the in-line phase W current.    | None.                                                              | Phase current in Amperes (A).                                    |
      | `MEASure:DIREction?`        | Measures the motor direction.            | None.                                                              | Motor direction as a string (`FORWard`, `REVErse`, `UNKNown`).   |
+     | `MEASure:POSition?`         | Measures the rotor position.             | None.                                                              | Hall sensor edges counted since power up, negative in reverse.  |
      | `MEASure:DUTYcycle?`        | Measures the motor duty cycle.           | None.                                                              | Motor duty cycle as a percentage (%).                            |
      | `MEASure:VOLTage?`          | Measures the system voltage.             | None.                                                              | System voltage in Volts (V).                                     |
+     | `MEASure:ALL?`              | Measures all variables at one instant.   | Optional list of variables, e.g. `SPEEd,IBUS,VOLTage`.              | The variables as one comma separated line, or a block.           |
+     | `FETCh?`                    | Returns the last `MEASure:ALL?` again.   | Optional list of variables.                                        | The variables as one comma separated line, or a block.           |
+     | `FORMat:DATA`               | Sets the format of `MEASure:ALL?` and `FETCh?`. | Format (`ASCii`, `INTeger` or `REAL`).                      | None, or error code and message if incorrect parameter.          |
+     | `FORMat:DATA?`              | Queries the bulk data format.            | None.                                                              | The format (`ASCii`, `INTeger` or `REAL`).                       |
+
+     `MEASure:ALL?` copies all measured variables with interrupts briefly
+     disabled, so they are from the same instant. Without a list it returns
+     `<speed>,<ibus>,<iphu>,<iphv>,<iphw>,<voltage>,<duty>,<position>,<direction>,<enable>,<faults>`,
+     in the units of the single queries, with the fault flags as an integer.
+     The variables are named `SPEEd`, `IBUS`, `IPHU`, `IPHV`, `IPHW`,
+     `VOLTage`, `DUTYcycle`, `POSition`, `DIREction`, `ENABle` and `FAULts`,
+     and up to \ref SCPI_ARRAY_SIZE can be selected in one query.
+
+     With `FORMat:DATA INTeger` the variables are returned as an IEEE 488.2
+     definite-length block `#<n><length><bytes>`, where `<n>` is the number of
+     digits of `<length>` and `<length>` the number of bytes. Every variable is
+     a little-endian signed 32-bit integer, scaled as in the binary telemetry
+     records. With `REAL` they are little-endian 32-bit floats in the units of
+     the single queries. The block is followed by the line terminator.
+
+     The `SPEEd` filter channel filters the time between hall sensor changes
+     that the speed is calculated from when \ref SPEED_ESTIMATOR is \ref
+     SPEED_ESTIMATOR_FILTER, and `INPut` filters the local speed input. The power up filters are set by \ref FILTER_IBUS_TYPE, \ref
+     FILTER_VBUS_TYPE, \ref FILTER_SPEED_TYPE and \ref FILTER_INPUT_TYPE.
+
+     The control method can be changed while the motor is running. The new
+     regulator takes over from the present duty cycle, and with a remote source
+     the set point is rescaled to the present speed, current or duty cycle. The
+     power up method is \ref SPEED_CONTROL_METHOD. Closed loop control cannot
+     be selected when \ref EMULATE_HALL is \ref TRUE.
+
+     This command is only available when \ref TURN_OFF_MODE is \ref
+     TURN_OFF_MODE_BRAKE.
+
+     | Command                      | Description                               | Parameters                                                      | Return Value                                                    |
+     |------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `MEASure:BRAKe?`             | Measures the last braking.                | None.                                                           | `<time>,<energy>` with the stopping time in milliseconds (ms) and the regenerated energy in millijoules (mJ). |
+
+     This command is only available when \ref THERMAL_MODEL is \ref TRUE.
+
+     | Command                      | Description                               | Parameters                                                      | Return Value                                                    |
+     |------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `MEASure:THERmal?`           | Measures the remaining thermal budget.    | None.                                                           | `<motor>,<mosfet>` remaining I²t budget in percent (%).         |
 
-     These commands are only available when \ref SPEED_CONTROL_METHOD is \ref
-     SPEED_CONTROL_OPEN_LOOP.
+     These commands are only available when \ref POWER_METER is \ref TRUE.
+
+     | Command                      | Description                               | Parameters                                                      | Return Value                                                    |
+     |------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `MEASure:POWer?`             | Measures the electrical power.            | None.                                                           | `<average>,<peak>` over the last window in watts (W).           |
+     | `MEASure:POWer:WINDow`       | Sets the power metering window.           | Window in milliseconds (ms), 10 to 25000.                       | None, or error code and message if incorrect parameter.          |
+     | `MEASure:POWer:WINDow?`      | Queries the power metering window.        | None.                                                           | Window in milliseconds (ms), a whole number of measurements.    |
+     | `MEASure:ENERgy?`            | Measures the electrical energy.           | None.                                                           | Energy since power up or the last reset in millijoules (mJ).    |
+     | `MEASure:ENERgy:RESet`       | Resets the electrical energy to zero.     | None.                                                           | None.                                                           |
+
+     These commands are only available when \ref TELEMETRY_STREAM is \ref
+     TRUE.
+
+     | Command                        | Description                               | Parameters                                                      | Return Value                                                    |
+     |--------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `TELemetry:STReam`             | Starts or stops the telemetry stream.     | Boolean (`ON` or `1` to start, `OFF` or `0` to stop).           | None, or error code and message if incorrect parameter.          |
+     | `TELemetry:STReam?`            | Queries the telemetry stream state.       | None.                                                           | `1` while streaming, `0` otherwise.                              |
+     | `TELemetry:STReam:RATE`        | Sets the record rate.                     | Rate in Hertz (Hz). Min: `1`, Max: the speed controller rate.   | None, or error code and message if the rate is out of range.     |
+     | `TELemetry:STReam:RATE?`       | Queries the record rate.                  | None.                                                           | Record rate in Hertz (Hz).                                       |
+     | `TELemetry:STReam:FORMat`      | Sets the record format.                   | Format (`ASCii` or `BINary`).                                   | None, or error code and message if incorrect parameter.          |
+     | `TELemetry:STReam:FORMat?`     | Queries the record format.                | None.                                                           | The record format (`ASCii` or `BINary`).                         |
+     | `TELemetry:STReam:VARiables`   | Selects the variables of the records.     | Optional list of variables as for `MEASure:ALL?`.               | None, or error code and message if incorrect parameter.          |
+     | `TELemetry:STReam:VARiables?`  | Queries the variables of the records.     | None.                                                           | The variable names as one comma separated line.                  |
+
+     While streaming, a record is taken every whole number of speed
+     controller iterations, at most the gate drive frequency divided by \ref
+     SPEED_CONTROLLER_TIME_BASE. Every record is a snapshot taken in the
+     interrupt, so it is from one instant. Records are written in turn with
+     the responses to commands, which are still accepted. The sequence number
+     counts from 0 at the start of the stream and also counts records dropped
+     because the interface could not keep up, see \ref TELEMETRY_QUEUE_LENGTH.
+
+     An ASCII record is the line `<sequence>,<timestamp>,<variables>`, with
+     the timestamp in microseconds since power up and the variables as for
+     `MEASure:ALL?`. A binary record is the byte `0xA5`, the number of bytes
+     that follow, the sequence number as an unsigned 16-bit integer, the
+     timestamp as an unsigned 32-bit integer and every variable as a signed
+     32-bit integer, all little-endian. Speed, currents, voltage and duty cycle
+     are scaled by 10 to the power of \ref SCPI_MEASURE_DECIMALS, and the
+     direction is `0` forward, `1` reverse and `3` unknown. Responses are ASCII
+     text, so they never start with `0xA5`.
+
+     These commands are only available when \ref WAVEFORM_CAPTURE is \ref
+     TRUE.
+
+     | Command                        | Description                               | Parameters                                                      | Return Value                                                    |
+     |--------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `ACQuire:STATe`                | Arms or stops the waveform capture.       | Boolean (`ON` or `1` to arm, `OFF` or `0` to stop).             | None, or error code and message if incorrect parameter.          |
+     | `ACQuire:STATe?`               | Queries the capture state.                | None.                                                           | `IDLE`, `ARMed`, `TRIGgered` or `DONE`.                          |
+     | `ACQuire:VARiables`            | Selects the captured variables.           | 1 to \ref CAPTURE_CHANNELS of `IBUS`, `IPHU`, `IPHV`, `IPHW`, `VOLTage`, `DUTYcycle` and `HALL`. | None, or error code and message if incorrect parameter.          |
+     | `ACQuire:VARiables?`           | Queries the captured variables.           | None.                                                           | The variable names as one comma separated line.                  |
+     | `ACQuire:DECimation`           | Sets the sample decimation.               | PWM periods per sample. Min: `1`, Max: `255`.                   | None, or error code and message if incorrect parameter.          |
+     | `ACQuire:DECimation?`          | Queries the sample decimation.            | None.                                                           | PWM periods per sample.                                          |
+     | `ACQuire:POINts?`              | Queries the number of samples.            | None.                                                           | \ref CAPTURE_LENGTH.                                             |
+     | `ACQuire:DATA?`                | Reads out a completed capture.            | Optional index of the first sample and number of samples.       | Definite-length block of samples, see below.                     |
+     | `TRIGger:SOURce`               | Sets the trigger source.                  | Source (`LEVel`, `HALL`, `FAULt` or `BUS`).                     | None, or error code and message if incorrect parameter.          |
+     | `TRIGger:SOURce?`              | Queries the trigger source.               | None.                                                           | The trigger source.                                              |
+     | `TRIGger:LEVel`                | Sets the level trigger.                   | Variable as for `ACQuire:VARiables` and level in its register unit. | None, or error code and message if incorrect parameter.      |
+     | `TRIGger:LEVel?`               | Queries the level trigger.                | None.                                                           | `<variable>,<level>`.                                            |
+     | `TRIGger:SLOPe`                | Sets the level crossing direction.        | Slope (`POSitive` or `NEGative`).                               | None, or error code and message if incorrect parameter.          |
+     | `TRIGger:SLOPe?`               | Queries the level crossing direction.     | None.                                                           | `POSitive` or `NEGative`.                                        |
+     | `TRIGger:PRETrigger`           | Sets the pretrigger depth.                | Samples before the trigger. Min: `0`, Max: \ref CAPTURE_LENGTH - 1. | None, or error code and message if incorrect parameter.      |
+     | `TRIGger:PRETrigger?`          | Queries the pretrigger depth.             | None.                                                           | Samples before the trigger.                                      |
+     | `TRIGger:IMMediate`            | Triggers an armed capture now.            | None.                                                           | None, or error code and message if the capture is not armed.     |
+
+     The samples are taken every PWM period at `ACQuire:DECimation 1`. While
+     the capture runs, its currents and voltage are converted by the ADC at the
+     start of every PWM period, unfiltered and at a reduced resolution, and the
+     sample is taken when they are done. A conversion takes about 14 us, so
+     when they do not all fit in one PWM period a sample is taken every second
+     PWM period instead. Settings take effect when the capture is armed. Once armed, the trigger is accepted after the `TRIGger:PRETrigger`
+     samples have been taken. `LEVel` triggers when the variable crosses the
+     level in the `TRIGger:SLOPe` direction, `HALL` on a hall sensor edge,
+     `FAULt` when a fault flag other than motor stopped is set and `BUS` on
+     `TRIGger:IMMediate` only, which also works with the other sources. The
+     capture is done when the buffer of \ref CAPTURE_LENGTH samples is full.
+
+     `ACQuire:DATA?` returns the samples oldest first as a definite-length
+     block, with the variables of every sample in their selected order. Every
+     value is a little-endian signed 16-bit register value: ADC counts for the
+     currents and the voltage, with the phase current zero at `511`, the
+     Timer4 compare value for the duty cycle and `0`-`7` for the hall sensor
+     state. With `FORMat:DATA REAL` the values are little-endian 32-bit floats
+     in the units of the single measurement queries instead. The whole
+     capture is returned by one query, written in parts as the interface
+     accepts them, and no further commands are read until it is complete.
+     Commands that follow `ACQuire:DATA?` in the same message would answer
+     in the middle of the block, so send it as the last command of a message.
+
+     The speed input source is shared by all control methods, so the
+     `DUTYcycle:SOURce`, `TORQue:SOURce` and `SPEEd:SOURce` commands set the
+     same source. The set point commands are only accepted when the matching
+     control method is selected.
+
+     Open loop control (`CONFigure:METHod OPEN`).
 
      | Command                      | Description                               | Parameters                                                      | Return Value                                                    |
      |------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
@@ -335,14 +688,65 @@ void ScpiInput(Stream &interface);
      | `CONFigure:DUTYcycle:SOURce?`| Queries the duty cycle source.            | None.                                                           | Current duty cycle source (`0` = local, `1` = remote).           |
      | `CONFigure:DUTYcycle`        | Sets the duty cycle for the motor.        | Duty cycle in percentage (%). Min: `0.0 %`, Max: `100.0 %`.      | None, or error code and message if incorrect parameter.          |
 
-     These commands are only available when \ref SPEED_CONTROL_METHOD is \ref
-     SPEED_CONTROL_CLOSED_LOOP.
+     Torque control (`CONFigure:METHod TORQue`).
+
+     | Command                      | Description                               | Parameters                                                      | Return Value                                                    |
+     |------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `CONFigure:TORQue:SOURce`    | Sets the torque source for the motor.     | `0` for local (speed input pin), `1` for remote.                 | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:TORQue:SOURce?`   | Queries the torque source.                | None.                                                           | Current torque source (`0` = local, `1` = remote).               |
+     | `CONFigure:TORQue`           | Sets the bus current for the motor.       | Current in Amperes (A), up to three decimals. Min: `0.0`, Max: \ref TORQUE_MAX_CURRENT. | None, or error code and message if incorrect parameter.          |
+
+     Position control (`CONFigure:METHod POSition`).
+
+     | Command                      | Description                               | Parameters                                                      | Return Value                                                    |
+     |------------------------------|-------------------------------------------|-----------------------------------------------------------------|-----------------------------------------------------------------|
+     | `CONFigure:POSition`         | Moves the motor to a position.            | Target in hall sensor edges, six per electrical revolution.     | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:POSition?`        | Queries the target position.              | None.                                                           | Target in hall sensor edges.                                     |
+
+     The move accelerates by \ref POSITION_ACCELERATION to \ref
+     POSITION_MAX_SPEED and decelerates to \ref POSITION_MIN_SPEED in time to
+     stop within one hall sensor sector of the target. The closed loop speed
+     controller follows this profile, so the PID gains apply. Selecting position
+     control holds the present position.
+
+     Closed loop speed control (`CONFigure:METHod CLOSed`). The PID gain
+     schedule can be changed with any method selected, the auto-tune requires
+     closed loop control.
 
      | Command                     | Description                             | Parameters                                                                 | Return Value                                                    |
      |-----------------------------|-----------------------------------------|----------------------------------------------------------------------------|-----------------------------------------------------------------|
      | `CONFigure:SPEEd:SOURce`    | Sets the speed source for the motor.    | `0` for local (speed input pin), `1` for remote.                           | None, or error code and message if incorrect parameter.          |
      | `CONFigure:SPEEd:SOURce?`   | Queries the speed source for the motor. | None.                                                                      | Current speed source (`0` = local, `1` = remote).                |
      | `CONFigure:SPEEd`           | Sets the speed for the motor.           | Speed in revolutions per minute (RPM). Min: `0`, Max: \ref SPEED_CONTROLLER_MAX_SPEED | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:PID:TABLe`       | Sets one PID gain schedule breakpoint.  | Index (`0` to \ref PID_GAIN_SCHEDULE_POINTS - 1), speed in RPM, P, I and D gains (`0` to `32767`). Speeds must stay in ascending order. | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:PID:TABLe?`      | Queries one PID gain schedule breakpoint. | Index (`0` to \ref PID_GAIN_SCHEDULE_POINTS - 1).                       | `<speed>,<P>,<I>,<D>` with the speed in RPM.                     |
+     | `CONFigure:PID:TABLe:DATA`  | Sets the whole PID gain schedule.       | Definite-length block of all breakpoints, see below.                       | None, or error code and message if incorrect parameter.          |
+     | `CONFigure:PID:TABLe:DATA?` | Queries the whole PID gain schedule.    | None.                                                                      | Definite-length block of all breakpoints.                        |
+     | `CONFigure:PID:SAVE`        | Stores the PID gain schedule in EEPROM. | None.                                                                      | None. The stored table is loaded at the next power up.           |
+
+     The `CONFigure:PID:TABLe:DATA` block holds \ref PID_GAIN_SCHEDULE_POINTS
+     breakpoints in ascending order, each the speed, P, I and D gains as
+     little-endian signed 16-bit integers. The speed is in the unit of the
+     speed controller, electrical revolutions per second, i.e. RPM times \ref
+     MOTOR_POLES divided by 120. The whole command must fit in \ref
+     SCPI_BUFFER_LENGTH characters. Block data may hold any byte, including
+     `,`, `;` and the line terminator.
+
+     The PID gains are linearly interpolated between the gain schedule
+     breakpoints from the measured speed, and changes take effect on the next
+     speed controller iteration without resetting the integrator.
+
+     | Command                     | Description                             | Parameters                                                                 | Return Value                                                    |
+     |-----------------------------|-----------------------------------------|----------------------------------------------------------------------------|-----------------------------------------------------------------|
+     | `CALibrate:PID`             | Starts a relay feedback PID auto-tune.  | Speed in RPM, optionally the rule (`ZN` Ziegler-Nichols or `TL` Tyreus-Luyben, default `ZN`) and a boolean to store the result in EEPROM (default `OFF`). | None, or error code and message if incorrect parameter, the motor is disabled or closed loop control is not selected. |
+     | `CALibrate:PID?`            | Queries the PID auto-tune.              | None.                                                                      | `<state>,<P>,<I>,<D>` with the state `IDLE`, `RUNNING`, `DONE` or `FAILED`. |
+
+     The auto-tune switches the duty cycle \ref PID_AUTOTUNE_STEP above and
+     below its present value whenever the measured speed crosses the requested
+     speed, and measures the period and amplitude of the resulting oscillation.
+     The motor should already run close to the requested speed when it is
+     started. On success the gains are loaded into the controller and into the
+     nearest gain schedule breakpoint. Disabling the motor aborts the auto-tune.
 
      \subsection scpi_commands_conclusion Conclusion
 
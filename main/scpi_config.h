@@ -25,39 +25,34 @@
 #ifndef _SCPI_CONFIG_H_
 #define _SCPI_CONFIG_H_
 
-/*! \def SCPI_MAX_TOKENS
- * \brief Maximum number of valid SCPI tokens (keywords) that the parser can recognize.
+/*! \def SCPI_KEYWORD_LENGTH
+ * \brief Size of the storage for one keyword of the command table.
  *
  * \details
- * This constant determines the size of the internal storage for unique command tokens
- * extracted from registered commands. Increasing this value allows for more complex
- * command structures with a larger vocabulary of keywords, but also increases memory usage.
- * Default value is 20.
+ * This constant determines the size of every entry of the keyword table in flash,
+ * including the terminating null character, so the longest keyword can have
+ * SCPI_KEYWORD_LENGTH - 1 characters. Default value is 11.
  */
-#define SCPI_MAX_TOKENS 20
+#define SCPI_KEYWORD_LENGTH 11
 
-/*! \def SCPI_MAX_COMMANDS
- * \brief Maximum number of distinct SCPI commands that can be registered with the parser.
+/*! \def SCPI_MAX_KEYWORD_FORMS
+ * \brief Maximum number of keyword forms that the parser can recognize.
  *
  * \details
- * This constant defines the capacity of the internal storage for registered command
- * hash codes and their associated callback functions. Increasing this value allows
- * the parser to handle a larger set of unique SCPI commands, but also increases memory usage.
- * Default value is 20.
+ * This constant determines the size of the table of keyword forms in flash, sorted by
+ * hash. Every keyword has a short and a long form, which count once when they are the
+ * same. Must be 32, 64 or 128. Default value is 128.
  */
-#define SCPI_MAX_COMMANDS 20
+#define SCPI_MAX_KEYWORD_FORMS 128
 
-/*! \def SCPI_MAX_SPECIAL_COMMANDS
- * \brief Maximum number of special SCPI commands (without parameters) that can be registered.
+/*! \def SCPI_MAX_COMMANDS
+ * \brief Maximum number of distinct SCPI commands in the command table.
  *
  * \details
- * This constant defines the capacity of the internal storage for registered special
- * command hash codes and their associated callback functions. Special commands are
- * typically used for actions or queries that do not require parameters. Setting this
- * value to 0 disables the support for special commands, which can save memory if not needed.
- * Default value is 0.
+ * This constant determines the size of the table of command indices in flash, sorted
+ * by hash code. Must be 32, 64 or 128. Default value is 128.
  */
-#define SCPI_MAX_SPECIAL_COMMANDS 0
+#define SCPI_MAX_COMMANDS 128
 
 /*! \def SCPI_BUFFER_LENGTH
  * \brief Length of the buffer used to store incoming SCPI messages from the communication interface.
@@ -70,27 +65,113 @@
  */
 #define SCPI_BUFFER_LENGTH 64
 
+/*! \def SCPI_RX_BUFFER_LENGTH
+ * \brief Length of the ring buffer used to queue received characters.
+ *
+ * \details
+ * Received characters are queued in this ring buffer until a complete message is
+ * executed, so several pipelined messages can be received while one is executed.
+ * No more characters are read from the communication interface while the buffer is
+ * full, which holds off the sender instead of overflowing. Must be a power of two,
+ * no greater than 128 and no less than \ref SCPI_BUFFER_LENGTH. Default value is
+ * 128 bytes.
+ */
+#define SCPI_RX_BUFFER_LENGTH 128
+
+#if ((SCPI_RX_BUFFER_LENGTH & (SCPI_RX_BUFFER_LENGTH - 1)) != 0) || (SCPI_RX_BUFFER_LENGTH > 128) || (SCPI_RX_BUFFER_LENGTH < SCPI_BUFFER_LENGTH)
+#error "SCPI_RX_BUFFER_LENGTH must be a power of two between SCPI_BUFFER_LENGTH and 128."
+#endif
+
+/*! \def SCPI_TX_BUFFER_LENGTH
+ * \brief Length of the buffer used to collect SCPI responses before they are sent.
+ *
+ * \details
+ * Responses of all commands in a message are collected in this buffer and sent with
+ * as few writes as possible when the message has been executed, without waiting for
+ * the communication interface. Should hold the longest response, the `*IDN?` reply.
+ * Must be no greater than 255. Default value is 192 bytes.
+ */
+#define SCPI_TX_BUFFER_LENGTH 192
+
+#if (SCPI_TX_BUFFER_LENGTH > 255)
+#error "SCPI_TX_BUFFER_LENGTH must be no greater than 255."
+#endif
+
+//! Discard a response that does not fit in the response buffer.
+#define SCPI_TX_OVERFLOW_DISCARD 0
+
+//! Wait for the communication interface when the response buffer is full.
+#define SCPI_TX_OVERFLOW_BLOCK 1
+
+/*! \def SCPI_TX_OVERFLOW_POLICY
+ * \brief Handling of a response that does not fit in the response buffer.
+ *
+ * \details
+ * When the response buffer is full and the communication interface does not accept
+ * more characters, \ref SCPI_TX_OVERFLOW_DISCARD drops the part of the response that
+ * was not sent yet, ends a partly sent line with "\r\n" and reports an output overflow
+ * error, so the control loop never waits for the host. \ref SCPI_TX_OVERFLOW_BLOCK writes the buffer through to the
+ * interface, which waits until the host reads it. Default value is
+ * \ref SCPI_TX_OVERFLOW_DISCARD.
+ */
+#define SCPI_TX_OVERFLOW_POLICY SCPI_TX_OVERFLOW_DISCARD
+
+#if (SCPI_TX_OVERFLOW_POLICY != SCPI_TX_OVERFLOW_DISCARD) && (SCPI_TX_OVERFLOW_POLICY != SCPI_TX_OVERFLOW_BLOCK)
+#error "SCPI_TX_OVERFLOW_POLICY must be SCPI_TX_OVERFLOW_DISCARD or SCPI_TX_OVERFLOW_BLOCK."
+#endif
+
 /*! \def SCPI_ARRAY_SIZE
  * \brief Maximum branch size of the command tree and the maximum number of parameters that can be parsed from a command.
  *
  * \details
- * This constant serves two purposes: it limits the depth of the hierarchical command
- * tree that can be defined using the `SetCommandTreeBase` function, and it also
- * limits the maximum number of parameters that the parser will attempt to extract
- * from a received command. Default value is 6.
+ * This constant serves two purposes: it limits the number of keywords of a received
+ * command, and it also limits the maximum number of parameters that the parser will
+ * attempt to extract from a received command. Default value is 6.
  */
 #define SCPI_ARRAY_SIZE 6
 
+/*! \def SCPI_MEASURE_DECIMALS
+ * \brief Number of decimal places of measurement replies.
+ *
+ * \details
+ * Measurements are converted with fixed-point scale factors generated at compile time
+ * and printed with this number of decimal places. Must be 0 to 3. Default value is 2.
+ */
+#define SCPI_MEASURE_DECIMALS 2
+
+#if (SCPI_MEASURE_DECIMALS < 0) || (SCPI_MEASURE_DECIMALS > 3)
+#error "SCPI_MEASURE_DECIMALS must be between 0 and 3."
+#endif
+
 /*! \def SCPI_HASH_TYPE
  * \brief Integer data type used for calculating and storing command hash codes.
  *
  * \details
- * This constant defines the underlying integer type used for the hash values generated
- * for registered SCPI commands. The size of this data type affects the range of possible
- * hash values and thus the likelihood of hash collisions. Common choices include `uint8_t`,
- * `uint16_t`, or `uint32_t`. Default value is `uint8_t`.
+ * This constant defines the underlying integer type used for the hash values of
+ * keywords and commands. The size of this data type affects the likelihood of hash
+ * collisions. Common choices include `uint16_t` or `uint32_t`. Default value is
+ * `uint16_t`.
+ */
+#define SCPI_HASH_TYPE uint16_t
+
+/*! \def SCPI_HASH_MAGIC_NUMBER
+ * \brief Multiplier of every hashing step.
+ *
+ * \details
+ * The keyword and command tables are generated at compile time, and a static_assert
+ * fails when two keyword forms or two commands have the same hash. Try another value
+ * for this constant or \ref SCPI_HASH_MAGIC_OFFSET when that happens after changing
+ * the command set. Default value is 37.
+ */
+#define SCPI_HASH_MAGIC_NUMBER 37
+
+/*! \def SCPI_HASH_MAGIC_OFFSET
+ * \brief Initial value of every hash.
+ *
+ * \details
+ * See \ref SCPI_HASH_MAGIC_NUMBER. Default value is 7.
  */
-#define SCPI_HASH_TYPE uint8_t
+#define SCPI_HASH_MAGIC_OFFSET 7
 
 // SCPI Identification Definitions
 /*! \def SCPI_IDN_MANUFACTURER
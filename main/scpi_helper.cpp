@@ -10,6 +10,16 @@
         and mapping choice values to their string representations. These functions
         are intended to be used in the implementation of SCPI commands.
 
+        Parameters are parsed in place on the tokens of the parser buffer, so
+        no memory is allocated. Numbers may use engineering notation (1.5E3)
+        and an SI multiplier suffix (MA, K, M, U or N, as defined by IEEE
+        488.2, so M is milli and MA is mega). Integer parameters are rejected
+        when they are out of the range of their type or have a fraction left
+        after scaling.
+
+        Measurements are printed from fixed-point values by \ref
+        ScpiPrintFixed, without floating point code.
+
    \author
         Nexperia: http://www.nexperia.com
 
@@ -22,22 +32,180 @@
  ******************************************************************************/
 
 #include "scpi_helper.h"
+// Include character classification and number conversion
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+
+//! Largest power of ten accepted in an exponent.
+#define SCPI_MAX_EXPONENT 38
+
+/*! \struct _SCPI_multiplier_t
+ * \brief Defines an SI multiplier suffix of a numeric parameter.
+ */
+typedef struct _SCPI_multiplier_t
+{
+    char name[3];     /*!< Multiplier mnemonic. */
+    int8_t exponent;  /*!< Power of ten of the multiplier. */
+} SCPI_multiplier_t;
+
+/**
+ * \brief SI multiplier suffixes accepted after a numeric parameter.
+ *
+ * The mnemonics follow IEEE 488.2, which compares them case-insensitively, so
+ * 'M' is milli and 'MA' is mega.
+ */
+static const SCPI_multiplier_t scpiMultipliers[] PROGMEM = {
+    {"MA", 6},
+    {"K", 3},
+    {"M", -3},
+    {"U", -6},
+    {"N", -9},
+};
+
+/**
+ * \brief Parses the exponent and SI multiplier suffix of a numeric parameter.
+ *
+ * The text following the mantissa may hold an exponent ('E' followed by a
+ * signed integer), whitespace and one of the multipliers in \ref
+ * scpiMultipliers, in that order, and nothing else.
+ *
+ * \param text The text following the mantissa.
+ * \param exponent A reference to the power of ten to scale the mantissa by.
+ * \return 1 if the text was valid, 0 otherwise.
+ */
+static uint8_t ScpiParseExponent(const char *text, int8_t &exponent)
+{
+    exponent = 0;
+
+    if ((*text == 'E' || *text == 'e') && (isdigit(text[1]) || ((text[1] == '+' || text[1] == '-') && isdigit(text[2]))))
+    {
+        char *end;
+        long power = strtol(text + 1, &end, 10);
+        if (power < -SCPI_MAX_EXPONENT || power > SCPI_MAX_EXPONENT)
+            return FALSE;
+        exponent = power;
+        text = end;
+    }
+
+    while (isspace(*text))
+        text++;
+    size_t length = strlen(text);
+    while (length > 0 && isspace(text[length - 1]))
+        length--;
+    if (length == 0)
+        return TRUE;
+
+    for (size_t i = 0; i < sizeof(scpiMultipliers) / sizeof(scpiMultipliers[0]); i++)
+    {
+        if (strlen_P(scpiMultipliers[i].name) == length && strncasecmp_P(text, scpiMultipliers[i].name, length) == 0)
+        {
+            exponent += (int8_t)pgm_read_byte(&scpiMultipliers[i].exponent);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * \brief Parses the magnitude of an integer parameter.
+ *
+ * The digits, including any after a decimal point, are accumulated as an
+ * integer and then scaled by the exponent and multiplier, so '1.5K' is 1500.
+ * The result must be a whole number no greater than \a maximum.
+ *
+ * \param text The parameter text, without a sign.
+ * \param maximum The largest accepted magnitude.
+ * \param value A reference to a uint32_t variable where the magnitude will be stored.
+ * \param exponent Power of ten the magnitude is multiplied by, to parse it in
+ * smaller units.
+ * \return 1 if a valid magnitude was parsed, 0 otherwise.
+ */
+static uint8_t ScpiParseMagnitude(const char *text, uint32_t maximum, uint32_t &value, int8_t exponent = 0)
+{
+    uint32_t magnitude = 0;
+    uint8_t digits = 0;
+
+    for (uint8_t fraction = FALSE;; text++)
+    {
+        if (*text == '.' && !fraction)
+        {
+            fraction = TRUE;
+            continue;
+        }
+        if (!isdigit(*text))
+            break;
+        uint8_t digit = *text - '0';
+        if (magnitude > (UINT32_MAX - digit) / 10)
+            return FALSE;
+        magnitude = magnitude * 10 + digit;
+        exponent -= fraction;
+        digits++;
+    }
+
+    int8_t scale;
+    if (digits == 0 || !ScpiParseExponent(text, scale))
+        return FALSE;
+    exponent += scale;
+
+    for (; exponent > 0; exponent--)
+    {
+        if (magnitude > maximum / 10)
+            return FALSE;
+        magnitude *= 10;
+    }
+    for (; exponent < 0; exponent++)
+    {
+        if (magnitude % 10)
+            return FALSE;
+        magnitude /= 10;
+    }
+    if (magnitude > maximum)
+        return FALSE;
+
+    value = magnitude;
+    return TRUE;
+}
+
+/**
+ * \brief Parses a signed integer parameter.
+ *
+ * \param text The parameter text.
+ * \param minimum The smallest accepted value.
+ * \param maximum The largest accepted value.
+ * \param value A reference to an int32_t variable where the value will be stored.
+ * \return 1 if a valid value was parsed, 0 otherwise.
+ */
+static uint8_t ScpiParseSigned(const char *text, int32_t minimum, int32_t maximum, int32_t &value)
+{
+    uint8_t negative = (*text == '-');
+    if (*text == '-' || *text == '+')
+        text++;
+
+    uint32_t magnitude;
+    if (!ScpiParseMagnitude(text, negative ? -(uint32_t)minimum : (uint32_t)maximum, magnitude))
+        return FALSE;
+
+    value = negative ? -(int32_t)(magnitude - 1) - 1 : (int32_t)magnitude;
+    return TRUE;
+}
 
 /**
  * \brief Extracts a string parameter from the SCPI parameter list.
  *
  * This function checks if there are any parameters available. If so, it pops
- * the last parameter from the list and converts it to a String.
+ * the last parameter from the list and returns a pointer to it. The string is
+ * stored in the parser buffer and is valid until the next message is read.
  *
  * \param parameters A reference to the SCPI parameter list.
- * \param param A reference to a String variable where the extracted parameter will be stored.
+ * \param param A reference to a pointer where the extracted parameter will be stored.
  * \return 1 if a string parameter was successfully extracted, 0 otherwise (if no parameters are available).
  */
-uint8_t ScpiParamString(SCPI_P &parameters, String &param)
+uint8_t ScpiParamString(SCPI_P &parameters, const char *&param)
 {
     if (parameters.Size() == 0)
         return FALSE;
-    param = String(parameters.Pop());
+    param = parameters.Pop();
     return TRUE;
 }
 
@@ -49,13 +217,14 @@ uint8_t ScpiParamString(SCPI_P &parameters, String &param)
  *
  * \param parameters A reference to the SCPI parameter list.
  * \param param A reference to a uint8_t variable where the extracted parameter will be stored.
- * \return 1 if an unsigned 8-bit integer parameter was successfully extracted, 0 otherwise (if no parameters are available).
+ * \return 1 if an unsigned 8-bit integer parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is invalid or out of range).
  */
 uint8_t ScpiParamUInt8(SCPI_P &parameters, uint8_t &param)
 {
-    if (parameters.Size() == 0)
+    uint32_t value;
+    if (!ScpiParamUInt32(parameters, value) || value > UINT8_MAX)
         return FALSE;
-    param = String(parameters.Pop()).toInt();
+    param = value;
     return TRUE;
 }
 
@@ -67,13 +236,74 @@ uint8_t ScpiParamUInt8(SCPI_P &parameters, uint8_t &param)
  *
  * \param parameters A reference to the SCPI parameter list.
  * \param param A reference to a uint32_t variable where the extracted parameter will be stored.
- * \return 1 if an unsigned 32-bit integer parameter was successfully extracted, 0 otherwise (if no parameters are available).
+ * \return 1 if an unsigned 32-bit integer parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is invalid or out of range).
  */
 uint8_t ScpiParamUInt32(SCPI_P &parameters, uint32_t &param)
 {
     if (parameters.Size() == 0)
         return FALSE;
-    param = String(parameters.Pop()).toInt();
+    const char *text = parameters.Pop();
+    if (*text == '+')
+        text++;
+    return ScpiParseMagnitude(text, UINT32_MAX, param);
+}
+
+/**
+ * \brief Extracts an unsigned fixed-point parameter from the SCPI parameter list.
+ *
+ * This function pops the last parameter and converts it to an integer in
+ * units of 10^-\p decimals without floating point, so '2.5' with 3 decimals
+ * is 2500. Parameters with more decimal places are invalid.
+ *
+ * \param parameters A reference to the SCPI parameter list.
+ * \param decimals The number of decimal places of the result.
+ * \param maximum The largest accepted result.
+ * \param param A reference to a uint32_t variable where the extracted parameter will be stored.
+ * \return 1 if a fixed-point parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is invalid or out of range).
+ */
+uint8_t ScpiParamFixed(SCPI_P &parameters, uint8_t decimals, uint32_t maximum, uint32_t &param)
+{
+    if (parameters.Size() == 0)
+        return FALSE;
+    const char *text = parameters.Pop();
+    if (*text == '+')
+        text++;
+    return ScpiParseMagnitude(text, maximum, param, decimals);
+}
+
+/**
+ * \brief Extracts a signed 32-bit integer parameter from the SCPI parameter list.
+ *
+ * This function checks if there are any parameters available. If so, it pops
+ * the last parameter from the list and converts it to a signed 32-bit integer.
+ *
+ * \param parameters A reference to the SCPI parameter list.
+ * \param param A reference to an int32_t variable where the extracted parameter will be stored.
+ * \return 1 if a signed 32-bit integer parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is invalid or out of range).
+ */
+uint8_t ScpiParamInt32(SCPI_P &parameters, int32_t &param)
+{
+    if (parameters.Size() == 0)
+        return FALSE;
+    return ScpiParseSigned(parameters.Pop(), INT32_MIN, INT32_MAX, param);
+}
+
+/**
+ * \brief Extracts a signed 8-bit integer parameter from the SCPI parameter list.
+ *
+ * This function checks if there are any parameters available. If so, it pops
+ * the last parameter from the list and converts it to a signed 8-bit integer.
+ *
+ * \param parameters A reference to the SCPI parameter list.
+ * \param param A reference to an int8_t variable where the extracted parameter will be stored.
+ * \return 1 if a signed 8-bit integer parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is invalid or out of range).
+ */
+uint8_t ScpiParamInt8(SCPI_P &parameters, int8_t &param)
+{
+    int32_t value;
+    if (parameters.Size() == 0 || !ScpiParseSigned(parameters.Pop(), INT8_MIN, INT8_MAX, value))
+        return FALSE;
+    param = value;
     return TRUE;
 }
 
@@ -81,17 +311,38 @@ uint8_t ScpiParamUInt32(SCPI_P &parameters, uint32_t &param)
  * \brief Extracts a double-precision floating-point parameter from the SCPI parameter list.
  *
  * This function checks if there are any parameters available. If so, it pops
- * the last parameter from the list and converts it to a double.
+ * the last parameter from the list and converts it to a double, scaled by
+ * its SI multiplier suffix if there is one.
  *
  * \param parameters A reference to the SCPI parameter list.
  * \param param A reference to a double variable where the extracted parameter will be stored.
- * \return 1 if a double-precision floating-point parameter was successfully extracted, 0 otherwise (if no parameters are available).
+ * \return 1 if a double-precision floating-point parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is invalid).
  */
 uint8_t ScpiParamDouble(SCPI_P &parameters, double &param)
 {
     if (parameters.Size() == 0)
         return FALSE;
-    param = String(parameters.Pop()).toDouble();
+    const char *text = parameters.Pop();
+
+    // Only decimal numbers, strtod() also accepts INF and NAN
+    const char *mantissa = (*text == '-' || *text == '+') ? text + 1 : text;
+    if (!isdigit(*mantissa) && !(*mantissa == '.' && isdigit(mantissa[1])))
+        return FALSE;
+
+    char *end;
+    double value = strtod(text, &end);
+    int8_t exponent;
+    if (!ScpiParseExponent(end, exponent))
+        return FALSE;
+
+    for (; exponent > 0; exponent--)
+        value *= 10.0;
+    for (; exponent < 0; exponent++)
+        value /= 10.0;
+    if (isinf(value))
+        return FALSE;
+
+    param = value;
     return TRUE;
 }
 
@@ -99,8 +350,8 @@ uint8_t ScpiParamDouble(SCPI_P &parameters, double &param)
  * \brief Extracts a boolean parameter ('ON', '1', 'OFF', or '0') from the SCPI parameter list.
  *
  * This function checks if there are any parameters available. If so, it pops
- * the last parameter from the list, converts it to uppercase, and checks if it
- * matches "ON", "1" (for true) or "OFF", "0" (for false).
+ * the last parameter from the list and checks if it matches "ON", "1" (for
+ * true) or "OFF", "0" (for false), ignoring case.
  *
  * \param parameters A reference to the SCPI parameter list.
  * \param param A reference to a bool variable where the extracted parameter will be stored.
@@ -110,12 +361,11 @@ uint8_t ScpiParamBool(SCPI_P &parameters, bool &param)
 {
     if (parameters.Size() == 0)
         return FALSE;
-    String rawParam = String(parameters.Pop());
-    rawParam.toUpperCase();
+    const char *rawParam = parameters.Pop();
 
-    if (rawParam == "ON" || rawParam == "1")
+    if (strcasecmp_P(rawParam, PSTR("ON")) == 0 || strcmp_P(rawParam, PSTR("1")) == 0)
         param = TRUE;
-    else if (rawParam == "OFF" || rawParam == "0")
+    else if (strcasecmp_P(rawParam, PSTR("OFF")) == 0 || strcmp_P(rawParam, PSTR("0")) == 0)
         param = FALSE;
     else
         return FALSE;
@@ -131,23 +381,25 @@ uint8_t ScpiParamBool(SCPI_P &parameters, bool &param)
  * If a match is found, the corresponding numerical tag is stored in the output parameter.
  *
  * \param parameters A reference to the SCPI parameter list.
- * \param options A pointer to an array of SCPI_choice_def_t structures defining the valid choices.
+ * \param options A pointer to an array of SCPI_choice_def_t structures in program memory defining the valid choices.
  * \param optionsSize The number of elements in the \a options array.
  * \param param A reference to a uint8_t variable where the numerical tag of the matched choice will be stored.
  * \return 1 if a valid choice parameter was found and its tag was extracted, 0 otherwise (if no parameters are available or no match is found).
  */
 uint8_t ScpiParamChoice(SCPI_P &parameters, const SCPI_choice_def_t *options, size_t optionsSize, uint8_t &param)
 {
-    String paramStr;
+    const char *paramStr;
     uint8_t result = ScpiParamString(parameters, paramStr);
     if (result)
     {
         // Check if the parsed string matches any of the valid choices
         for (size_t i = 0; i < optionsSize; i++)
         {
-            if (paramStr.equalsIgnoreCase(options[i].stem) || paramStr.equalsIgnoreCase(options[i].stem + options[i].suffix))
+            size_t stemLength = strlen_P(options[i].stem);
+            if (strncasecmp_P(paramStr, options[i].stem, stemLength) == 0 &&
+                (paramStr[stemLength] == '\0' || strcasecmp_P(paramStr + stemLength, options[i].suffix) == 0))
             {
-                param = options[i].tag;
+                param = (int8_t)pgm_read_byte(&options[i].tag);
                 return TRUE;
             }
         }
@@ -155,29 +407,132 @@ uint8_t ScpiParamChoice(SCPI_P &parameters, const SCPI_choice_def_t *options, si
     return FALSE;
 }
 
+/**
+ * \brief Extracts a definite length arbitrary block parameter from the SCPI parameter list.
+ *
+ * This function pops the last parameter and checks that it is one block,
+ * `#<n><length><data>`, optionally followed by whitespace. The data is not
+ * copied, it stays in the parser buffer and is valid until the next message
+ * is read. It can contain any byte values, including null characters.
+ *
+ * \param parameters A reference to the SCPI parameter list.
+ * \param data A reference to a pointer where the start of the block data will be stored.
+ * \param length A reference to a uint16_t variable where the number of data bytes will be stored.
+ * \return 1 if a block parameter was successfully extracted, 0 otherwise (if no parameters are available or the parameter is not a block).
+ */
+uint8_t ScpiParamBlock(SCPI_P &parameters, const char *&data, uint16_t &length)
+{
+    const char *param;
+    if (!ScpiParamString(parameters, param))
+        return FALSE;
+
+    uint8_t header = SCPI_Block_Scanner::Header(param, length);
+    if (header == 0)
+        return FALSE;
+
+    // Nothing but whitespace may follow the data
+    const char *end = param + header + length;
+    while (isspace(*end))
+        end++;
+    if (*end != '\0')
+        return FALSE;
+
+    data = param + header;
+    return TRUE;
+}
+
 /**
  * \brief Converts a numerical choice tag back to its string representation.
  *
  * This function iterates through the provided list of valid choices and compares
  * the input numerical tag with the tag of each choice. If a match is found,
  * the stem and suffix of the corresponding choice are concatenated and stored
- * in the output string.
+ * in the output buffer.
  *
- * \param options A pointer to an array of SCPI_choice_def_t structures defining the valid choices.
+ * \param options A pointer to an array of SCPI_choice_def_t structures in program memory defining the valid choices.
  * \param optionsSize The number of elements in the \a options array.
  * \param value The numerical tag to convert to a string.
- * \param name A reference to a String variable where the string representation of the tag will be stored.
- * \return 1 if a matching choice was found and its name was stored in \a name, 0 otherwise (if no matching tag is found).
+ * \param name A buffer of \ref SCPI_CHOICE_NAME_LENGTH characters where the string representation of the tag will be stored.
+ * \return 1 if a matching choice was found and its name was stored in \a name, 0 otherwise (if no matching tag is found, \a name is then empty).
  */
-uint8_t ScpiChoiceToName(const SCPI_choice_def_t *options, size_t optionsSize, int8_t value, String &name)
+uint8_t ScpiChoiceToName(const SCPI_choice_def_t *options, size_t optionsSize, int8_t value, char *name)
 {
     for (size_t i = 0; i < optionsSize; i++)
     {
-        if (options[i].tag == value)
+        if ((int8_t)pgm_read_byte(&options[i].tag) == value)
         {
-            name = options[i].stem + options[i].suffix;
+            strcpy_P(name, options[i].stem);
+            strcat_P(name, options[i].suffix);
             return TRUE;
         }
     }
+    name[0] = '\0';
     return FALSE;
-}
\ No newline at end of file
+}
+
+/**
+ * \brief Prints a fixed-point number in decimal.
+ *
+ * The digits are generated with the narrowest division the remaining value
+ * needs, so most numbers only use 16-bit divisions, and they are written with
+ * a single call.
+ *
+ * \param interface The interface to print to.
+ * \param value The number, in units of the last decimal place.
+ * \param decimals The number of decimal places.
+ */
+void ScpiPrintFixed(Print &interface, int64_t value, uint8_t decimals)
+{
+    // Sign, 20 digits, decimal point
+    char text[22];
+    uint8_t i = sizeof(text);
+    uint64_t magnitude = (value < 0) ? -(uint64_t)value : value;
+
+    // At least one digit before the decimal point
+    for (uint8_t digits = 0; magnitude != 0 || digits <= decimals; digits++)
+    {
+        if (digits == decimals && decimals != 0)
+            text[--i] = '.';
+
+        uint8_t digit;
+        if (magnitude > UINT32_MAX)
+        {
+            digit = magnitude % 10;
+            magnitude /= 10;
+        }
+        else if (magnitude > UINT16_MAX)
+        {
+            digit = (uint32_t)magnitude % 10;
+            magnitude = (uint32_t)magnitude / 10;
+        }
+        else
+        {
+            digit = (uint16_t)magnitude % 10;
+            magnitude = (uint16_t)magnitude / 10;
+        }
+        text[--i] = '0' + digit;
+    }
+    if (value < 0)
+        text[--i] = '-';
+
+    interface.write((const uint8_t *)&text[i], sizeof(text) - i);
+}
+
+/**
+ * \brief Prints the header of a definite length arbitrary block.
+ *
+ * The header `#<n><length>` is followed by \p length data bytes, which the
+ * caller writes after it.
+ *
+ * \param interface The interface to print to.
+ * \param length The number of data bytes of the block.
+ */
+void ScpiPrintBlockHeader(Print &interface, uint16_t length)
+{
+    uint8_t digits = 1;
+    for (uint16_t rest = length; rest >= 10; rest /= 10)
+        digits++;
+    interface.print('#');
+    interface.print((char)('0' + digits));
+    interface.print(length);
+}
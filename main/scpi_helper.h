@@ -27,6 +27,15 @@
 #include "config.h"
 #include "scpi_parser.h"
 
+//! Length of the longest choice keyword stem, including the terminator.
+#define SCPI_CHOICE_STEM_LENGTH 5
+
+//! Length of the longest choice keyword suffix, including the terminator.
+#define SCPI_CHOICE_SUFFIX_LENGTH 6
+
+//! Length of a buffer for a full choice name, see \ref ScpiChoiceToName.
+#define SCPI_CHOICE_NAME_LENGTH (SCPI_CHOICE_STEM_LENGTH + SCPI_CHOICE_SUFFIX_LENGTH - 1)
+
 /*! \struct _SCPI_choice_def_t
  * \brief Defines a structure for SCPI choice options.
  *
@@ -34,22 +43,69 @@
  * This structure is used to define the possible choices for SCPI parameters
  * that accept a limited set of string values. It includes the stem and suffix
  * of the command keyword, as well as a numerical tag associated with the choice.
+ * Choice tables are stored in program memory (PROGMEM).
  */
 typedef struct _SCPI_choice_def_t
 {
-    String stem;   /*!< Choice keyword stem. */
-    String suffix; /*!< Choice keyword suffix. */
-    int8_t tag;    /*!< Numerical tag. */
+    char stem[SCPI_CHOICE_STEM_LENGTH];     /*!< Choice keyword stem. */
+    char suffix[SCPI_CHOICE_SUFFIX_LENGTH]; /*!< Choice keyword suffix. */
+    int8_t tag;                             /*!< Numerical tag. */
 } SCPI_choice_def_t;
 
+//! Fraction bits of the fixed-point measurement scale factors.
+#define SCPI_FIXED_SHIFT 12
+
+/*!
+ * \brief Power of ten.
+ *
+ * \param exponent The exponent.
+ * \return 10 to the power of \p exponent.
+ */
+constexpr uint32_t ScpiPow10(uint8_t exponent)
+{
+    return (exponent == 0) ? 1 : 10 * ScpiPow10(exponent - 1);
+}
+
+/*!
+ * \brief Fixed-point scale factor of a measurement.
+ *
+ * Evaluated at compile time, so no floating point code is used at run time.
+ *
+ * \param unitsPerCount Measurement unit per register count.
+ * \param shift Number of fraction bits.
+ * \return Scale factor with \p shift fraction bits, from register counts to
+ * units with \ref SCPI_MEASURE_DECIMALS decimal places.
+ */
+constexpr uint32_t ScpiFixedScale(double unitsPerCount, uint8_t shift = SCPI_FIXED_SHIFT)
+{
+    return (uint32_t)(unitsPerCount * ScpiPow10(SCPI_MEASURE_DECIMALS) * (1UL << shift) + 0.5);
+}
+
+/*!
+ * \brief Scales a register value with a fixed-point scale factor.
+ *
+ * \param value The register value.
+ * \param scale Scale factor from \ref ScpiFixedScale.
+ * \return The rounded measurement with \ref SCPI_MEASURE_DECIMALS decimal places.
+ */
+static inline int32_t ScpiFixedMultiply(int32_t value, uint32_t scale)
+{
+    return (value * (int32_t)scale + (1L << (SCPI_FIXED_SHIFT - 1))) >> SCPI_FIXED_SHIFT;
+}
+
 // Prototypes
-uint8_t ScpiParamString(SCPI_P &parameters, String &param);
+uint8_t ScpiParamString(SCPI_P &parameters, const char *&param);
 uint8_t ScpiParamUInt8(SCPI_P &parameters, uint8_t &param);
 uint8_t ScpiParamUInt32(SCPI_P &parameters, uint32_t &param);
+uint8_t ScpiParamInt32(SCPI_P &parameters, int32_t &param);
+uint8_t ScpiParamFixed(SCPI_P &parameters, uint8_t decimals, uint32_t maximum, uint32_t &param);
 uint8_t ScpiParamDouble(SCPI_P &parameters, double &param);
 uint8_t ScpiParamBool(SCPI_P &parameters, bool &param);
 uint8_t ScpiParamInt8(SCPI_P &parameters, int8_t &param);
 uint8_t ScpiParamChoice(SCPI_P &parameters, const SCPI_choice_def_t *options, size_t optionsSize, uint8_t &param);
-uint8_t ScpiChoiceToName(const SCPI_choice_def_t *options, size_t optionsSize, int8_t value, String &name);
+uint8_t ScpiParamBlock(SCPI_P &parameters, const char *&data, uint16_t &length);
+uint8_t ScpiChoiceToName(const SCPI_choice_def_t *options, size_t optionsSize, int8_t value, char *name);
+void ScpiPrintFixed(Print &interface, int64_t value, uint8_t decimals = SCPI_MEASURE_DECIMALS);
+void ScpiPrintBlockHeader(Print &interface, uint16_t length);
 
 #endif // _SCPI_HELPER_H_
\ No newline at end of file
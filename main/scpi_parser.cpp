@@ -14,11 +14,8 @@
 
         This class provides the functionality to parse and execute commands adhering to
         the Standard Commands for Programmable Instruments (SCPI) syntax. It includes
-        methods for registering SCPI commands with associated callback functions, setting
-        a command tree base for hierarchical command organization, processing incoming
-        SCPI messages from a serial stream, and handling errors. The class also defines
-        internal structures and variables used for command storage, tokenization, and
-        hashing to efficiently match received commands with their registered handlers.
+        matching of received commands with the command table in flash, processing of
+        incoming SCPI messages from a serial stream, and error handling.
 
    \author
         Nexperia: http://www.nexperia.com
@@ -46,297 +43,120 @@ void DefaultErrorHandler(SCPI_C c, SCPI_P p, Stream &interface) {}
  * \brief SCPI_Parser class constructor.
  *
  * \details
- * Initializes the SCPI_Parser object. It sets the default error handler
- * to a no-operation function.
+ * Initializes the SCPI_Parser object with a command table. It sets the default
+ * error handler to a no-operation function.
  *
  * \code
- * SCPI_Parser my_instrument;
+ * SCPI_Parser my_instrument(my_table);
  * \endcode
+ *
+ * \param table The command table, with all of its tables stored in flash.
  */
-SCPI_Parser::SCPI_Parser()
-{
-  callers_[max_commands] = &DefaultErrorHandler;
-}
+SCPI_Parser::SCPI_Parser(const SCPI_Table &table) : table_(table), error_handler_(&DefaultErrorHandler) {}
 
 /**
- * \brief Adds a token to the internal tokens' storage.
+ * \brief Gets the index of a received keyword in the keyword table.
  *
  * \details
- * This private method adds a given token (keyword) to the internal storage
- * used for command parsing. It prevents adding duplicate tokens and checks
- * for potential overflow of the token storage. Query symbols ('?') at the
- * end of the token are removed before storing.
+ * The hash of the keyword is looked up by binary search in the keyword form
+ * table, and the keyword found is compared with the received one. Either the
+ * short or the long form matches, in any case.
  *
- * \param token A pointer to a null-terminated character array representing the token to add.
+ * \param keyword A pointer to the received keyword.
+ * \param length The length of the keyword without the query symbol.
+ * \return The index of the keyword, or \ref SCPI_EMPTY_ENTRY if it is unknown.
  */
-void SCPI_Parser::AddToken_(char *token)
+uint8_t SCPI_Parser::FindKeyword_(const char *keyword, uint8_t length)
 {
-  if (tokens_size_ >= max_tokens)
+  scpi_hash_t hash = ScpiKeywordHash(keyword, length);
+  uint8_t low = 0;
+  uint8_t high = table_.keyword_form_count;
+  while (low < high)
   {
-    setup_errors.token_overflow = true;
-    return;
+    uint8_t middle = (low + high) / 2;
+    uint8_t form = pgm_read_byte(&table_.keyword_forms[middle]);
+    const SCPI_Keyword *entry = &table_.keywords[form / 2];
+    scpi_hash_t candidate;
+    memcpy_P(&candidate, (form & 1) ? &entry->long_hash : &entry->short_hash, sizeof(candidate));
+    if (candidate < hash)
+    {
+      low = middle + 1;
+    }
+    else if (candidate > hash)
+    {
+      high = middle;
+    }
+    else
+    {
+      // Check that the keyword is not just another one with the same hash
+      SCPI_Keyword found;
+      memcpy_P(&found, entry, sizeof(found));
+      if ((length != ScpiShortLength(found.name)) and (length != ScpiLongLength(found.name)))
+        return SCPI_EMPTY_ENTRY;
+      if (strncasecmp(keyword, found.name, length) != 0)
+        return SCPI_EMPTY_ENTRY;
+      return form / 2;
+    }
   }
-  size_t token_size = strlen(token);
-  // Remove query symbols
-  if (token[token_size - 1] == '?')
-    token_size--;
-  for (uint8_t i = 0; i < tokens_size_; i++)
-    // Check if the token is already added
-    if ((strncmp(token, tokens_[i], token_size) == 0) and (token_size == strlen(tokens_[i])))
-      return;
-  char *stored_token = new char[token_size + 1];
-  strncpy(stored_token, token, token_size);
-  stored_token[token_size] = '\0';
-  tokens_[tokens_size_] = stored_token;
-  tokens_size_++;
+  return SCPI_EMPTY_ENTRY;
 }
 
 /**
- * \brief Gets a hash code for a valid SCPI command.
+ * \brief Gets the index of a received command in the command table.
  *
  * \details
- * This private method calculates a hash code for a given SCPI command
- * represented by a \ref SCPI_Commands object. The hash is computed based
- * on the sequence of keywords in the command and the currently set
- * command tree base. If any of the keywords in the command are not
- * registered as known tokens, the function returns `unknown_hash`.
+ * The hash code of the command is calculated from the indices of its keywords
+ * as in \ref ScpiCommandCode(), and looked up by binary search in the command
+ * order table.
  *
  * \param commands A reference to the \ref SCPI_Commands object representing the command keywords.
- * \return The calculated hash code for the command, or `unknown_hash` if unregistered tokens are found.
- *
- * \see SetCommandTreeBase
+ * \return The index of the command, or \ref SCPI_EMPTY_ENTRY if it is unknown.
  */
-scpi_hash_t SCPI_Parser::GetCommandCode_(SCPI_Commands &commands)
+uint8_t SCPI_Parser::FindCommand_(SCPI_Commands &commands)
 {
-  if (tree_code_ == invalid_hash)
-    return invalid_hash;
-  scpi_hash_t code;
-  code = (tree_code_ == 0) ? hash_magic_offset : tree_code_;
   if (commands.Size() == 0)
-    return unknown_hash;
+    return SCPI_EMPTY_ENTRY;
+  scpi_hash_t code = SCPI_HASH_MAGIC_OFFSET;
   // Loop all keywords in the command
   for (uint8_t i = 0; i < commands.Size(); i++)
   {
     // Get keywords's length
-    size_t header_length = strlen(commands[i]);
+    uint8_t header_length = strlen(commands[i]);
     // For the last keyword remove the query symbol if needed
     bool is_query = false;
     if (i == commands.Size() - 1)
     {
-      is_query = (commands[i][header_length - 1] == '?');
+      is_query = (header_length > 0) and (commands[i][header_length - 1] == '?');
       if (is_query)
         header_length--;
     }
 
-    // Loop over all the known tokens
-    for (uint8_t j = 0; j < tokens_size_; j++)
-    {
-      // Get the token's short and long lengths
-      size_t short_length = 0;
-      while (isupper(tokens_[j][short_length]))
-        short_length++;
-      size_t long_length = strlen(tokens_[j]);
-
-      // If the token allows numeric suffixes
-      // remove the trailing digits from the keyword
-      if ((tokens_[j][long_length - 1] == '#') and (commands[i][header_length - 1] != '#'))
-      {
-        long_length--;
-        while (isdigit(commands[i][header_length - 1]))
-          header_length--;
-      }
-
-      // Test if the keyword match with the token
-      // otherwise test next token
-      if (header_length == short_length)
-      {
-        for (uint8_t k = 0; k < short_length; k++)
-          if (not(toupper(commands[i][k]) == tokens_[j][k]))
-            goto no_header_token_match;
-      }
-      else if (header_length == long_length)
-      {
-        for (uint8_t k = 0; k < long_length; k++)
-          if (not(toupper(commands[i][k]) == toupper(tokens_[j][k])))
-            goto no_header_token_match;
-      }
-      else
-      {
-        goto no_header_token_match;
-      }
-
-      // Apply the hashing step using token number j
-      // hash(i) = hash(i - 1) * hash_magic_number + j
-      code *= hash_magic_number;
-      code += j;
-      break;
-
-    no_header_token_match:;
-      // If the keyword does not match any token return unknown_hash
-      if (j == (tokens_size_ - 1))
-        return unknown_hash;
-    }
+    uint8_t keyword = FindKeyword_(commands[i], header_length);
+    if (keyword == SCPI_EMPTY_ENTRY)
+      return SCPI_EMPTY_ENTRY;
+    code = ScpiHashStep(code, keyword);
+
     // If last keyword is a query, add a hashing step
     if (is_query)
-    {
-      code *= hash_magic_number;
-      code -= 1;
-    }
-  }
-  return code;
-}
-
-/**
- * \brief Changes the base of the command tree for subsequent RegisterCommand calls.
- *
- * \details
- * This method sets a new tree base for organizing SCPI commands hierarchically.
- * The tree base is a sequence of command keywords separated by colons (':').
- * Subsequent calls to \ref RegisterCommand will have their command hashes
- * calculated relative to this tree base. An empty string `""` resets the
- * tree base to the root.
- *
- * \param tree_base A pointer to a null-terminated character array (RAM string) representing the new tree base.
- * Example: `"SYSTem:COMMunication"`.
- *
- * \see RegisterCommand
- */
-void SCPI_Parser::SetCommandTreeBase(char *tree_base)
-{
-  SCPI_Commands tree_tokens(tree_base);
-  if (tree_tokens.Size() == 0)
-  {
-    tree_code_ = 0;
-    tree_length_ = 0;
-    return;
-  }
-  for (uint8_t i = 0; i < tree_tokens.Size(); i++)
-    AddToken_(tree_tokens[i]);
-  tree_code_ = 0;
-  tree_code_ = this->GetCommandCode_(tree_tokens);
-  tree_length_ = tree_tokens.Size();
-  if (tree_tokens.overflow_error)
-  {
-    setup_errors.branch_overflow = true;
-    tree_code_ = invalid_hash;
+      code = ScpiHashStep(code, SCPI_QUERY_STEP);
   }
-}
-
-/**
- * \brief SetCommandTreeBase version with RAM string support.
- *
- * \details
- * This overload of \ref SetCommandTreeBase accepts a constant character pointer
- * for the tree base string, which resides in RAM.
- *
- * \param tree_base A constant pointer to a null-terminated character array (RAM string) representing the new tree base.
- * Example: `"SYSTem:LED"`.
- *
- * \see SetCommandTreeBase(char *tree_base)
- */
-void SCPI_Parser::SetCommandTreeBase(const char *tree_base)
-{
-  strcpy(msg_buffer_, tree_base);
-  this->SetCommandTreeBase(msg_buffer_);
-}
-
-/**
- * \brief SetCommandTreeBase version with Flash strings (F() macro) support.
- *
- * \details
- * This overload of \ref SetCommandTreeBase accepts a Flash string helper object,
- * allowing the tree base string to reside in program memory (Flash), saving RAM.
- *
- * \param tree_base A Flash string helper object (created using the F() macro) representing the new tree base.
- * Example: `F("SYSTem:LED")`.
- *
- * \see SetCommandTreeBase(char *tree_base)
- */
-void SCPI_Parser::SetCommandTreeBase(const __FlashStringHelper *tree_base)
-{
-  strcpy_P(msg_buffer_, (const char *)tree_base);
-  this->SetCommandTreeBase(msg_buffer_);
-}
 
-/**
- * \brief Registers a new valid SCPI command and associates a callback function with it.
- *
- * \details
- * This method registers a new SCPI command that the parser will recognize. When
- * a matching command is received and parsed, the provided callback function
- * will be executed. The command string can include a query symbol ('?') for
- * query commands. The command is tokenized, and each token is added to the
- * internal token storage if it's not already present. The command's hash
- * is calculated based on the current tree base.
- *
- * \param command A pointer to a null-terminated character array (RAM string) representing the command.
- * Example: `"*IDN?"`, `"MEASure:VOLTage?"`, `"CONFigure:VOLTage 10.5"`.
- * \param caller A function pointer to the callback function (\ref SCPI_caller_t)
- * to be executed when the command is received.
- */
-void SCPI_Parser::RegisterCommand(char *command, SCPI_caller_t caller)
-{
-  if (codes_size_ >= max_commands)
+  uint8_t low = 0;
+  uint8_t high = table_.command_count;
+  while (low < high)
   {
-    setup_errors.command_overflow = true;
-    return;
+    uint8_t middle = (low + high) / 2;
+    uint8_t index = pgm_read_byte(&table_.command_order[middle]);
+    scpi_hash_t candidate;
+    memcpy_P(&candidate, &table_.commands[index].code, sizeof(candidate));
+    if (candidate < code)
+      low = middle + 1;
+    else if (candidate > code)
+      high = middle;
+    else
+      return index;
   }
-  SCPI_Commands command_tokens(command);
-  for (uint8_t i = 0; i < command_tokens.Size(); i++)
-    this->AddToken_(command_tokens[i]);
-  scpi_hash_t code = this->GetCommandCode_(command_tokens);
-
-  // Check for errors
-  if (code == unknown_hash)
-    code = invalid_hash;
-  bool overflow_error = command_tokens.overflow_error;
-  overflow_error |= (tree_length_ + command_tokens.Size()) > command_tokens.storage_size;
-  setup_errors.command_overflow |= overflow_error;
-  if (overflow_error)
-    code = invalid_hash;
-
-  valid_codes_[codes_size_] = code;
-  callers_[codes_size_] = caller;
-  codes_size_++;
-}
-
-/**
- * \brief RegisterCommand version with RAM string support.
- *
- * \details
- * This overload of \ref RegisterCommand accepts a constant character pointer
- * for the command string, which resides in RAM.
- *
- * \param command A constant pointer to a null-terminated character array (RAM string) representing the command.
- * Example: `"*IDN?"`.
- * \param caller A function pointer to the callback function (\ref SCPI_caller_t).
- *
- * \see RegisterCommand(char *command, SCPI_caller_t caller)
- */
-void SCPI_Parser::RegisterCommand(const char *command, SCPI_caller_t caller)
-{
-  strcpy(msg_buffer_, command);
-  this->RegisterCommand(msg_buffer_, caller);
-}
-
-/**
- * \brief RegisterCommand version with Flash strings (F() macro) support.
- *
- * \details
- * This overload of \ref RegisterCommand accepts a Flash string helper object,
- * allowing the command string to reside in program memory (Flash), saving RAM.
- *
- * \param command A Flash string helper object (created using the F() macro) representing the command.
- * Example: `F("*IDN?")`.
- * \param caller A function pointer to the callback function (\ref SCPI_caller_t).
- *
- * \see RegisterCommand(char *command, SCPI_caller_t caller)
- */
-void SCPI_Parser::RegisterCommand(const __FlashStringHelper *command,
-                                  SCPI_caller_t caller)
-{
-  strcpy_P(msg_buffer_, (const char *)command);
-  this->RegisterCommand(msg_buffer_, caller);
+  return SCPI_EMPTY_ENTRY;
 }
 
 /**
@@ -354,7 +174,7 @@ void SCPI_Parser::RegisterCommand(const __FlashStringHelper *command,
  */
 void SCPI_Parser::SetErrorHandler(SCPI_caller_t caller)
 {
-  callers_[max_commands] = caller;
+  error_handler_ = caller;
 }
 
 /**
@@ -364,8 +184,11 @@ void SCPI_Parser::SetErrorHandler(SCPI_caller_t caller)
  * This method takes a SCPI message as input, parses it into commands and
  * parameters, and then attempts to find a registered command that matches.
  * If a match is found, the associated callback function is executed, with
- * the parsed commands, parameters, and the communication interface passed as arguments.
- * The message can contain multiple commands separated by semicolons (';').
+ * the parsed commands, parameters, and the response buffer passed as arguments.
+ * The message can contain multiple commands separated by semicolons (';'),
+ * which are not searched for in block data.
+ * Their responses are collected and sent to the interface at once, without
+ * waiting for it, when the whole message has been executed.
  *
  * \param message A pointer to a null-terminated character array containing the SCPI message to process.
  * Example: `"*IDN?; MEASure:VOLTage?"`.
@@ -375,45 +198,49 @@ void SCPI_Parser::SetErrorHandler(SCPI_caller_t caller)
  */
 void SCPI_Parser::Execute(char *message, Stream &interface)
 {
+  response_.Begin(interface);
   while (message != NULL)
   {
     // Save multicomands for later
-    char *multicomands = strpbrk(message, ";");
+    char *multicomands = SCPI_Block_Scanner::Find(message, ';');
     if (multicomands != NULL)
     {
       multicomands[0] = '\0';
       multicomands++;
     }
 
-    tree_code_ = 0;
     SCPI_Commands commands(message);
     message = multicomands;
     SCPI_Parameters parameters(commands.not_processed_message);
-    scpi_hash_t code = this->GetCommandCode_(commands);
-    if (code == unknown_hash)
+    uint8_t index = this->FindCommand_(commands);
+    if (index == SCPI_EMPTY_ENTRY)
     {
       // Call ErrorHandler UnknownCommand
       last_error = ErrorCode::UnknownCommand;
-      (*callers_[max_commands])(commands, parameters, interface);
+      (*error_handler_)(commands, parameters, response_);
       continue;
     }
-    for (uint8_t i = 0; i < codes_size_; i++)
-      if (valid_codes_[i] == code)
-      {
-        (*callers_[i])(commands, parameters, interface);
-        break;
-      }
+    SCPI_caller_t caller = (SCPI_caller_t)pgm_read_ptr(&table_.commands[index].caller);
+    (*caller)(commands, parameters, response_);
   }
+
+  // Send the responses of all commands at once
+  if (!response_.End())
+    last_error = ErrorCode::OutputOverflow;
+  response_.Send();
 }
 
 /**
  * \brief Reads a message from a Stream interface and executes it.
  *
  * \details
- * This method continuously reads data from the provided Stream interface
+ * This method reads the available data from the provided Stream interface
  * until a termination character (or sequence of characters) is detected.
  * Once a complete message is received, it is passed to the \ref Execute
- * method for parsing and execution.
+ * method for parsing and execution. One message is executed per call, further
+ * received messages stay queued for the next calls. No message is executed
+ * until the response of the last one has been sent, so the responses never
+ * wait for the interface.
  *
  * \param interface A reference to a Stream object (e.g., Serial) to read the message from.
  * \param term_chars A constant pointer to a null-terminated character array containing the termination characters for a message (e.g., "\n", "\r\n").
@@ -423,6 +250,11 @@ void SCPI_Parser::Execute(char *message, Stream &interface)
  */
 void SCPI_Parser::ProcessInput(Stream &interface, const char *term_chars)
 {
+  // Finish sending the last response first
+  response_.Send();
+  if (response_.Pending() > 0)
+    return;
+
   char *message = this->GetMessage(interface, term_chars);
   if (message != NULL)
   {
@@ -430,12 +262,103 @@ void SCPI_Parser::ProcessInput(Stream &interface, const char *term_chars)
   }
 }
 
+/**
+ * \brief Starts output that is not the response to a command.
+ *
+ * \details
+ * Output such as a streamed record is written through the response buffer, so
+ * it never splits a response. It is only started when the last response or
+ * output has been sent, so output and received messages take turns.
+ *
+ * \param interface A reference to a Stream object (e.g., Serial) to write the output to.
+ * \return The stream to write the output to, or NULL while earlier output is still being sent.
+ *
+ * \see EndOutput
+ */
+Stream *SCPI_Parser::BeginOutput(Stream &interface)
+{
+  response_.Send();
+  if (response_.Pending() > 0)
+    return NULL;
+
+  response_.Begin(interface);
+  return &response_;
+}
+
+/**
+ * \brief Finishes output started with \ref BeginOutput and sends it.
+ *
+ * \return false if the output did not fit in the response buffer and was discarded, true otherwise.
+ */
+bool SCPI_Parser::EndOutput()
+{
+  bool complete = response_.End();
+  response_.Send();
+  return complete;
+}
+
+/**
+ * \brief Matches the termination characters with one more received character.
+ *
+ * \param block The block data scanner of the message.
+ * \param c The received character.
+ * \param term_chars The termination characters.
+ * \param matched The number of termination characters matched before \p c.
+ * \return The number of termination characters matched with \p c.
+ */
+uint8_t SCPI_Parser::MatchTerm_(SCPI_Block_Scanner &block, char c, const char *term_chars, uint8_t matched)
+{
+  // Block data is never a termination char
+  if (block.Scan(c))
+    return 0;
+  if (c == term_chars[matched])
+    return matched + 1;
+  return (c == term_chars[0]);
+}
+
+/**
+ * \brief Reads a received character that has not been returned as a message.
+ *
+ * \details
+ * This method takes the characters queued after the last returned message out
+ * of the receive ring buffer, unchanged, so a command that switches the
+ * interface to another protocol loses none of the data sent after it. The
+ * characters left in the ring buffer are scanned again for messages by the
+ * next call of \ref GetMessage.
+ *
+ * \return The oldest queued character, or -1 if the ring buffer is empty.
+ */
+int SCPI_Parser::ReadQueued()
+{
+  rx_messages_ = 0;
+  message_length_ = 0;
+  term_matched_ = 0;
+  rx_block_ = SCPI_Block_Scanner();
+  if (rx_tail_ == rx_head_)
+    return -1;
+
+  uint8_t c = rx_buffer_[rx_tail_ % SCPI_RX_BUFFER_LENGTH];
+  ++rx_tail_;
+  rx_scan_ = rx_tail_;
+  return c;
+}
+
 /**
  * \brief Reads a message from a Stream interface until termination characters are found.
  *
  * \details
- * This method reads characters from the provided Stream interface and stores
- * them in an internalinternal buffer until one of the specified termination character sequences is encountered. It also handles communication timeouts and buffer overflows, calling the error handler if either occurs.
+ * This method moves the available characters from the provided Stream
+ * interface to the receive ring buffer, as long as it has room for them. The
+ * termination characters are matched incrementally as every character is
+ * received, so only the end of the buffer is checked. The characters are
+ * queued unchanged, so the ones after a message can still be read by \ref
+ * ReadQueued. The data of definite length arbitrary blocks is never taken as
+ * termination characters, so blocks can hold any byte values. Several
+ * messages can be queued, and the oldest is copied to the internal message
+ * buffer, without its termination characters, and returned. It also handles
+ * communication timeouts and buffer overflows of the incomplete message,
+ * calling the error handler if either occurs. An incomplete message only
+ * overflows once the messages queued before it have been returned.
  *
  * \param interface A reference to a Stream object (e.g., Serial) to read the message from.
  * \param term_chars A constant pointer to a null-terminated character array containing the termination characters for a message (e.g., "\r\n").
@@ -443,57 +366,66 @@ void SCPI_Parser::ProcessInput(Stream &interface, const char *term_chars)
  */
 char *SCPI_Parser::GetMessage(Stream &interface, const char *term_chars)
 {
-  while (interface.available())
+  while (message_length_ < buffer_length)
   {
-    // Read the new char
-    msg_buffer_[message_length_] = interface.read();
+    // Scan the characters left in the ring buffer first, then read new ones
+    if (rx_scan_ == rx_head_)
+    {
+      if (((uint8_t)(rx_head_ - rx_tail_) >= SCPI_RX_BUFFER_LENGTH) || !interface.available())
+        break;
+      rx_buffer_[rx_head_ % SCPI_RX_BUFFER_LENGTH] = interface.read();
+      ++rx_head_;
+      time_checker_ = millis();
+    }
+    char c = rx_buffer_[rx_scan_ % SCPI_RX_BUFFER_LENGTH];
+    ++rx_scan_;
     ++message_length_;
-    time_checker_ = millis();
 
-    if (message_length_ >= buffer_length)
+    // Test for termination chars (end of the message)
+    term_matched_ = MatchTerm_(rx_block_, c, term_chars, term_matched_);
+    if (term_chars[term_matched_] == '\0')
     {
-      // Call ErrorHandler due BufferOverflow
-      last_error = ErrorCode::BufferOverflow;
-      (*callers_[max_commands])(SCPI_C(), SCPI_P(), interface);
+      // Queue the received message
+      ++rx_messages_;
       message_length_ = 0;
-      return NULL;
+      term_matched_ = 0;
+      rx_block_ = SCPI_Block_Scanner();
     }
+  }
+  // No more chars available yet, no more room for them or the incomplete
+  // message fills the message buffer
 
-#if SCPI_MAX_SPECIAL_COMMANDS
-    // For the first space only.
-    if (strcspn(msg_buffer_, " ") == message_length_ - 1)
-    {
-      msg_buffer_[message_length_ - 1] = '\0';
-      tree_code_ = 0;
-      SCPI_Commands commands(msg_buffer_);
-      scpi_hash_t code = this->GetCommandCode_(commands);
-      for (uint8_t i = 0; i < special_codes_size_; i++)
-        if (valid_special_codes_[i] == code)
-        {
-          (*special_callers_[i])(commands, interface);
-          message_length_ = 0;
-          return msg_buffer_;
-        }
-      // restore original message.
-      msg_buffer_[message_length_ - 1] = ' ';
-      for (uint8_t i = 0; i < commands.Size() - 1; i++)
-        commands[i][strlen(commands[i])] = ':';
-      commands.not_processed_message--;
-      commands.not_processed_message[0] = ' ';
-    }
-#endif
+  // The incomplete message only overflows once the messages before it are executed
+  if ((message_length_ >= buffer_length) && (rx_messages_ == 0))
+  {
+    // Call ErrorHandler due BufferOverflow
+    last_error = ErrorCode::BufferOverflow;
+    (*error_handler_)(SCPI_C(), SCPI_P(), interface);
+    rx_tail_ = rx_scan_;
+    message_length_ = 0;
+    term_matched_ = 0;
+    rx_block_ = SCPI_Block_Scanner();
+    return NULL;
+  }
 
-    // Test for termination chars (end of the message)
-    msg_buffer_[message_length_] = '\0';
-    if (strstr(msg_buffer_, term_chars) != NULL)
+  // Return the oldest received message
+  if (rx_messages_ > 0)
+  {
+    // The termination characters are found again, they are not copied
+    SCPI_Block_Scanner block;
+    uint8_t length = 0;
+    uint8_t matched = 0;
+    do
     {
-      // Return the received message
-      msg_buffer_[message_length_ - strlen(term_chars)] = '\0';
-      message_length_ = 0;
-      return msg_buffer_;
-    }
+      char c = rx_buffer_[rx_tail_ % SCPI_RX_BUFFER_LENGTH];
+      msg_buffer_[length++] = c;
+      ++rx_tail_;
+      matched = MatchTerm_(block, c, term_chars, matched);
+    } while (term_chars[matched] != '\0');
+    msg_buffer_[length - matched] = '\0';
+    --rx_messages_;
+    return msg_buffer_;
   }
-  // No more chars available yet
 
   // Return NULL if no message is incoming
   if (message_length_ == 0)
@@ -504,8 +436,11 @@ char *SCPI_Parser::GetMessage(Stream &interface, const char *term_chars)
   {
     // Call ErrorHandler due Timeout
     last_error = ErrorCode::Timeout;
-    (*callers_[max_commands])(SCPI_C(), SCPI_P(), interface);
+    (*error_handler_)(SCPI_C(), SCPI_P(), interface);
+    rx_tail_ = rx_scan_;
     message_length_ = 0;
+    term_matched_ = 0;
+    rx_block_ = SCPI_Block_Scanner();
     return NULL;
   }
 
@@ -514,244 +449,83 @@ char *SCPI_Parser::GetMessage(Stream &interface, const char *term_chars)
 }
 
 /**
- * \brief Prints debug information about the SCPI parser configuration and status to a Stream interface.
+ * \brief Prints debug information about the SCPI parser configuration and command table to a Stream interface.
  *
  * \details
- * This method prints various internal details of the SCPI parser, including
- * the maximum sizes of internal buffers and arrays, the currently registered
- * tokens and commands with their hash codes and associated handler function
- * addresses, and any setup errors that might have occurred (e.g., buffer
- * overflows). This information is useful for debugging and understanding
- * the parser's internal state.
+ * This method prints the sizes of the internal buffers, the keyword forms with
+ * their hashes, and the commands with their hash codes and handler function
+ * addresses, in the order they are searched. The tables are checked for hash
+ * collisions at compile time, so this is only useful for understanding the
+ * parser's internal state.
  *
  * \param interface A reference to a Stream object (e.g., Serial) to print the debug information to.
  */
 void SCPI_Parser::PrintDebugInfo(Stream &interface)
 {
   interface.println(F("*** DEBUG INFO ***\n"));
-  interface.print(F("Max command tree branches: "));
+  interface.print(F("Max command keywords: "));
   interface.print(SCPI_ARRAY_SIZE);
   interface.println(F(" (SCPI_ARRAY_SIZE)"));
-  if (setup_errors.branch_overflow)
-    interface.println(F(" **ERROR** Max branch size exceeded."));
   interface.print(F("Max number of parameters: "));
   interface.print(SCPI_ARRAY_SIZE);
   interface.println(F(" (SCPI_ARRAY_SIZE)"));
   interface.print(F("Message buffer size: "));
   interface.print(buffer_length);
-  interface.println(F(" (SCPI_BUFFER_LENGTH)\n"));
+  interface.println(F(" (SCPI_BUFFER_LENGTH)"));
+  interface.print(F("Receive buffer size: "));
+  interface.print(SCPI_RX_BUFFER_LENGTH);
+  interface.println(F(" (SCPI_RX_BUFFER_LENGTH)\n"));
 
-  interface.print(F("TOKENS : "));
-  interface.print(tokens_size_);
+  interface.print(F("KEYWORD FORMS : "));
+  interface.print(table_.keyword_form_count);
   interface.print(F(" / "));
-  interface.print(max_tokens);
-  interface.println(F(" (SCPI_MAX_TOKENS)"));
-  if (setup_errors.token_overflow)
-    interface.println(F(" **ERROR** Max tokens exceeded."));
-  for (uint8_t i = 0; i < tokens_size_; i++)
+  interface.print(SCPI_MAX_KEYWORD_FORMS);
+  interface.println(F(" (SCPI_MAX_KEYWORD_FORMS)"));
+  interface.println(F("  #\tHash\tKeyword"));
+  for (uint8_t i = 0; i < table_.keyword_form_count; i++)
   {
-    interface.print(F("  "));
-    interface.print(i + 1);
+    uint8_t form = pgm_read_byte(&table_.keyword_forms[i]);
+    SCPI_Keyword keyword;
+    memcpy_P(&keyword, &table_.keywords[form / 2], sizeof(keyword));
+    interface.print(F("  "));
+    interface.print(form / 2 + 1);
     interface.print(F(":\t"));
-    interface.println(String(tokens_[i]));
+    interface.print((form & 1) ? keyword.long_hash : keyword.short_hash, HEX);
+    interface.print(F("\t"));
+    interface.write((const uint8_t *)keyword.name, (form & 1) ? ScpiLongLength(keyword.name) : ScpiShortLength(keyword.name));
+    interface.println();
     interface.flush();
   }
   interface.println();
 
-  bool hash_crash = false;
-  bool unknown_error = false;
-  bool invalid_error = false;
-  interface.print(F("VALID CODES : "));
-  interface.print(codes_size_);
+  interface.print(F("COMMANDS : "));
+  interface.print(table_.command_count);
   interface.print(F(" / "));
-  interface.print(max_commands);
+  interface.print(SCPI_MAX_COMMANDS);
   interface.println(F(" (SCPI_MAX_COMMANDS)"));
-  if (setup_errors.command_overflow)
-    interface.println(F(" **ERROR** Max commands exceeded."));
-  interface.println(F("  #\tHash\t\tHandler"));
-  for (uint8_t i = 0; i < codes_size_; i++)
-  {
-    interface.print(F("  "));
-    interface.print(i + 1);
-    interface.print(F(":\t"));
-    interface.print(valid_codes_[i], HEX);
-    if (valid_codes_[i] == unknown_hash)
-    {
-      interface.print(F("!*"));
-      unknown_error = true;
-    }
-    else if (valid_codes_[i] == invalid_hash)
-    {
-      interface.print(F("!%"));
-      invalid_error = true;
-    }
-    else
-      for (uint8_t j = 0; j < i; j++)
-        if (valid_codes_[i] == valid_codes_[j])
-        {
-          interface.print("!!");
-          hash_crash = true;
-          break;
-        }
-    interface.print(F("\t\t0x"));
-    interface.print(long(callers_[i]), HEX);
-    interface.println();
-    interface.flush();
-  }
-  if (unknown_error)
-    interface.println(F(" **ERROR** Tried to register ukwnonk tokens. (!*)"));
-  if (invalid_error)
-    interface.println(F(" **ERROR** Tried to register invalid commands. (!%)"));
-  if (hash_crash)
-    interface.println(F(" **ERROR** Hash crashes found. (!!)"));
-
-#if SCPI_MAX_SPECIAL_COMMANDS
-  hash_crash = false;
-  unknown_error = false;
-  invalid_error = false;
-  interface.println();
-  interface.print(F("VALID SPECIAL CODES : "));
-  interface.print(special_codes_size_);
-  interface.print(F(" / "));
-  interface.print(max_special_commands);
-  interface.println(F(" (SCPI_MAX_SPECIAL_COMMANDS)"));
-  if (setup_errors.special_command_overflow)
-    interface.println(F(" **ERROR** Max special commands exceeded."));
-  interface.println(F("  #\tHash\t\tHandler"));
-  for (uint8_t i = 0; i < special_codes_size_; i++)
+  interface.println(F("  #\tHash\t\tHandler"));
+  for (uint8_t i = 0; i < table_.command_count; i++)
   {
-    interface.print(F("  "));
-    interface.print(i + 1);
+    uint8_t index = pgm_read_byte(&table_.command_order[i]);
+    SCPI_Command command;
+    memcpy_P(&command, &table_.commands[index], sizeof(command));
+    interface.print(F("  "));
+    interface.print(index + 1);
     interface.print(F(":\t"));
-    interface.print(valid_special_codes_[i], HEX);
-    if (valid_special_codes_[i] == unknown_hash)
-    {
-      interface.print(F("!*"));
-      unknown_error = true;
-    }
-    else if (valid_special_codes_[i] == invalid_hash)
-    {
-      interface.print(F("!%"));
-      invalid_error = true;
-    }
-    else
-      for (uint8_t j = 0; j < i; j++)
-        if (valid_special_codes_[i] == valid_special_codes_[j])
-        {
-          interface.print("!!");
-          hash_crash = true;
-          break;
-        }
+    interface.print(command.code, HEX);
     interface.print(F("\t\t0x"));
-    interface.print(long(special_callers_[i]), HEX);
+    interface.print(long(command.caller), HEX);
     interface.println();
     interface.flush();
   }
-  if (unknown_error)
-    interface.println(F(" **ERROR** Tried to register ukwnonk tokens. (!*)"));
-  if (invalid_error)
-    interface.println(F(" **ERROR** Tried to register invalid commands. (!%)"));
-  if (hash_crash)
-    interface.println(F(" **ERROR** Hash crashes found. (!!)"));
-#endif
 
   interface.println(F("\nHASH Configuration:"));
-  interface.print(F("  Hash size: "));
+  interface.print(F("  Hash size: "));
   interface.print((uint8_t)(sizeof(scpi_hash_t) * 8));
   interface.println(F("bits (SCPI_HASH_TYPE)"));
-  interface.print(F("  Hash magic number: "));
-  interface.println(hash_magic_number);
-  interface.print(F("  Hash magic offset: "));
-  interface.println(hash_magic_offset);
+  interface.print(F("  Hash magic number: "));
+  interface.println(SCPI_HASH_MAGIC_NUMBER);
+  interface.print(F("  Hash magic offset: "));
+  interface.println(SCPI_HASH_MAGIC_OFFSET);
   interface.println(F("\n*******************\n"));
 }
-
-#if SCPI_MAX_SPECIAL_COMMANDS
-
-/**
- * \brief Registers a new valid special SCPI command (without parameters) and associates a callback function with it.
- *
- * \details
- * This method registers a special SCPI command that does not expect any parameters.
- * When a matching special command is received, the provided callback function
- * will be executed. The command string can include a query symbol ('?').
- * The command is tokenized, and each token is added to the internal token
- * storage if it's not already present. The command's hash is calculated
- * based on the current tree base. Special commands are typically used for
- * actions or queries that don't require additional arguments. They are
- * checked for specifically at the beginning of the input buffer.
- *
- * \param command A pointer to a null-terminated character array (RAM string) representing the special command.
- * Example: `"RESET"`, `"GET:STATUS?"`.
- * \param caller A function pointer to the callback function (\ref SCPI_special_caller_t)
- * to be executed when the special command is received.
- */
-void SCPI_Parser::RegisterSpecialCommand(char *command,
-                                         SCPI_special_caller_t caller)
-{
-  if (special_codes_size_ >= max_special_commands)
-  {
-    setup_errors.special_command_overflow = true;
-    return;
-  }
-  SCPI_Commands command_tokens(command);
-  for (uint8_t i = 0; i < command_tokens.Size(); i++)
-    this->AddToken_(command_tokens[i]);
-  scpi_hash_t code = this->GetCommandCode_(command_tokens);
-
-  // Check for errors
-  if (code == unknown_hash)
-    code = invalid_hash;
-  bool overflow_error = command_tokens.overflow_error;
-  overflow_error |= (tree_length_ + command_tokens.Size()) > command_tokens.storage_size;
-  setup_errors.branch_overflow |= overflow_error;
-  if (overflow_error)
-    code = invalid_hash;
-
-  valid_special_codes_[special_codes_size_] = code;
-  special_callers_[special_codes_size_] = caller;
-  special_codes_size_++;
-}
-
-/**
- * \brief RegisterSpecialCommand version with RAM string support.
- *
- * \details
- * This overload of \ref RegisterSpecialCommand accepts a constant character
- * pointer for the special command string, which resides in RAM.
- *
- * \param command A constant pointer to a null-terminated character array (RAM string) representing the special command.
- * Example: `"GET:DATA"`.
- * \param caller A function pointer to the callback function (\ref SCPI_special_caller_t).
- *
- * \see RegisterSpecialCommand(char *command, SCPI_special_caller_t caller)
- */
-void SCPI_Parser::RegisterSpecialCommand(const char *command,
-                                         SCPI_special_caller_t caller)
-{
-  strcpy(msg_buffer_, command);
-  this->RegisterSpecialCommand(msg_buffer_, caller);
-}
-
-/**
- * \brief RegisterSpecialCommand version with Flash strings (F() macro) support.
- *
- * \details
- * This overload of \ref RegisterSpecialCommand accepts a Flash string helper
- * object, allowing the special command string to reside in program memory
- * (Flash), saving RAM.
- *
- * \param command A Flash string helper object (created using the F() macro) representing the special command.
- * Example: `F("GET:DATA")`.
- * \param caller A function pointer to the callback function (\ref SCPI_special_caller_t).
- *
- * \see RegisterSpecialCommand(char *command, SCPI_special_caller_t caller)
- */
-void SCPI_Parser::RegisterSpecialCommand(const __FlashStringHelper *command,
-                                         SCPI_special_caller_t caller)
-{
-  strcpy_P(msg_buffer_, (const char *)command);
-  this->RegisterSpecialCommand(msg_buffer_, caller);
-}
-
-#endif
\ No newline at end of file
@@ -14,11 +14,11 @@
 
         This class provides the functionality to parse and execute commands adhering to
         the Standard Commands for Programmable Instruments (SCPI) syntax. It includes
-        methods for registering SCPI commands with associated callback functions, setting
-        a command tree base for hierarchical command organization, processing incoming
-        SCPI messages from a serial stream, and handling errors. The class also defines
-        internal structures and variables used for command storage, tokenization, and
-        hashing to efficiently match received commands with their registered handlers.
+        the command table types and the compile time functions that generate its
+        sorted hash tables in flash, processing of incoming SCPI messages from a
+        serial stream, and error handling. A received command is matched with one
+        binary search per keyword and one for the command, and the command table
+        takes no RAM.
 
    \author
         Nexperia: http://www.nexperia.com
@@ -37,10 +37,301 @@
 #include "scpi_config.h"
 #include "scpi_types.h"
 
-/// Void template used with SCPI_Parser::RegisterCommand.
+/// Void template used for the command and error handlers.
 using SCPI_caller_t = void (*)(SCPI_Commands, SCPI_Parameters, Stream &);
-/// Void template used with SCPI_Parser::RegisterSpecialCommand.
-using SCPI_special_caller_t = void (*)(SCPI_Commands, Stream &);
+
+//! Table value of an unused entry.
+#define SCPI_EMPTY_ENTRY 0xff
+
+//! Hashing step value of the query symbol, never a keyword index.
+#define SCPI_QUERY_STEP 0xff
+
+/*!
+ * \brief Keyword of a command table.
+ *
+ * \details
+ * Entries are created with \ref SCPI_KEYWORD(), which hashes both forms of the
+ * keyword at compile time.
+ */
+struct SCPI_Keyword
+{
+  //! Keyword text.
+  char name[SCPI_KEYWORD_LENGTH];
+  //! Hash of the short form.
+  scpi_hash_t short_hash;
+  //! Hash of the long form.
+  scpi_hash_t long_hash;
+};
+
+/*!
+ * \brief Command of a command table.
+ *
+ * \details
+ * Entries are created with \ref ScpiCommandCode() from the command text, so
+ * the text itself is not stored.
+ */
+struct SCPI_Command
+{
+  //! Hash code of the command's keywords.
+  scpi_hash_t code;
+  //! Function to be called when the command is received.
+  SCPI_caller_t caller;
+};
+
+/*!
+ * \brief Command table.
+ *
+ * \details
+ * All tables are stored in flash and generated at compile time. The keyword
+ * forms and commands are looked up by binary search on their hashes.
+ */
+struct SCPI_Table
+{
+  //! Keywords used by the commands.
+  const SCPI_Keyword *keywords;
+  //! Keyword forms sorted by hash.
+  const uint8_t *keyword_forms;
+  //! Number of keyword forms.
+  uint8_t keyword_form_count;
+  //! Commands with their hash codes and handlers.
+  const SCPI_Command *commands;
+  //! Command indices sorted by hash code.
+  const uint8_t *command_order;
+  //! Number of commands.
+  uint8_t command_count;
+};
+
+/*
+ * Compile time generation of the command table. The functions are written as
+ * single return statements, as required for C++11 constexpr functions. The
+ * hashing functions are also used at run time, so both sides hash the same way.
+ *
+ * Keyword form f is the short (even f) or long (odd f) form of keyword f / 2.
+ * The long form is left out when it hashes the same as the short form.
+ */
+
+//! Upper case of an ASCII character.
+constexpr char ScpiUpper(char c)
+{
+  return ((c >= 'a') && (c <= 'z')) ? (c - 'a' + 'A') : c;
+}
+
+//! One hashing step, hash(i) = hash(i - 1) * SCPI_HASH_MAGIC_NUMBER + value.
+constexpr scpi_hash_t ScpiHashStep(scpi_hash_t hash, uint8_t value)
+{
+  return (scpi_hash_t)(hash * SCPI_HASH_MAGIC_NUMBER + value);
+}
+
+//! Hash of the first \p length characters of a keyword, ignoring case.
+constexpr scpi_hash_t ScpiKeywordHash(const char *keyword, uint8_t length,
+                                      scpi_hash_t hash = SCPI_HASH_MAGIC_OFFSET)
+{
+  return (length == 0) ? hash : ScpiKeywordHash(keyword + 1, length - 1, ScpiHashStep(hash, ScpiUpper(*keyword)));
+}
+
+//! Length of the long form of a keyword.
+constexpr uint8_t ScpiLongLength(const char *keyword)
+{
+  return (*keyword == '\0') ? 0 : 1 + ScpiLongLength(keyword + 1);
+}
+
+//! Length of the short form of a keyword, its leading characters that are not lower case.
+constexpr uint8_t ScpiShortLength(const char *keyword)
+{
+  return ((*keyword == '\0') || ((*keyword >= 'a') && (*keyword <= 'z'))) ? 0 : 1 + ScpiShortLength(keyword + 1);
+}
+
+/*!
+ * \brief Keyword table entry.
+ *
+ * \param name The keyword with its short form in upper case followed by the
+ * rest of its long form in lower case, for example "CONFigure".
+ */
+#define SCPI_KEYWORD(name) {name, ScpiKeywordHash(name, ScpiShortLength(name)), ScpiKeywordHash(name, ScpiLongLength(name))}
+
+//! Hash of keyword form \p form.
+constexpr scpi_hash_t ScpiFormHash(const SCPI_Keyword *keywords, size_t form)
+{
+  return (form & 1) ? keywords[form / 2].long_hash : keywords[form / 2].short_hash;
+}
+
+//! TRUE if keyword form \p form is in the keyword form table.
+constexpr bool ScpiFormExists(const SCPI_Keyword *keywords, size_t form)
+{
+  return ((form & 1) == 0) || (keywords[form / 2].long_hash != keywords[form / 2].short_hash);
+}
+
+/*!
+ * \brief Gets the number of keyword forms.
+ *
+ * \param keywords The keyword table.
+ * \param form First form to count, leave at the default.
+ * \return The number of entries used in the keyword form table.
+ */
+template <size_t N>
+constexpr uint8_t ScpiFormCount(const SCPI_Keyword (&keywords)[N], size_t form = 0)
+{
+  return (form >= 2 * N) ? 0 : ScpiFormExists(keywords, form) + ScpiFormCount(keywords, form + 1);
+}
+
+//! TRUE if form \p form has another hash than all forms from \p other on.
+template <size_t N>
+constexpr bool ScpiFormUnique(const SCPI_Keyword (&keywords)[N], size_t form, size_t other)
+{
+  return (other >= 2 * N) ? true
+                          : (!ScpiFormExists(keywords, other) || (ScpiFormHash(keywords, form) != ScpiFormHash(keywords, other))) &&
+                                ScpiFormUnique(keywords, form, other + 1);
+}
+
+/*!
+ * \brief Checks that no two keyword forms have the same hash.
+ *
+ * \details
+ * A keyword listed twice also fails this check.
+ *
+ * \param keywords The keyword table.
+ * \param form First form to check, leave at the default.
+ * \return TRUE if all hashes are different.
+ */
+template <size_t N>
+constexpr bool ScpiFormsUnique(const SCPI_Keyword (&keywords)[N], size_t form = 0)
+{
+  return (form >= 2 * N) ? true
+                         : (!ScpiFormExists(keywords, form) || ScpiFormUnique(keywords, form, form + 1)) &&
+                               ScpiFormsUnique(keywords, form + 1);
+}
+
+//! Number of keyword forms with a lower hash than form \p form.
+template <size_t N>
+constexpr uint8_t ScpiFormRank(const SCPI_Keyword (&keywords)[N], size_t form, size_t other = 0)
+{
+  return (other >= 2 * N) ? 0
+                          : (ScpiFormExists(keywords, other) && (ScpiFormHash(keywords, other) < ScpiFormHash(keywords, form))) +
+                                ScpiFormRank(keywords, form, other + 1);
+}
+
+/*!
+ * \brief Gets an entry of the keyword form table, sorted by hash.
+ *
+ * \param keywords The keyword table.
+ * \param rank The entry.
+ * \param form First form to check, leave at the default.
+ * \return The keyword form with \p rank lower hashes, or \ref
+ * SCPI_EMPTY_ENTRY past the last form.
+ */
+template <size_t N>
+constexpr uint8_t ScpiKeywordFormAt(const SCPI_Keyword (&keywords)[N], uint16_t rank, size_t form = 0)
+{
+  return (form >= 2 * N) ? SCPI_EMPTY_ENTRY
+         : (ScpiFormExists(keywords, form) && (ScpiFormRank(keywords, form) == rank)) ? form
+                                                                                        : ScpiKeywordFormAt(keywords, rank, form + 1);
+}
+
+// Deliberately not constexpr, so a command with a keyword missing from the
+// keyword table fails to compile here.
+uint8_t ScpiKeywordNotInTable(void);
+
+//! TRUE if the command text from \p text on starts with keyword \p name.
+constexpr bool ScpiKeywordIs(const char *text, const char *name)
+{
+  return (*name == '\0') ? ((*text == '\0') || (*text == ':') || (*text == '?'))
+                         : ((*text == *name) && ScpiKeywordIs(text + 1, name + 1));
+}
+
+//! Index of the keyword at the start of \p text.
+template <size_t N>
+constexpr uint8_t ScpiKeywordIndex(const SCPI_Keyword (&keywords)[N], const char *text, size_t i = 0)
+{
+  return (i >= N) ? ScpiKeywordNotInTable() : ScpiKeywordIs(text, keywords[i].name) ? i : ScpiKeywordIndex(keywords, text, i + 1);
+}
+
+//! Command text after the keyword at the start of \p text.
+constexpr const char *ScpiNextKeyword(const char *text)
+{
+  return (*text == ':') ? (text + 1) : ((*text == '\0') || (*text == '?')) ? text : ScpiNextKeyword(text + 1);
+}
+
+/*!
+ * \brief Gets the hash code of a command.
+ *
+ * \details
+ * Every keyword adds a hashing step with its index in the keyword table, and
+ * a query symbol adds a step with \ref SCPI_QUERY_STEP.
+ *
+ * \param keywords The keyword table.
+ * \param text The command text with long form keywords, for example
+ * "MEASure:CURRent:IBUS?".
+ * \param code Hash so far, leave at the default.
+ * \return The hash code of the command.
+ */
+template <size_t N>
+constexpr scpi_hash_t ScpiCommandCode(const SCPI_Keyword (&keywords)[N], const char *text,
+                                      scpi_hash_t code = SCPI_HASH_MAGIC_OFFSET)
+{
+  return (*text == '\0')  ? code
+         : (*text == '?') ? ScpiHashStep(code, SCPI_QUERY_STEP)
+                          : ScpiCommandCode(keywords, ScpiNextKeyword(text), ScpiHashStep(code, ScpiKeywordIndex(keywords, text)));
+}
+
+//! TRUE if command \p i has another hash code than all commands from \p j on.
+template <size_t N>
+constexpr bool ScpiCommandUnique(const SCPI_Command (&commands)[N], size_t i, size_t j)
+{
+  return (j >= N) ? true : (commands[i].code != commands[j].code) && ScpiCommandUnique(commands, i, j + 1);
+}
+
+/*!
+ * \brief Checks that no two commands have the same hash code.
+ *
+ * \details
+ * A command listed twice also fails this check.
+ *
+ * \param commands The command table.
+ * \param i First command to check, leave at the default.
+ * \return TRUE if all hash codes are different.
+ */
+template <size_t N>
+constexpr bool ScpiCommandsUnique(const SCPI_Command (&commands)[N], size_t i = 0)
+{
+  return (i >= N) ? true : ScpiCommandUnique(commands, i, i + 1) && ScpiCommandsUnique(commands, i + 1);
+}
+
+//! Number of commands with a lower hash code than command \p i.
+template <size_t N>
+constexpr uint8_t ScpiCommandRank(const SCPI_Command (&commands)[N], size_t i, size_t j = 0)
+{
+  return (j >= N) ? 0 : (commands[j].code < commands[i].code) + ScpiCommandRank(commands, i, j + 1);
+}
+
+/*!
+ * \brief Gets an entry of the command order table, sorted by hash code.
+ *
+ * \param commands The command table.
+ * \param rank The entry.
+ * \param i First command to check, leave at the default.
+ * \return Index of the command with \p rank lower hash codes, or \ref
+ * SCPI_EMPTY_ENTRY past the last command.
+ */
+template <size_t N>
+constexpr uint8_t ScpiCommandAt(const SCPI_Command (&commands)[N], uint16_t rank, size_t i = 0)
+{
+  return (i >= N) ? SCPI_EMPTY_ENTRY : (ScpiCommandRank(commands, i) == rank) ? i : ScpiCommandAt(commands, rank, i + 1);
+}
+
+/*
+ * Initializer lists with the entries f(0) to f(size - 1), used to generate the
+ * sorted tables.
+ */
+//! @cond
+#define SCPI_ENTRIES_4(f, n) f(n), f(n + 1), f(n + 2), f(n + 3)
+#define SCPI_ENTRIES_16(f, n) SCPI_ENTRIES_4(f, n), SCPI_ENTRIES_4(f, n + 4), SCPI_ENTRIES_4(f, n + 8), SCPI_ENTRIES_4(f, n + 12)
+#define SCPI_ENTRIES_32(f, n) SCPI_ENTRIES_16(f, n), SCPI_ENTRIES_16(f, n + 16)
+#define SCPI_ENTRIES_64(f, n) SCPI_ENTRIES_32(f, n), SCPI_ENTRIES_32(f, n + 32)
+#define SCPI_ENTRIES_128(f, n) SCPI_ENTRIES_64(f, n), SCPI_ENTRIES_64(f, n + 64)
+#define SCPI_ENTRIES_EXPAND(size, f) SCPI_ENTRIES_##size(f, 0)
+//! @endcond
+//! Initializer list of a table with \p size entries, 32, 64 or 128.
+#define SCPI_ENTRIES(size, f) SCPI_ENTRIES_EXPAND(size, f)
 
 /*!
  * \brief SCPI Parser class.
@@ -48,27 +339,15 @@ using SCPI_special_caller_t = void (*)(SCPI_Commands, Stream &);
  * \details
  * This class provides the functionality to parse and execute commands
  * based on the Standard Commands for Programmable Instruments (SCPI)
- * syntax. It allows registering commands with associated callback functions
- * and handles the processing of incoming messages from a serial stream.
+ * syntax. The commands and their callback functions are given by a
+ * command table in flash, and the class handles the processing of
+ * incoming messages from a serial stream.
  */
 class SCPI_Parser
 {
 public:
   // Constructor
-  SCPI_Parser();
-  // Change the TreeBase for the next RegisterCommand calls
-  void SetCommandTreeBase(char *tree_base);
-  // SetCommandTreeBase version with RAM string support
-  void SetCommandTreeBase(const char *tree_base);
-  // SetCommandTreeBase version with Flash strings (F() macro) support
-  void SetCommandTreeBase(const __FlashStringHelper *tree_base);
-  // Registers a new valid command and associate a procedure to it
-  void RegisterCommand(char *command, SCPI_caller_t caller);
-  // RegisterCommand version with RAM string support.
-  void RegisterCommand(const char *command, SCPI_caller_t caller);
-  // RegisterCommand version with Flash strings (F() macro) support
-  void RegisterCommand(const __FlashStringHelper *command,
-                       SCPI_caller_t caller);
+  SCPI_Parser(const SCPI_Table &table);
   // Set the function to be used by the error handler.
   void SetErrorHandler(SCPI_caller_t caller);
   //! Variable that holds the last error code.
@@ -79,90 +358,53 @@ public:
   void ProcessInput(Stream &interface, const char *term_chars);
   // Gets a message from a Stream interface
   char *GetMessage(Stream &interface, const char *term_chars);
-  // Prints registered tokens and command hashes to the serial interface
+  // Reads a received character that is not part of a returned message
+  int ReadQueued();
+  // Starts output that is not the response to a command
+  Stream *BeginOutput(Stream &interface);
+  // Finishes and sends the output
+  bool EndOutput();
+  // Prints the command table to the serial interface
   void PrintDebugInfo(Stream &interface);
-  //! Magic number used for hashing the commands
-  scpi_hash_t hash_magic_number = 37;
-  //! Magic offset used for hashing the commands
-  scpi_hash_t hash_magic_offset = 7;
   //! Timeout, in miliseconds, for GetMessage and ProcessInput.
   unsigned long timeout = 10;
 
-#if SCPI_MAX_SPECIAL_COMMANDS
-  // Registers a new valid special command and associate a procedure to it
-  void RegisterSpecialCommand(char *command, SCPI_special_caller_t caller);
-  // RegisterSpecialCommand version with RAM string support.
-  void RegisterSpecialCommand(const char *command,
-                              SCPI_special_caller_t caller);
-  // RegisterSpecialCommand version with Flash strings (F() macro) support
-  void RegisterSpecialCommand(const __FlashStringHelper *command,
-                              SCPI_special_caller_t caller);
-#endif
-
 protected:
   //! Length of the message buffer.
   const uint8_t buffer_length = SCPI_BUFFER_LENGTH;
-  //! Max number of valid tokens.
-  const uint8_t max_tokens = SCPI_MAX_TOKENS;
-  //! Max number of registered commands.
-  const uint8_t max_commands = SCPI_MAX_COMMANDS;
-  /*! \struct internal_errors
-   *  \brief Internal errors container
-   *
-   *  This struct holds boolean flags for checking if the
-   *  internal storage containers overflowed during setup.
-   */
-  struct internal_errors
-  {
-    //! Command storage overflow error
-    bool command_overflow = false;
-    //! Token storage overflow error
-    bool token_overflow = false;
-    //! Branch (SCPI_Commands) storage overflow error
-    bool branch_overflow = false;
-    //! Special command storage overflow error
-    bool special_command_overflow = false;
-  } setup_errors;
-  //! Hash result for unknown commands
-  const scpi_hash_t unknown_hash = 0;
-  //! Hash reserved for invalid commands
-  const scpi_hash_t invalid_hash = 1;
-
-  //! Add a token to the tokens' storage
-  void AddToken_(char *token);
-  //! Get a hash from a command
-  scpi_hash_t GetCommandCode_(SCPI_Commands &commands);
-  //! Number of stored tokens
-  uint8_t tokens_size_ = 0;
-  //! Storage for tokens
-  char *tokens_[SCPI_MAX_TOKENS];
-  //! Number of registered commands
-  uint8_t codes_size_ = 0;
-  //! Registered commands' hash storage
-  scpi_hash_t valid_codes_[SCPI_MAX_COMMANDS];
-  //! Pointers to the functions to be called when a valid command is received
-  SCPI_caller_t callers_[SCPI_MAX_COMMANDS + 1];
-  //! TreeBase branch's hash used when calculating hashes (0 for root)
-  scpi_hash_t tree_code_ = 0;
-  //! TreeBase branch's length (0 for root)
-  uint8_t tree_length_ = 0;
+
+  //! Get the index of a received keyword in the keyword table
+  uint8_t FindKeyword_(const char *keyword, uint8_t length);
+  //! Match the termination characters with one more received character
+  static uint8_t MatchTerm_(SCPI_Block_Scanner &block, char c, const char *term_chars, uint8_t matched);
+  //! Get the index of a received command in the command table
+  uint8_t FindCommand_(SCPI_Commands &commands);
+  //! Command table in flash
+  SCPI_Table table_;
+  //! Function to be called when an error occurs
+  SCPI_caller_t error_handler_;
   //! Message buffer.
   char msg_buffer_[SCPI_BUFFER_LENGTH];
-  //! Length of the readed message
+  //! Response buffer
+  SCPI_Response response_;
+  //! Ring buffer of received characters.
+  char rx_buffer_[SCPI_RX_BUFFER_LENGTH];
+  //! Free running write index of the ring buffer
+  uint8_t rx_head_ = 0;
+  //! Free running read index of the ring buffer
+  uint8_t rx_tail_ = 0;
+  //! Free running index of the next character to scan for termination characters
+  uint8_t rx_scan_ = 0;
+  //! Number of complete messages in the ring buffer
+  uint8_t rx_messages_ = 0;
+  //! Number of termination characters matched at the end of the ring buffer
+  uint8_t term_matched_ = 0;
+  //! Length of the incomplete message at the end of the ring buffer
   uint8_t message_length_ = 0;
+  //! Block data of the incomplete message at the end of the ring buffer
+  SCPI_Block_Scanner rx_block_;
   //! Varible used for checking timeout errors
   unsigned long time_checker_;
-
-#if SCPI_MAX_SPECIAL_COMMANDS
-  //! Max number of registered special commands.
-  const uint8_t max_special_commands = SCPI_MAX_SPECIAL_COMMANDS;
-  //! Number of registered special commands
-  uint8_t special_codes_size_ = 0;
-  //! Registered special commands' hash storage
-  scpi_hash_t valid_special_codes_[SCPI_MAX_SPECIAL_COMMANDS];
-  //! Pointers to the functions to be called when a special command is received
-  SCPI_special_caller_t special_callers_[SCPI_MAX_SPECIAL_COMMANDS];
-#endif
 };
 
-#endif
\ No newline at end of file
+#endif
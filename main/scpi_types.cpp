@@ -7,7 +7,8 @@
    \details
         This file contains the implementation of helper classes used for SCPI
         command parsing, including string array management and tokenization
-        of command and parameter messages.
+        of command and parameter messages, and the buffered output of
+        responses.
 
         Most of this code was originally written by Diego González Chávez as part of the
         [Vrekrer SCPI Parser](https://github.com/Vrekrer/Vrekrer_scpi_parser) project.
@@ -110,6 +111,97 @@ uint8_t SCPI_String_Array::Size() const
   return size_;
 }
 
+// ========================== SCPI_Block_Scanner member functions ==========================
+
+/*!
+ * \brief Scan one character of a message.
+ *
+ * \param c The next character of the message.
+ * \return true if the character is block data, false otherwise.
+ */
+bool SCPI_Block_Scanner::Scan(char c)
+{
+  if (remaining_ > 0)
+  {
+    --remaining_;
+    return true;
+  }
+
+  if (digits_ == SCPI_BLOCK_HASH)
+  {
+    // Number of length digits
+    digits_ = (c >= '1' && c <= '9') ? (c - '0') : 0;
+    length_ = 0;
+  }
+  else if (digits_ > 0)
+  {
+    // Length digits, the data follows the last one
+    if (isdigit(c))
+    {
+      length_ = length_ * 10 + (c - '0');
+      if (--digits_ == 0)
+        remaining_ = length_;
+    }
+    else
+    {
+      digits_ = 0;
+    }
+  }
+  else if (c == '#')
+  {
+    digits_ = SCPI_BLOCK_HASH;
+  }
+  return false;
+}
+
+/*!
+ * \brief Find a separator outside blocks.
+ *
+ * Like \c strchr, but separators and null characters in block data are skipped.
+ *
+ * \param text Message text to search.
+ * \param separator Separator character.
+ * \return Pointer to the first separator, or NULL if there is none.
+ */
+char *SCPI_Block_Scanner::Find(char *text, char separator)
+{
+  SCPI_Block_Scanner block;
+  for (;; text++)
+  {
+    if (block.Scan(*text))
+      continue;
+    if (*text == separator)
+      return text;
+    if (*text == '\0')
+      return NULL;
+  }
+}
+
+/*!
+ * \brief Read a block header.
+ *
+ * Reads the header the same way as \c Scan.
+ *
+ * \param text Text starting with the header.
+ * \param length Number of data bytes of the block.
+ * \return Length of the header, 0 if the text does not start with a header.
+ */
+uint8_t SCPI_Block_Scanner::Header(const char *text, uint16_t &length)
+{
+  if (text[0] != '#' || text[1] < '1' || text[1] > '9')
+    return 0;
+
+  uint8_t digits = text[1] - '0';
+  length = 0;
+  for (uint8_t i = 2; i < digits + 2; i++)
+  {
+    if (!isdigit(text[i]))
+      return 0;
+    length = length * 10 + (text[i] - '0');
+  }
+  return digits + 2;
+}
+
 // ========================== SCPI_Commands member functions ==========================
 
 /*!
@@ -158,8 +250,9 @@ SCPI_Parameters::SCPI_Parameters() {}
 /*!
  * \brief Construct and tokenize parameters from a message.
  *
- * Splits the input string on ',' characters and trims leading whitespace for each parameter.
- * Stores each parameter as a separate element in the array.
+ * Splits the input string on ',' characters outside block data and trims leading
+ * whitespace for each parameter. Stores each parameter as a separate element in the
+ * array.
  *
  * \param message Null-terminated string containing the SCPI parameter message.
  */
@@ -167,13 +260,212 @@ SCPI_Parameters::SCPI_Parameters(char *message)
 {
   char *parameter = message;
   // Split using ','
-  parameter = strtok(parameter, ",");
   while (parameter != NULL)
   {
+    while (*parameter == ',')
+      parameter++;
+    if (*parameter == '\0')
+      break;
+    char *next = SCPI_Block_Scanner::Find(parameter, ',');
+    if (next != NULL)
+    {
+      next[0] = '\0';
+      next++;
+    }
     while (isspace(*parameter))
       parameter++;
     this->Append(parameter);
-    parameter = strtok(NULL, ",");
+    parameter = next;
   }
   // TODO add support for strings parameters (do not split parameters inside "")
 }
+
+/*!
+ * \brief Start a response.
+ *
+ * Characters written from now on belong to the response, which is discarded as a
+ * whole when it overflows and nothing of it has been sent yet.
+ *
+ * \param interface Communication interface the response is sent to.
+ */
+void SCPI_Response::Begin(Stream &interface)
+{
+  interface_ = &interface;
+  start_ = length_;
+  overflow_ = false;
+  sending_ = false;
+}
+
+/*!
+ * \brief Finish a response.
+ *
+ * Removes the characters of an overflowed response that were not sent yet. If part
+ * of it was sent already, the line is ended with "\r\n" instead.
+ *
+ * \return false if the response overflowed, true otherwise.
+ */
+bool SCPI_Response::End()
+{
+  bool complete = !overflow_;
+  if (!complete && !sending_)
+  {
+    length_ = start_;
+  }
+  else if (!complete)
+  {
+    // Everything left in the buffer was sent, terminate the truncated line
+    length_ = 0;
+    sent_ = 0;
+    buffer_[length_++] = '\r';
+    buffer_[length_++] = '\n';
+  }
+  start_ = length_;
+  overflow_ = false;
+  sending_ = false;
+  return complete;
+}
+
+/*!
+ * \brief Send the buffer without blocking.
+ *
+ * Writes as many characters as the interface accepts without blocking, in one write.
+ */
+void SCPI_Response::Send()
+{
+  uint8_t pending = length_ - sent_;
+  if (interface_ == NULL || pending == 0)
+    return;
+
+  int space = interface_->availableForWrite();
+  if (space <= 0)
+    return;
+  if (pending > space)
+    pending = space;
+  sent_ += interface_->write((const uint8_t *)&buffer_[sent_], pending);
+  if (sent_ > start_)
+    sending_ = true;
+
+  // Start over when everything is sent
+  if (sent_ == length_)
+  {
+    length_ = 0;
+    sent_ = 0;
+    start_ = 0;
+  }
+}
+
+/*!
+ * \brief Get the number of characters not sent yet.
+ *
+ * \return Number of characters waiting in the buffer.
+ */
+uint8_t SCPI_Response::Pending() const
+{
+  return length_ - sent_;
+}
+
+/*!
+ * \brief Drop sent characters from the buffer.
+ *
+ * Sends what the interface accepts and moves the characters not sent yet to the
+ * start of the buffer.
+ */
+void SCPI_Response::MakeRoom_()
+{
+  this->Send();
+  if (sent_ == 0)
+    return;
+  memmove(buffer_, &buffer_[sent_], length_ - sent_);
+  length_ -= sent_;
+  start_ = (start_ > sent_) ? (start_ - sent_) : 0;
+  sent_ = 0;
+}
+
+/*!
+ * \brief Buffer one character.
+ *
+ * \param value Character to write.
+ * \return 1 if the character was buffered, 0 if it was discarded.
+ */
+size_t SCPI_Response::write(uint8_t value)
+{
+  return this->write(&value, 1);
+}
+
+/*!
+ * \brief Buffer a block of characters.
+ *
+ * \param buffer Characters to write.
+ * \param size Number of characters to write.
+ * \return Number of characters buffered.
+ */
+size_t SCPI_Response::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+  while (!overflow_ && written < size)
+  {
+    if (length_ == SCPI_TX_BUFFER_LENGTH)
+      this->MakeRoom_();
+    if (length_ == SCPI_TX_BUFFER_LENGTH)
+    {
+#if (SCPI_TX_OVERFLOW_POLICY == SCPI_TX_OVERFLOW_BLOCK)
+      // Wait for the interface
+      interface_->write((const uint8_t *)&buffer_[sent_], length_ - sent_);
+      length_ = 0;
+      sent_ = 0;
+      start_ = 0;
+#else
+      // Discard the rest of the response
+      overflow_ = true;
+      break;
+#endif
+    }
+    uint8_t count = SCPI_TX_BUFFER_LENGTH - length_;
+    if (count > size - written)
+      count = size - written;
+    memcpy(&buffer_[length_], &buffer[written], count);
+    length_ += count;
+    written += count;
+  }
+  return written;
+}
+
+/*!
+ * \brief Get the free space in the buffer.
+ *
+ * \return Number of characters that can be buffered.
+ */
+int SCPI_Response::availableForWrite()
+{
+  return SCPI_TX_BUFFER_LENGTH - length_;
+}
+
+/*!
+ * \brief Get the number of characters to read from the interface.
+ *
+ * \return Number of characters available, 0 without an interface.
+ */
+int SCPI_Response::available()
+{
+  return (interface_ == NULL) ? 0 : interface_->available();
+}
+
+/*!
+ * \brief Read a character from the interface.
+ *
+ * \return The character read, or -1 if none is available.
+ */
+int SCPI_Response::read()
+{
+  return (interface_ == NULL) ? -1 : interface_->read();
+}
+
+/*!
+ * \brief Peek at a character from the interface.
+ *
+ * \return The next character, or -1 if none is available.
+ */
+int SCPI_Response::peek()
+{
+  return (interface_ == NULL) ? -1 : interface_->peek();
+}
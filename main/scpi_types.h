@@ -62,6 +62,32 @@ protected:
   char *values_[SCPI_ARRAY_SIZE]; ///< Internal storage for string pointers.
 };
 
+//! State of \ref SCPI_Block_Scanner after a '#' character.
+#define SCPI_BLOCK_HASH 0xff
+
+/*!
+ * \class SCPI_Block_Scanner
+ * \brief Finds the data of definite length arbitrary blocks in a message.
+ *
+ * A definite length arbitrary block (IEEE 488.2 7.7.6) is \c '#', one digit \c n
+ * from 1 to 9, \c n digits with the number of data bytes and the data bytes. The
+ * data bytes can have any value, so they must not be taken as separators or
+ * termination characters. The characters of a message are passed to \c Scan one at
+ * a time from its start, which tells whether each is block data.
+ */
+class SCPI_Block_Scanner
+{
+public:
+  bool Scan(char c);                                         ///< Scan one character, true if it is block data.
+  static char *Find(char *text, char separator);             ///< Find a separator outside blocks.
+  static uint8_t Header(const char *text, uint16_t &length); ///< Read a block header.
+
+protected:
+  uint8_t digits_ = 0;     ///< Length digits left to read, \c SCPI_BLOCK_HASH after '#'.
+  uint16_t length_ = 0;    ///< Block length read so far.
+  uint16_t remaining_ = 0; ///< Data bytes left in the block.
+};
+
 /*!
  * \class SCPI_Commands
  * \brief Stores parsed command tokens.
@@ -84,7 +110,8 @@ public:
  * \brief Stores parsed command parameters.
  *
  * Derived from \c SCPI_String_Array, this class splits a message using commas
- * to extract and store parameters following an SCPI command.
+ * to extract and store parameters following an SCPI command. Commas in the data
+ * of definite length arbitrary blocks do not split parameters.
  *
  * Whitespace before each parameter is trimmed. The remaining unprocessed
  * string is stored in \c not_processed_message.
@@ -97,6 +124,49 @@ public:
   char *not_processed_message;    ///< Remaining message text after parsing.
 };
 
+/*!
+ * \class SCPI_Response
+ * \brief Buffered, non-blocking output stream for SCPI responses.
+ *
+ * Command handlers write their responses to this stream, which collects them in a
+ * buffer of \c SCPI_TX_BUFFER_LENGTH characters instead of writing every \c print
+ * call to the communication interface. \c Send writes the buffer with as few writes
+ * as the interface accepts without blocking, as reported by its \c availableForWrite.
+ *
+ * When the buffer is full, sent characters are dropped from it to make room. If the
+ * interface does not accept more, \c SCPI_TX_OVERFLOW_POLICY decides between
+ * discarding the rest of the response and writing the buffer through to the interface.
+ * A discarded response leaves nothing on the interface, unless part of it was sent
+ * already. That part is then ended with "\r\n", so the host never sees a line without
+ * a terminator and the next response starts on a line of its own.
+ * Reads are passed on to the interface.
+ */
+class SCPI_Response : public Stream
+{
+public:
+  void Begin(Stream &interface);                    ///< Start a response to an interface.
+  bool End();                                       ///< Finish a response, false if it overflowed.
+  void Send();                                      ///< Send the buffer without blocking.
+  uint8_t Pending() const;                          ///< Get the number of characters not sent yet.
+  size_t write(uint8_t value);                      ///< Buffer one character.
+  size_t write(const uint8_t *buffer, size_t size); ///< Buffer a block of characters.
+  using Print::write;                               ///< Buffer strings.
+  int availableForWrite();                          ///< Get the free space in the buffer.
+  int available();                                  ///< Get the number of characters to read from the interface.
+  int read();                                       ///< Read a character from the interface.
+  int peek();                                       ///< Peek at a character from the interface.
+
+protected:
+  void MakeRoom_();                     ///< Drop sent characters from the buffer.
+  Stream *interface_ = NULL;            ///< Interface the buffer is sent to.
+  char buffer_[SCPI_TX_BUFFER_LENGTH];  ///< Response buffer.
+  uint8_t length_ = 0;                  ///< Number of characters in the buffer.
+  uint8_t sent_ = 0;                    ///< Number of characters of the buffer already sent.
+  uint8_t start_ = 0;                   ///< Start of the current response in the buffer.
+  bool overflow_ = false;               ///< Flag set when the current response overflowed.
+  bool sending_ = false;                ///< Flag set when part of the current response was sent.
+};
+
 /// \typedef SCPI_C
 /// \brief Alias for \c SCPI_Commands.
 using SCPI_C = SCPI_Commands;
@@ -130,6 +200,9 @@ enum class ErrorCode
 
   /// A required parameter was missing or an invalid parameter was provided.
   MissingOrInvalidParameter,
+
+  /// A response did not fit in the response buffer and was discarded.
+  OutputOverflow,
 };
 
 #endif
\ No newline at end of file
@@ -164,4 +164,37 @@ const uint8_t expectedHallSequenceReverse[7] PROGMEM =
     {
         0xff, 5, 3, 1, 6, 4, 2};
 
+/*! \brief Table of Hall Sensor Sectors
+
+    This array maps a hall sensor value to the number of its sector, 0-5, in
+    the order the sectors are passed when running in the forward direction.
+    Illegal hall values map to 0xff.
+
+    For example, hall sensor value '3' follows '1' in the forward direction, so
+    it is sector 1.
+*/
+const uint8_t hallSectorTable[8] PROGMEM =
+    {
+        0xff, 0, 2, 1, 4, 5, 3, 0xff};
+
+/*! \brief Table of VBUS Reciprocals
+
+    This array holds \f$ 2^{16} / v \f$ for every 16th VBUS register value v,
+    so entry n is the reciprocal of 16 n. Values in between are interpolated
+    linearly. Entry 0 repeats entry 1, as VBUS is never that low when driving.
+
+    \see VBUS_COMPENSATION
+*/
+const uint16_t vbusReciprocalTable[65] PROGMEM =
+    {
+        4096, 4096, 2048, 1365, 1024, 819, 683, 585,
+        512, 455, 410, 372, 341, 315, 293, 273,
+        256, 241, 228, 216, 205, 195, 186, 178,
+        171, 164, 158, 152, 146, 141, 137, 132,
+        128, 124, 120, 117, 114, 111, 108, 105,
+        102, 100, 98, 95, 93, 91, 89, 87,
+        85, 84, 82, 80, 79, 77, 76, 74,
+        73, 72, 71, 69, 68, 67, 66, 65,
+        64};
+
 #endif /* _TABLES_H_ */
@@ -0,0 +1,98 @@
+/* This file has been prepared for Doxygen automatic documentation generation.*/
+/*! \file ********************************************************************
+
+   \brief
+        Thermal overload model source file.
+
+   \details
+        This file contains the implementation of the I²t thermal overload
+        model.
+
+   \author
+        Nexperia: http://www.nexperia.com
+
+   \par Support Page
+        For additional support, visit: https://www.nexperia.com/support
+
+   $Author: Aanas Sayed $
+   $Date: 2024/03/08 $  \n
+
+ ******************************************************************************/
+
+#include "thermal.h"
+// Include interrupt locking for reading the model outside its ISR
+#include <util/atomic.h>
+
+/*! \brief Initialise a thermal model.
+
+    Starts the model cold, with the full thermal budget. The reciprocal of the
+    derating budget is calculated here, so \ref ThermalModelDerate() needs no
+    division.
+
+    \param model  Thermal model status. \param ratedCurrent  Current that can
+    be carried continuously, as an IBUS register value. \param capacity  Heat
+    at which the budget is empty, see \ref THERMAL_MOTOR_CAPACITY.
+*/
+void ThermalModelInit(thermalModel_t *model, uint16_t ratedCurrent, uint32_t capacity)
+{
+     model->heat = 0;
+     model->capacity = capacity;
+     model->derateBudget = (capacity / 100) * THERMAL_DERATE_BUDGET;
+     model->ratedSquared = (uint32_t)ratedCurrent * ratedCurrent;
+
+     uint8_t shift = 0;
+     while ((model->derateBudget >> shift) > UINT16_MAX)
+     {
+          shift++;
+     }
+     model->derateShift = shift;
+     // The budget is at least 2^8, see THERMAL_MOTOR_CAPACITY, so the scale
+     // is at most 2^16.
+     model->derateScale = ((uint32_t)THERMAL_DERATE_NONE << 16) / (model->derateBudget >> shift);
+}
+
+/*! \brief Get the derating factor.
+
+    The output is not derated while the remaining budget is above \ref
+    THERMAL_DERATE_BUDGET percent. Below it the factor falls linearly to zero
+    at an empty budget. Called on every bus current measurement, so it uses
+    the reciprocal from \ref ThermalModelInit() instead of a division.
+
+    \param model  Thermal model status. \return Derating factor in Q8, \ref
+    THERMAL_DERATE_NONE for full output.
+*/
+uint16_t ThermalModelDerate(const thermalModel_t *model)
+{
+     uint32_t remaining;
+
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+     {
+          remaining = model->capacity - model->heat;
+     }
+
+     if (remaining >= model->derateBudget)
+     {
+          return THERMAL_DERATE_NONE;
+     }
+
+     uint32_t derate = ((uint16_t)(remaining >> model->derateShift) * model->derateScale) >> 16;
+     return (derate < THERMAL_DERATE_NONE) ? derate : THERMAL_DERATE_NONE;
+}
+
+/*! \brief Get the remaining thermal budget.
+
+    \param model  Thermal model status. \return Remaining budget in percent,
+    100 when cold and 0 when the output is fully derated.
+*/
+uint8_t ThermalModelBudget(const thermalModel_t *model)
+{
+     uint32_t remaining;
+
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+     {
+          remaining = model->capacity - model->heat;
+     }
+
+     uint8_t budget = remaining / (model->capacity / 100);
+     return (budget > 100) ? 100 : budget;
+}
@@ -0,0 +1,95 @@
+/* This file has been prepared for Doxygen automatic documentation generation.*/
+/*! \file ********************************************************************
+
+   \brief
+        Thermal overload model header file.
+
+   \details
+        This file contains typedefs and prototypes for the I²t thermal
+        overload model.
+
+        The model integrates the square of the bus current above a rated
+        current on every bus current measurement, and lets it cool down again
+        below the rated current. Its capacity is the heat of running at a
+        peak current for a given time from cold, so short peaks are allowed
+        while a sustained overload empties the thermal budget. Below a part of
+        the budget the output is derated linearly, down to zero when the
+        budget is empty, so the current settles at the rated current instead
+        of tripping.
+
+        Currents are IBUS register values, so only integer multiplications
+        are needed on every measurement.
+
+   \author
+        Nexperia: http://www.nexperia.com
+
+   \par Support Page
+        For additional support, visit: https://www.nexperia.com/support
+
+   $Author: Aanas Sayed $
+   $Date: 2024/03/08 $  \n
+
+ ******************************************************************************/
+
+#ifndef THERMAL_H
+#define THERMAL_H
+
+// Include standard integer type definitions
+#include "stdint.h"
+
+// Include motor config (derating budget)
+#include "config.h"
+
+//! Derating factor for full output, 1.0 in Q8.
+#define THERMAL_DERATE_NONE 256
+
+/*! \brief Thermal Model Status
+
+   State of one I²t thermal overload model.
+*/
+typedef struct thermalModel
+{
+     //! Accumulated heat in IBUS register values squared times samples
+     uint32_t heat;
+     //! Heat at which the thermal budget is empty
+     uint32_t capacity;
+     //! Remaining budget below which the output is derated
+     uint32_t derateBudget;
+     //! Shift of the remaining budget to 16 bits for derating
+     uint8_t derateShift;
+     //! Derating factor per shifted budget, in Q16
+     uint32_t derateScale;
+     //! Square of the rated current
+     uint32_t ratedSquared;
+} thermalModel_t;
+
+// Prototypes
+void ThermalModelInit(thermalModel_t *model, uint16_t ratedCurrent, uint32_t capacity);
+uint16_t ThermalModelDerate(const thermalModel_t *model);
+uint8_t ThermalModelBudget(const thermalModel_t *model);
+
+/*! \brief Update the model with one current measurement.
+
+    Adds the square of the current less the square of the rated current to
+    the heat, limited to the range from zero to the capacity.
+
+    \param model  Thermal model status. \param current  Bus current as an
+    IBUS register value.
+*/
+static inline void ThermalModelUpdate(thermalModel_t *model, uint16_t current)
+{
+     uint32_t squared = (uint32_t)current * current;
+
+     if (squared >= model->ratedSquared)
+     {
+          uint32_t rise = squared - model->ratedSquared;
+          model->heat = (rise < model->capacity - model->heat) ? (model->heat + rise) : model->capacity;
+     }
+     else
+     {
+          uint32_t fall = model->ratedSquared - squared;
+          model->heat = (fall < model->heat) ? (model->heat - fall) : 0;
+     }
+}
+
+#endif
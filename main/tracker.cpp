@@ -0,0 +1,205 @@
+/* This file has been prepared for Doxygen automatic documentation generation.*/
+/*! \file ********************************************************************
+
+   \brief
+        Speed and angle tracker source file.
+
+   \details
+        This file contains the implementation of the hall sensor speed and
+        angle tracker.
+
+   \author
+        Nexperia: http://www.nexperia.com
+
+   \par Support Page
+        For additional support, visit: https://www.nexperia.com/support
+
+   $Author: Aanas Sayed $
+   $Date: 2024/03/08 $  \n
+
+ ******************************************************************************/
+
+#include "tracker.h"
+// Include the hall sensor sector table
+#include "tables.h"
+// Include interrupt locking for reading the tracker outside its ISRs
+#include <util/atomic.h>
+
+//! Largest speed magnitude, half a sector per PWM tick.
+#define TRACKER_SPEED_MAX (TRACKER_SECTOR_ANGLE >> 1)
+
+/*! \brief Limit a speed.
+
+    Limits the magnitude to \ref TRACKER_SPEED_MAX and never lets a correction
+    change the direction, lock is lost instead.
+
+    \param speed  Speed to limit. \param direction  Actual direction of
+    rotation, DIRECTION_FORWARD or DIRECTION_REVERSE. \return Limited speed.
+*/
+static int32_t TrackerLimit(int32_t speed, uint8_t direction)
+{
+     if (direction == DIRECTION_FORWARD)
+     {
+          return (speed > TRACKER_SPEED_MAX) ? TRACKER_SPEED_MAX : ((speed < 1) ? 1 : speed);
+     }
+     return (speed < -TRACKER_SPEED_MAX) ? -TRACKER_SPEED_MAX : ((speed > -1) ? -1 : speed);
+}
+
+/*! \brief Reset the tracker.
+
+    Clears the speed estimate and unlocks the loop. The tracker locks again
+    after the next two hall sensor edges. Call when the motor has stopped.
+
+    \param tracker  Tracker status.
+*/
+void TrackerReset(speedTracker_t *tracker)
+{
+     tracker->integrator = 0;
+     tracker->speed = 0;
+     tracker->angle = tracker->edgeAngle;
+     tracker->locked = FALSE;
+}
+
+/*! \brief Correct the tracker at a hall sensor edge.
+
+    Compares the extrapolated angle with the angle of the edge, which is the
+    start of the new sector when running forward and the end of it in
+    reverse. The phase error, relative to one sector, is fed to a PI loop
+    filter with a proportional gain of
+    \f$ 2^{1 - \text{SPEED\_TRACKER\_BANDWIDTH}} \f$ and an integral gain of
+    \f$ 2^{-2 \cdot \text{SPEED\_TRACKER\_BANDWIDTH}} \f$, which gives a
+    critically damped loop. The output sets the speed the angle is
+    extrapolated with until the next edge, so the angle never jumps. The
+    relative error is found by scaling with the speed instead of dividing by
+    the time since the last edge, so the loop bandwidth is a fixed fraction of
+    the hall sensor edge rate.
+
+    If the loop is not locked, the direction has changed or the phase error is
+    larger than half a sector, the speed is measured again from the time since
+    the last edge and the angle is set to the angle of the edge. This is the
+    only division.
+
+    \param tracker  Tracker status. \param hall  New hall sensor value.
+    \param direction  Actual direction of rotation, DIRECTION_*. \param ticks
+    Number of PWM ticks since the last hall sensor edge.
+*/
+void TrackerHallEdge(speedTracker_t *tracker, uint8_t hall, uint8_t direction, uint16_t ticks)
+{
+     uint8_t sector = pgm_read_byte_near(&hallSectorTable[hall & 0x07]);
+
+     // Illegal hall value, wait for valid edges to lock again.
+     if (sector == 0xff)
+     {
+          TrackerReset(tracker);
+          return;
+     }
+
+     uint32_t measured = (uint32_t)sector * TRACKER_SECTOR_ANGLE;
+     if (direction == DIRECTION_REVERSE)
+     {
+          measured += TRACKER_SECTOR_ANGLE;
+     }
+
+     if (direction == DIRECTION_UNKNOWN)
+     {
+          tracker->edgeAngle = measured;
+          TrackerReset(tracker);
+          return;
+     }
+
+     int32_t error = (int32_t)(measured - tracker->angle);
+
+     if ((tracker->locked == FALSE) ||
+         ((direction == DIRECTION_FORWARD) != (tracker->speed > 0)) ||
+         (error > TRACKER_LOCK_LIMIT) || (error < -TRACKER_LOCK_LIMIT))
+     {
+          // Acquire lock from the time since the last edge.
+          int32_t speed = TRACKER_SECTOR_ANGLE / ((ticks > 2) ? ticks : 2);
+          tracker->integrator = (direction == DIRECTION_FORWARD) ? speed : -speed;
+          tracker->speed = tracker->integrator;
+          tracker->angle = measured;
+          tracker->edgeAngle = measured;
+          tracker->locked = TRUE;
+          return;
+     }
+
+     // The speed error relative to the speed is error / sector, which is
+     // error * 6 / 2^32. Both factors are scaled down by 2^13 to keep the
+     // product within 32 bits.
+     int32_t magnitude = (tracker->integrator < 0) ? -tracker->integrator : tracker->integrator;
+     int32_t correction = (((magnitude >> 13) * (error >> 13)) >> 5) * 3;
+
+     tracker->integrator = TrackerLimit(tracker->integrator + (correction >> TRACKER_KI_SHIFT), direction);
+     tracker->speed = TrackerLimit(tracker->integrator + (correction >> TRACKER_KP_SHIFT), direction);
+     tracker->edgeAngle = measured;
+}
+
+/*! \brief Get the electrical angle.
+
+    The extrapolated angle is limited to the sector given by the last hall
+    sensor edge, so it never contradicts the hall sensors.
+
+    \param tracker  Tracker status. \return Electrical angle, 65536 per
+    revolution.
+*/
+uint16_t TrackerAngle(const speedTracker_t *tracker)
+{
+     uint32_t angle;
+     uint32_t edgeAngle;
+     int32_t speed;
+
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+     {
+          angle = tracker->angle;
+          edgeAngle = tracker->edgeAngle;
+          speed = tracker->speed;
+     }
+
+     int32_t travel = (int32_t)(angle - edgeAngle);
+     if (speed >= 0)
+     {
+          travel = (travel < 0) ? 0 : ((travel > TRACKER_SECTOR_ANGLE) ? TRACKER_SECTOR_ANGLE : travel);
+     }
+     else
+     {
+          travel = (travel > 0) ? 0 : ((travel < -TRACKER_SECTOR_ANGLE) ? -TRACKER_SECTOR_ANGLE : travel);
+     }
+
+     return (uint16_t)((edgeAngle + (uint32_t)travel) >> 16);
+}
+
+/*! \brief Get the electrical frequency.
+
+    \param tracker  Tracker status. \param tim4Freq  PWM frequency in Hz.
+    \return Electrical frequency in 1/16 Hz, regardless of direction.
+
+    \see TrackerSpeedFrequency
+*/
+uint32_t TrackerFrequency(const speedTracker_t *tracker, uint32_t tim4Freq)
+{
+     int32_t speed;
+
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+     {
+          speed = tracker->speed;
+     }
+
+     return TrackerSpeedFrequency(speed, tim4Freq);
+}
+
+/*! \brief Convert a tracker speed to the electrical frequency.
+
+    Converts the speed from angle per PWM tick to revolutions per second
+    without dividing, \f$ f = \omega \cdot f_{PWM} / 2^{32} \f$, using two 32-bit
+    multiplications.
+
+    \param speed  Tracker speed, angle per PWM tick. \param tim4Freq  PWM
+    frequency in Hz. \return Electrical frequency in 1/16 Hz, regardless of
+    direction.
+*/
+uint32_t TrackerSpeedFrequency(int32_t speed, uint32_t tim4Freq)
+{
+     uint32_t magnitude = (speed < 0) ? -speed : speed;
+
+     return (((magnitude >> 16) * tim4Freq) >> 12) + ((((magnitude & 0xffff) >> 4) * tim4Freq) >> 24);
+}
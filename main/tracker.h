@@ -0,0 +1,103 @@
+/* This file has been prepared for Doxygen automatic documentation generation.*/
+/*! \file ********************************************************************
+
+   \brief
+        Speed and angle tracker header file.
+
+   \details
+        This file contains defines, typedefs and prototypes for the hall
+        sensor speed and angle tracker.
+
+        The tracker is a second order phase-locked loop (PLL). The electrical
+        angle is extrapolated with the estimated speed on every PWM tick and
+        compared with the known angle of the hall sensor edge when one
+        occurs. A PI loop filter turns the phase error into the speed, so the
+        speed follows a constant acceleration without lag and the angle is
+        continuous between the hall sensor edges.
+
+        The angle is a 32-bit fraction of one electrical revolution and the
+        speed is the angle travelled in one PWM tick, so only additions are
+        needed on every tick. Angle zero is the start of hall state 1 when
+        running forward.
+
+   \author
+        Nexperia: http://www.nexperia.com
+
+   \par Support Page
+        For additional support, visit: https://www.nexperia.com/support
+
+   $Author: Aanas Sayed $
+   $Date: 2024/03/08 $  \n
+
+ ******************************************************************************/
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+// Include standard integer type definitions
+#include "stdint.h"
+
+// Include motor config (tracker bandwidth)
+#include "config.h"
+
+//! Angle of one hall sector (60 electrical degrees), 1/6 of a revolution.
+#define TRACKER_SECTOR_ANGLE 715827883L
+
+//! Phase error, as a fraction of a sector, above which lock is lost.
+#define TRACKER_LOCK_LIMIT (TRACKER_SECTOR_ANGLE >> 1)
+
+//! Shift of the proportional gain of the loop filter, 2 * bandwidth.
+#define TRACKER_KP_SHIFT (SPEED_TRACKER_BANDWIDTH - 1)
+
+//! Shift of the integral gain of the loop filter, bandwidth squared.
+#define TRACKER_KI_SHIFT (2 * SPEED_TRACKER_BANDWIDTH)
+
+/*! \brief Speed and Angle Tracker Status
+
+   State of the hall sensor phase-locked loop.
+*/
+typedef struct speedTracker
+{
+     //! Extrapolated electrical angle, 2^32 per revolution
+     uint32_t angle;
+     //! Electrical angle of the last hall sensor edge
+     uint32_t edgeAngle;
+     //! Angle travelled per PWM tick, negative in reverse
+     int32_t speed;
+     //! Integral part of the speed
+     int32_t integrator;
+     //! TRUE when the loop is locked to the hall sensor edges
+     uint8_t locked;
+} speedTracker_t;
+
+// Prototypes
+void TrackerReset(speedTracker_t *tracker);
+void TrackerHallEdge(speedTracker_t *tracker, uint8_t hall, uint8_t direction, uint16_t ticks);
+uint16_t TrackerAngle(const speedTracker_t *tracker);
+uint32_t TrackerFrequency(const speedTracker_t *tracker, uint32_t tim4Freq);
+uint32_t TrackerSpeedFrequency(int32_t speed, uint32_t tim4Freq);
+
+/*! \brief Advance the tracker by one PWM tick.
+
+    Extrapolates the angle with the estimated speed. The angle is not allowed
+    to run more than two sectors past the last hall sensor edge, so the phase
+    error stays bounded when the motor slows down or stops.
+
+    \param tracker  Tracker status.
+*/
+static inline void TrackerTick(speedTracker_t *tracker)
+{
+     tracker->angle += (uint32_t)tracker->speed;
+
+     int32_t travel = (int32_t)(tracker->angle - tracker->edgeAngle);
+     if (travel > 2 * TRACKER_SECTOR_ANGLE)
+     {
+          tracker->angle = tracker->edgeAngle + 2 * TRACKER_SECTOR_ANGLE;
+     }
+     else if (travel < -2 * TRACKER_SECTOR_ANGLE)
+     {
+          tracker->angle = tracker->edgeAngle - 2 * TRACKER_SECTOR_ANGLE;
+     }
+}
+
+#endif